@@ -3,15 +3,54 @@
 
 #include "Lexer.h"
 #include "Types.h"
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/IR/Value.h"
 #include <memory>
+#include <string>
+#include <vector>
+
+class BytecodeEmitter;
+class OperatorExprAST;
+
+// Speculation cost of an expression that must not run unless its result is
+// needed: it could trap (a division, a view access) or has side effects
+constexpr unsigned NotSpeculatable = ~0u;
+
+// Cost of evaluating two expressions, saturating at NotSpeculatable
+inline unsigned addSpeculationCost(unsigned A, unsigned B) {
+  return A >= NotSpeculatable - B ? NotSpeculatable : A + B;
+}
 
 // Base Expressions Class: Everything, "5", "5 + 10", etc. are expressions
 class ExprAST {
+protected:
+  SourceLocation Loc;
+  KirkType ResolvedType = KIRK_VOID; // Filled in by typecheck()
+
 public:
+  explicit ExprAST(SourceLocation Loc) : Loc(Loc) {}
   virtual ~ExprAST() = default;
 
+  const SourceLocation &getLoc() const { return Loc; }
+  KirkType getType() const { return ResolvedType; }
+  // True if evaluating the expression can't assign a variable or have any
+  // other side effect, so sibling operands needn't be ordered around it
+  virtual bool isPure() const { return false; }
+  // Roughly how many instructions evaluating the expression takes, if it
+  // can also be evaluated where it wouldn't have run: "a and b" computes a
+  // cheap b anyway and selects, instead of branching around it
+  virtual unsigned getSpeculationCost() const { return NotSpeculatable; }
+  // Non-null for operators (OperatorExprAST), whose operands are walked
+  // without recursion
+  virtual OperatorExprAST *asOperator() { return nullptr; }
+
+  // Semantic analysis (Sema.cpp): resolves names and types, inserts implicit
+  // casts into the children and returns the node's own type
+  virtual KirkType typecheck() = 0;
   virtual llvm::Value *codegen() = 0;
+  // Lowering for --interp (Bytecode.cpp): returns the register holding the
+  // value, or -1 for expressions without one
+  virtual int lowerToBytecode(BytecodeEmitter &E) = 0;
 };
 
 // Number Node (Leaf)
@@ -21,82 +60,329 @@ class NumberExprAST : public ExprAST {
   bool IsInteger = false;
 
 public:
-  explicit NumberExprAST(double Val) : Val(Val), IntVal(0), IsInteger(false) {}
-  explicit NumberExprAST(long long Val)
-      : Val(static_cast<double>(Val)), IntVal(Val), IsInteger(true) {}
-
+  NumberExprAST(SourceLocation Loc, double Val)
+      : ExprAST(Loc), Val(Val), IntVal(0), IsInteger(false) {}
+  NumberExprAST(SourceLocation Loc, long long Val)
+      : ExprAST(Loc), Val(static_cast<double>(Val)), IntVal(Val),
+        IsInteger(true) {}
+
+  bool isPure() const override { return true; }
+  unsigned getSpeculationCost() const override { return 0; }
   bool isInteger() const { return IsInteger; }
   long long getIntVal() const { return IntVal; }
   double getDoubleVal() const { return Val; }
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Operator Node: the base of casts, binary and unary operations.
+// Machine-generated sums and formulas nest these millions of levels deep, so
+// every pass walks nested operators with an explicit stack
+// (WalkOperatorTree) instead of recursing. A node only handles its own
+// operation, once its operands are done.
+class OperatorExprAST : public ExprAST {
+protected:
+  bool Pure = true; // Set by the subclasses from their operands
+  unsigned SpeculationCost = NotSpeculatable; // Likewise
+
+  // Called by the destructors of the subclasses, before their members go:
+  // nested operands are freed from a worklist instead of by nested
+  // unique_ptr destructors
+  void releaseOperands();
+
+public:
+  using ExprAST::ExprAST;
+
+  bool isPure() const override { return Pure; }
+  unsigned getSpeculationCost() const override { return SpeculationCost; }
+  OperatorExprAST *asOperator() override { return this; }
+  virtual size_t getNumOperands() const = 0;
+  virtual std::unique_ptr<ExprAST> &getOperand(size_t I) = 0;
+
+  // The operands have been checked (Sema.cpp)
+  virtual KirkType typecheckOperator() = 0;
+  // The operands' values are in Operands (Codegen.cpp)
+  virtual llvm::Value *
+  codegenOperator(llvm::ArrayRef<llvm::Value *> Operands) = 0;
+  // The operands' registers are in Operands (Bytecode.cpp)
+  virtual int lowerOperatorToBytecode(BytecodeEmitter &E,
+                                      llvm::ArrayRef<int> Operands) = 0;
+  // Called after each operand is lowered, before the next one; returns the
+  // register to use for it
+  virtual int lowerOperandDone(BytecodeEmitter &, size_t, int Reg) {
+    return Reg;
+  }
+
+  KirkType typecheck() final;
+  llvm::Value *codegen() final;
+  int lowerToBytecode(BytecodeEmitter &E) final;
+};
+
+// Post-order walk over Root and the operator nodes nested in it, without
+// recursion. Enter(Node) is called before a node's operands are visited.
+// Leaf(ExprAST *) handles every operand that isn't an operator and returns
+// its result, AfterOperand(Node, Index, Result &) sees each operand's result
+// before the next operand is visited, and Combine(Node, ArrayRef<T>) turns
+// a node's operand results into its own.
+template <typename T, typename EnterFn, typename LeafFn,
+          typename AfterOperandFn, typename CombineFn>
+T WalkOperatorTree(OperatorExprAST *Root, EnterFn Enter, LeafFn Leaf,
+                   AfterOperandFn AfterOperand, CombineFn Combine) {
+  struct Frame {
+    OperatorExprAST *Node;
+    size_t Next; // Index of the next operand to visit
+  };
+  std::vector<Frame> Frames = {{Root, 0}};
+  std::vector<T> Results; // Finished operands of all open frames
+  Enter(Root);
+
+  while (true) {
+    OperatorExprAST *Node = Frames.back().Node;
+    size_t Next = Frames.back().Next;
+
+    if (Next < Node->getNumOperands()) {
+      ExprAST *Operand = Node->getOperand(Next).get();
+      if (auto *Nested = Operand->asOperator()) {
+        Frames.push_back({Nested, 0});
+        Enter(Nested);
+        continue;
+      }
+      Results.push_back(Leaf(Operand));
+    } else {
+      size_t N = Node->getNumOperands();
+      T Result = Combine(Node, llvm::ArrayRef<T>(Results).take_back(N));
+      Results.resize(Results.size() - N);
+      Frames.pop_back();
+      if (Frames.empty())
+        return Result;
+      Results.push_back(Result);
+    }
+
+    Frame &Parent = Frames.back();
+    AfterOperand(Parent.Node, Parent.Next, Results.back());
+    ++Parent.Next;
+  }
+}
+
+inline void OperatorExprAST::releaseOperands() {
+  // Operands that aren't operators are left to the members' destructors
+  std::vector<std::unique_ptr<ExprAST>> Pending;
+  for (size_t I = 0; I < getNumOperands(); ++I)
+    if (getOperand(I) && getOperand(I)->asOperator())
+      Pending.push_back(std::move(getOperand(I)));
+
+  while (!Pending.empty()) {
+    std::unique_ptr<ExprAST> Operand = std::move(Pending.back());
+    Pending.pop_back();
+
+    // Take a nested operator's operands first, so freeing it goes no deeper
+    if (auto *Nested = Operand->asOperator())
+      for (size_t I = 0; I < Nested->getNumOperands(); ++I)
+        if (Nested->getOperand(I))
+          Pending.push_back(std::move(Nested->getOperand(I)));
+  }
+}
+
+// Implicit Conversion Node, inserted by semantic analysis wherever an operand
+// has to change type (int -> double in "1 + 2.5", the condition of an "if")
+class CastExprAST : public OperatorExprAST {
+  std::unique_ptr<ExprAST> Operand;
+
+public:
+  CastExprAST(std::unique_ptr<ExprAST> Operand, KirkType DestType)
+      : OperatorExprAST(Operand->getLoc()), Operand(std::move(Operand)) {
+    ResolvedType = DestType;
+    Pure = this->Operand->isPure();
+    SpeculationCost =
+        addSpeculationCost(this->Operand->getSpeculationCost(), 1);
+  }
+  ~CastExprAST() override { releaseOperands(); }
+
+  size_t getNumOperands() const override { return 1; }
+  std::unique_ptr<ExprAST> &getOperand(size_t) override { return Operand; }
+
+  KirkType typecheckOperator() override;
+  llvm::Value *
+  codegenOperator(llvm::ArrayRef<llvm::Value *> Operands) override;
+  int lowerOperatorToBytecode(BytecodeEmitter &E,
+                              llvm::ArrayRef<int> Operands) override;
 };
 
 // Binary Operation Node (Branch): Holds the Operator ('+'), the Left side (A),
 // and the Right side (B).
-class BinaryExprAST : public ExprAST {
+class BinaryExprAST : public OperatorExprAST {
   int Op; // The operator, like '+', '-', etc.
   std::unique_ptr<ExprAST> LHS;
   std::unique_ptr<ExprAST> RHS;
 
 public:
-  BinaryExprAST(char Op, std::unique_ptr<ExprAST> LHS,
+  BinaryExprAST(SourceLocation Loc, int Op, std::unique_ptr<ExprAST> LHS,
                 std::unique_ptr<ExprAST> RHS)
-      : Op(Op), LHS(std::move(LHS)), RHS(std::move(RHS)) {}
+      : OperatorExprAST(Loc), Op(Op), LHS(std::move(LHS)),
+        RHS(std::move(RHS)) {
+    Pure = this->LHS->isPure() && this->RHS->isPure();
+    // Division can trap and pow is a libm call
+    if (Op != '/' && Op != '%' && Op != '^')
+      SpeculationCost = addSpeculationCost(
+          addSpeculationCost(this->LHS->getSpeculationCost(),
+                             this->RHS->getSpeculationCost()),
+          1);
+  }
+  ~BinaryExprAST() override { releaseOperands(); }
+
+  size_t getNumOperands() const override { return 2; }
+  std::unique_ptr<ExprAST> &getOperand(size_t I) override {
+    return I == 0 ? LHS : RHS;
+  }
+
+  KirkType typecheckOperator() override;
+  llvm::Value *
+  codegenOperator(llvm::ArrayRef<llvm::Value *> Operands) override;
+  int lowerOperatorToBytecode(BytecodeEmitter &E,
+                              llvm::ArrayRef<int> Operands) override;
+  int lowerOperandDone(BytecodeEmitter &E, size_t I, int Reg) override;
+};
+
+// Logical Node: "a and b and c" or "a or b or c". Chains of the same
+// operator share one node. Evaluation stops at the first operand that
+// decides the result, so "i < n and v[i] > 0" never reads v[n].
+class LogicalExprAST : public ExprAST {
+  int Op; // TOK_AND or TOK_OR
+  std::vector<std::unique_ptr<ExprAST>> Operands;
+  bool Pure = true;
+  unsigned SpeculationCost = 0;
 
+public:
+  LogicalExprAST(SourceLocation Loc, int Op, std::unique_ptr<ExprAST> LHS)
+      : ExprAST(Loc), Op(Op) {
+    addOperand(std::move(LHS));
+  }
+
+  int getOp() const { return Op; }
+  void addOperand(std::unique_ptr<ExprAST> Operand) {
+    Pure &= Operand->isPure();
+    SpeculationCost = addSpeculationCost(
+        addSpeculationCost(SpeculationCost, Operand->getSpeculationCost()),
+        Operands.empty() ? 0 : 1);
+    Operands.push_back(std::move(Operand));
+  }
+
+  bool isPure() const override { return Pure; }
+  unsigned getSpeculationCost() const override { return SpeculationCost; }
+
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
 // Assignment Node, represents things like "x = 5 + 2"
 class AssignmentExprAST : public ExprAST {
   std::string Name;
-  SourceLocation Loc;
   std::unique_ptr<ExprAST> RHS;
 
 public:
   AssignmentExprAST(SourceLocation Loc, std::string Name,
                     std::unique_ptr<ExprAST> RHS)
-      : Name(std::move(Name)), Loc(Loc), RHS(std::move(RHS)) {}
+      : ExprAST(Loc), Name(std::move(Name)), RHS(std::move(RHS)) {}
 
-  const SourceLocation &getLoc() const { return Loc; }
   const std::string &getName() const { return Name; }
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
 // Variable Node, represents variable name like "x", "y", etc.
 class VariableExprAST : public ExprAST {
   std::string Name;
-  SourceLocation Loc;
 
 public:
   VariableExprAST(SourceLocation Loc, std::string Name)
-      : Loc(Loc), Name(Name) {}
+      : ExprAST(Loc), Name(Name) {}
+
+  bool isPure() const override { return true; }
+  unsigned getSpeculationCost() const override { return 1; } // A load
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
+// "if likely c" / "if unlikely c": which way the programmer expects the
+// branch to go, as !prof branch weights
+enum BranchHint { BRANCH_UNHINTED, BRANCH_LIKELY, BRANCH_UNLIKELY };
+
 // If-Expr AST, represents if-else branch
 class IfExprAST : public ExprAST {
   std::unique_ptr<ExprAST> Cond, Then, Else;
+  BranchHint Hint;
 
 public:
-  IfExprAST(std::unique_ptr<ExprAST> Cond, std::unique_ptr<ExprAST> Then,
-            std::unique_ptr<ExprAST> Else)
-      : Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else)) {}
+  IfExprAST(SourceLocation Loc, std::unique_ptr<ExprAST> Cond,
+            std::unique_ptr<ExprAST> Then, std::unique_ptr<ExprAST> Else,
+            BranchHint Hint = BRANCH_UNHINTED)
+      : ExprAST(Loc), Cond(std::move(Cond)), Then(std::move(Then)),
+        Else(std::move(Else)), Hint(Hint) {}
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
-class UnaryExprAST : public ExprAST {
-  int Opcode;
-  std::unique_ptr<ExprAST> Operand;
+// One pattern of a match arm: the ints from Low to Last, inclusive. "3" is
+// 3..3 and the range "10..20" is 10..19.
+struct MatchPattern {
+  long long Low, Last;
+  SourceLocation Loc;
+};
+
+// An arm of a match. The '_' arm, always the last one, has no patterns.
+struct MatchArm {
+  std::vector<MatchPattern> Patterns;
+  std::unique_ptr<ExprAST> Body;
+};
+
+// Match Node: "match x { 1 => a, 2 | 3 => b, 10..20 => c, _ => d }" picks
+// the arm whose patterns contain x. No two patterns overlap, so the arms can
+// be tested in any order: codegen emits a single switch.
+class MatchExprAST : public ExprAST {
+  std::unique_ptr<ExprAST> Subject;
+  std::vector<MatchArm> Arms;
 
 public:
-  UnaryExprAST(char Opcode, std::unique_ptr<ExprAST> Operand)
-      : Opcode(Opcode), Operand(std::move(Operand)) {}
+  MatchExprAST(SourceLocation Loc, std::unique_ptr<ExprAST> Subject,
+               std::vector<MatchArm> Arms)
+      : ExprAST(Loc), Subject(std::move(Subject)), Arms(std::move(Arms)) {}
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+class UnaryExprAST : public OperatorExprAST {
+  int Opcode;
+  std::unique_ptr<ExprAST> Operand;
+
+public:
+  UnaryExprAST(SourceLocation Loc, int Opcode,
+               std::unique_ptr<ExprAST> Operand)
+      : OperatorExprAST(Loc), Opcode(Opcode), Operand(std::move(Operand)) {
+    Pure = this->Operand->isPure();
+    SpeculationCost =
+        addSpeculationCost(this->Operand->getSpeculationCost(), 1);
+  }
+  ~UnaryExprAST() override { releaseOperands(); }
+
+  size_t getNumOperands() const override { return 1; }
+  std::unique_ptr<ExprAST> &getOperand(size_t) override { return Operand; }
+
+  KirkType typecheckOperator() override;
+  llvm::Value *
+  codegenOperator(llvm::ArrayRef<llvm::Value *> Operands) override;
+  int lowerOperatorToBytecode(BytecodeEmitter &E,
+                              llvm::ArrayRef<int> Operands) override;
 };
 
 // Block Expression, represents { expr1; expr2; ... }
@@ -104,55 +390,528 @@ class BlockExprAST : public ExprAST {
   std::vector<std::unique_ptr<ExprAST>> Expressions;
 
 public:
-  BlockExprAST(std::vector<std::unique_ptr<ExprAST>> Expressions)
-      : Expressions(std::move(Expressions)) {}
+  BlockExprAST(SourceLocation Loc,
+               std::vector<std::unique_ptr<ExprAST>> Expressions)
+      : ExprAST(Loc), Expressions(std::move(Expressions)) {}
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
 class PrintExprAST : public ExprAST {
   std::unique_ptr<ExprAST> Expr;
 
 public:
-  PrintExprAST(std::unique_ptr<ExprAST> Expr) : Expr(std::move(Expr)) {}
+  PrintExprAST(SourceLocation Loc, std::unique_ptr<ExprAST> Expr)
+      : ExprAST(Loc), Expr(std::move(Expr)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+enum BuiltinFunction {
+  BUILTIN_SQRT,
+  BUILTIN_ABS,
+  BUILTIN_MIN,
+  BUILTIN_MAX,
+  BUILTIN_FLOOR,
+  BUILTIN_FMA,
+  BUILTIN_POPCOUNT,
+  BUILTIN_CTZ,
+  BUILTIN_CLZ,
+  BUILTIN_CLOCK_NS,
+  BUILTIN_CYCLES,
+  BUILTIN_READ_INT,
+  BUILTIN_READ_DOUBLE,
+  BUILTIN_READ_BOOL,
+  BUILTIN_HAS_INPUT,
+  // Vector lanes (see "Vector Types" in the README)
+  BUILTIN_LANE,
+  BUILTIN_WITH_LANE,
+  BUILTIN_SHUFFLE,
+  BUILTIN_SELECT,
+  BUILTIN_REDUCE_ADD,
+  BUILTIN_REDUCE_MUL,
+  BUILTIN_REDUCE_MIN,
+  BUILTIN_REDUCE_MAX,
+  BUILTIN_ANY,
+  BUILTIN_ALL
+};
+
+// Builtin Node: sqrt(x), abs(x), min(a, b), max(a, b), floor(x) and
+// fma(a, b, c) are each a single LLVM intrinsic picked by operand type
+// (llvm.smin for ints, llvm.minnum for doubles), never a branch, and so are
+// popcount(x), ctz(x) and clz(x) on ints (llvm.ctpop, llvm.cttz and
+// llvm.ctlz, which give 64 for 0). clock_ns() reads the runtime's monotonic
+// clock and cycles() the CPU cycle counter. read_int(), read_double(),
+// read_bool() and has_input() call the runtime's buffered stdin reader. The
+// math builtins also work lane by lane on vectors, and the vector builtins
+// (lane, shuffle, reduce_add, ...) map to extractelement, shufflevector and
+// the llvm.vector.reduce intrinsics.
+class BuiltinCallExprAST : public ExprAST {
+  BuiltinFunction Callee;
+  std::vector<std::unique_ptr<ExprAST>> Args;
+  // Constant lane numbers of lane, with_lane and shuffle, which Sema moves
+  // out of Args
+  std::vector<unsigned> LaneNumbers;
+
+  KirkType typecheckVectorBuiltin();
+  llvm::Value *codegenVectorBuiltin(llvm::ArrayRef<llvm::Value *> ArgsV);
+  int lowerVectorBuiltin(BytecodeEmitter &E, llvm::ArrayRef<int> Regs);
+
+public:
+  BuiltinCallExprAST(SourceLocation Loc, BuiltinFunction Callee,
+                     std::vector<std::unique_ptr<ExprAST>> Args)
+      : ExprAST(Loc), Callee(Callee), Args(std::move(Args)) {}
+
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
-class WhileExprAST : public ExprAST {
+// Vector Constructor: "vec4d(1.0, 2.0, 3.0, 4.0)" sets every lane,
+// "vec4d(x)" splats a scalar or converts a vector with as many lanes
+class VectorExprAST : public ExprAST {
+  KirkType VectorType;
+  std::vector<std::unique_ptr<ExprAST>> Args;
+
+public:
+  VectorExprAST(SourceLocation Loc, KirkType VectorType,
+                std::vector<std::unique_ptr<ExprAST>> Args)
+      : ExprAST(Loc), VectorType(VectorType), Args(std::move(Args)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Benchmark Node: "bench "name" N { ... }" runs the block N times after a
+// warm-up of N / 10 runs, timing every run, and has the runtime report the
+// min, median and p99 time per run. The block's value is kept alive so the
+// optimizer can't delete the work.
+class BenchExprAST : public ExprAST {
+  std::string Name;
+  std::unique_ptr<ExprAST> Iterations, Body;
+
+public:
+  BenchExprAST(SourceLocation Loc, std::string Name,
+               std::unique_ptr<ExprAST> Iterations,
+               std::unique_ptr<ExprAST> Body)
+      : ExprAST(Loc), Name(std::move(Name)), Iterations(std::move(Iterations)),
+        Body(std::move(Body)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+enum FloatMode { FLOAT_STRICT, FLOAT_FAST };
+
+// Annotation Node: "@fast_math { ... }" or "@strict_math { ... }" sets the
+// floating-point mode for the expression that follows, overriding the
+// command-line flags
+class FloatModeExprAST : public ExprAST {
+  FloatMode Mode;
+  std::unique_ptr<ExprAST> Body;
+
+public:
+  FloatModeExprAST(SourceLocation Loc, FloatMode Mode,
+                   std::unique_ptr<ExprAST> Body)
+      : ExprAST(Loc), Mode(Mode), Body(std::move(Body)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// What "@unroll", "@nounroll", "@vectorize" and "@novectorize" ask of a
+// loop, passed on as its llvm.loop metadata. A count or width of 0 leaves
+// the number to LLVM.
+enum LoopHintSwitch { HINT_DEFAULT, HINT_ENABLE, HINT_DISABLE };
+struct LoopHints {
+  LoopHintSwitch Unroll = HINT_DEFAULT;
+  unsigned UnrollCount = 0;
+  LoopHintSwitch Vectorize = HINT_DEFAULT;
+  unsigned VectorizeWidth = 0;
+
+  bool empty() const {
+    return Unroll == HINT_DEFAULT && Vectorize == HINT_DEFAULT;
+  }
+};
+
+// Base of the loops break and continue work in: while and for. A loop can
+// be labeled ("outer: while ...") so a nested loop can leave it.
+class LoopExprAST : public ExprAST {
+protected:
+  std::string Label; // Empty if the loop has none
+  bool BreaksWithValue = false; // Set by Sema if a "break value" targets it
+  LoopHints Hints;
+
+public:
+  using ExprAST::ExprAST;
+
+  const std::string &getLabel() const { return Label; }
+  void setLabel(std::string L) { Label = std::move(L); }
+  const LoopHints &getHints() const { return Hints; }
+  void setHints(const LoopHints &H) { Hints = H; }
+  bool breaksWithValue() const { return BreaksWithValue; }
+  void setBreaksWithValue() { BreaksWithValue = true; }
+};
+
+class WhileExprAST : public LoopExprAST {
   std::unique_ptr<ExprAST> Cond, Body;
 
 public:
-  WhileExprAST(std::unique_ptr<ExprAST> Cond, std::unique_ptr<ExprAST> Body)
-      : Cond(std::move(Cond)), Body(std::move(Body)) {}
+  WhileExprAST(SourceLocation Loc, std::unique_ptr<ExprAST> Cond,
+               std::unique_ptr<ExprAST> Body)
+      : LoopExprAST(Loc), Cond(std::move(Cond)), Body(std::move(Body)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Counted Loop Node: "for i in a..b step s { ... }". The step is a nonzero
+// integer constant, so the trip count is known when the loop is entered. The
+// loop variable is read-only and only visible inside the loop.
+class ForExprAST : public LoopExprAST {
+  std::string VarName;
+  std::unique_ptr<ExprAST> Start, End, Body;
+  long long Step;
+
+public:
+  ForExprAST(SourceLocation Loc, std::string VarName,
+             std::unique_ptr<ExprAST> Start, std::unique_ptr<ExprAST> End,
+             long long Step, std::unique_ptr<ExprAST> Body)
+      : LoopExprAST(Loc), VarName(std::move(VarName)), Start(std::move(Start)),
+        End(std::move(End)), Body(std::move(Body)), Step(Step) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// "break", "break outer", "break value" or "break outer value": leaves the
+// innermost loop, or the one labeled outer. A loop that some break leaves
+// with a value evaluates to that value, and to zero when it ends otherwise.
+class BreakExprAST : public ExprAST {
+  std::string Label;              // Empty for the innermost loop
+  std::unique_ptr<ExprAST> Result; // The value; may be null
+  LoopExprAST *Target = nullptr;   // Resolved by Sema
+
+public:
+  BreakExprAST(SourceLocation Loc, std::string Label,
+               std::unique_ptr<ExprAST> Result)
+      : ExprAST(Loc), Label(std::move(Label)), Result(std::move(Result)) {}
+
+  bool hasValue() const { return Result != nullptr; }
+  KirkType getValueType() const { return Result->getType(); }
+  // Converts the value to the type of the loop, once all its breaks are known
+  void coerceValue(KirkType Type);
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// "continue" or "continue outer": starts the next iteration of the innermost
+// loop, or of the one labeled outer
+class ContinueExprAST : public ExprAST {
+  std::string Label;
+  LoopExprAST *Target = nullptr;
+
+public:
+  ContinueExprAST(SourceLocation Loc, std::string Label)
+      : ExprAST(Loc), Label(std::move(Label)) {}
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+enum ReductionOp { REDUCE_ADD, REDUCE_MUL, REDUCE_MIN, REDUCE_MAX };
+
+// One reduction variable of a parallel loop, like "+: sum"
+struct ReductionClause {
+  ReductionOp Op;
+  std::string VarName;
+  SourceLocation Loc;
+};
+
+// Parallel For, represents "parallel for i in a..b reduce(+: s) { ... }".
+// The body is outlined into its own function and run in chunks on the
+// runtime's thread pool.
+class ParallelForExprAST : public ExprAST {
+  std::string VarName;
+  std::unique_ptr<ExprAST> Start, End, Body;
+  std::vector<ReductionClause> Reductions;
+
+public:
+  ParallelForExprAST(SourceLocation Loc, std::string VarName,
+                     std::unique_ptr<ExprAST> Start,
+                     std::unique_ptr<ExprAST> End,
+                     std::vector<ReductionClause> Reductions,
+                     std::unique_ptr<ExprAST> Body)
+      : ExprAST(Loc), VarName(std::move(VarName)), Start(std::move(Start)),
+        End(std::move(End)), Body(std::move(Body)),
+        Reductions(std::move(Reductions)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
 class VarDeclExprAST : public ExprAST {
   std::string Name;
-  KirkType Type;
+  KirkType DeclType;
   std::unique_ptr<ExprAST> InitVal;
-  SourceLocation Loc;
+  bool IsExported = false; // "export int x = ..." at the top of a module
 
 public:
-  VarDeclExprAST(SourceLocation Loc, std::string Name, KirkType Type,
+  VarDeclExprAST(SourceLocation Loc, std::string Name, KirkType DeclType,
                  std::unique_ptr<ExprAST> InitVal)
-      : Name(std::move(Name)), Type(Type), InitVal(std::move(InitVal)),
-        Loc(Loc) {}
+      : ExprAST(Loc), Name(std::move(Name)), DeclType(DeclType),
+        InitVal(std::move(InitVal)) {}
 
-  const SourceLocation &getLoc() const { return Loc; }
   const std::string &getName() const { return Name; }
-  KirkType getType() const { return Type; }
+  KirkType getDeclType() const { return DeclType; }
+  void setExported() { IsExported = true; }
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// View Declaration: "view double prices = mmap("prices.bin")" maps a binary
+// file of native-endian 8-byte ints or doubles as a read-only array. A view
+// is not a value: it is only used as prices[i] and len(prices).
+class ViewDeclExprAST : public ExprAST {
+  std::string Name;
+  KirkType ElementType;
+  std::string Path;
+
+public:
+  ViewDeclExprAST(SourceLocation Loc, std::string Name, KirkType ElementType,
+                  std::string Path)
+      : ExprAST(Loc), Name(std::move(Name)), ElementType(ElementType),
+        Path(std::move(Path)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// View element: "prices[i]", a plain load without a bounds check
+class IndexExprAST : public ExprAST {
+  std::string Name;
+  std::unique_ptr<ExprAST> Index;
+
+public:
+  IndexExprAST(SourceLocation Loc, std::string Name,
+               std::unique_ptr<ExprAST> Index)
+      : ExprAST(Loc), Name(std::move(Name)), Index(std::move(Index)) {}
+
+  // Views never change, so only the index can have side effects
+  bool isPure() const override { return Index->isPure(); }
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Length: "len(prices)", the number of elements of a view, or of a
+// collection of records, whose size is a constant
+class LengthExprAST : public ExprAST {
+  std::string Name;
+  long long CollectionSize = 0; // Set by Sema for collections
+
+public:
+  LengthExprAST(SourceLocation Loc, std::string Name)
+      : ExprAST(Loc), Name(std::move(Name)) {}
+
+  bool isPure() const override { return true; }
 
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Struct Declaration: "struct Particle { double x, double v, int id }".
+// The parser has already registered the type; this only keeps the
+// statement in the program.
+class StructDeclExprAST : public ExprAST {
+  const RecordType *Record;
+
+public:
+  StructDeclExprAST(SourceLocation Loc, const RecordType *Record)
+      : ExprAST(Loc), Record(Record) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Record Declaration: "Particle p" declares one record, and
+// "Particle[1000] ps layout(soa)" a collection of them. Both are top-level
+// only and start with every field zero, like a C global.
+class RecordDeclExprAST : public ExprAST {
+  std::string Name;
+  const RecordType *Record;
+  long long Size; // 0 for a single record
+  RecordLayout Layout;
+
+public:
+  RecordDeclExprAST(SourceLocation Loc, std::string Name,
+                    const RecordType *Record, long long Size,
+                    RecordLayout Layout)
+      : ExprAST(Loc), Name(std::move(Name)), Record(Record), Size(Size),
+        Layout(Layout) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Field read: "p.x", or "ps[i].x" for an element of a collection, without
+// a bounds check
+class FieldExprAST : public ExprAST {
+  std::string Name;
+  std::unique_ptr<ExprAST> Index; // Null for a single record
+  std::string Field;
+  SourceLocation FieldLoc;
+  int FieldIndex = -1; // Resolved by Sema
+
+public:
+  FieldExprAST(SourceLocation Loc, std::string Name,
+               std::unique_ptr<ExprAST> Index, std::string Field,
+               SourceLocation FieldLoc)
+      : ExprAST(Loc), Name(std::move(Name)), Index(std::move(Index)),
+        Field(std::move(Field)), FieldLoc(FieldLoc) {}
+
+  const std::string &getName() const { return Name; }
+  bool isElement() const { return Index != nullptr; }
+  bool isPure() const override { return !Index || Index->isPure(); }
+  // An index may be out of range, so only a single record's field is
+  // safe to load where it wouldn't have been
+  unsigned getSpeculationCost() const override {
+    return Index ? NotSpeculatable : 1;
+  }
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+  // The field's address, with the element's index evaluated
+  llvm::Value *codegenAddress();
+  // For --interp: the field's own register for a single record. For an
+  // element, the register holding its slot in the collection's memory.
+  int lowerAddressToBytecode(BytecodeEmitter &E);
+};
+
+// Field assignment: "p.x = 1" or "ps[i].x = v". The index is evaluated
+// before the value.
+class FieldAssignmentExprAST : public ExprAST {
+  std::unique_ptr<FieldExprAST> Target;
+  std::unique_ptr<ExprAST> RHS;
+
+public:
+  FieldAssignmentExprAST(SourceLocation Loc,
+                         std::unique_ptr<FieldExprAST> Target,
+                         std::unique_ptr<ExprAST> RHS)
+      : ExprAST(Loc), Target(std::move(Target)), RHS(std::move(RHS)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// A parameter of a generator, like "int n"
+struct GeneratorParam {
+  std::string Name;
+  KirkType Type;
+};
+
+// A generator, registered by the parser once its definition is read and
+// never erased, so the loops consuming it can point to it. Its body is
+// checked once, at the definition, and then emitted (or, for --interp,
+// expanded) wherever a loop consumes it.
+struct GeneratorDef {
+  SourceLocation Loc;
+  std::string Name;
+  KirkType YieldType;
+  std::vector<GeneratorParam> Params;
+  std::unique_ptr<ExprAST> Body;
+  bool Checked = false;    // Set by Sema once the body is type-checked
+  unsigned NumYields = 0;  // The yield statements in the body, from Sema
+};
+
+// Generator Definition: "generator int evens(int n) { ... yield i ... }",
+// only as a top-level statement. Nothing runs until a loop consumes it. The
+// body sees its parameters, its own variables, views and records, but no
+// other variables.
+class GeneratorDeclExprAST : public ExprAST {
+  GeneratorDef *Def;
+
+public:
+  GeneratorDeclExprAST(SourceLocation Loc, GeneratorDef *Def)
+      : ExprAST(Loc), Def(Def) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// "yield v" in a generator's body: hands v to the consuming loop's body and
+// waits until the loop asks for the next value
+class YieldExprAST : public ExprAST {
+  std::unique_ptr<ExprAST> Operand;
+
+public:
+  YieldExprAST(SourceLocation Loc, std::unique_ptr<ExprAST> Operand)
+      : ExprAST(Loc), Operand(std::move(Operand)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
+};
+
+// Generator Loop: "for x in evens(100) { ... }" runs the body once per value
+// the generator yields, each computed only when the body asks for it. The
+// loop variable is read-only and only visible inside the loop, as in a
+// counted loop.
+class GeneratorForExprAST : public LoopExprAST {
+  std::string VarName;
+  GeneratorDef *Def;
+  std::vector<std::unique_ptr<ExprAST>> Args;
+  std::unique_ptr<ExprAST> Body;
+
+public:
+  GeneratorForExprAST(SourceLocation Loc, std::string VarName,
+                      GeneratorDef *Def,
+                      std::vector<std::unique_ptr<ExprAST>> Args,
+                      std::unique_ptr<ExprAST> Body)
+      : LoopExprAST(Loc), VarName(std::move(VarName)), Def(Def),
+        Args(std::move(Args)), Body(std::move(Body)) {}
+
+  KirkType typecheck() override;
+  llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
 class BoolExprAST : public ExprAST {
   bool Val;
 
 public:
-  BoolExprAST(bool Val) : Val(Val) {}
+  BoolExprAST(SourceLocation Loc, bool Val) : ExprAST(Loc), Val(Val) {}
+
+  bool getVal() const { return Val; }
+  bool isPure() const override { return true; }
+  unsigned getSpeculationCost() const override { return 0; }
+
+  KirkType typecheck() override;
   llvm::Value *codegen() override;
+  int lowerToBytecode(BytecodeEmitter &E) override;
 };
 
 #endif
@@ -0,0 +1,454 @@
+#include "Backend.h"
+#include "Codegen.h"
+#include "Remarks.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Bitcode/BitcodeWriterPass.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/LTO/LTO.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/CachePruning.h"
+#include "llvm/Support/Caching.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace llvm;
+
+std::string TargetCPU;
+unsigned OptLevel = 2;
+unsigned BackendJobs = 0;
+
+static std::string TargetFeatures; // Only set for -march=native
+
+static OptimizationLevel getOptimizationLevel() {
+  switch (OptLevel) {
+  case 0:
+    return OptimizationLevel::O0;
+  case 1:
+    return OptimizationLevel::O1;
+  case 3:
+    return OptimizationLevel::O3;
+  default:
+    return OptimizationLevel::O2;
+  }
+}
+
+CodeGenOptLevel getCodeGenOptLevel() {
+  switch (OptLevel) {
+  case 0:
+    return CodeGenOptLevel::None;
+  case 1:
+    return CodeGenOptLevel::Less;
+  case 3:
+    return CodeGenOptLevel::Aggressive;
+  default:
+    return CodeGenOptLevel::Default;
+  }
+}
+
+bool InitializeTarget() {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  std::string TargetTriple = sys::getDefaultTargetTriple();
+  std::string Error;
+  const Target *TheTarget = TargetRegistry::lookupTarget(TargetTriple, Error);
+  if (!TheTarget) {
+    std::cerr << "Error: " << Error << "\n";
+    return false;
+  }
+
+  if (TargetCPU == "native") {
+    TargetCPU = sys::getHostCPUName().str();
+
+    // The CPU name alone would also enable features the host lacks or has
+    // disabled (AVX-512 turned off in a VM, for example)
+    std::vector<std::string> Features;
+    for (const auto &Feature : sys::getHostCPUFeatures())
+      Features.push_back((Feature.second ? "+" : "-") + Feature.first().str());
+    std::sort(Features.begin(), Features.end());
+
+    for (const std::string &Feature : Features)
+      TargetFeatures += (TargetFeatures.empty() ? "" : ",") + Feature;
+  }
+
+  if (!TargetCPU.empty()) {
+    std::unique_ptr<MCSubtargetInfo> Subtarget(
+        TheTarget->createMCSubtargetInfo(TargetTriple, "", ""));
+    if (!Subtarget || !Subtarget->isCPUStringValid(TargetCPU)) {
+      std::cerr << "Error: Unknown CPU '" << TargetCPU << "' for target "
+                << TargetTriple << "\n";
+      return false;
+    }
+  }
+
+  std::unique_ptr<TargetMachine> TM(TheTarget->createTargetMachine(
+      TargetTriple, TargetCPU.empty() ? "generic" : TargetCPU, TargetFeatures,
+      TargetOptions(), Reloc::PIC_));
+  TheModule->setTargetTriple(TargetTriple);
+  TheModule->setDataLayout(TM->createDataLayout());
+  return true;
+}
+
+void ApplyTargetAttributes() {
+  if (TargetCPU.empty())
+    return;
+
+  for (Function &F : *TheModule) {
+    if (F.isDeclaration() || F.hasFnAttribute("target-cpu"))
+      continue;
+    F.addFnAttr("target-cpu", TargetCPU);
+    if (!TargetFeatures.empty())
+      F.addFnAttr("target-features", TargetFeatures);
+  }
+}
+
+// TargetMachines are not thread-safe, so every worker creates its own. The
+// functions' target attributes override its CPU where they differ.
+static std::unique_ptr<TargetMachine> CreateTargetMachine(std::string &Error) {
+  std::string TargetTriple = sys::getDefaultTargetTriple();
+  const Target *TheTarget = TargetRegistry::lookupTarget(TargetTriple, Error);
+  if (!TheTarget)
+    return nullptr;
+
+  // PIC, like the `llc -relocation-model=pic` step it replaces
+  TargetOptions Options;
+  return std::unique_ptr<TargetMachine>(TheTarget->createTargetMachine(
+      TargetTriple, TargetCPU.empty() ? "generic" : TargetCPU, TargetFeatures,
+      Options, Reloc::PIC_, {}, getCodeGenOptLevel()));
+}
+
+void OptimizeModule(Module &M, TargetMachine &TM) {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  PassBuilder PB(&TM);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM =
+      OptLevel == 0 ? PB.buildO0DefaultPipeline(OptimizationLevel::O0)
+                    : PB.buildPerModuleDefaultPipeline(getOptimizationLevel());
+  MPM.run(M, MAM);
+}
+
+// Targets M at TM's machine and runs the optimization pipeline on it
+static void OptimizeForTarget(Module &M, TargetMachine &TM) {
+  M.setDataLayout(TM.createDataLayout());
+  M.setTargetTriple(TM.getTargetTriple().str());
+  if (MissedRemarksEnabled || PassedRemarksEnabled)
+    CollectRemarks(M.getContext());
+  OptimizeModule(M, TM);
+}
+
+// Optimizes M, unless that was done before it was split, and generates an
+// object file into Out. Runs on worker threads, so it must only touch M's
+// own context and print nothing.
+static bool CompileModule(Module &M, raw_pwrite_stream &Out,
+                          std::string &Error, bool Optimize = true) {
+  std::unique_ptr<TargetMachine> TM = CreateTargetMachine(Error);
+  if (!TM)
+    return false;
+  if (Optimize)
+    OptimizeForTarget(M, *TM);
+
+  legacy::PassManager CodeGenPasses;
+  if (TM->addPassesToEmitFile(CodeGenPasses, Out, nullptr,
+                              CodeGenFileType::ObjectFile)) {
+    Error = "The target cannot emit object files";
+    return false;
+  }
+  CodeGenPasses.run(M);
+  return true;
+}
+
+static bool CompileModuleToFile(Module &M, const std::string &Path,
+                                std::string &Error, bool Optimize = true) {
+  std::error_code EC;
+  raw_fd_ostream Out(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    Error = "Could not open " + Path + ": " + EC.message();
+    return false;
+  }
+  return CompileModule(M, Out, Error, Optimize);
+}
+
+bool EmitObjectToMemory(SmallVectorImpl<char> &Object) {
+  // Compile a copy; TheModule stays as output.ll shows it
+  std::unique_ptr<Module> Copy = CloneModule(*TheModule);
+  raw_svector_ostream Out(Object);
+
+  std::string Error;
+  if (CompileModule(*Copy, Out, Error))
+    return true;
+  std::cerr << "Error: " << Error << "\n";
+  return false;
+}
+
+bool EmitObjectFiles(std::vector<std::string> &OutputFiles) {
+  unsigned Jobs = BackendJobs;
+  if (Jobs == 0)
+    Jobs = std::max(1u, std::thread::hardware_concurrency());
+
+  // Each partition needs at least one function body to be worth a thread;
+  // small programs (everything in main) are never split
+  unsigned NumDefined = 0;
+  for (const Function &F : *TheModule)
+    NumDefined += !F.isDeclaration();
+  Jobs = std::min(Jobs, NumDefined);
+
+  std::string Error;
+  if (Jobs <= 1) {
+    OutputFiles = {"output.o"};
+    if (CompileModuleToFile(*TheModule, OutputFiles[0], Error))
+      return true;
+    std::cerr << "Error: " << Error << "\n";
+    return false;
+  }
+
+  // A generator only becomes part of the loop consuming it once its ramp is
+  // inlined there, which SplitModule would mostly put in another partition.
+  // A module with generators is optimized whole before the split instead,
+  // and its partitions only generate code.
+  bool OptimizeWhole = std::any_of(
+      TheModule->begin(), TheModule->end(),
+      [](const Function &F) { return F.isPresplitCoroutine(); });
+  if (OptimizeWhole) {
+    std::unique_ptr<TargetMachine> TM = CreateTargetMachine(Error);
+    if (!TM) {
+      std::cerr << "Error: " << Error << "\n";
+      return false;
+    }
+    OptimizeForTarget(*TheModule, *TM);
+  }
+
+  // SplitModule hands out partitions in TheModule's context, which only one
+  // thread may use. Each partition is serialized to bitcode here and read
+  // back into a private context on its worker thread.
+  std::vector<SmallString<0>> Partitions;
+  SplitModule(
+      *TheModule, Jobs,
+      [&](std::unique_ptr<Module> Part) {
+        SmallString<0> Bitcode;
+        raw_svector_ostream OS(Bitcode);
+        WriteBitcodeToFile(*Part, OS);
+        Partitions.push_back(std::move(Bitcode));
+      },
+      /*PreserveLocals=*/false, /*RoundRobin=*/true);
+
+  OutputFiles.clear();
+  for (size_t i = 0; i < Partitions.size(); ++i)
+    OutputFiles.push_back("output." + std::to_string(i) + ".o");
+
+  std::vector<std::string> Errors(Partitions.size());
+  std::vector<std::thread> Workers;
+
+  for (size_t i = 0; i < Partitions.size(); ++i) {
+    Workers.emplace_back([&, i] {
+      LLVMContext Context;
+      MemoryBufferRef Buffer(
+          StringRef(Partitions[i].data(), Partitions[i].size()),
+          "kirk.partition");
+
+      Expected<std::unique_ptr<Module>> Part = parseBitcodeFile(Buffer, Context);
+      if (!Part) {
+        Errors[i] = toString(Part.takeError());
+        return;
+      }
+      CompileModuleToFile(**Part, OutputFiles[i], Errors[i], !OptimizeWhole);
+    });
+  }
+
+  for (std::thread &Worker : Workers)
+    Worker.join();
+
+  bool Success = true;
+  for (const std::string &E : Errors) {
+    if (!E.empty()) {
+      std::cerr << "Error: " << E << "\n";
+      Success = false;
+    }
+  }
+  return Success;
+}
+
+// The pipeline for OptLevel, stopped before the work ThinLTO redoes after
+// importing across modules, followed by the bitcode writer
+static void WriteThinLTOPreLink(Module &M, TargetMachine &TM,
+                                raw_ostream &Out) {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+
+  PassBuilder PB(&TM);
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+
+  ModulePassManager MPM =
+      OptLevel == 0
+          ? PB.buildO0DefaultPipeline(OptimizationLevel::O0,
+                                      ThinOrFullLTOPhase::ThinLTOPreLink)
+          : PB.buildThinLTOPreLinkDefaultPipeline(getOptimizationLevel());
+  // ThinLTO renames the internal symbols it promotes after the module hash
+  MPM.addPass(BitcodeWriterPass(Out, false, /*EmitSummaryIndex=*/true,
+                                /*EmitModuleHash=*/true));
+  MPM.run(M, MAM);
+}
+
+bool WriteThinLTOBitcode(const std::string &Path) {
+  std::string Error;
+  std::unique_ptr<TargetMachine> TM = CreateTargetMachine(Error);
+  if (!TM) {
+    std::cerr << "Error: " << Error << "\n";
+    return false;
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Out(Path, EC, sys::fs::OF_None);
+  if (EC) {
+    std::cerr << "Error: Could not open " << Path << ": " << EC.message()
+              << "\n";
+    return false;
+  }
+  WriteThinLTOPreLink(*TheModule, *TM, Out);
+  return true;
+}
+
+// Each module defines its own initializer and exported variables, so every
+// definition prevails. Only main is used from outside the bitcode; the rest
+// can be internalized once ThinLTO has imported what it needs.
+static Error AddToLink(lto::LTO &Link, MemoryBufferRef Bitcode) {
+  Expected<std::unique_ptr<lto::InputFile>> Input =
+      lto::InputFile::create(Bitcode);
+  if (!Input)
+    return Input.takeError();
+
+  std::vector<lto::SymbolResolution> Resolutions;
+  for (const lto::InputFile::Symbol &Symbol : (*Input)->symbols()) {
+    lto::SymbolResolution Resolution;
+    if (!Symbol.isUndefined()) {
+      Resolution.Prevailing = true;
+      Resolution.FinalDefinitionInLinkageUnit = true;
+      Resolution.VisibleToRegularObj = Symbol.getName() == "main";
+    }
+    Resolutions.push_back(Resolution);
+  }
+  return Link.add(std::move(*Input), Resolutions);
+}
+
+bool LinkThinLTO(const std::vector<std::string> &BitcodeFiles,
+                 const std::string &CacheDirectory,
+                 std::vector<std::string> &OutputFiles) {
+  std::string Error;
+  std::unique_ptr<TargetMachine> TM = CreateTargetMachine(Error);
+  if (!TM) {
+    std::cerr << "Error: " << Error << "\n";
+    return false;
+  }
+
+  SmallString<0> Program;
+  raw_svector_ostream ProgramOut(Program);
+  WriteThinLTOPreLink(*TheModule, *TM, ProgramOut);
+
+  lto::Config Conf;
+  Conf.CPU = TargetCPU.empty() ? "generic" : TargetCPU;
+  if (!TargetFeatures.empty())
+    Conf.MAttrs = {TargetFeatures};
+  Conf.RelocModel = Reloc::PIC_;
+  Conf.OptLevel = OptLevel;
+  Conf.CGOptLevel = getCodeGenOptLevel();
+  Conf.DefaultTriple = sys::getDefaultTargetTriple();
+
+  lto::LTO Link(std::move(Conf),
+                lto::createInProcessThinBackend(
+                    heavyweight_hardware_concurrency(BackendJobs)));
+
+  std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
+  llvm::Error Err = AddToLink(
+      Link, MemoryBufferRef(StringRef(Program.data(), Program.size()),
+                            "output.bc"));
+  for (const std::string &Path : BitcodeFiles) {
+    if (Err)
+      break;
+    ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer = MemoryBuffer::getFile(Path);
+    if (!Buffer) {
+      std::cerr << "Error: Could not read " << Path << ": "
+                << Buffer.getError().message() << "\n";
+      return false;
+    }
+    Buffers.push_back(std::move(*Buffer));
+    Err = AddToLink(Link, Buffers.back()->getMemBufferRef());
+  }
+
+  // Called from the backend threads, once per module, with the object file
+  // either just generated or found in the cache
+  std::mutex OutputMutex;
+  bool WriteFailed = false;
+  auto AddBuffer = [&](size_t Task, const Twine &,
+                       std::unique_ptr<MemoryBuffer> Object) {
+    std::string Path = "output." + std::to_string(Task) + ".o";
+    std::error_code EC;
+    raw_fd_ostream Out(Path, EC, sys::fs::OF_None);
+    Out << Object->getBuffer();
+
+    std::lock_guard<std::mutex> Lock(OutputMutex);
+    if (EC) {
+      std::cerr << "Error: Could not write " << Path << ": " << EC.message()
+                << "\n";
+      WriteFailed = true;
+    }
+    OutputFiles.push_back(Path);
+  };
+
+  // Nothing else passes through a separate stream: every module is a
+  // ThinLTO module, and those all go through the cache
+  auto AddStream = [&](size_t, const Twine &)
+      -> Expected<std::unique_ptr<CachedFileStream>> {
+    return createStringError(inconvertibleErrorCode(),
+                             "Unexpected regular LTO output");
+  };
+
+  OutputFiles.clear();
+  Expected<FileCache> Cache =
+      localCache("ThinLTO", "Thin", CacheDirectory, AddBuffer);
+  if (!Cache)
+    Err = joinErrors(std::move(Err), Cache.takeError());
+  if (!Err)
+    Err = Link.run(AddStream, *Cache);
+  if (Err) {
+    std::cerr << "Error: " << toString(std::move(Err)) << "\n";
+    return false;
+  }
+
+  pruneCache(CacheDirectory, CachePruningPolicy());
+  if (WriteFailed)
+    return false;
+
+  // In task order
+  std::sort(OutputFiles.begin(), OutputFiles.end(),
+            [](const std::string &A, const std::string &B) {
+              return A.size() != B.size() ? A.size() < B.size() : A < B;
+            });
+  return true;
+}
@@ -0,0 +1,59 @@
+#ifndef BACKEND_H
+#define BACKEND_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Support/CodeGen.h"
+#include <string>
+#include <vector>
+
+// Target selection, and the in-process backend for `--emit-obj`: runs the
+// LLVM optimization pipeline and the code generator on TheModule and writes
+// native object files, replacing the separate opt and llc steps.
+
+// Set by `-mcpu=` / `-march=`: the CPU to tune and select instructions for.
+// "native" is resolved to the host CPU and its exact feature set by
+// InitializeTarget(). Empty means a generic CPU for the target triple.
+extern std::string TargetCPU;
+
+// Set by `-O0` .. `-O3` (default 2)
+extern unsigned OptLevel;
+// Set by `--jobs=N`: threads used to optimize and generate code. 0 means one
+// per hardware thread.
+extern unsigned BackendJobs;
+
+namespace llvm {
+class Module;
+class TargetMachine;
+} // namespace llvm
+
+// Sets the host triple and data layout on TheModule and resolves TargetCPU.
+// Returns false (after printing why) for an unknown CPU name.
+bool InitializeTarget();
+// Stamps "target-cpu" / "target-features" on every function body that
+// doesn't carry its own yet, so llc sees them in output.ll too
+void ApplyTargetAttributes();
+
+// The optimization pipeline for OptLevel, and the matching code generator
+// level. The REPL uses them for its JIT too.
+void OptimizeModule(llvm::Module &M, llvm::TargetMachine &TM);
+llvm::CodeGenOptLevel getCodeGenOptLevel();
+
+// Writes "output.o", or "output.<n>.o" per partition when the module is split
+// across several threads. Returns false (after printing why) on failure.
+bool EmitObjectFiles(std::vector<std::string> &OutputFiles);
+// Compiles a copy of TheModule the same way, into memory
+bool EmitObjectToMemory(llvm::SmallVectorImpl<char> &Object);
+
+// `--module`: runs the ThinLTO pre-link pipeline on TheModule and writes it
+// to Path as bitcode with a module summary
+bool WriteThinLTOBitcode(const std::string &Path);
+// `--emit-obj` for a program that imports modules: links TheModule and the
+// modules' bitcode with ThinLTO, which optimizes and generates each module
+// on its own thread after importing what it calls from the others. Writes
+// "output.<n>.o" per module. Object files are cached in CacheDirectory, and
+// only regenerated for modules whose code or imports changed.
+bool LinkThinLTO(const std::vector<std::string> &BitcodeFiles,
+                 const std::string &CacheDirectory,
+                 std::vector<std::string> &OutputFiles);
+
+#endif
@@ -0,0 +1,1138 @@
+#include "Bytecode.h"
+#include "AST.h"
+#include "Lexer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+uint16_t BytecodeEmitter::allocate() {
+  if (NextRegister > UINT16_MAX) {
+    std::cerr << "Error: Program needs more than 65536 interpreter registers\n";
+    std::exit(1);
+  }
+
+  uint16_t Reg = NextRegister++;
+  if (NextRegister > Program.NumRegisters)
+    Program.NumRegisters = NextRegister;
+  if (VariableTypes.size() < NextRegister)
+    VariableTypes.resize(NextRegister, KIRK_VOID);
+  return Reg;
+}
+
+// Constants are filled in before execution and variables must survive any
+// loop around their declaration, so neither may share a register with a
+// temporary used anywhere else: they always go above the high-water mark
+uint16_t BytecodeEmitter::allocatePermanent(unsigned Count) {
+  NextRegister = Program.NumRegisters;
+  uint16_t Reg = allocate();
+  for (unsigned i = 1; i < Count; ++i)
+    allocate();
+  FirstFreeTemp = NextRegister;
+  return Reg;
+}
+
+uint16_t BytecodeEmitter::newLaneTemps(unsigned Lanes,
+                                       const std::vector<LaneSource> &Sources,
+                                       bool LaneWise) {
+  // Move past every source the result would clobber, until none is left
+  unsigned First = NextRegister;
+  bool Moved = true;
+  while (Moved) {
+    Moved = false;
+    for (const LaneSource &Source : Sources) {
+      unsigned Begin = Source.Reg;
+      unsigned End = Begin + Source.Lanes;
+      bool Overlaps = Begin < First + Lanes && First < End;
+      bool SameLanes = LaneWise && Begin == First && Source.Lanes == Lanes;
+      if (Source.Reg >= 0 && Overlaps && !SameLanes) {
+        First = End;
+        Moved = true;
+      }
+    }
+  }
+
+  NextRegister = First;
+  uint16_t Reg = allocate();
+  for (unsigned i = 1; i < Lanes; ++i)
+    allocate();
+  return Reg;
+}
+
+void BytecodeEmitter::releaseTemps(unsigned Mark) {
+  NextRegister = Mark > FirstFreeTemp ? Mark : FirstFreeTemp;
+}
+
+void BytecodeEmitter::retainTemps(int Reg, unsigned Count) {
+  if (Reg >= static_cast<int>(FirstFreeTemp) && NextRegister < Reg + Count)
+    NextRegister = Reg + Count;
+}
+
+uint16_t BytecodeEmitter::getIntConstant(int64_t Val) {
+  auto Iter = IntConstants.find(Val);
+  if (Iter != IntConstants.end())
+    return Iter->second;
+
+  uint16_t Reg = allocatePermanent();
+  BytecodeValue Slot;
+  Slot.I = Val;
+  Program.Constants.push_back({Reg, Slot});
+  IntConstants[Val] = Reg;
+  return Reg;
+}
+
+uint16_t BytecodeEmitter::getDoubleConstant(double Val) {
+  uint64_t Bits;
+  std::memcpy(&Bits, &Val, sizeof(Bits));
+
+  auto Iter = DoubleConstants.find(Bits);
+  if (Iter != DoubleConstants.end())
+    return Iter->second;
+
+  uint16_t Reg = allocatePermanent();
+  BytecodeValue Slot;
+  Slot.D = Val;
+  Program.Constants.push_back({Reg, Slot});
+  DoubleConstants[Bits] = Reg;
+  return Reg;
+}
+
+uint16_t BytecodeEmitter::declareVariable(const std::string &Name,
+                                          KirkType Type) {
+  unsigned Lanes = getLaneCount(Type);
+  uint16_t Reg = allocatePermanent(Lanes);
+  for (unsigned i = 0; i < Lanes; ++i)
+    VariableTypes[Reg + i] = Type;
+  Variables[Name] = Reg;
+  return Reg;
+}
+
+uint16_t BytecodeEmitter::lookupVariable(const std::string &Name) const {
+  return Variables.at(Name); // Sema has already resolved every name
+}
+
+size_t BytecodeEmitter::emit(Opcode Op, uint16_t A, uint16_t B, uint16_t C) {
+  Program.Code.push_back({Op, A, B, C});
+  return Program.Code.size() - 1;
+}
+
+void BytecodeEmitter::emitMove(uint16_t Dst, uint16_t Src, KirkType Type) {
+  for (unsigned i = 0; i < getLaneCount(Type); ++i)
+    emit(OP_Move, Dst + i, Src + i);
+}
+
+size_t BytecodeEmitter::emitJump(Opcode Op, uint16_t A) {
+  return emit(Op, A, 0, 0);
+}
+
+void BytecodeEmitter::patchJump(size_t At, size_t Target) {
+  Program.Code[At].B = Target & 0xFFFF;
+  Program.Code[At].C = Target >> 16;
+}
+
+uint16_t BytecodeEmitter::addBenchmark(const std::string &Name) {
+  if (Program.BenchmarkNames.size() > UINT16_MAX) {
+    std::cerr << "Error: Program has more than 65536 benchmarks\n";
+    std::exit(1);
+  }
+  Program.BenchmarkNames.push_back(Name);
+  return Program.BenchmarkNames.size() - 1;
+}
+
+uint16_t BytecodeEmitter::declareView(const std::string &Name,
+                                      const std::string &Path) {
+  if (Program.ViewPaths.size() > UINT16_MAX) {
+    std::cerr << "Error: Program has more than 65536 views\n";
+    std::exit(1);
+  }
+  Program.ViewPaths.push_back(Path);
+  return Views[Name] = Program.ViewPaths.size() - 1;
+}
+
+void BytecodeEmitter::declareCollection(const std::string &Name,
+                                        unsigned NumFields, int64_t Size,
+                                        RecordLayout Layout) {
+  if (Program.CollectionSlots.size() > UINT16_MAX) {
+    std::cerr << "Error: Program has more than 65536 collections\n";
+    std::exit(1);
+  }
+  Program.CollectionSlots.push_back(Size * NumFields);
+  Collections[Name] = {
+      static_cast<uint16_t>(Program.CollectionSlots.size() - 1), NumFields,
+      Size, Layout};
+}
+
+BytecodeProgram BytecodeEmitter::finish() {
+  emit(OP_Halt);
+  return std::move(Program);
+}
+
+int NumberExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  if (isInteger())
+    return E.getIntConstant(getIntVal());
+  return E.getDoubleConstant(getDoubleVal());
+}
+
+int BoolExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  return E.getIntConstant(Val ? 1 : 0);
+}
+
+// Lowers the operands of Root and of the operators nested in it, left to
+// right, then each operator's own instruction
+int OperatorExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  std::vector<unsigned> Marks; // Temporaries in use when each node started
+  return WalkOperatorTree<int>(
+      this, [&](OperatorExprAST *) { Marks.push_back(E.markTemps()); },
+      [&](ExprAST *Leaf) { return Leaf->lowerToBytecode(E); },
+      [&](OperatorExprAST *Node, size_t I, int &Reg) {
+        Reg = Node->lowerOperandDone(E, I, Reg);
+      },
+      [&](OperatorExprAST *Node, llvm::ArrayRef<int> Operands) {
+        // The operands' temporaries are dead once this node's instruction
+        // has read them, so its result may reuse one. Otherwise a long
+        // chained sum would need a register per operator.
+        E.releaseTemps(Marks.back());
+        Marks.pop_back();
+        return Node->lowerOperatorToBytecode(E, Operands);
+      });
+}
+
+int CastExprAST::lowerOperatorToBytecode(BytecodeEmitter &E,
+                                         llvm::ArrayRef<int> Operands) {
+  int Src = Operands[0];
+  KirkType SrcType = Operand->getType();
+  unsigned Lanes = getLaneCount(ResolvedType);
+
+  // A splat copies the scalar, which Sema already converted, into every lane
+  if (!isVectorType(SrcType) && isVectorType(ResolvedType)) {
+    uint16_t Dst = E.newLaneTemps(Lanes, {{Src, 1}});
+    for (unsigned i = 0; i < Lanes; ++i)
+      E.emit(OP_Move, Dst + i, Src);
+    return Dst;
+  }
+
+  KirkType SrcElement = getElementType(SrcType);
+  KirkType DstElement = getElementType(ResolvedType);
+
+  // Bools already are 0/1 integers. The operand's temporaries were released
+  // before this node, so they must be kept from the next operand.
+  if (SrcElement == KIRK_BOOL && DstElement == KIRK_INT) {
+    E.retainTemps(Src, Lanes);
+    return Src;
+  }
+
+  Opcode Op;
+  switch (DstElement) {
+  case KIRK_DOUBLE:
+    Op = OP_IntToDouble; // From int or bool
+    break;
+  case KIRK_INT:
+    Op = OP_DoubleToInt;
+    break;
+  case KIRK_BOOL:
+    Op = SrcElement == KIRK_DOUBLE ? OP_DoubleToBool : OP_IntToBool;
+    break;
+  default:
+    return Src;
+  }
+
+  uint16_t Dst = E.newLaneTemps(Lanes, {{Src, Lanes}}, true);
+  for (unsigned i = 0; i < Lanes; ++i)
+    E.emit(Op, Dst + i, Src + i);
+  return Dst;
+}
+
+int VariableExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  return E.lookupVariable(Name);
+}
+
+int ViewDeclExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  E.emit(OP_MapView, E.declareView(Name, Path));
+  return -1;
+}
+
+int IndexExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int IndexReg = Index->lowerToBytecode(E);
+  uint16_t Dst = E.newTemp();
+  E.emit(ResolvedType == KIRK_DOUBLE ? OP_LoadViewD : OP_LoadViewI, Dst,
+         E.lookupView(Name), IndexReg);
+  return Dst;
+}
+
+int LengthExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  if (CollectionSize)
+    return E.getIntConstant(CollectionSize);
+  uint16_t Dst = E.newTemp();
+  E.emit(OP_ViewLen, Dst, E.lookupView(Name));
+  return Dst;
+}
+
+int StructDeclExprAST::lowerToBytecode(BytecodeEmitter &) { return -1; }
+
+// Registers and collection slots both start zeroed
+int RecordDeclExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  if (Size) {
+    E.declareCollection(Name, Record->Fields.size(), Size, Layout);
+    return -1;
+  }
+  for (const RecordField &Field : Record->Fields)
+    E.declareVariable(Name + "." + Field.Name, Field.Type);
+  return -1;
+}
+
+int FieldExprAST::lowerAddressToBytecode(BytecodeEmitter &E) {
+  if (!Index)
+    return E.lookupVariable(Name + "." + Field);
+
+  const BytecodeCollection &Collection = E.lookupCollection(Name);
+  int IndexReg = Index->lowerToBytecode(E);
+  int Slot = IndexReg;
+  if (Collection.Layout == LAYOUT_AOS && Collection.NumFields > 1) {
+    Slot = E.newTemp();
+    E.emit(OP_MulI, Slot, IndexReg, E.getIntConstant(Collection.NumFields));
+  }
+
+  int64_t Offset = Collection.Layout == LAYOUT_AOS
+                       ? FieldIndex
+                       : FieldIndex * Collection.Size;
+  if (Offset != 0) {
+    uint16_t Sum = Slot == IndexReg ? E.newTemp() : Slot;
+    E.emit(OP_AddI, Sum, Slot, E.getIntConstant(Offset));
+    Slot = Sum;
+  }
+  return Slot;
+}
+
+int FieldExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int Slot = lowerAddressToBytecode(E);
+  if (!Index)
+    return Slot;
+
+  uint16_t Dst = E.newTemp();
+  E.emit(OP_LoadField, Dst, E.lookupCollection(Name).Id, Slot);
+  return Dst;
+}
+
+int FieldAssignmentExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int Slot = Target->lowerAddressToBytecode(E);
+  if (!Target->isElement()) {
+    int Src = RHS->lowerToBytecode(E);
+    if (Src != Slot)
+      E.emitMove(Slot, Src, ResolvedType);
+    return Slot;
+  }
+
+  // An index read straight from a variable must not see the value assign
+  // to it, as in "ps[i].x = (i = 5)"
+  if (E.isVariable(Slot) && !RHS->isPure()) {
+    uint16_t Copy = E.newTemp();
+    E.emit(OP_Move, Copy, Slot);
+    Slot = Copy;
+  }
+
+  int Src = RHS->lowerToBytecode(E);
+  E.emit(OP_StoreField, Src, E.lookupCollection(Target->getName()).Id, Slot);
+  return Src;
+}
+
+int AssignmentExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int Src = RHS->lowerToBytecode(E);
+  uint16_t Reg = E.lookupVariable(Name);
+  if (Src != Reg)
+    E.emitMove(Reg, Src, ResolvedType);
+  return Reg;
+}
+
+int VarDeclExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int Src = InitVal->lowerToBytecode(E);
+  uint16_t Reg = E.declareVariable(Name, DeclType);
+  E.emitMove(Reg, Src, DeclType);
+  return Reg;
+}
+
+// A variable read directly from its register must be snapshotted if the
+// right side might assign to it, as in "x + (x = 1)"
+int BinaryExprAST::lowerOperandDone(BytecodeEmitter &E, size_t I, int Reg) {
+  if (I != 0 || !E.isVariable(Reg) || RHS->isPure())
+    return Reg;
+
+  uint16_t Copy = E.newLaneTemps(getLaneCount(LHS->getType()));
+  E.emitMove(Copy, Reg, LHS->getType());
+  return Copy;
+}
+
+int BinaryExprAST::lowerOperatorToBytecode(BytecodeEmitter &E,
+                                           llvm::ArrayRef<int> Operands) {
+  int L = Operands[0];
+  int R = Operands[1];
+  bool IsDouble = getElementType(LHS->getType()) == KIRK_DOUBLE;
+
+  Opcode Op;
+  switch (this->Op) {
+  case '+':
+    Op = IsDouble ? OP_AddD : OP_AddI;
+    break;
+  case '-':
+    Op = IsDouble ? OP_SubD : OP_SubI;
+    break;
+  case '*':
+    Op = IsDouble ? OP_MulD : OP_MulI;
+    break;
+  case '/':
+    Op = IsDouble ? OP_DivD : OP_DivI;
+    break;
+  case '%':
+    Op = IsDouble ? OP_RemD : OP_RemI;
+    break;
+  case '<':
+    Op = IsDouble ? OP_LtD : OP_LtI;
+    break;
+  case '>':
+    Op = IsDouble ? OP_GtD : OP_GtI;
+    break;
+  case TOK_EQ:
+    Op = IsDouble ? OP_EqD : OP_EqI;
+    break;
+  case TOK_NEQ:
+    Op = IsDouble ? OP_NeD : OP_NeI;
+    break;
+  case TOK_GEQ:
+    Op = IsDouble ? OP_GeD : OP_GeI;
+    break;
+  case TOK_LEQ:
+    Op = IsDouble ? OP_LeD : OP_LeI;
+    break;
+  case '^':
+    Op = OP_PowD;
+    break;
+  case '&':
+    Op = OP_AndI;
+    break;
+  case '|':
+    Op = OP_OrI;
+    break;
+  case TOK_XOR:
+    Op = OP_XorI;
+    break;
+  case TOK_SHL:
+    Op = OP_ShlI;
+    break;
+  case TOK_SHR:
+    Op = OP_ShrI;
+    break;
+  case TOK_USHR:
+    Op = OP_UShrI;
+    break;
+  default:
+    return -1;
+  }
+
+  unsigned Lanes = getLaneCount(LHS->getType());
+  if (Lanes > 1) {
+    uint16_t Dst = E.newLaneTemps(Lanes, {{L, Lanes}, {R, Lanes}}, true);
+    for (unsigned i = 0; i < Lanes; ++i)
+      E.emit(Op, Dst + i, L + i, R + i);
+    return Dst;
+  }
+
+  uint16_t Dst = E.newTemp();
+  E.emit(Op, Dst, L, R);
+  return Dst;
+}
+
+int UnaryExprAST::lowerOperatorToBytecode(BytecodeEmitter &E,
+                                          llvm::ArrayRef<int> Operands) {
+  int Src = Operands[0];
+  unsigned Lanes = getLaneCount(ResolvedType);
+  uint16_t Dst = E.newLaneTemps(Lanes, {{Src, Lanes}}, true);
+  for (unsigned i = 0; i < Lanes; ++i) {
+    // Bools are 0 or 1, so "not b" is "b == 0"
+    if (Opcode == TOK_NOT)
+      E.emit(OP_EqI, Dst + i, Src + i, E.getIntConstant(0));
+    else if (Opcode == '~')
+      E.emit(OP_NotI, Dst + i, Src + i);
+    else
+      E.emit(getElementType(ResolvedType) == KIRK_DOUBLE ? OP_NegD : OP_NegI,
+             Dst + i, Src + i);
+  }
+  return Dst;
+}
+
+// The interpreter always short-circuits: it has no select to speculate with
+int LogicalExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  bool IsAnd = Op == TOK_AND;
+  uint16_t Result = E.newTemp();
+  unsigned Mark = E.markTemps();
+  uint16_t Zero = E.getIntConstant(0);
+
+  std::vector<size_t> ToEnd;
+  for (size_t i = 0; i < Operands.size(); ++i) {
+    if (i > 0) {
+      // Stop at a false operand of "and", a true one of "or"
+      if (IsAnd) {
+        ToEnd.push_back(E.emitJump(OP_JumpIfFalse, Result));
+      } else {
+        uint16_t IsFalse = E.newTemp();
+        E.emit(OP_EqI, IsFalse, Result, Zero);
+        ToEnd.push_back(E.emitJump(OP_JumpIfFalse, IsFalse));
+      }
+    }
+    E.emit(OP_Move, Result, Operands[i]->lowerToBytecode(E));
+    E.releaseTemps(Mark);
+  }
+
+  for (size_t Jump : ToEnd)
+    E.patchJump(Jump, E.here());
+  return Result;
+}
+
+int IfExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  bool HasValue = ResolvedType != KIRK_VOID;
+  uint16_t Result = HasValue ? E.newLaneTemps(getLaneCount(ResolvedType)) : 0;
+
+  int CondReg = Cond->lowerToBytecode(E);
+  size_t ToElse = E.emitJump(OP_JumpIfFalse, CondReg);
+
+  int ThenReg = Then->lowerToBytecode(E);
+  if (HasValue)
+    E.emitMove(Result, ThenReg, ResolvedType);
+  size_t ToEnd = E.emitJump(OP_Jump);
+
+  E.patchJump(ToElse, E.here());
+  int ElseReg = Else->lowerToBytecode(E);
+  if (HasValue)
+    E.emitMove(Result, ElseReg, ResolvedType);
+
+  E.patchJump(ToEnd, E.here());
+  return HasValue ? Result : -1;
+}
+
+// The interpreter tests the patterns one after the other, then jumps to the
+// arm of the first that contains the subject
+int MatchExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  bool HasValue = ResolvedType != KIRK_VOID;
+  uint16_t Result = HasValue ? E.newLaneTemps(getLaneCount(ResolvedType)) : 0;
+  int SubjectReg = Subject->lowerToBytecode(E);
+  unsigned Mark = E.markTemps();
+
+  std::vector<std::vector<size_t>> ToArm(Arms.size());
+  uint16_t Test = E.newTemp();
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    for (const MatchPattern &Pattern : Arms[i].Patterns) {
+      if (Pattern.Low == Pattern.Last) {
+        E.emit(OP_NeI, Test, SubjectReg, E.getIntConstant(Pattern.Low));
+        ToArm[i].push_back(E.emitJump(OP_JumpIfFalse, Test));
+        continue;
+      }
+      E.emit(OP_GeI, Test, SubjectReg, E.getIntConstant(Pattern.Low));
+      size_t Below = E.emitJump(OP_JumpIfFalse, Test);
+      E.emit(OP_GtI, Test, SubjectReg, E.getIntConstant(Pattern.Last));
+      ToArm[i].push_back(E.emitJump(OP_JumpIfFalse, Test));
+      E.patchJump(Below, E.here());
+    }
+  }
+  ToArm.back().push_back(E.emitJump(OP_Jump));
+  E.releaseTemps(Mark);
+
+  std::vector<size_t> ToEnd;
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    for (size_t Jump : ToArm[i])
+      E.patchJump(Jump, E.here());
+    int ArmReg = Arms[i].Body->lowerToBytecode(E);
+    if (HasValue)
+      E.emitMove(Result, ArmReg, ResolvedType);
+    E.releaseTemps(Mark);
+    ToEnd.push_back(E.emitJump(OP_Jump));
+  }
+
+  for (size_t Jump : ToEnd)
+    E.patchJump(Jump, E.here());
+  return HasValue ? Result : -1;
+}
+
+int BlockExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int Last = -1;
+  for (size_t i = 0; i < Expressions.size(); ++i) {
+    unsigned Mark = E.markTemps();
+    Last = Expressions[i]->lowerToBytecode(E);
+
+    // Only the last expression's value outlives its statement
+    if (i + 1 < Expressions.size())
+      E.releaseTemps(Mark);
+  }
+  return Last;
+}
+
+int PrintExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int Src = Expr->lowerToBytecode(E);
+
+  KirkType Type = Expr->getType();
+  if (isVectorType(Type)) {
+    KirkType Element = getElementType(Type);
+    E.emit(Element == KIRK_DOUBLE ? OP_PrintVecD
+           : Element == KIRK_INT  ? OP_PrintVecI
+                                  : OP_PrintVecB,
+           Src, getLaneCount(Type));
+    return -1;
+  }
+
+  switch (Expr->getType()) {
+  case KIRK_DOUBLE:
+    E.emit(OP_PrintD, Src);
+    break;
+  case KIRK_BOOL:
+    E.emit(OP_PrintB, Src);
+    break;
+  default:
+    E.emit(OP_PrintI, Src);
+    break;
+  }
+  return -1;
+}
+
+// Lowers call arguments left to right. Variables are snapshotted like
+// BinaryExprAST does, if a later argument might assign to them.
+static std::vector<int>
+LowerArguments(BytecodeEmitter &E,
+               const std::vector<std::unique_ptr<ExprAST>> &Args) {
+  std::vector<int> Regs;
+  for (size_t i = 0; i < Args.size(); ++i) {
+    int Reg = Args[i]->lowerToBytecode(E);
+
+    bool LaterMayAssign = false;
+    for (size_t j = i + 1; j < Args.size(); ++j)
+      LaterMayAssign |= !Args[j]->isPure();
+    if (E.isVariable(Reg) && LaterMayAssign) {
+      KirkType Type = Args[i]->getType();
+      uint16_t Copy = E.newLaneTemps(getLaneCount(Type));
+      E.emitMove(Copy, Reg, Type);
+      Reg = Copy;
+    }
+    Regs.push_back(Reg);
+  }
+  return Regs;
+}
+
+int BuiltinCallExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  std::vector<int> Regs = LowerArguments(E, Args);
+  if (Callee >= BUILTIN_LANE)
+    return lowerVectorBuiltin(E, Regs);
+
+  // Math on vectors is one instruction per lane
+  bool IsDouble = getElementType(ResolvedType) == KIRK_DOUBLE;
+  unsigned Lanes = getLaneCount(ResolvedType);
+  uint16_t Dst = E.newLaneTemps(Lanes);
+  for (unsigned i = 0; i < Lanes; ++i) {
+    switch (Callee) {
+    case BUILTIN_CLOCK_NS:
+      E.emit(OP_ClockNs, Dst);
+      break;
+    case BUILTIN_CYCLES:
+      E.emit(OP_Cycles, Dst);
+      break;
+    case BUILTIN_READ_INT:
+      E.emit(OP_ReadI, Dst);
+      break;
+    case BUILTIN_READ_DOUBLE:
+      E.emit(OP_ReadD, Dst);
+      break;
+    case BUILTIN_READ_BOOL:
+      E.emit(OP_ReadB, Dst);
+      break;
+    case BUILTIN_HAS_INPUT:
+      E.emit(OP_HasInput, Dst);
+      break;
+    case BUILTIN_SQRT:
+      E.emit(OP_SqrtD, Dst + i, Regs[0] + i);
+      break;
+    case BUILTIN_ABS:
+      E.emit(IsDouble ? OP_AbsD : OP_AbsI, Dst + i, Regs[0] + i);
+      break;
+    case BUILTIN_MIN:
+      E.emit(IsDouble ? OP_MinD : OP_MinI, Dst + i, Regs[0] + i, Regs[1] + i);
+      break;
+    case BUILTIN_MAX:
+      E.emit(IsDouble ? OP_MaxD : OP_MaxI, Dst + i, Regs[0] + i, Regs[1] + i);
+      break;
+    case BUILTIN_FLOOR:
+      E.emit(OP_FloorD, Dst + i, Regs[0] + i);
+      break;
+    case BUILTIN_FMA:
+      E.emit(OP_Move, Dst + i, Regs[2] + i);
+      E.emit(OP_FmaD, Dst + i, Regs[0] + i, Regs[1] + i);
+      break;
+    case BUILTIN_POPCOUNT:
+      E.emit(OP_PopcntI, Dst + i, Regs[0] + i);
+      break;
+    case BUILTIN_CTZ:
+      E.emit(OP_CtzI, Dst + i, Regs[0] + i);
+      break;
+    case BUILTIN_CLZ:
+      E.emit(OP_ClzI, Dst + i, Regs[0] + i);
+      break;
+    default:
+      break;
+    }
+  }
+  return Dst;
+}
+
+int BuiltinCallExprAST::lowerVectorBuiltin(BytecodeEmitter &E,
+                                           llvm::ArrayRef<int> Regs) {
+  KirkType SourceType = Args[0]->getType();
+  unsigned SourceLanes = getLaneCount(SourceType);
+  bool IsDouble = getElementType(SourceType) == KIRK_DOUBLE;
+
+  // Reductions fold the lanes in order, like the compiled code
+  Opcode Fold;
+  switch (Callee) {
+  case BUILTIN_LANE:
+    return Regs[0] + LaneNumbers[0];
+
+  case BUILTIN_WITH_LANE: {
+    uint16_t Dst = E.newLaneTemps(SourceLanes);
+    E.emitMove(Dst, Regs[0], SourceType);
+    E.emit(OP_Move, Dst + LaneNumbers[0], Regs[1]);
+    return Dst;
+  }
+
+  case BUILTIN_SHUFFLE: {
+    // Lanes of the second vector follow those of the first
+    uint16_t Dst = E.newLaneTemps(LaneNumbers.size());
+    for (unsigned i = 0; i < LaneNumbers.size(); ++i) {
+      unsigned Lane = LaneNumbers[i];
+      int Src = Lane < SourceLanes ? Regs[0] + Lane
+                                   : Regs[1] + (Lane - SourceLanes);
+      E.emit(OP_Move, Dst + i, Src);
+    }
+    return Dst;
+  }
+
+  case BUILTIN_SELECT: {
+    uint16_t Dst = E.newLaneTemps(SourceLanes);
+    E.emitMove(Dst, Regs[2], ResolvedType);
+    for (unsigned i = 0; i < SourceLanes; ++i)
+      E.emit(OP_MoveIf, Dst + i, Regs[0] + i, Regs[1] + i);
+    return Dst;
+  }
+
+  case BUILTIN_REDUCE_ADD:
+    Fold = IsDouble ? OP_AddD : OP_AddI;
+    break;
+  case BUILTIN_REDUCE_MUL:
+    Fold = IsDouble ? OP_MulD : OP_MulI;
+    break;
+  case BUILTIN_REDUCE_MIN:
+    Fold = IsDouble ? OP_MinD : OP_MinI;
+    break;
+  case BUILTIN_REDUCE_MAX:
+    Fold = IsDouble ? OP_MaxD : OP_MaxI;
+    break;
+  // Mask lanes are 0 or 1: any is their maximum, all their minimum
+  case BUILTIN_ANY:
+    Fold = OP_MaxI;
+    break;
+  case BUILTIN_ALL:
+    Fold = OP_MinI;
+    break;
+  default:
+    return -1;
+  }
+
+  uint16_t Dst = E.newTemp();
+  E.emit(OP_Move, Dst, Regs[0]);
+  for (unsigned i = 1; i < SourceLanes; ++i)
+    E.emit(Fold, Dst, Dst, Regs[0] + i);
+  return Dst;
+}
+
+int VectorExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  std::vector<int> Regs = LowerArguments(E, Args);
+  if (Regs.size() == 1)
+    return Regs[0]; // Sema already splatted or converted it
+
+  uint16_t Dst = E.newLaneTemps(Regs.size());
+  for (unsigned i = 0; i < Regs.size(); ++i)
+    E.emit(OP_Move, Dst + i, Regs[i]);
+  return Dst;
+}
+
+// Same loop as the compiled code: N / 10 rounded up warm-up runs, then N
+// timed ones, all recorded, with the interpreter reporting like the runtime
+int BenchExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int IterationsReg = Iterations->lowerToBytecode(E);
+
+  uint16_t Zero = E.getIntConstant(0);
+  uint16_t Count = E.newTemp();
+  E.emit(OP_MaxI, Count, IterationsReg, Zero);
+  uint16_t Warmup = E.newTemp();
+  E.emit(OP_AddI, Warmup, Count, E.getIntConstant(9));
+  E.emit(OP_DivI, Warmup, Warmup, E.getIntConstant(10));
+  uint16_t Total = E.newTemp();
+  E.emit(OP_AddI, Total, Count, Warmup);
+
+  uint16_t Bench = E.addBenchmark(Name);
+  E.emit(OP_BenchBegin, Bench);
+
+  uint16_t Iteration = E.newTemp();
+  E.emit(OP_Move, Iteration, Zero);
+
+  size_t Top = E.here();
+  unsigned Mark = E.markTemps();
+  uint16_t InRange = E.newTemp();
+  E.emit(OP_LtI, InRange, Iteration, Total);
+  size_t Exit = E.emitJump(OP_JumpIfFalse, InRange);
+  E.releaseTemps(Mark);
+
+  uint16_t StartNs = E.newTemp();
+  E.emit(OP_ClockNs, StartNs);
+  Body->lowerToBytecode(E);
+  uint16_t EndNs = E.newTemp();
+  E.emit(OP_ClockNs, EndNs);
+  E.emit(OP_SubI, EndNs, EndNs, StartNs);
+  E.emit(OP_BenchSample, Bench, EndNs);
+  E.releaseTemps(Mark);
+
+  E.emit(OP_AddI, Iteration, Iteration, E.getIntConstant(1));
+  E.patchJump(E.emitJump(OP_Jump), Top);
+  E.patchJump(Exit, E.here());
+
+  E.emit(OP_BenchEnd, Bench, Warmup);
+  return E.getDoubleConstant(0.0);
+}
+
+// The interpreter always evaluates in strict IEEE order
+int FloatModeExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  return Body->lowerToBytecode(E);
+}
+
+// The loops being lowered, innermost last, with the jumps of their breaks
+// and continues, which are patched once the loop is done
+namespace {
+struct BytecodeLoop {
+  const LoopExprAST *Loop;
+  int Result; // The loop's value if a break leaves it with one, or -1
+  std::vector<size_t> Breaks, Continues;
+};
+} // namespace
+
+static std::vector<BytecodeLoop> BytecodeLoops;
+
+static BytecodeLoop &FindBytecodeLoop(const LoopExprAST *Loop) {
+  auto It = std::find_if(
+      BytecodeLoops.rbegin(), BytecodeLoops.rend(),
+      [&](const BytecodeLoop &L) { return L.Loop == Loop; });
+  return *It;
+}
+
+// Called before the loop's first instruction. The value of a loop that
+// breaks with one starts as zero, which a plain break or the normal exit
+// leave in place.
+static void BeginBytecodeLoop(BytecodeEmitter &E, const LoopExprAST &Loop) {
+  int Result = -1;
+  if (Loop.breaksWithValue()) {
+    KirkType Type = Loop.getType();
+    Result = E.newLaneTemps(getLaneCount(Type));
+    uint16_t Zero = getElementType(Type) == KIRK_DOUBLE
+                        ? E.getDoubleConstant(0.0)
+                        : E.getIntConstant(0);
+    for (unsigned Lane = 0; Lane < getLaneCount(Type); ++Lane)
+      E.emit(OP_Move, Result + Lane, Zero);
+  }
+  BytecodeLoops.push_back({&Loop, Result, {}, {}});
+}
+
+// Called after the loop's last instruction: points its breaks here and its
+// continues at ContinueTarget, and returns the loop's value
+static int EndBytecodeLoop(BytecodeEmitter &E, size_t ContinueTarget) {
+  BytecodeLoop Loop = std::move(BytecodeLoops.back());
+  BytecodeLoops.pop_back();
+
+  for (size_t Jump : Loop.Breaks)
+    E.patchJump(Jump, E.here());
+  for (size_t Jump : Loop.Continues)
+    E.patchJump(Jump, ContinueTarget);
+  return Loop.Result >= 0 ? Loop.Result : E.getDoubleConstant(0.0);
+}
+
+int BreakExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  BytecodeLoop &Loop = FindBytecodeLoop(Target);
+  if (Result) {
+    int ResultReg = Result->lowerToBytecode(E);
+    E.emitMove(Loop.Result, ResultReg, Result->getType());
+  }
+  Loop.Breaks.push_back(E.emitJump(OP_Jump));
+  return E.getDoubleConstant(0.0);
+}
+
+int ContinueExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  FindBytecodeLoop(Target).Continues.push_back(E.emitJump(OP_Jump));
+  return E.getDoubleConstant(0.0);
+}
+
+int WhileExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  BeginBytecodeLoop(E, *this);
+  size_t Top = E.here();
+  unsigned Mark = E.markTemps();
+
+  int CondReg = Cond->lowerToBytecode(E);
+  size_t Exit = E.emitJump(OP_JumpIfFalse, CondReg);
+  E.releaseTemps(Mark);
+
+  Body->lowerToBytecode(E);
+  E.releaseTemps(Mark);
+
+  E.patchJump(E.emitJump(OP_Jump), Top);
+  E.patchJump(Exit, E.here());
+
+  // 0.0, unless a break leaves the loop with a value
+  return EndBytecodeLoop(E, Top);
+}
+
+// Runs the loop serially, with the same per-chunk reduction protocol the
+// compiled code uses on a single thread: private accumulators start at the
+// identity and are merged into the shared variable at the end
+int ForExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int StartReg = Start->lowerToBytecode(E);
+  int EndReg = End->lowerToBytecode(E);
+
+  // Snapshot the bound: the compiled loop computes its trip count up front,
+  // so assignments in the body to a variable used in End don't count
+  uint16_t Bound = E.newTemp();
+  E.emit(OP_Move, Bound, EndReg);
+
+  std::map<std::string, uint16_t> Outer = E.saveScope();
+  uint16_t Index = E.declareVariable(VarName, KIRK_INT);
+  E.emit(OP_Move, Index, StartReg);
+
+  BeginBytecodeLoop(E, *this);
+  size_t Top = E.here();
+  unsigned Mark = E.markTemps();
+  uint16_t InRange = E.newTemp();
+  if (Step > 0)
+    E.emit(OP_LtI, InRange, Index, Bound);
+  else
+    E.emit(OP_GtI, InRange, Index, Bound);
+  size_t Exit = E.emitJump(OP_JumpIfFalse, InRange);
+  E.releaseTemps(Mark);
+
+  Body->lowerToBytecode(E);
+  E.releaseTemps(Mark);
+
+  size_t Latch = E.here();
+  E.emit(OP_AddI, Index, Index, E.getIntConstant(Step));
+  E.patchJump(E.emitJump(OP_Jump), Top);
+  E.patchJump(Exit, E.here());
+  int Result = EndBytecodeLoop(E, Latch);
+
+  // Only the loop variable goes out of scope; the body's declarations stay
+  std::map<std::string, uint16_t> Scope = E.saveScope();
+  auto Shadowed = Outer.find(VarName);
+  if (Shadowed != Outer.end())
+    Scope[VarName] = Shadowed->second;
+  else
+    Scope.erase(VarName);
+  E.restoreScope(std::move(Scope));
+
+  return Result;
+}
+
+int ParallelForExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  int StartReg = Start->lowerToBytecode(E);
+  int EndReg = End->lowerToBytecode(E);
+
+  // Snapshot the bound: the body may update a reduction variable used in it
+  uint16_t Bound = E.newTemp();
+  E.emit(OP_Move, Bound, EndReg);
+
+  std::map<std::string, uint16_t> Saved = E.saveScope();
+
+  struct PrivateReduction {
+    const ReductionClause *Clause;
+    uint16_t Shared;
+    uint16_t Private;
+    bool IsDouble;
+  };
+  std::vector<PrivateReduction> Privates;
+
+  for (const ReductionClause &R : Reductions) {
+    uint16_t Shared = E.lookupVariable(R.VarName);
+    KirkType Type = E.getVariableType(Shared);
+    bool IsDouble = Type == KIRK_DOUBLE;
+
+    uint16_t Identity;
+    switch (R.Op) {
+    case REDUCE_ADD:
+      Identity = IsDouble ? E.getDoubleConstant(0.0) : E.getIntConstant(0);
+      break;
+    case REDUCE_MUL:
+      Identity = IsDouble ? E.getDoubleConstant(1.0) : E.getIntConstant(1);
+      break;
+    case REDUCE_MIN:
+      Identity = IsDouble ? E.getDoubleConstant(HUGE_VAL)
+                          : E.getIntConstant(INT64_MAX);
+      break;
+    case REDUCE_MAX:
+      Identity = IsDouble ? E.getDoubleConstant(-HUGE_VAL)
+                          : E.getIntConstant(INT64_MIN);
+      break;
+    }
+
+    uint16_t Private = E.declareVariable(R.VarName, Type);
+    E.emit(OP_Move, Private, Identity);
+    Privates.push_back({&R, Shared, Private, IsDouble});
+  }
+
+  uint16_t Index = E.declareVariable(VarName, KIRK_INT);
+  E.emit(OP_Move, Index, StartReg);
+
+  size_t Top = E.here();
+  unsigned Mark = E.markTemps();
+  uint16_t InRange = E.newTemp();
+  E.emit(OP_LtI, InRange, Index, Bound);
+  size_t Exit = E.emitJump(OP_JumpIfFalse, InRange);
+  E.releaseTemps(Mark);
+
+  Body->lowerToBytecode(E);
+  E.releaseTemps(Mark);
+
+  E.emit(OP_AddI, Index, Index, E.getIntConstant(1));
+  E.patchJump(E.emitJump(OP_Jump), Top);
+  E.patchJump(Exit, E.here());
+
+  for (const PrivateReduction &R : Privates) {
+    bool D = R.IsDouble;
+    switch (R.Clause->Op) {
+    case REDUCE_ADD:
+      E.emit(D ? OP_AddD : OP_AddI, R.Shared, R.Shared, R.Private);
+      break;
+    case REDUCE_MUL:
+      E.emit(D ? OP_MulD : OP_MulI, R.Shared, R.Shared, R.Private);
+      break;
+    case REDUCE_MIN:
+    case REDUCE_MAX: {
+      // shared = (shared < private) ? shared : private, and likewise for >
+      bool IsMin = R.Clause->Op == REDUCE_MIN;
+      uint16_t Keep = E.newTemp();
+      E.emit(IsMin ? (D ? OP_LtD : OP_LtI) : (D ? OP_GtD : OP_GtI), Keep,
+             R.Shared, R.Private);
+      size_t Skip = E.emitJump(OP_JumpIfFalse, Keep);
+      size_t Done = E.emitJump(OP_Jump);
+      E.patchJump(Skip, E.here());
+      E.emit(OP_Move, R.Shared, R.Private);
+      E.patchJump(Done, E.here());
+      break;
+    }
+    }
+  }
+
+  E.restoreScope(std::move(Saved));
+  return E.getDoubleConstant(0.0);
+}
+
+// The interpreter has no coroutines, so each loop consuming a generator
+// expands it in place as a state machine:
+//
+//         (arguments into the parameters)
+//         (the generator's body; each yield moves its value into the loop
+//         variable, sets Site to its index and jumps to Body)
+//         Jump Exit
+//   Body: (the loop body)
+//         Jump back after the yield that handed over the value, by Site
+//   Exit:
+//
+// The generator's temporaries may be live across a yield, while the loop
+// body runs, so the body's are pinned above them.
+namespace {
+struct BytecodeExpansion {
+  uint16_t Var; // The loop variable, which yields write
+  int Site;     // Which yield to resume, if there is more than one, or -1
+  std::vector<size_t> ToBody;  // Each yield's jump to the loop body
+  std::vector<size_t> Resumes; // Where each yield resumes
+};
+} // namespace
+
+static std::vector<BytecodeExpansion> BytecodeExpansions;
+
+// Nothing runs until a loop consumes the generator
+int GeneratorDeclExprAST::lowerToBytecode(BytecodeEmitter &) { return -1; }
+
+int YieldExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  // The loop consuming a generator nested in this one lowers its body after
+  // that generator's, so the expansion on top is this yield's
+  BytecodeExpansion &Expansion = BytecodeExpansions.back();
+
+  int ValueReg = Operand->lowerToBytecode(E);
+  E.emitMove(Expansion.Var, ValueReg, Operand->getType());
+  if (Expansion.Site >= 0)
+    E.emit(OP_Move, Expansion.Site,
+           E.getIntConstant(Expansion.Resumes.size()));
+  Expansion.ToBody.push_back(E.emitJump(OP_Jump));
+  Expansion.Resumes.push_back(E.here());
+  return E.getDoubleConstant(0.0);
+}
+
+int GeneratorForExprAST::lowerToBytecode(BytecodeEmitter &E) {
+  std::vector<int> ArgRegs;
+  for (auto &Arg : Args)
+    ArgRegs.push_back(Arg->lowerToBytecode(E));
+
+  std::map<std::string, uint16_t> Outer = E.saveScope();
+  uint16_t Var = E.declareVariable(VarName, Def->YieldType);
+  // Named so no program can refer to it
+  int Site = Def->NumYields > 1 ? E.declareVariable("yield.site", KIRK_INT)
+                                : -1;
+
+  BeginBytecodeLoop(E, *this);
+  std::map<std::string, uint16_t> Consumer = E.saveScope();
+
+  // The generator's body sees only what Sema let it: records, and its
+  // parameters over anything else
+  for (size_t i = 0; i < Def->Params.size(); ++i) {
+    const GeneratorParam &Param = Def->Params[i];
+    uint16_t Reg = E.declareVariable(Param.Name, Param.Type);
+    E.emitMove(Reg, ArgRegs[i], Param.Type);
+  }
+
+  BytecodeExpansions.push_back({Var, Site, {}, {}});
+  Def->Body->lowerToBytecode(E);
+  BytecodeExpansion Expansion = std::move(BytecodeExpansions.back());
+  BytecodeExpansions.pop_back();
+  size_t Exit = E.emitJump(OP_Jump);
+
+  E.restoreScope(std::move(Consumer));
+  E.pinTemps();
+  unsigned Mark = E.markTemps();
+
+  size_t Body = E.here();
+  for (size_t Jump : Expansion.ToBody)
+    E.patchJump(Jump, Body);
+  this->Body->lowerToBytecode(E);
+  E.releaseTemps(Mark);
+
+  // A continue asks for the next value, like the end of the body
+  size_t Dispatch = E.here();
+  for (size_t i = 0; i + 1 < Expansion.Resumes.size(); ++i) {
+    uint16_t Other = E.newTemp();
+    E.emit(OP_NeI, Other, Site, E.getIntConstant(i));
+    E.patchJump(E.emitJump(OP_JumpIfFalse, Other), Expansion.Resumes[i]);
+    E.releaseTemps(Mark);
+  }
+  E.patchJump(E.emitJump(OP_Jump), Expansion.Resumes.back());
+
+  // The generator's body ran off its end: the loop is done
+  E.patchJump(Exit, E.here());
+  int Result = EndBytecodeLoop(E, Dispatch);
+
+  // Only the loop variable goes out of scope; the body's declarations stay
+  std::map<std::string, uint16_t> Scope = E.saveScope();
+  auto Shadowed = Outer.find(VarName);
+  if (Shadowed != Outer.end())
+    Scope[VarName] = Shadowed->second;
+  else
+    Scope.erase(VarName);
+  E.restoreScope(std::move(Scope));
+
+  return Result;
+}
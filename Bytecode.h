@@ -0,0 +1,179 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include "Types.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Register bytecode for `kirk --interp`.
+//
+// Every instruction names its registers directly, so "x = a + b * c" is two
+// instructions instead of a stack machine's push/pop sequence. Constants live
+// in registers that are filled in before execution starts, and variables
+// keep one register for the whole program. Instructions are typed (AddI vs
+// AddD) because Sema has already resolved every operand type. A vector
+// value takes one register per lane, consecutive, and vector operations are
+// lowered to one scalar instruction per lane.
+
+// Opcode list, expanded into the enum below and into the interpreter's
+// computed-goto dispatch table (Interpreter.cpp)
+#define KIRK_OPCODES(X)                                                        \
+  X(Move)                                                                      \
+  X(AddI) X(SubI) X(MulI) X(DivI) X(RemI) X(NegI)                              \
+  X(AddD) X(SubD) X(MulD) X(DivD) X(RemD) X(NegD) X(PowD)                      \
+  X(AbsI) X(MinI) X(MaxI)                                                      \
+  X(AndI) X(OrI) X(XorI) X(ShlI) X(ShrI) X(UShrI) X(NotI)                      \
+  X(PopcntI) X(CtzI) X(ClzI)                                                   \
+  X(SqrtD) X(AbsD) X(MinD) X(MaxD) X(FloorD) X(FmaD)                           \
+  X(LtI) X(GtI) X(EqI) X(NeI) X(LeI) X(GeI)                                    \
+  X(LtD) X(GtD) X(EqD) X(NeD) X(LeD) X(GeD)                                    \
+  X(IntToDouble) X(DoubleToInt) X(IntToBool) X(DoubleToBool)                   \
+  X(Jump) X(JumpIfFalse)                                                       \
+  X(PrintI) X(PrintD) X(PrintB)                                                \
+  X(ClockNs) X(Cycles)                                                         \
+  X(ReadI) X(ReadD) X(ReadB) X(HasInput)                                       \
+  X(BenchBegin) X(BenchSample) X(BenchEnd)                                     \
+  X(MapView) X(LoadViewI) X(LoadViewD) X(ViewLen)                              \
+  X(LoadField) X(StoreField)                                                   \
+  X(MoveIf) X(PrintVecI) X(PrintVecD) X(PrintVecB)                             \
+  X(Halt)
+
+enum Opcode : uint16_t {
+#define KIRK_OPCODE_ENUM(Name) OP_##Name,
+  KIRK_OPCODES(KIRK_OPCODE_ENUM)
+#undef KIRK_OPCODE_ENUM
+};
+
+// Registers hold an int64 (ints and 0/1 bools) or a double
+union BytecodeValue {
+  int64_t I;
+  double D;
+};
+
+// Fixed 8-byte instruction: A is the destination (or the register a branch
+// tests), B and C are sources. Jumps store their target in B | C << 16.
+// FmaD also reads A, as its addend: A = B * C + A, and MoveIf sets A to C
+// if B is true. PrintVec prints the B lanes starting at register A. The Bench instructions
+// name a benchmark in A (an index into BenchmarkNames): BenchBegin starts it,
+// BenchSample records register B as one iteration's time, and BenchEnd
+// reports it, skipping the first B (a register) iterations as warm-up.
+// The view instructions name a view in B (an index into ViewPaths), except
+// MapView, which maps view A. LoadViewI/LoadViewD load element C of it.
+// LoadField and StoreField copy slot C of collection B (an index into
+// CollectionSlots) to or from register A.
+struct Instruction {
+  uint16_t Op;
+  uint16_t A;
+  uint16_t B;
+  uint16_t C;
+
+  uint32_t getTarget() const { return B | (uint32_t(C) << 16); }
+};
+
+struct BytecodeProgram {
+  std::vector<Instruction> Code;
+  std::vector<std::pair<uint16_t, BytecodeValue>> Constants;
+  std::vector<std::string> BenchmarkNames;
+  std::vector<std::string> ViewPaths;
+  // The number of 8-byte slots of each collection of records, zeroed when
+  // the program starts
+  std::vector<int64_t> CollectionSlots;
+  unsigned NumRegisters = 0;
+};
+
+// A collection of records in the interpreter's memory. Element I's field F
+// is slot I * NumFields + F of it for an array of structs, and slot
+// F * Size + I for SoA, so the fields are laid out as in compiled code.
+struct BytecodeCollection {
+  uint16_t Id; // Index into CollectionSlots
+  unsigned NumFields;
+  int64_t Size;
+  RecordLayout Layout;
+};
+
+// Builds a BytecodeProgram while the AST lowers itself (Bytecode.cpp)
+class BytecodeEmitter {
+  BytecodeProgram Program;
+  std::map<std::string, uint16_t> Variables;
+  std::map<std::string, uint16_t> Views;
+  std::map<std::string, BytecodeCollection> Collections;
+  std::map<int64_t, uint16_t> IntConstants;
+  std::map<uint64_t, uint16_t> DoubleConstants; // Keyed by bit pattern
+  std::vector<KirkType> VariableTypes; // Per register, KIRK_VOID if not a var
+
+  unsigned NextRegister = 0;
+  unsigned FirstFreeTemp = 0; // Everything below is pinned by a permanent
+
+  uint16_t allocate();
+  uint16_t allocatePermanent(unsigned Count = 1);
+
+public:
+  // Registers
+  uint16_t newTemp() { return allocate(); }
+  // Lanes consecutive temporaries for a vector computed lane by lane while
+  // Sources (first register, lane count) are read. They only reuse a
+  // source's registers when LaneWise says each lane is read right before
+  // the same lane of the result is written, and the widths match.
+  struct LaneSource {
+    int Reg;
+    unsigned Lanes;
+  };
+  uint16_t newLaneTemps(unsigned Lanes,
+                        const std::vector<LaneSource> &Sources = {},
+                        bool LaneWise = false);
+  unsigned markTemps() const { return NextRegister; }
+  void releaseTemps(unsigned Mark);
+  // Claims Count released temporaries from Reg on again, for an operator
+  // whose result is its operand's register
+  void retainTemps(int Reg, unsigned Count);
+  // Keeps every temporary used so far out of the code lowered next, which
+  // runs while they are still live
+  void pinTemps() { NextRegister = FirstFreeTemp = Program.NumRegisters; }
+
+  uint16_t getIntConstant(int64_t Val);
+  uint16_t getDoubleConstant(double Val);
+
+  // Variables
+  uint16_t declareVariable(const std::string &Name, KirkType Type);
+  uint16_t lookupVariable(const std::string &Name) const;
+  bool isVariable(uint16_t Reg) const { return VariableTypes[Reg] != KIRK_VOID; }
+  KirkType getVariableType(uint16_t Reg) const { return VariableTypes[Reg]; }
+  std::map<std::string, uint16_t> saveScope() const { return Variables; }
+  void restoreScope(std::map<std::string, uint16_t> Scope) {
+    Variables = std::move(Scope);
+  }
+
+  // Instructions
+  size_t emit(Opcode Op, uint16_t A = 0, uint16_t B = 0, uint16_t C = 0);
+  // One Move per lane of a value of type Type
+  void emitMove(uint16_t Dst, uint16_t Src, KirkType Type);
+  size_t emitJump(Opcode Op, uint16_t A = 0); // Target patched later
+  void patchJump(size_t At, size_t Target);
+  size_t here() const { return Program.Code.size(); }
+
+  // Benchmarks
+  uint16_t addBenchmark(const std::string &Name);
+
+  // Views
+  uint16_t declareView(const std::string &Name, const std::string &Path);
+  uint16_t lookupView(const std::string &Name) const {
+    return Views.at(Name);
+  }
+
+  // Collections of records. A single record is a variable per field
+  // instead, named "p.x".
+  void declareCollection(const std::string &Name, unsigned NumFields,
+                         int64_t Size, RecordLayout Layout);
+  const BytecodeCollection &lookupCollection(const std::string &Name) const {
+    return Collections.at(Name);
+  }
+
+  BytecodeProgram finish();
+};
+
+// Runs a finished program with threaded dispatch (Interpreter.cpp)
+void RunBytecode(const BytecodeProgram &Program);
+
+#endif
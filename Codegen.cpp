@@ -1,10 +1,18 @@
 #include "Codegen.h"
 #include "AST.h"
 #include "Algorithms.h"
-#include "Errors.h"
+#include "DebugInfo.h"
 #include "Lexer.h"
+#include "Modules.h"
+#include "Multiversion.h"
+#include "Profiler.h"
+#include "TopLevel.h"
 #include "Types.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Verifier.h"
+#include <algorithm>
 #include <iostream>
 
 using namespace llvm;
@@ -14,6 +22,9 @@ std::unique_ptr<IRBuilder<>> Builder;
 std::unique_ptr<Module> TheModule;
 
 std::map<std::string, VarInfo> NamedValues;
+std::map<std::string, ViewInfo> NamedViews;
+std::map<std::string, RecordInfo> NamedRecords;
+FastMathFlags DefaultFastMath;
 
 void InitializeModule() {
   // Holds types and constants
@@ -24,9 +35,14 @@ void InitializeModule() {
 
   // Builder to insert instructions
   Builder = std::make_unique<IRBuilder<>>(*TheContext);
+  Builder->setFastMathFlags(DefaultFastMath);
 }
 
 Type *getLLVMType(KirkType Type) {
+  if (isVectorType(Type))
+    return FixedVectorType::get(getLLVMType(getElementType(Type)),
+                                getLaneCount(Type));
+
   switch (Type) {
   case KIRK_INT:
     return llvm::Type::getInt64Ty(*TheContext);
@@ -41,61 +57,66 @@ Type *getLLVMType(KirkType Type) {
   }
 }
 
-static KirkType getKirkTypeFromLLVM(Type *Ty) {
-  if (Ty->isDoubleTy())
-    return KIRK_DOUBLE;
-  if (Ty->isIntegerTy(64))
-    return KIRK_INT;
-  if (Ty->isIntegerTy(1))
-    return KIRK_BOOL;
-  if (Ty->isVoidTy())
-    return KIRK_VOID;
-  return KIRK_DOUBLE;
-}
+StructType *getRecordLLVMType(const RecordType &Record) {
+  std::string Name = "struct." + Record.Name;
+  if (StructType *Existing = StructType::getTypeByName(*TheContext, Name))
+    return Existing;
 
-static int getTypeRank(KirkType T) {
-  switch (T) {
-  case KIRK_DOUBLE:
-    return 3;
-  case KIRK_INT:
-    return 2;
-  case KIRK_BOOL:
-    return 1;
-  default:
-    return 0;
-  }
+  std::vector<Type *> Fields;
+  for (const RecordField &Field : Record.Fields)
+    Fields.push_back(getLLVMType(Field.Type));
+  return StructType::create(*TheContext, Fields, Name);
 }
 
-static KirkType getCommonType(KirkType A, KirkType B) {
-  return getTypeRank(A) >= getTypeRank(B) ? A : B;
+std::vector<Type *> getRecordStorageTypes(const RecordType &Record,
+                                          long long CollectionSize,
+                                          RecordLayout Layout) {
+  if (CollectionSize == 0)
+    return {getRecordLLVMType(Record)};
+  if (Layout == LAYOUT_AOS)
+    return {ArrayType::get(getRecordLLVMType(Record), CollectionSize)};
+
+  std::vector<Type *> Columns;
+  for (const RecordField &Field : Record.Fields)
+    Columns.push_back(ArrayType::get(getLLVMType(Field.Type), CollectionSize));
+  return Columns;
 }
 
-static Value *CastToType(Value *Val, KirkType DestType,
+// Emits the conversion chosen by semantic analysis for a CastExprAST.
+// Vectors convert lane by lane with the same instructions.
+static Value *CastToType(Value *Val, KirkType SrcType, KirkType DestType,
                          const std::string &Name) {
-  KirkType SrcType = getKirkTypeFromLLVM(Val->getType());
   if (SrcType == DestType)
     return Val;
 
-  switch (DestType) {
+  // A scalar becomes a vector by converting it to the element type first
+  if (isVectorType(DestType) && !isVectorType(SrcType)) {
+    Val = CastToType(Val, SrcType, getElementType(DestType), Name);
+    return Builder->CreateVectorSplat(getLaneCount(DestType), Val, Name);
+  }
+
+  Type *DestTy = getLLVMType(DestType);
+  KirkType SrcElement = getElementType(SrcType);
+  switch (getElementType(DestType)) {
   case KIRK_DOUBLE:
-    if (SrcType == KIRK_INT)
-      return Builder->CreateSIToFP(Val, Type::getDoubleTy(*TheContext), Name);
-    if (SrcType == KIRK_BOOL)
-      return Builder->CreateUIToFP(Val, Type::getDoubleTy(*TheContext), Name);
+    if (SrcElement == KIRK_INT)
+      return Builder->CreateSIToFP(Val, DestTy, Name);
+    if (SrcElement == KIRK_BOOL)
+      return Builder->CreateUIToFP(Val, DestTy, Name);
     break;
   case KIRK_INT:
-    if (SrcType == KIRK_DOUBLE)
-      return Builder->CreateFPToSI(Val, Type::getInt64Ty(*TheContext), Name);
-    if (SrcType == KIRK_BOOL)
-      return Builder->CreateZExt(Val, Type::getInt64Ty(*TheContext), Name);
+    if (SrcElement == KIRK_DOUBLE)
+      return Builder->CreateFPToSI(Val, DestTy, Name);
+    if (SrcElement == KIRK_BOOL)
+      return Builder->CreateZExt(Val, DestTy, Name);
     break;
   case KIRK_BOOL:
-    if (SrcType == KIRK_DOUBLE)
+    if (SrcElement == KIRK_DOUBLE)
       return Builder->CreateFCmpONE(
-          Val, ConstantFP::get(*TheContext, APFloat(0.0)), Name);
-    if (SrcType == KIRK_INT)
+          Val, Constant::getNullValue(Val->getType()), Name);
+    if (SrcElement == KIRK_INT)
       return Builder->CreateICmpNE(
-          Val, ConstantInt::get(Type::getInt64Ty(*TheContext), 0), Name);
+          Val, Constant::getNullValue(Val->getType()), Name);
     break;
   default:
     break;
@@ -117,109 +138,112 @@ Value *BoolExprAST::codegen() {
   return ConstantInt::get(Type::getInt1Ty(*TheContext), Val ? 1 : 0);
 }
 
-// Turns any expression into IR operation
-Value *BinaryExprAST::codegen() {
-  // Generate codes for the Left side and Right side
-  Value *L = LHS->codegen();
-  Value *R = RHS->codegen();
-
-  if (!L || !R)
-    return nullptr;
+// Generates the operands of Root and of the operators nested in it, left to
+// right, then each operator's own instruction
+Value *OperatorExprAST::codegen() {
+  return WalkOperatorTree<Value *>(
+      this, [](OperatorExprAST *) {},
+      [](ExprAST *Leaf) { return Leaf->codegen(); },
+      [](OperatorExprAST *, size_t, Value *&) {},
+      [](OperatorExprAST *Node, ArrayRef<Value *> Operands) -> Value * {
+        for (Value *Operand : Operands)
+          if (!Operand)
+            return nullptr;
+        return Node->codegenOperator(Operands);
+      });
+}
 
-  KirkType LTy = getKirkTypeFromLLVM(L->getType());
-  KirkType RTy = getKirkTypeFromLLVM(R->getType());
+Value *CastExprAST::codegenOperator(ArrayRef<Value *> Operands) {
+  SourceLocationScope Scope(Loc);
+  return CastToType(Operands[0], Operand->getType(), ResolvedType, "casttmp");
+}
 
-  auto CastBoth = [&](KirkType Target) {
-    L = CastToType(L, Target, "lhscast");
-    R = CastToType(R, Target, "rhscast");
-  };
+// Turns any expression into IR operation
+Value *BinaryExprAST::codegenOperator(ArrayRef<Value *> Operands) {
+  SourceLocationScope Scope(Loc);
+  Value *L = Operands[0];
+  Value *R = Operands[1];
 
-  KirkType CommonType = getCommonType(LTy, RTy);
-  KirkType NumericType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
+  // Semantic analysis already cast both operands to the same type. Vector
+  // operands use the same instructions, lane by lane.
+  bool IsDouble = getElementType(LHS->getType()) == KIRK_DOUBLE;
 
   // Create the instruction based on the operator
   switch (Op) {
 
     // Arithmetic
   case '+':
-    CastBoth(NumericType);
-    return NumericType == KIRK_DOUBLE ? Builder->CreateFAdd(L, R, "addtmp")
-                                      : Builder->CreateAdd(L, R, "addtmp");
+    return IsDouble ? Builder->CreateFAdd(L, R, "addtmp")
+                    : Builder->CreateAdd(L, R, "addtmp");
 
   case '-':
-    CastBoth(NumericType);
-    return NumericType == KIRK_DOUBLE ? Builder->CreateFSub(L, R, "subtmp")
-                                      : Builder->CreateSub(L, R, "subtmp");
+    return IsDouble ? Builder->CreateFSub(L, R, "subtmp")
+                    : Builder->CreateSub(L, R, "subtmp");
 
   case '*':
-    CastBoth(NumericType);
-    return NumericType == KIRK_DOUBLE ? Builder->CreateFMul(L, R, "multmp")
-                                      : Builder->CreateMul(L, R, "multmp");
+    return IsDouble ? Builder->CreateFMul(L, R, "multmp")
+                    : Builder->CreateMul(L, R, "multmp");
 
   case '/':
-    CastBoth(NumericType);
-    return NumericType == KIRK_DOUBLE ? Builder->CreateFDiv(L, R, "divtmp")
-                                      : Builder->CreateSDiv(L, R, "divtmp");
+    return IsDouble ? Builder->CreateFDiv(L, R, "divtmp")
+                    : Builder->CreateSDiv(L, R, "divtmp");
 
   case '%':
-    CastBoth(NumericType);
-    return NumericType == KIRK_DOUBLE ? Builder->CreateFRem(L, R, "modtmp")
-                                      : Builder->CreateSRem(L, R, "modtmp");
+    return IsDouble ? Builder->CreateFRem(L, R, "modtmp")
+                    : Builder->CreateSRem(L, R, "modtmp");
 
   // Comparison
-  case '<': {
-    KirkType CmpType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
-    CastBoth(CmpType);
-    return CmpType == KIRK_DOUBLE ? Builder->CreateFCmpOLT(L, R, "cmptmp")
-                                  : Builder->CreateICmpSLT(L, R, "cmptmp");
-  }
+  case '<':
+    return IsDouble ? Builder->CreateFCmpOLT(L, R, "cmptmp")
+                    : Builder->CreateICmpSLT(L, R, "cmptmp");
 
-  case '>': {
-    KirkType CmpType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
-    CastBoth(CmpType);
-    return CmpType == KIRK_DOUBLE ? Builder->CreateFCmpOGT(L, R, "cmptmp")
-                                  : Builder->CreateICmpSGT(L, R, "cmptmp");
-  }
+  case '>':
+    return IsDouble ? Builder->CreateFCmpOGT(L, R, "cmptmp")
+                    : Builder->CreateICmpSGT(L, R, "cmptmp");
 
-  case TOK_EQ: {
-    KirkType CmpType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
-    CastBoth(CmpType);
-    return CmpType == KIRK_DOUBLE ? Builder->CreateFCmpOEQ(L, R, "cmptmp")
-                                  : Builder->CreateICmpEQ(L, R, "cmptmp");
-  }
+  case TOK_EQ:
+    return IsDouble ? Builder->CreateFCmpOEQ(L, R, "cmptmp")
+                    : Builder->CreateICmpEQ(L, R, "cmptmp");
 
-  case TOK_NEQ: {
-    KirkType CmpType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
-    CastBoth(CmpType);
-    return CmpType == KIRK_DOUBLE ? Builder->CreateFCmpONE(L, R, "cmptmp")
-                                  : Builder->CreateICmpNE(L, R, "cmptmp");
-  }
+  case TOK_NEQ:
+    return IsDouble ? Builder->CreateFCmpONE(L, R, "cmptmp")
+                    : Builder->CreateICmpNE(L, R, "cmptmp");
 
-  case TOK_GEQ: {
-    KirkType CmpType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
-    CastBoth(CmpType);
-    return CmpType == KIRK_DOUBLE ? Builder->CreateFCmpOGE(L, R, "cmptmp")
-                                  : Builder->CreateICmpSGE(L, R, "cmptmp");
-  }
+  case TOK_GEQ:
+    return IsDouble ? Builder->CreateFCmpOGE(L, R, "cmptmp")
+                    : Builder->CreateICmpSGE(L, R, "cmptmp");
 
-  case TOK_LEQ: {
-    KirkType CmpType = (CommonType == KIRK_BOOL) ? KIRK_INT : CommonType;
-    CastBoth(CmpType);
-    return CmpType == KIRK_DOUBLE ? Builder->CreateFCmpOLE(L, R, "cmptmp")
-                                  : Builder->CreateICmpSLE(L, R, "cmptmp");
-  }
+  case TOK_LEQ:
+    return IsDouble ? Builder->CreateFCmpOLE(L, R, "cmptmp")
+                    : Builder->CreateICmpSLE(L, R, "cmptmp");
   // Power
   case '^': {
-    // Ensure both operands are double
-    CastBoth(KIRK_DOUBLE);
-
     Function *PowFunc = Intrinsic::getOrInsertDeclaration(
-        TheModule.get(), Intrinsic::pow, Type::getDoubleTy(*TheContext));
+        TheModule.get(), Intrinsic::pow, getLLVMType(LHS->getType()));
 
     return Builder->CreateCall(PowFunc, {L, R}, "powtmp");
   }
+
+  // Bitwise. Shift amounts are taken modulo 64, as x86 does, instead of
+  // giving poison for 64 and up: the mask folds into the shift instruction.
+  case '&':
+    return Builder->CreateAnd(L, R, "andtmp");
+  case '|':
+    return Builder->CreateOr(L, R, "ortmp");
+  case TOK_XOR:
+    return Builder->CreateXor(L, R, "xortmp");
+  case TOK_SHL:
+  case TOK_SHR:
+  case TOK_USHR: {
+    Value *Amount =
+        Builder->CreateAnd(R, ConstantInt::get(R->getType(), 63), "shamt");
+    if (Op == TOK_SHL)
+      return Builder->CreateShl(L, Amount, "shltmp");
+    if (Op == TOK_SHR)
+      return Builder->CreateAShr(L, Amount, "shrtmp");
+    return Builder->CreateLShr(L, Amount, "ushrtmp");
+  }
   default:
-    SyntaxError(CurLoc, "Error: invalid binary operator");
     return nullptr;
   }
 }
@@ -233,40 +257,174 @@ AllocaInst *CreateEntryBlockAlloca(Function *TheFunction,
 }
 
 Value *VarDeclExprAST::codegen() {
-  if (NamedValues.count(Name)) {
-    SyntaxError(Loc, "Variable already declared").raise();
-    return nullptr;
-  }
-
+  SourceLocationScope Scope(Loc);
   Value *Init = InitVal->codegen();
   if (!Init)
     return nullptr;
 
-  Init = CastToType(Init, Type, "initcast");
-
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
-  AllocaInst *Alloca = CreateEntryBlockAlloca(TheFunction, Name, Type);
+  Value *Ptr;
+  if (TheFunction == TopLevelFunction) {
+    GlobalVariable *Global = CreateTopLevelVariable(Name, DeclType);
+    if (IsExported)
+      ExportVariable(Global, Name, DeclType);
+    Ptr = Global;
+  } else {
+    Ptr = CreateEntryBlockAlloca(TheFunction, Name, DeclType);
+  }
 
-  Builder->CreateStore(Init, Alloca);
+  Builder->CreateStore(Init, Ptr);
 
-  // Store both Alloc and Type in symbol table
-  NamedValues[Name] = {Alloca, Type};
+  // Store both the storage and the Type in symbol table
+  NamedValues[Name] = {Ptr, DeclType};
   return Init;
 }
 
+Value *ViewDeclExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  Type *PtrTy = PointerType::getUnqual(*TheContext);
+
+  auto *Base = new GlobalVariable(*TheModule, PtrTy, false,
+                                  GlobalValue::InternalLinkage,
+                                  Constant::getNullValue(PtrTy),
+                                  "kirk.view." + Name);
+  auto *Length = new GlobalVariable(*TheModule, I64, false,
+                                    GlobalValue::InternalLinkage,
+                                    Constant::getNullValue(I64),
+                                    "kirk.view." + Name + ".len");
+
+  FunctionCallee MapFunc = TheModule->getOrInsertFunction(
+      "kirk_map_file", PtrTy, PtrTy, I64, PtrTy);
+  Value *PathV = Builder->CreateGlobalString(Path, "viewpath");
+  Value *Data = Builder->CreateCall(
+      MapFunc, {PathV, Builder->getInt64(8), Length}, Name + ".data");
+  Builder->CreateStore(Data, Base);
+
+  NamedViews[Name] = {Base, Length, ElementType};
+  return Data;
+}
+
+// The mapping is read-only and never changes, so the element load is marked
+// invariant: LLVM may hoist, merge or vectorize it like a constant's
+Value *IndexExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *IndexV = Index->codegen();
+  if (!IndexV)
+    return nullptr;
+
+  const ViewInfo &View = NamedViews[Name];
+  Type *ElementTy = getLLVMType(View.ElementType);
+
+  Value *Base = Builder->CreateLoad(PointerType::getUnqual(*TheContext),
+                                    View.Base, Name + ".base");
+  Value *Addr =
+      Builder->CreateInBoundsGEP(ElementTy, Base, IndexV, Name + ".addr");
+  LoadInst *Element =
+      Builder->CreateAlignedLoad(ElementTy, Addr, Align(8), Name + ".elem");
+  Element->setMetadata(LLVMContext::MD_invariant_load,
+                       MDNode::get(*TheContext, {}));
+  return Element;
+}
+
+Value *LengthExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  if (CollectionSize)
+    return Builder->getInt64(CollectionSize);
+  return Builder->CreateLoad(Type::getInt64Ty(*TheContext),
+                             NamedViews[Name].Length, Name + ".len");
+}
+
+// Only names the LLVM type; the declaration has no value
+Value *StructDeclExprAST::codegen() {
+  getRecordLLVMType(*Record);
+  return nullptr;
+}
+
+// Zero-initialized globals: declaring a record runs no code
+Value *RecordDeclExprAST::codegen() {
+  RecordInfo Info = {Record, Size, Layout, {}};
+  std::vector<Type *> Types = getRecordStorageTypes(*Record, Size, Layout);
+
+  for (size_t i = 0; i < Types.size(); ++i) {
+    std::string GlobalName = "kirk.var." + Name;
+    if (Types.size() > 1)
+      GlobalName += "." + Record->Fields[i].Name;
+    auto *Global = new GlobalVariable(*TheModule, Types[i], false,
+                                      GlobalValue::InternalLinkage,
+                                      Constant::getNullValue(Types[i]),
+                                      GlobalName);
+    // Aligned to a cache line, so the vectorizer's loads of a field
+    // column don't straddle two
+    if (Size)
+      Global->setAlignment(Align(64));
+    Info.Storage.push_back(Global);
+  }
+
+  NamedRecords[Name] = Info;
+  return Info.Storage[0];
+}
+
+Value *FieldExprAST::codegenAddress() {
+  const RecordInfo &Info = NamedRecords[Name];
+  if (!Index)
+    return Builder->CreateStructGEP(getRecordLLVMType(*Info.Record),
+                                    Info.Storage[0], FieldIndex,
+                                    Name + "." + Field + ".addr");
+
+  Value *IndexV = Index->codegen();
+  if (!IndexV)
+    return nullptr;
+
+  // An array of structs steps over whole records; a column is the field's
+  // own array, whose consecutive elements are adjacent
+  Value *Zero = Builder->getInt64(0);
+  if (Info.Layout == LAYOUT_AOS)
+    return Builder->CreateInBoundsGEP(
+        Info.Storage[0]->getValueType(), Info.Storage[0],
+        {Zero, IndexV, Builder->getInt32(FieldIndex)},
+        Name + "." + Field + ".addr");
+  GlobalVariable *Column = Info.Storage[FieldIndex];
+  return Builder->CreateInBoundsGEP(Column->getValueType(), Column,
+                                    {Zero, IndexV},
+                                    Name + "." + Field + ".addr");
+}
+
+Value *FieldExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *Addr = codegenAddress();
+  if (!Addr)
+    return nullptr;
+  return Builder->CreateLoad(getLLVMType(ResolvedType), Addr,
+                             Name + "." + Field);
+}
+
+Value *FieldAssignmentExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *Addr = Target->codegenAddress();
+  if (!Addr)
+    return nullptr;
+  Value *Val = RHS->codegen();
+  if (!Val)
+    return nullptr;
+
+  Builder->CreateStore(Val, Addr);
+  return Val;
+}
+
 Value *VariableExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
   // Look up the variable in the symbol table
   auto Iter = NamedValues.find(Name);
-  if (Iter != NamedValues.end()) {
-    AllocaInst *A = Iter->second.Alloca;
-    return Builder->CreateLoad(A->getAllocatedType(), A, Name.c_str());
-  }
+  if (Iter == NamedValues.end())
+    return nullptr; // Unreachable once Sema has resolved the name
 
-  ReferenceError(Loc, Name, NamedValues).raise();
-  return nullptr;
+  return Builder->CreateLoad(getLLVMType(Iter->second.Type), Iter->second.Ptr,
+                             Name.c_str());
 }
 
 Value *AssignmentExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
   // Generate code for the RHS first
   Value *Val = RHS->codegen();
   if (!Val)
@@ -274,32 +432,22 @@ Value *AssignmentExprAST::codegen() {
 
   // Look up the variable
   auto Iter = NamedValues.find(Name);
-  if (Iter == NamedValues.end()) {
-    SyntaxError(Loc, "Variable must be declared with a type before use")
-        .raise();
-    return nullptr;
-  }
-
-  AllocaInst *Alloca = Iter->second.Alloca;
-  KirkType VarType = Iter->second.Type;
-
-  Value *CastVal = CastToType(Val, VarType, "assigncast");
+  if (Iter == NamedValues.end())
+    return nullptr; // Unreachable once Sema has resolved the name
 
   // Generate the Store instruction
-  Builder->CreateStore(CastVal, Alloca);
+  Builder->CreateStore(Val, Iter->second.Ptr);
 
   // Assignment expressions usually return the value assigned (allows x = y = 5)
-  return CastVal;
+  return Val;
 }
 
 Value *IfExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
   Value *CondV = Cond->codegen();
   if (!CondV)
     return nullptr;
 
-  // Convert condition to a boolean
-  CondV = CastToType(CondV, KIRK_BOOL, "ifcond");
-
   // Get the current function so we can insert blocks into it
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
@@ -310,7 +458,15 @@ Value *IfExprAST::codegen() {
 
   // Create the Conditional Branch
   // "If CondV is true, go to ThenBB, otherwise go to ElseBB"
-  Builder->CreateCondBr(CondV, ThenBB, ElseBB);
+  MDNode *Weights = nullptr;
+  if (Hint != BRANCH_UNHINTED) {
+    // The weights clang gives __builtin_expect: taken 2000 times in 2001
+    uint32_t Taken = 2000, NotTaken = 1;
+    if (Hint == BRANCH_UNLIKELY)
+      std::swap(Taken, NotTaken);
+    Weights = MDBuilder(*TheContext).createBranchWeights(Taken, NotTaken);
+  }
+  Builder->CreateCondBr(CondV, ThenBB, ElseBB, Weights);
 
   Builder->SetInsertPoint(ThenBB);
 
@@ -334,15 +490,13 @@ Value *IfExprAST::codegen() {
   TheFunction->insert(TheFunction->end(), MergeBB);
   Builder->SetInsertPoint(MergeBB);
 
-  KirkType ThenType = getKirkTypeFromLLVM(ThenV->getType());
-  KirkType ElseType = getKirkTypeFromLLVM(ElseV->getType());
-  KirkType MergeType = getCommonType(ThenType, ElseType);
-
-  ThenV = CastToType(ThenV, MergeType, "thencast");
-  ElseV = CastToType(ElseV, MergeType, "elsecast");
+  // Branches without a value (like print) need no PHI; Sema keeps the
+  // result of such an if from being used
+  if (ResolvedType == KIRK_VOID)
+    return ThenV;
 
-  // The PHI Node
-  PHINode *PN = Builder->CreatePHI(ThenV->getType(), 2, "iftmp");
+  // The PHI Node, both branches were already cast to the merged type
+  PHINode *PN = Builder->CreatePHI(getLLVMType(ResolvedType), 2, "iftmp");
 
   PN->addIncoming(ThenV, ThenBB);
   PN->addIncoming(ElseV, ElseBB);
@@ -350,31 +504,167 @@ Value *IfExprAST::codegen() {
   return PN;
 }
 
-Value *UnaryExprAST::codegen() {
-  Value *OperandV = Operand->codegen();
-  if (!OperandV)
+// Ranges with more values than this are tested with a comparison before
+// the switch instead of becoming one case per value
+static const uint64_t MaxSwitchRange = 128;
+
+// One SwitchInst for all arms. LLVM's switch lowering then picks jump
+// tables, bit tests or a binary search, and merges runs of cases that lead
+// to the same arm into range checks.
+Value *MatchExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *SubjectV = Subject->codegen();
+  if (!SubjectV)
     return nullptr;
 
-  KirkType OperandType = getKirkTypeFromLLVM(OperandV->getType());
-  if (OperandType == KIRK_BOOL)
-    OperandV = CastToType(OperandV, KIRK_INT, "boolneg");
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+
+  std::vector<BasicBlock *> ArmBBs;
+  for (const MatchArm &Arm : Arms)
+    ArmBBs.push_back(BasicBlock::Create(
+        *TheContext, Arm.Patterns.empty() ? "matchdefault" : "matcharm"));
+  BasicBlock *MergeBB = BasicBlock::Create(*TheContext, "matchcont");
+
+  // Long ranges first. Patterns don't overlap, so the order doesn't matter.
+  unsigned NumCases = 0;
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    for (const MatchPattern &Pattern : Arms[i].Patterns) {
+      uint64_t Span = uint64_t(Pattern.Last) - uint64_t(Pattern.Low);
+      if (Span < MaxSwitchRange) {
+        NumCases += Span + 1;
+        continue;
+      }
+
+      // Low <= x <= Last as one unsigned comparison
+      Value *InRange = Builder->CreateICmpULE(
+          Builder->CreateSub(SubjectV, Builder->getInt64(Pattern.Low)),
+          Builder->getInt64(Span), "matchrange");
+      BasicBlock *NextBB =
+          BasicBlock::Create(*TheContext, "matchnext", TheFunction);
+      Builder->CreateCondBr(InRange, ArmBBs[i], NextBB);
+      Builder->SetInsertPoint(NextBB);
+    }
+  }
+
+  SwitchInst *Switch =
+      Builder->CreateSwitch(SubjectV, ArmBBs.back(), NumCases);
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    for (const MatchPattern &Pattern : Arms[i].Patterns) {
+      uint64_t Span = uint64_t(Pattern.Last) - uint64_t(Pattern.Low);
+      if (Span >= MaxSwitchRange)
+        continue;
+      for (uint64_t Offset = 0; Offset <= Span; ++Offset)
+        Switch->addCase(Builder->getInt64(uint64_t(Pattern.Low) + Offset),
+                        ArmBBs[i]);
+    }
+  }
+
+  // The arms, and one PHI merging their values
+  std::vector<std::pair<Value *, BasicBlock *>> ArmValues;
+  for (size_t i = 0; i < Arms.size(); ++i) {
+    TheFunction->insert(TheFunction->end(), ArmBBs[i]);
+    Builder->SetInsertPoint(ArmBBs[i]);
+
+    Value *ArmV = Arms[i].Body->codegen();
+    if (!ArmV)
+      return nullptr;
+    Builder->CreateBr(MergeBB);
+    ArmValues.push_back({ArmV, Builder->GetInsertBlock()});
+  }
+
+  TheFunction->insert(TheFunction->end(), MergeBB);
+  Builder->SetInsertPoint(MergeBB);
+
+  // Sema keeps the result of a match with a valueless arm from being used
+  if (ResolvedType == KIRK_VOID)
+    return ArmValues[0].first;
+
+  PHINode *PN = Builder->CreatePHI(getLLVMType(ResolvedType), Arms.size(),
+                                   "matchtmp");
+  for (const auto &ArmValue : ArmValues)
+    PN->addIncoming(ArmValue.first, ArmValue.second);
+  return PN;
+}
 
-  OperandType = getKirkTypeFromLLVM(OperandV->getType());
+Value *UnaryExprAST::codegenOperator(ArrayRef<Value *> Operands) {
+  SourceLocationScope Scope(Loc);
+  Value *OperandV = Operands[0];
 
+  // Bool operands were already promoted to int, except for "not"
   switch (Opcode) {
   case '-':
-    if (OperandType == KIRK_DOUBLE)
+    if (getElementType(ResolvedType) == KIRK_DOUBLE)
       return Builder->CreateFNeg(OperandV);
-    if (OperandType == KIRK_INT)
-      return Builder->CreateNeg(OperandV);
-    SyntaxError(CurLoc, "Unknown unary operand type").raise();
-    return nullptr;
+    return Builder->CreateNeg(OperandV);
+  case '~':
+  case TOK_NOT:
+    return Builder->CreateNot(OperandV, "nottmp");
   default:
-    SyntaxError(CurLoc, "Unknown unary operator");
     return nullptr;
   }
 }
 
+// Operands up to this cost are evaluated unconditionally and combined with
+// a select, which keeps a condition like "x > 0 and x < n" branchless
+static const unsigned MaxSpeculationCost = 8;
+
+// Each operand that could decide the result ends its block with a branch
+// to the end, where one PHI collects the results
+Value *LogicalExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  bool IsAnd = Op == TOK_AND;
+
+  Value *Result = Operands[0]->codegen();
+  if (!Result)
+    return nullptr;
+
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  BasicBlock *EndBB = nullptr;
+  std::vector<BasicBlock *> Decided; // Blocks that branch to EndBB early
+
+  for (size_t i = 1; i < Operands.size(); ++i) {
+    if (Operands[i]->getSpeculationCost() <= MaxSpeculationCost) {
+      Value *OperandV = Operands[i]->codegen();
+      if (!OperandV)
+        return nullptr;
+      Result = IsAnd ? Builder->CreateLogicalAnd(Result, OperandV, "andtmp")
+                     : Builder->CreateLogicalOr(Result, OperandV, "ortmp");
+      continue;
+    }
+
+    if (!EndBB)
+      EndBB = BasicBlock::Create(*TheContext, IsAnd ? "andend" : "orend");
+    BasicBlock *NextBB = BasicBlock::Create(
+        *TheContext, IsAnd ? "andrhs" : "orrhs", TheFunction);
+    if (IsAnd)
+      Builder->CreateCondBr(Result, NextBB, EndBB);
+    else
+      Builder->CreateCondBr(Result, EndBB, NextBB);
+    Decided.push_back(Builder->GetInsertBlock());
+
+    Builder->SetInsertPoint(NextBB);
+    Result = Operands[i]->codegen();
+    if (!Result)
+      return nullptr;
+  }
+
+  if (!EndBB)
+    return Result;
+
+  Builder->CreateBr(EndBB);
+  BasicBlock *LastBB = Builder->GetInsertBlock();
+  TheFunction->insert(TheFunction->end(), EndBB);
+  Builder->SetInsertPoint(EndBB);
+
+  // An early exit means the result is false for "and" and true for "or"
+  PHINode *PN = Builder->CreatePHI(Builder->getInt1Ty(), Decided.size() + 1,
+                                   IsAnd ? "andtmp" : "ortmp");
+  for (BasicBlock *BB : Decided)
+    PN->addIncoming(Builder->getInt1(!IsAnd), BB);
+  PN->addIncoming(Result, LastBB);
+  return PN;
+}
+
 Value *BlockExprAST::codegen() {
   Value *LastVal = nullptr;
   for (auto &Expr : Expressions) {
@@ -384,26 +674,47 @@ Value *BlockExprAST::codegen() {
 }
 
 Value *PrintExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
   Value *Val = Expr->codegen();
   if (!Val)
     return nullptr;
 
   Function *PrintfFunc = TheModule->getFunction("printf");
-  Type *Ty = Val->getType();
+  KirkType Ty = Expr->getType();
+
+  // Vectors print on one line, as "<1.00, 2.00, 3.00, 4.00>"
+  if (isVectorType(Ty)) {
+    KirkType Element = getElementType(Ty);
+    const char *LaneFormat = Element == KIRK_DOUBLE ? "%.2f"
+                             : Element == KIRK_INT  ? "%lld"
+                                                    : "%d";
+    std::string Format = "<";
+    std::vector<Value *> PrintArgs = {nullptr};
+    for (unsigned Lane = 0; Lane < getLaneCount(Ty); ++Lane) {
+      Format += Lane == 0 ? LaneFormat : std::string(", ") + LaneFormat;
+      Value *LaneV = Builder->CreateExtractElement(Val, Lane, "printlane");
+      if (Element == KIRK_BOOL)
+        LaneV = Builder->CreateZExt(LaneV, Type::getInt32Ty(*TheContext),
+                                    "booltoint");
+      PrintArgs.push_back(LaneV);
+    }
+    PrintArgs[0] = Builder->CreateGlobalStringPtr(Format + ">\n", "printstrvec");
+    return Builder->CreateCall(PrintfFunc, PrintArgs, "printcall");
+  }
 
-  if (Ty->isDoubleTy()) {
+  if (Ty == KIRK_DOUBLE) {
     Value *FormatStr =
         Builder->CreateGlobalStringPtr("%.2f\n", "printstrdbl");
     return Builder->CreateCall(PrintfFunc, {FormatStr, Val}, "printcall");
   }
 
-  if (Ty->isIntegerTy(64)) {
+  if (Ty == KIRK_INT) {
     Value *FormatStr =
         Builder->CreateGlobalStringPtr("%lld\n", "printstrint");
     return Builder->CreateCall(PrintfFunc, {FormatStr, Val}, "printcall");
   }
 
-  if (Ty->isIntegerTy(1)) {
+  if (Ty == KIRK_BOOL) {
     Value *Zext = Builder->CreateZExt(Val, Type::getInt32Ty(*TheContext),
                                       "booltoint");
     Value *FormatStr =
@@ -411,18 +722,516 @@ Value *PrintExprAST::codegen() {
     return Builder->CreateCall(PrintfFunc, {FormatStr, Zext}, "printcall");
   }
 
-  SyntaxError(CurLoc, "Unsupported type for print").raise();
   return nullptr;
 }
 
+Value *BuiltinCallExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+
+  if (Callee == BUILTIN_CLOCK_NS) {
+    FunctionCallee ClockFunc = TheModule->getOrInsertFunction(
+        "kirk_clock_ns", Type::getInt64Ty(*TheContext));
+    return Builder->CreateCall(ClockFunc, {}, "clockns");
+  }
+  if (Callee == BUILTIN_CYCLES) {
+    Function *CounterFunc = Intrinsic::getOrInsertDeclaration(
+        TheModule.get(), Intrinsic::readcyclecounter);
+    return Builder->CreateCall(CounterFunc, {}, "cycles");
+  }
+  if (Callee == BUILTIN_READ_INT || Callee == BUILTIN_READ_DOUBLE) {
+    FunctionCallee ReadFunc = TheModule->getOrInsertFunction(
+        Callee == BUILTIN_READ_INT ? "kirk_read_int" : "kirk_read_double",
+        getLLVMType(ResolvedType));
+    return Builder->CreateCall(ReadFunc, {}, "input");
+  }
+  if (Callee == BUILTIN_READ_BOOL || Callee == BUILTIN_HAS_INPUT) {
+    // The runtime returns these as 0 / 1 in an i32
+    FunctionCallee ReadFunc = TheModule->getOrInsertFunction(
+        Callee == BUILTIN_READ_BOOL ? "kirk_read_bool" : "kirk_has_input",
+        Type::getInt32Ty(*TheContext));
+    return Builder->CreateICmpNE(Builder->CreateCall(ReadFunc, {}, "input"),
+                                 Builder->getInt32(0), "inputbool");
+  }
+
+  std::vector<Value *> ArgsV;
+  for (auto &Arg : Args) {
+    Value *V = Arg->codegen();
+    if (!V)
+      return nullptr;
+    ArgsV.push_back(V);
+  }
+
+  if (Callee >= BUILTIN_LANE)
+    return codegenVectorBuiltin(ArgsV);
+
+  // Semantic analysis already cast every argument to the result type, which
+  // may be a vector: the intrinsics work lane by lane
+  bool IsDouble = getElementType(ResolvedType) == KIRK_DOUBLE;
+  Intrinsic::ID ID;
+  switch (Callee) {
+  case BUILTIN_SQRT:
+    ID = Intrinsic::sqrt;
+    break;
+  case BUILTIN_FLOOR:
+    ID = Intrinsic::floor;
+    break;
+  case BUILTIN_FMA:
+    ID = Intrinsic::fma;
+    break;
+  case BUILTIN_ABS:
+    if (IsDouble) {
+      ID = Intrinsic::fabs;
+    } else {
+      // Not poison for the most negative int, which wraps to itself
+      ID = Intrinsic::abs;
+      ArgsV.push_back(Builder->getFalse());
+    }
+    break;
+  case BUILTIN_MIN:
+    ID = IsDouble ? Intrinsic::minnum : Intrinsic::smin;
+    break;
+  case BUILTIN_MAX:
+    ID = IsDouble ? Intrinsic::maxnum : Intrinsic::smax;
+    break;
+  case BUILTIN_POPCOUNT:
+    ID = Intrinsic::ctpop;
+    break;
+  // Defined for 0 (64), so there's no branch around tzcnt / lzcnt
+  case BUILTIN_CTZ:
+  case BUILTIN_CLZ:
+    ID = Callee == BUILTIN_CTZ ? Intrinsic::cttz : Intrinsic::ctlz;
+    ArgsV.push_back(Builder->getFalse());
+    break;
+  default:
+    return nullptr;
+  }
+
+  Function *Intrinsic = Intrinsic::getOrInsertDeclaration(
+      TheModule.get(), ID, getLLVMType(ResolvedType));
+  return Builder->CreateCall(Intrinsic, ArgsV, "calltmp");
+}
+
+Value *BuiltinCallExprAST::codegenVectorBuiltin(ArrayRef<Value *> ArgsV) {
+  KirkType Element = getElementType(Args[0]->getType());
+  bool IsDouble = Element == KIRK_DOUBLE;
+
+  switch (Callee) {
+  case BUILTIN_LANE:
+    return Builder->CreateExtractElement(ArgsV[0], LaneNumbers[0], "lane");
+  case BUILTIN_WITH_LANE:
+    return Builder->CreateInsertElement(ArgsV[0], ArgsV[1], LaneNumbers[0],
+                                        "withlane");
+  case BUILTIN_SHUFFLE: {
+    SmallVector<int, 8> Mask(LaneNumbers.begin(), LaneNumbers.end());
+    Value *Second = ArgsV.size() > 1
+                        ? ArgsV[1]
+                        : PoisonValue::get(ArgsV[0]->getType());
+    return Builder->CreateShuffleVector(ArgsV[0], Second, Mask, "shuffle");
+  }
+  case BUILTIN_SELECT:
+    return Builder->CreateSelect(ArgsV[0], ArgsV[1], ArgsV[2], "select");
+
+  // The floating-point sums and products start from the identity and add
+  // the lanes in order, unless the fast-math flags allow reassociation
+  case BUILTIN_REDUCE_ADD:
+    return IsDouble ? Builder->CreateFAddReduce(
+                          ConstantFP::getNegativeZero(
+                              Type::getDoubleTy(*TheContext)),
+                          ArgsV[0])
+                    : Builder->CreateAddReduce(ArgsV[0]);
+  case BUILTIN_REDUCE_MUL:
+    return IsDouble ? Builder->CreateFMulReduce(
+                          ConstantFP::get(Type::getDoubleTy(*TheContext), 1.0),
+                          ArgsV[0])
+                    : Builder->CreateMulReduce(ArgsV[0]);
+  case BUILTIN_REDUCE_MIN:
+    return IsDouble ? Builder->CreateFPMinReduce(ArgsV[0])
+                    : Builder->CreateIntMinReduce(ArgsV[0], /*IsSigned=*/true);
+  case BUILTIN_REDUCE_MAX:
+    return IsDouble ? Builder->CreateFPMaxReduce(ArgsV[0])
+                    : Builder->CreateIntMaxReduce(ArgsV[0], /*IsSigned=*/true);
+  case BUILTIN_ANY:
+    return Builder->CreateOrReduce(ArgsV[0]);
+  case BUILTIN_ALL:
+    return Builder->CreateAndReduce(ArgsV[0]);
+  default:
+    return nullptr;
+  }
+}
+
+// Lanes are inserted one by one; the Builder folds constant lanes into a
+// constant vector
+Value *VectorExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  if (Args.size() == 1)
+    return Args[0]->codegen(); // Sema already splatted or converted it
+
+  Value *Result = PoisonValue::get(getLLVMType(VectorType));
+  for (unsigned Lane = 0; Lane < Args.size(); ++Lane) {
+    Value *LaneV = Args[Lane]->codegen();
+    if (!LaneV)
+      return nullptr;
+    Result = Builder->CreateInsertElement(Result, LaneV, Lane, "vecinit");
+  }
+  return Result;
+}
+
+// Where break and continue jump to, for the loops being emitted, innermost
+// last
+namespace {
+struct LoopTarget {
+  const LoopExprAST *Loop;
+  BasicBlock *BreakBB;
+  BasicBlock *ContinueBB; // A for loop's latch is only created if needed
+  // The values breaks leave the loop with, and the blocks they leave from
+  std::vector<std::pair<Value *, BasicBlock *>> BreakValues;
+  Value *Generator = nullptr; // The coroutine a generator loop consumes
+};
+} // namespace
+
+static std::vector<LoopTarget> LoopTargets;
+
+static LoopTarget &FindLoopTarget(const LoopExprAST *Loop) {
+  auto It = std::find_if(LoopTargets.rbegin(), LoopTargets.rend(),
+                         [&](const LoopTarget &T) { return T.Loop == Loop; });
+  return *It;
+}
+
+// Destroys the generators of LoopTargets[Depth] and the loops inside it,
+// innermost first. A generator loop does it in its exit block, which a
+// break or continue to an outer loop jumps past.
+static void DestroyGeneratorsFrom(size_t Depth) {
+  for (size_t I = LoopTargets.size(); I-- > Depth;)
+    if (Value *Handle = LoopTargets[I].Generator)
+      Builder->CreateCall(Intrinsic::getOrInsertDeclaration(
+                              TheModule.get(), Intrinsic::coro_destroy),
+                          {Handle});
+}
+
+// Past the loop a break or continue targets: the loops it leaves
+static size_t getExitedDepth(const LoopTarget &T) {
+  return &T - LoopTargets.data() + 1;
+}
+
+// Code after a break or continue can't run. It goes into a block nothing
+// branches to, which the optimizer deletes.
+static void StartUnreachableBlock() {
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  Builder->SetInsertPoint(
+      BasicBlock::Create(*TheContext, "afterjump", TheFunction));
+}
+
+// The value of a finished loop, emitted at the start of its exit block: 0.0,
+// or a PHI of the break values and of zero for the blocks in NormalExits
+static Value *EmitLoopValue(const LoopExprAST &Loop, const LoopTarget &Target,
+                            ArrayRef<BasicBlock *> NormalExits) {
+  if (!Loop.breaksWithValue())
+    return Constant::getNullValue(Type::getDoubleTy(*TheContext));
+
+  Type *Ty = getLLVMType(Loop.getType());
+  PHINode *PN = Builder->CreatePHI(
+      Ty, NormalExits.size() + Target.BreakValues.size(), "loopvalue");
+  for (BasicBlock *Exit : NormalExits)
+    PN->addIncoming(Constant::getNullValue(Ty), Exit);
+  for (const auto &Break : Target.BreakValues)
+    PN->addIncoming(Break.first, Break.second);
+  return PN;
+}
+
+Value *BreakExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *ResultV = nullptr;
+  if (Result && !(ResultV = Result->codegen()))
+    return nullptr;
+
+  LoopTarget &T = FindLoopTarget(Target);
+  if (Target->breaksWithValue())
+    T.BreakValues.push_back(
+        {ResultV ? ResultV
+                 : Constant::getNullValue(getLLVMType(Target->getType())),
+         Builder->GetInsertBlock()});
+  DestroyGeneratorsFrom(getExitedDepth(T));
+  Builder->CreateBr(T.BreakBB);
+
+  StartUnreachableBlock();
+  return Constant::getNullValue(Type::getDoubleTy(*TheContext));
+}
+
+Value *ContinueExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  LoopTarget &T = FindLoopTarget(Target);
+  if (!T.ContinueBB)
+    T.ContinueBB = BasicBlock::Create(*TheContext, "forlatch");
+  DestroyGeneratorsFrom(getExitedDepth(T));
+  Builder->CreateBr(T.ContinueBB);
+
+  StartUnreachableBlock();
+  return Constant::getNullValue(Type::getDoubleTy(*TheContext));
+}
+
+// Gives every branch back to Header (all but the one from Preheader) the
+// llvm.loop metadata for the loop's hints, and with debug info the loop's
+// own location, which optimization remarks about it point at. LLVM only
+// reads a loop ID that all of a loop's latches share.
+static void AttachLoopMetadata(const LoopExprAST &Loop, BasicBlock *Header,
+                               BasicBlock *Preheader) {
+  const LoopHints &Hints = Loop.getHints();
+  DILocation *Start = Builder->getCurrentDebugLocation().get();
+  if (Hints.empty() && !Start)
+    return;
+
+  SmallVector<Metadata *, 4> Operands = {nullptr}; // The loop ID itself
+  if (Start)
+    Operands.push_back(Start);
+  auto AddHint = [&](const char *Name, Metadata *Value) {
+    SmallVector<Metadata *, 2> Hint = {MDString::get(*TheContext, Name)};
+    if (Value)
+      Hint.push_back(Value);
+    Operands.push_back(MDNode::get(*TheContext, Hint));
+  };
+  auto I32 = [&](unsigned V) {
+    return ConstantAsMetadata::get(Builder->getInt32(V));
+  };
+  auto I1 = [&](bool V) {
+    return ConstantAsMetadata::get(Builder->getInt1(V));
+  };
+
+  if (Hints.Unroll == HINT_DISABLE)
+    AddHint("llvm.loop.unroll.disable", nullptr);
+  else if (Hints.UnrollCount)
+    AddHint("llvm.loop.unroll.count", I32(Hints.UnrollCount));
+  else if (Hints.Unroll == HINT_ENABLE)
+    AddHint("llvm.loop.unroll.enable", nullptr);
+
+  if (Hints.Vectorize != HINT_DEFAULT)
+    AddHint("llvm.loop.vectorize.enable", I1(Hints.Vectorize == HINT_ENABLE));
+  if (Hints.VectorizeWidth)
+    AddHint("llvm.loop.vectorize.width", I32(Hints.VectorizeWidth));
+
+  MDNode *LoopID = MDNode::getDistinct(*TheContext, Operands);
+  LoopID->replaceOperandWith(0, LoopID);
+  for (BasicBlock *Pred : predecessors(Header))
+    if (Pred != Preheader)
+      Pred->getTerminator()->setMetadata(LLVMContext::MD_loop, LoopID);
+}
+
+// Lowered to the canonical loop shape LLVM's loop passes look for: a counter
+// from 0 to a trip count computed in the preheader, stepped with "add nuw
+// nsw", and the loop variable derived from it. SCEV then knows the trip count
+// without having to analyze the body.
+Value *ForExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *StartV = Start->codegen();
+  Value *EndV = End->codegen();
+  if (!StartV || !EndV)
+    return nullptr;
+
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+
+  ProfileProbe Probe;
+  if (ProfilingEnabled)
+    Probe = BeginProfileProbe(Loc, PROFILE_LOOP);
+
+  // The loop runs for the values Start, Start + Step, ... strictly before End:
+  // (|End - Start| - 1) / |Step| + 1 times when End is ahead of Start in the
+  // step's direction, and not at all otherwise
+  Value *Low = Step > 0 ? StartV : EndV;
+  Value *High = Step > 0 ? EndV : StartV;
+  uint64_t Stride = Step > 0 ? uint64_t(Step) : 0 - uint64_t(Step);
+
+  Value *NonEmpty = Builder->CreateICmpSLT(Low, High, "nonempty");
+  Value *Distance = Builder->CreateSub(High, Low, "distance");
+  Value *TripCount = Builder->CreateAdd(
+      Builder->CreateUDiv(Builder->CreateSub(Distance, Builder->getInt64(1)),
+                          Builder->getInt64(Stride)),
+      Builder->getInt64(1), "tripcount");
+
+  AllocaInst *VarAlloca =
+      CreateEntryBlockAlloca(TheFunction, VarName, KIRK_INT);
+
+  BasicBlock *PreheaderBB = Builder->GetInsertBlock();
+  BasicBlock *LoopBB = BasicBlock::Create(*TheContext, "forbody", TheFunction);
+  BasicBlock *AfterBB = BasicBlock::Create(*TheContext, "afterfor");
+  Builder->CreateCondBr(NonEmpty, LoopBB, AfterBB);
+
+  Builder->SetInsertPoint(LoopBB);
+  PHINode *Counter = Builder->CreatePHI(Builder->getInt64Ty(), 2, "counter");
+  Counter->addIncoming(Builder->getInt64(0), PreheaderBB);
+
+  Value *Offset = Step == 1 ? static_cast<Value *>(Counter)
+                            : Builder->CreateNSWMul(
+                                  Counter, Builder->getInt64(Step), "offset");
+  Builder->CreateStore(Builder->CreateNSWAdd(StartV, Offset, VarName),
+                       VarAlloca);
+
+  if (ProfilingEnabled)
+    CountProfileTrip(Probe);
+
+  // The loop variable shadows an outer variable until the loop ends
+  auto Outer = NamedValues.find(VarName);
+  bool HadOuter = Outer != NamedValues.end();
+  VarInfo Saved = HadOuter ? Outer->second : VarInfo{nullptr, KIRK_VOID};
+  NamedValues[VarName] = {VarAlloca, KIRK_INT};
+
+  LoopTargets.push_back({this, AfterBB, nullptr, {}});
+  bool BodyOK = Body->codegen() != nullptr;
+  LoopTarget Target = std::move(LoopTargets.back());
+  LoopTargets.pop_back();
+  if (!BodyOK)
+    return nullptr;
+
+  // The latch, if a continue needs a block to jump to
+  if (Target.ContinueBB) {
+    Builder->CreateBr(Target.ContinueBB);
+    TheFunction->insert(TheFunction->end(), Target.ContinueBB);
+    Builder->SetInsertPoint(Target.ContinueBB);
+  }
+
+  if (HadOuter)
+    NamedValues[VarName] = Saved;
+  else
+    NamedValues.erase(VarName);
+
+  Value *Next = Builder->CreateAdd(Counter, Builder->getInt64(1), "nextcounter",
+                                   /*HasNUW=*/true, /*HasNSW=*/true);
+  BasicBlock *LatchBB = Builder->GetInsertBlock();
+  Counter->addIncoming(Next, LatchBB);
+  Builder->CreateCondBr(Builder->CreateICmpULT(Next, TripCount, "forcond"),
+                        LoopBB, AfterBB);
+  AttachLoopMetadata(*this, LoopBB, PreheaderBB);
+
+  TheFunction->insert(TheFunction->end(), AfterBB);
+  Builder->SetInsertPoint(AfterBB);
+
+  // Like while loops, for loops return 0.0 or their break value
+  Value *Result = EmitLoopValue(*this, Target, {PreheaderBB, LatchBB});
+
+  if (ProfilingEnabled)
+    EndProfileProbe(Probe);
+
+  return Result;
+}
+
+// An empty inline asm statement that claims to read V and all of memory.
+// LLVM can't see through it, so whatever computed V has to be kept. Vectors
+// are kept lane by lane.
+static void EmitKeepAlive(Value *V) {
+  if (auto *VecTy = dyn_cast<FixedVectorType>(V->getType())) {
+    for (unsigned Lane = 0; Lane < VecTy->getNumElements(); ++Lane)
+      EmitKeepAlive(Builder->CreateExtractElement(V, Lane));
+    return;
+  }
+
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  if (V->getType()->isDoubleTy())
+    V = Builder->CreateBitCast(V, I64);
+  else if (V->getType() != I64)
+    V = Builder->CreateZExt(V, I64);
+
+  InlineAsm *Barrier =
+      InlineAsm::get(FunctionType::get(Type::getVoidTy(*TheContext), {I64},
+                                       false),
+                     "", "r,~{memory}", /*hasSideEffects=*/true);
+  Builder->CreateCall(Barrier, {V});
+}
+
+// One loop runs the warm-up and the timed iterations and records every
+// iteration's time into a buffer from the runtime, which skips the warm-up
+// runs when it reports.
+Value *BenchExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  Type *PtrTy = PointerType::getUnqual(*TheContext);
+
+  Value *IterationsV = Iterations->codegen();
+  if (!IterationsV)
+    return nullptr;
+
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+
+  // A negative count runs nothing; the warm-up is N / 10 rounded up
+  Value *Count =
+      Builder->CreateSelect(Builder->CreateICmpSGT(IterationsV,
+                                                   Builder->getInt64(0)),
+                            IterationsV, Builder->getInt64(0), "benchcount");
+  Value *Warmup = Builder->CreateUDiv(
+      Builder->CreateAdd(Count, Builder->getInt64(9)), Builder->getInt64(10),
+      "benchwarmup");
+  Value *Total = Builder->CreateAdd(Count, Warmup, "benchtotal");
+
+  FunctionCallee BeginFunc =
+      TheModule->getOrInsertFunction("kirk_bench_begin", PtrTy, I64);
+  FunctionCallee ClockFunc =
+      TheModule->getOrInsertFunction("kirk_clock_ns", I64);
+  FunctionCallee EndFunc = TheModule->getOrInsertFunction(
+      "kirk_bench_end", Type::getVoidTy(*TheContext), PtrTy, PtrTy, I64, I64);
+
+  Value *Samples = Builder->CreateCall(BeginFunc, {Total}, "benchsamples");
+
+  BasicBlock *PreheaderBB = Builder->GetInsertBlock();
+  BasicBlock *LoopBB =
+      BasicBlock::Create(*TheContext, "benchbody", TheFunction);
+  BasicBlock *AfterBB = BasicBlock::Create(*TheContext, "afterbench");
+  Builder->CreateCondBr(
+      Builder->CreateICmpNE(Total, Builder->getInt64(0), "nonempty"), LoopBB,
+      AfterBB);
+
+  Builder->SetInsertPoint(LoopBB);
+  PHINode *Counter = Builder->CreatePHI(I64, 2, "benchiter");
+  Counter->addIncoming(Builder->getInt64(0), PreheaderBB);
+
+  Value *StartNs = Builder->CreateCall(ClockFunc, {}, "benchstart");
+  Value *BodyV = Body->codegen();
+  if (!BodyV)
+    return nullptr;
+  if (Body->getType() != KIRK_VOID)
+    EmitKeepAlive(BodyV);
+  Value *EndNs = Builder->CreateCall(ClockFunc, {}, "benchend");
+
+  Value *Slot = Builder->CreateGEP(I64, Samples, Counter, "benchslot");
+  Builder->CreateStore(Builder->CreateSub(EndNs, StartNs, "benchns"), Slot);
+
+  Value *Next = Builder->CreateAdd(Counter, Builder->getInt64(1), "nextiter",
+                                   /*HasNUW=*/true, /*HasNSW=*/true);
+  Counter->addIncoming(Next, Builder->GetInsertBlock());
+  Builder->CreateCondBr(Builder->CreateICmpULT(Next, Total, "benchcond"),
+                        LoopBB, AfterBB);
+
+  TheFunction->insert(TheFunction->end(), AfterBB);
+  Builder->SetInsertPoint(AfterBB);
+
+  Value *NameV = Builder->CreateGlobalString(Name, "benchname");
+  Builder->CreateCall(EndFunc, {NameV, Samples, Total, Warmup});
+
+  return Constant::getNullValue(Type::getDoubleTy(*TheContext));
+}
+
+Value *FloatModeExprAST::codegen() {
+  // Every floating-point operation the Builder creates inside Body gets
+  // these flags; the guard restores the enclosing ones afterwards
+  IRBuilder<>::FastMathFlagGuard Guard(*Builder);
+  FastMathFlags Flags;
+  if (Mode == FLOAT_FAST)
+    Flags.setFast();
+  Builder->setFastMathFlags(Flags);
+
+  return Body->codegen();
+}
+
 Value *WhileExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
   Function *TheFunction = Builder->GetInsertBlock()->getParent();
 
+  ProfileProbe Probe;
+  if (ProfilingEnabled)
+    Probe = BeginProfileProbe(Loc, PROFILE_LOOP);
+
   BasicBlock *LoopCondBB =
       BasicBlock::Create(*TheContext, "loopcond", TheFunction);
   BasicBlock *LoopBodyBB = BasicBlock::Create(*TheContext, "loopbody");
   BasicBlock *AfterBB = BasicBlock::Create(*TheContext, "afterloop");
 
+  BasicBlock *PreheaderBB = Builder->GetInsertBlock();
   Builder->CreateBr(LoopCondBB);
   Builder->SetInsertPoint(LoopCondBB);
 
@@ -430,25 +1239,543 @@ Value *WhileExprAST::codegen() {
   if (!CondV)
     return nullptr;
 
-  CondV = CastToType(CondV, KIRK_BOOL, "loopcond");
-
   // Conditional Branch: if true -> Body, else -> After
+  BasicBlock *CondEndBB = Builder->GetInsertBlock();
   Builder->CreateCondBr(CondV, LoopBodyBB, AfterBB);
 
   // Loop Body Block
   TheFunction->insert(TheFunction->end(), LoopBodyBB);
   Builder->SetInsertPoint(LoopBodyBB);
 
-  if (!Body->codegen())
+  if (ProfilingEnabled)
+    CountProfileTrip(Probe);
+
+  // break jumps to the exit, continue back to the condition
+  LoopTargets.push_back({this, AfterBB, LoopCondBB, {}});
+  bool BodyOK = Body->codegen() != nullptr;
+  LoopTarget Target = std::move(LoopTargets.back());
+  LoopTargets.pop_back();
+  if (!BodyOK)
     return nullptr;
 
   // Jump back to the condition to loop again
   Builder->CreateBr(LoopCondBB);
+  AttachLoopMetadata(*this, LoopCondBB, PreheaderBB);
 
   // After Loop Block
   TheFunction->insert(TheFunction->end(), AfterBB);
   Builder->SetInsertPoint(AfterBB);
 
-  // While loops always return 0.0
+  // 0.0, unless a break leaves the loop with a value
+  Value *Result = EmitLoopValue(*this, Target, {CondEndBB});
+
+  if (ProfilingEnabled)
+    EndProfileProbe(Probe);
+
+  return Result;
+}
+
+// Starting value of each private reduction accumulator
+static Value *GetReductionIdentity(ReductionOp Op, KirkType VarType) {
+  if (VarType == KIRK_DOUBLE) {
+    Type *DoubleTy = Type::getDoubleTy(*TheContext);
+    switch (Op) {
+    case REDUCE_ADD:
+      return ConstantFP::get(DoubleTy, 0.0);
+    case REDUCE_MUL:
+      return ConstantFP::get(DoubleTy, 1.0);
+    case REDUCE_MIN:
+      return ConstantFP::getInfinity(DoubleTy, false);
+    case REDUCE_MAX:
+      return ConstantFP::getInfinity(DoubleTy, true);
+    }
+  }
+
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  switch (Op) {
+  case REDUCE_ADD:
+    return ConstantInt::get(I64, 0);
+  case REDUCE_MUL:
+    return ConstantInt::get(I64, 1);
+  case REDUCE_MIN:
+    return ConstantInt::get(I64, INT64_MAX);
+  case REDUCE_MAX:
+    return ConstantInt::get(I64, INT64_MIN, true);
+  }
+  return nullptr;
+}
+
+static Value *CombineReduction(ReductionOp Op, KirkType VarType, Value *L,
+                               Value *R) {
+  bool IsDouble = VarType == KIRK_DOUBLE;
+
+  switch (Op) {
+  case REDUCE_ADD:
+    return IsDouble ? Builder->CreateFAdd(L, R, "redadd")
+                    : Builder->CreateAdd(L, R, "redadd");
+  case REDUCE_MUL:
+    return IsDouble ? Builder->CreateFMul(L, R, "redmul")
+                    : Builder->CreateMul(L, R, "redmul");
+  case REDUCE_MIN: {
+    Value *Less = IsDouble ? Builder->CreateFCmpOLT(L, R, "redlt")
+                           : Builder->CreateICmpSLT(L, R, "redlt");
+    return Builder->CreateSelect(Less, L, R, "redmin");
+  }
+  case REDUCE_MAX: {
+    Value *Greater = IsDouble ? Builder->CreateFCmpOGT(L, R, "redgt")
+                              : Builder->CreateICmpSGT(L, R, "redgt");
+    return Builder->CreateSelect(Greater, L, R, "redmax");
+  }
+  }
+  return nullptr;
+}
+
+Value *ParallelForExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  Type *PtrTy = PointerType::getUnqual(*TheContext);
+  Type *VoidTy = Type::getVoidTy(*TheContext);
+
+  Value *StartV = Start->codegen();
+  Value *EndV = End->codegen();
+  if (!StartV || !EndV)
+    return nullptr;
+
+  std::map<std::string, const ReductionClause *> ReductionsByName;
+  for (const ReductionClause &R : Reductions)
+    ReductionsByName[R.VarName] = &R;
+
+  // Every variable in scope is visible in the body: top-level globals
+  // directly, locals through an array of pointers. Reduction variables get a
+  // private accumulator per chunk that is merged back under the runtime lock;
+  // everything else is copied in once per chunk (Sema made those read-only
+  // inside the body).
+  std::map<std::string, VarInfo> Captures = NamedValues;
+  std::vector<Value *> EnvSlots;
+  for (const auto &Capture : Captures)
+    if (!isa<GlobalVariable>(Capture.second.Ptr))
+      EnvSlots.push_back(Capture.second.Ptr);
+  ArrayType *EnvTy = ArrayType::get(PtrTy, EnvSlots.size());
+
+  BasicBlock *CallerBB = Builder->GetInsertBlock();
+  Function *CallerFunc = CallerBB->getParent();
+
+  FunctionType *BodyTy = FunctionType::get(VoidTy, {I64, I64, PtrTy}, false);
+  Function *BodyFunc = Function::Create(BodyTy, Function::InternalLinkage,
+                                        "kirk.parallel.body", TheModule.get());
+  MarkHotFunction(BodyFunc);
+  Argument *Lo = BodyFunc->getArg(0);
+  Argument *Hi = BodyFunc->getArg(1);
+  Argument *EnvArg = BodyFunc->getArg(2);
+  Lo->setName("lo");
+  Hi->setName("hi");
+  EnvArg->setName("env");
+
+  BasicBlock *EntryBB = BasicBlock::Create(*TheContext, "entry", BodyFunc);
+  Builder->SetInsertPoint(EntryBB);
+
+  std::map<std::string, VarInfo> SavedNamedValues = std::move(NamedValues);
+  NamedValues.clear();
+
+  struct PrivateReduction {
+    const ReductionClause *Clause;
+    Value *Shared;
+    AllocaInst *Private;
+    KirkType Type;
+  };
+  std::vector<PrivateReduction> PrivateReductions;
+
+  unsigned Index = 0;
+  for (const auto &Capture : Captures) {
+    const std::string &Name = Capture.first;
+    KirkType VarType = Capture.second.Type;
+
+    auto Reduction = ReductionsByName.find(Name);
+    bool IsReduction = Reduction != ReductionsByName.end();
+
+    // Read-only globals are used in place; nothing to copy
+    Value *Shared = Capture.second.Ptr;
+    if (isa<GlobalVariable>(Shared) && !IsReduction) {
+      NamedValues[Name] = Capture.second;
+      continue;
+    }
+
+    if (!isa<GlobalVariable>(Shared)) {
+      Value *Slot =
+          Builder->CreateConstInBoundsGEP2_32(EnvTy, EnvArg, 0, Index++);
+      Shared = Builder->CreateLoad(PtrTy, Slot, Name + ".shared");
+    }
+    AllocaInst *Local = CreateEntryBlockAlloca(BodyFunc, Name, VarType);
+
+    if (IsReduction) {
+      Builder->CreateStore(GetReductionIdentity(Reduction->second->Op, VarType),
+                           Local);
+      PrivateReductions.push_back({Reduction->second, Shared, Local, VarType});
+    } else {
+      Builder->CreateStore(
+          Builder->CreateLoad(getLLVMType(VarType), Shared, Name), Local);
+    }
+    NamedValues[Name] = {Local, VarType};
+  }
+
+  // The loop variable shadows any captured variable with the same name
+  AllocaInst *IndexAlloca = CreateEntryBlockAlloca(BodyFunc, VarName, KIRK_INT);
+  Builder->CreateStore(Lo, IndexAlloca);
+  NamedValues[VarName] = {IndexAlloca, KIRK_INT};
+
+  BasicBlock *CondBB = BasicBlock::Create(*TheContext, "parcond", BodyFunc);
+  BasicBlock *LoopBodyBB = BasicBlock::Create(*TheContext, "parbody");
+  BasicBlock *AfterBB = BasicBlock::Create(*TheContext, "parafter");
+
+  Builder->CreateBr(CondBB);
+  Builder->SetInsertPoint(CondBB);
+
+  Value *IndexV = Builder->CreateLoad(I64, IndexAlloca, VarName);
+  Builder->CreateCondBr(Builder->CreateICmpSLT(IndexV, Hi, "parcond"),
+                        LoopBodyBB, AfterBB);
+
+  BodyFunc->insert(BodyFunc->end(), LoopBodyBB);
+  Builder->SetInsertPoint(LoopBodyBB);
+
+  if (!Body->codegen()) {
+    NamedValues = std::move(SavedNamedValues);
+    Builder->SetInsertPoint(CallerBB);
+    return nullptr;
+  }
+
+  IndexV = Builder->CreateLoad(I64, IndexAlloca, VarName);
+  Builder->CreateStore(
+      Builder->CreateNSWAdd(IndexV, ConstantInt::get(I64, 1), "parnext"),
+      IndexAlloca);
+  Builder->CreateBr(CondBB);
+
+  BodyFunc->insert(BodyFunc->end(), AfterBB);
+  Builder->SetInsertPoint(AfterBB);
+
+  // Merge this chunk's partial results, once per chunk rather than per
+  // iteration, so a plain lock is cheap enough for every operator and type
+  if (!PrivateReductions.empty()) {
+    Builder->CreateCall(
+        TheModule->getOrInsertFunction("kirk_parallel_lock", VoidTy));
+
+    for (const PrivateReduction &R : PrivateReductions) {
+      Type *Ty = getLLVMType(R.Type);
+      Value *SharedV = Builder->CreateLoad(Ty, R.Shared, "redshared");
+      Value *PrivateV = Builder->CreateLoad(Ty, R.Private, "redprivate");
+      Builder->CreateStore(
+          CombineReduction(R.Clause->Op, R.Type, SharedV, PrivateV), R.Shared);
+    }
+
+    Builder->CreateCall(
+        TheModule->getOrInsertFunction("kirk_parallel_unlock", VoidTy));
+  }
+  Builder->CreateRetVoid();
+
+  NamedValues = std::move(SavedNamedValues);
+  Builder->SetInsertPoint(CallerBB);
+
+  // Hand the environment and the outlined body to the runtime's thread pool
+  IRBuilder<> TmpB(&CallerFunc->getEntryBlock(),
+                   CallerFunc->getEntryBlock().begin());
+  AllocaInst *Env = TmpB.CreateAlloca(EnvTy, nullptr, "parenv");
+
+  for (unsigned i = 0; i < EnvSlots.size(); ++i)
+    Builder->CreateStore(EnvSlots[i],
+                         Builder->CreateConstInBoundsGEP2_32(EnvTy, Env, 0, i));
+
+  FunctionCallee ParallelFor = TheModule->getOrInsertFunction(
+      "kirk_parallel_for", VoidTy, I64, I64, PtrTy, PtrTy);
+  Builder->CreateCall(ParallelFor, {StartV, EndV, BodyFunc, Env});
+
+  // Like while loops, parallel loops return 0.0
+  return Constant::getNullValue(Type::getDoubleTy(*TheContext));
+}
+
+// Generators are LLVM coroutines with switched resumption. "kirk.gen.<name>"
+// is the ramp: called with the arguments, it allocates the frame, runs the
+// body up to the first yield and returns the coroutine's handle. Each yield
+// stores its value in the promise and suspends. The consuming loop reads the
+// promise, runs its body and resumes the handle until the coroutine reaches
+// its final suspend point, then destroys it. CoroSplit turns the body into
+// resume and destroy functions; once the ramp is inlined into the loop,
+// CoroElide moves the frame from malloc to the loop's stack and makes the
+// resumes direct calls, which the inliner then fuses into the loop.
+namespace {
+struct GeneratorFrame {
+  Value *Promise;
+  Align PromiseAlign;
+  BasicBlock *CleanupBB; // Frees the frame, on destroy
+  BasicBlock *SuspendBB; // Returns to the ramp's caller or the resumer
+  size_t LoopDepth;      // The LoopTargets outside the body
+};
+} // namespace
+
+// The generator being emitted, which its yields suspend
+static GeneratorFrame *CurrentGenerator = nullptr;
+
+// What malloc guarantees, and so the most the promise may ask for. LLVM
+// pads the frame itself for locals that need more.
+static const Align FrameAlign(16);
+
+static Align getPromiseAlign(KirkType YieldType) {
+  return std::min(
+      TheModule->getDataLayout().getPrefTypeAlign(getLLVMType(YieldType)),
+      FrameAlign);
+}
+
+static Value *EmitCoroIntrinsic(Intrinsic::ID ID, ArrayRef<Value *> Args,
+                                const Twine &Name = "",
+                                ArrayRef<Type *> Types = {}) {
+  Function *Intrinsic =
+      Intrinsic::getOrInsertDeclaration(TheModule.get(), ID, Types);
+  return Builder->CreateCall(Intrinsic, Args, Name);
+}
+
+// Emits the generator into TheModule the first time a loop consumes it, so
+// every REPL entry gets a copy it can inline
+static Function *GetGeneratorFunction(GeneratorDef &Def) {
+  std::string Name = "kirk.gen." + Def.Name;
+  if (Function *F = TheModule->getFunction(Name))
+    return F;
+
+  Type *PtrTy = PointerType::getUnqual(*TheContext);
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  Type *VoidTy = Type::getVoidTy(*TheContext);
+  Value *NoToken = ConstantTokenNone::get(*TheContext);
+
+  std::vector<Type *> ParamTypes;
+  for (const GeneratorParam &Param : Def.Params)
+    ParamTypes.push_back(getLLVMType(Param.Type));
+  Function *F =
+      Function::Create(FunctionType::get(PtrTy, ParamTypes, false),
+                       Function::InternalLinkage, Name, TheModule.get());
+  F->setPresplitCoroutine();
+
+  // The generator is emitted in the middle of the loop consuming it, whose
+  // position, variables and floating-point mode it must not inherit
+  IRBuilderBase::InsertPointGuard InsertGuard(*Builder);
+  IRBuilderBase::FastMathFlagGuard FastMathGuard(*Builder);
+  Builder->setFastMathFlags(DefaultFastMath);
+  std::map<std::string, VarInfo> SavedNamedValues = std::move(NamedValues);
+  NamedValues.clear();
+  GeneratorFrame *SavedGenerator = CurrentGenerator;
+
+  BasicBlock *EntryBB = BasicBlock::Create(*TheContext, "entry", F);
+  Builder->SetInsertPoint(EntryBB);
+  SourceLocationScope Scope(Def.Loc);
+
+  Align PromiseAlign = getPromiseAlign(Def.YieldType);
+  AllocaInst *Promise = CreateEntryBlockAlloca(F, "promise", Def.YieldType);
+  Promise->setAlignment(PromiseAlign);
+  Value *Id = EmitCoroIntrinsic(
+      Intrinsic::coro_id,
+      {Builder->getInt32(FrameAlign.value()), Promise,
+       ConstantPointerNull::get(PointerType::getUnqual(*TheContext)),
+       ConstantPointerNull::get(PointerType::getUnqual(*TheContext))},
+      "id");
+
+  // coro.alloc is false once CoroElide has given the frame a home
+  BasicBlock *AllocBB = BasicBlock::Create(*TheContext, "genalloc", F);
+  BasicBlock *BeginBB = BasicBlock::Create(*TheContext, "genbegin", F);
+  Builder->CreateCondBr(EmitCoroIntrinsic(Intrinsic::coro_alloc, {Id},
+                                          "needframe"),
+                        AllocBB, BeginBB);
+
+  Builder->SetInsertPoint(AllocBB);
+  Value *Size = EmitCoroIntrinsic(Intrinsic::coro_size, {}, "framesize", {I64});
+  FunctionCallee Malloc =
+      TheModule->getOrInsertFunction("malloc", PtrTy, I64);
+  Value *Allocated = Builder->CreateCall(Malloc, {Size}, "frame");
+  Builder->CreateBr(BeginBB);
+
+  Builder->SetInsertPoint(BeginBB);
+  PHINode *Memory = Builder->CreatePHI(PtrTy, 2, "framemem");
+  Memory->addIncoming(ConstantPointerNull::get(PointerType::getUnqual(
+                          *TheContext)),
+                      EntryBB);
+  Memory->addIncoming(Allocated, AllocBB);
+  Value *Handle =
+      EmitCoroIntrinsic(Intrinsic::coro_begin, {Id, Memory}, "handle");
+
+  // The parameters are ordinary variables of the body, kept in the frame
+  for (size_t i = 0; i < Def.Params.size(); ++i) {
+    const GeneratorParam &Param = Def.Params[i];
+    Argument *Arg = F->getArg(i);
+    Arg->setName(Param.Name);
+    AllocaInst *Alloca = CreateEntryBlockAlloca(F, Param.Name, Param.Type);
+    Builder->CreateStore(Arg, Alloca);
+    NamedValues[Param.Name] = {Alloca, Param.Type};
+  }
+
+  BasicBlock *CleanupBB = BasicBlock::Create(*TheContext, "gencleanup");
+  BasicBlock *SuspendBB = BasicBlock::Create(*TheContext, "gensuspend");
+  GeneratorFrame Frame = {Promise, PromiseAlign, CleanupBB, SuspendBB,
+                          LoopTargets.size()};
+  CurrentGenerator = &Frame;
+  bool BodyOK = Def.Body->codegen() != nullptr;
+  CurrentGenerator = SavedGenerator;
+  NamedValues = std::move(SavedNamedValues);
+  if (!BodyOK) {
+    F->eraseFromParent();
+    return nullptr;
+  }
+
+  // The end of the body waits at the final suspend point, where coro.done
+  // is true, until the loop destroys the coroutine. It is never resumed.
+  Value *Final = EmitCoroIntrinsic(Intrinsic::coro_suspend,
+                                   {NoToken, Builder->getTrue()}, "final");
+  BasicBlock *ResumedBB = BasicBlock::Create(*TheContext, "genfinal", F);
+  SwitchInst *Switch = Builder->CreateSwitch(Final, SuspendBB, 2);
+  Switch->addCase(Builder->getInt8(0), ResumedBB);
+  Switch->addCase(Builder->getInt8(1), CleanupBB);
+  Builder->SetInsertPoint(ResumedBB);
+  Builder->CreateUnreachable();
+
+  // coro.free is null for an elided frame, and free(NULL) does nothing
+  F->insert(F->end(), CleanupBB);
+  Builder->SetInsertPoint(CleanupBB);
+  Value *Freed = EmitCoroIntrinsic(Intrinsic::coro_free, {Id, Handle},
+                                   "framefree");
+  Builder->CreateCall(TheModule->getOrInsertFunction("free", VoidTy, PtrTy),
+                      {Freed});
+  Builder->CreateBr(SuspendBB);
+
+  F->insert(F->end(), SuspendBB);
+  Builder->SetInsertPoint(SuspendBB);
+  EmitCoroIntrinsic(Intrinsic::coro_end, {Handle, Builder->getFalse(), NoToken});
+  Builder->CreateRet(Handle);
+  return F;
+}
+
+// Emitted where a consuming loop needs it
+Value *GeneratorDeclExprAST::codegen() { return nullptr; }
+
+Value *YieldExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  Value *V = Operand->codegen();
+  if (!V)
+    return nullptr;
+
+  GeneratorFrame &Frame = *CurrentGenerator;
+  Builder->CreateAlignedStore(V, Frame.Promise, Frame.PromiseAlign);
+
+  // 0 when the loop resumes the coroutine, 1 when it destroys it
+  Value *Suspend = EmitCoroIntrinsic(
+      Intrinsic::coro_suspend,
+      {ConstantTokenNone::get(*TheContext), Builder->getFalse()}, "suspend");
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  BasicBlock *ResumeBB =
+      BasicBlock::Create(*TheContext, "afteryield", TheFunction);
+  SwitchInst *Switch = Builder->CreateSwitch(Suspend, Frame.SuspendBB, 2);
+  Switch->addCase(Builder->getInt8(0), ResumeBB);
+
+  // Destroyed at a yield inside its own generator loops, the generator
+  // destroys the generators they consume before its frame
+  BasicBlock *DestroyBB = Frame.CleanupBB;
+  if (std::any_of(LoopTargets.begin() + Frame.LoopDepth, LoopTargets.end(),
+                  [](const LoopTarget &T) { return T.Generator; })) {
+    DestroyBB = BasicBlock::Create(*TheContext, "yielddestroy", TheFunction);
+    Builder->SetInsertPoint(DestroyBB);
+    DestroyGeneratorsFrom(Frame.LoopDepth);
+    Builder->CreateBr(Frame.CleanupBB);
+  }
+  Switch->addCase(Builder->getInt8(1), DestroyBB);
+  Builder->SetInsertPoint(ResumeBB);
+
   return Constant::getNullValue(Type::getDoubleTy(*TheContext));
 }
+
+Value *GeneratorForExprAST::codegen() {
+  SourceLocationScope Scope(Loc);
+  std::vector<Value *> ArgsV;
+  for (auto &Arg : Args) {
+    Value *V = Arg->codegen();
+    if (!V)
+      return nullptr;
+    ArgsV.push_back(V);
+  }
+
+  Function *Ramp = GetGeneratorFunction(*Def);
+  if (!Ramp)
+    return nullptr;
+
+  Function *TheFunction = Builder->GetInsertBlock()->getParent();
+  Type *YieldTy = getLLVMType(Def->YieldType);
+  Align PromiseAlign = getPromiseAlign(Def->YieldType);
+
+  ProfileProbe Probe;
+  if (ProfilingEnabled)
+    Probe = BeginProfileProbe(Loc, PROFILE_LOOP);
+
+  Value *Handle = Builder->CreateCall(Ramp, ArgsV, Def->Name);
+  Value *Promise = EmitCoroIntrinsic(
+      Intrinsic::coro_promise,
+      {Handle, Builder->getInt32(PromiseAlign.value()), Builder->getFalse()},
+      "promise");
+  AllocaInst *VarAlloca =
+      CreateEntryBlockAlloca(TheFunction, VarName, Def->YieldType);
+
+  BasicBlock *PreheaderBB = Builder->GetInsertBlock();
+  BasicBlock *CondBB = BasicBlock::Create(*TheContext, "gencond", TheFunction);
+  BasicBlock *LoopBB = BasicBlock::Create(*TheContext, "genbody");
+  BasicBlock *ResumeBB = BasicBlock::Create(*TheContext, "genresume");
+  BasicBlock *AfterBB = BasicBlock::Create(*TheContext, "aftergen");
+  Builder->CreateBr(CondBB);
+
+  // Done once the generator has reached the end of its body
+  Builder->SetInsertPoint(CondBB);
+  Builder->CreateCondBr(
+      EmitCoroIntrinsic(Intrinsic::coro_done, {Handle}, "done"), AfterBB,
+      LoopBB);
+
+  TheFunction->insert(TheFunction->end(), LoopBB);
+  Builder->SetInsertPoint(LoopBB);
+  Builder->CreateStore(
+      Builder->CreateAlignedLoad(YieldTy, Promise, PromiseAlign, VarName),
+      VarAlloca);
+
+  if (ProfilingEnabled)
+    CountProfileTrip(Probe);
+
+  // The loop variable shadows an outer variable until the loop ends
+  auto Outer = NamedValues.find(VarName);
+  bool HadOuter = Outer != NamedValues.end();
+  VarInfo Saved = HadOuter ? Outer->second : VarInfo{nullptr, KIRK_VOID};
+  NamedValues[VarName] = {VarAlloca, Def->YieldType};
+
+  // continue resumes the generator for its next value
+  LoopTargets.push_back({this, AfterBB, ResumeBB, {}, Handle});
+  bool BodyOK = Body->codegen() != nullptr;
+  LoopTarget Target = std::move(LoopTargets.back());
+  LoopTargets.pop_back();
+  if (!BodyOK)
+    return nullptr;
+
+  if (HadOuter)
+    NamedValues[VarName] = Saved;
+  else
+    NamedValues.erase(VarName);
+
+  Builder->CreateBr(ResumeBB);
+  TheFunction->insert(TheFunction->end(), ResumeBB);
+  Builder->SetInsertPoint(ResumeBB);
+  EmitCoroIntrinsic(Intrinsic::coro_resume, {Handle});
+  Builder->CreateBr(CondBB);
+  AttachLoopMetadata(*this, CondBB, PreheaderBB);
+
+  TheFunction->insert(TheFunction->end(), AfterBB);
+  Builder->SetInsertPoint(AfterBB);
+
+  // Like other loops, generator loops return 0.0 or their break value
+  Value *Result = EmitLoopValue(*this, Target, {CondBB});
+
+  // A break leaves the generator suspended at a yield; destroying it there
+  // frees the frame just the same. A break or continue to an outer loop
+  // destroys it on its way out instead.
+  EmitCoroIntrinsic(Intrinsic::coro_destroy, {Handle});
+
+  if (ProfilingEnabled)
+    EndProfileProbe(Probe);
+
+  return Result;
+}
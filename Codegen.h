@@ -9,6 +9,7 @@
 #include "llvm/IR/Module.h"
 #include <map>
 #include <memory>
+#include <vector>
 
 // Common LLVM tools to be used everywhere.
 extern std::unique_ptr<llvm::LLVMContext> TheContext;
@@ -16,15 +17,47 @@ extern std::unique_ptr<llvm::IRBuilder<>> Builder;
 extern std::unique_ptr<llvm::Module> TheModule;
 
 struct VarInfo {
-  llvm::AllocaInst *Alloca;
+  llvm::Value *Ptr; // An alloca, or a global for top-level variables
   KirkType Type;
 };
 
-// Symbol Table: Maps variables to their memory locations (AllocaInst)
+// Symbol Table: Maps variables to their memory locations
 extern std::map<std::string, VarInfo> NamedValues;
 
+// Views live in module globals set once by their declaration, so every
+// chunk and parallel body reads them in place without capturing anything
+struct ViewInfo {
+  llvm::GlobalVariable *Base;   // ptr to the first element
+  llvm::GlobalVariable *Length; // i64 element count
+  KirkType ElementType;
+};
+extern std::map<std::string, ViewInfo> NamedViews;
+
+// Records live in module globals too, never in allocas: a global of the
+// record's struct type, an array of those for a collection laid out as an
+// array of structs, or one array per field for "layout(soa)"
+struct RecordInfo {
+  const RecordType *Record;
+  long long CollectionSize; // 0 for a single record
+  RecordLayout Layout;
+  std::vector<llvm::GlobalVariable *> Storage; // One per field for SoA
+};
+extern std::map<std::string, RecordInfo> NamedRecords;
+
+// Floating-point flags for code outside any @fast_math / @strict_math
+// annotation. Set by --fast-math, --fp-reassoc and --fp-contract=fast.
+extern llvm::FastMathFlags DefaultFastMath;
+
 // Helper function to initialize the tools
 void InitializeModule();
+// LLVM type used to store a Kirk type
+llvm::Type *getLLVMType(KirkType Type);
+// The named LLVM struct type of a record type, "%struct.Particle"
+llvm::StructType *getRecordLLVMType(const RecordType &Record);
+// Types of the globals holding a record or a collection (see RecordInfo)
+std::vector<llvm::Type *> getRecordStorageTypes(const RecordType &Record,
+                                                long long CollectionSize,
+                                                RecordLayout Layout);
 // Helper function to create an alloca instruction
 llvm::AllocaInst *CreateEntryBlockAlloca(llvm::Function *TheFunction,
                                          const std::string &VarName,
@@ -0,0 +1,99 @@
+#include "DebugInfo.h"
+#include "Codegen.h"
+#include "llvm/IR/DIBuilder.h"
+#include "llvm/Support/Path.h"
+#include <set>
+
+using namespace llvm;
+
+bool DebugInfoEnabled = false;
+
+static std::unique_ptr<DIBuilder> DBuilder;
+static DICompileUnit *CompileUnit = nullptr;
+
+void InitializeDebugInfo(const std::string &InputPath) {
+  if (!DebugInfoEnabled)
+    return;
+
+  DBuilder = std::make_unique<DIBuilder>(*TheModule);
+  DIFile *File = DBuilder->createFile(sys::path::filename(InputPath),
+                                      sys::path::parent_path(InputPath));
+
+  // DW_LANG_C: Kirk has no language code, and tools only need the lines
+  CompileUnit = DBuilder->createCompileUnit(
+      dwarf::DW_LANG_C, File, "Kirk Compiler", false, "", 0, StringRef(),
+      DICompileUnit::LineTablesOnly);
+
+  TheModule->addModuleFlag(Module::Warning, "Debug Info Version",
+                           DEBUG_METADATA_VERSION);
+  TheModule->addModuleFlag(Module::Warning, "Dwarf Version", 4);
+}
+
+static DISubprogram *CreateSubprogram(Function &F) {
+  DISubroutineType *Type =
+      DBuilder->createSubroutineType(DBuilder->getOrCreateTypeArray({}));
+  return DBuilder->createFunction(CompileUnit, F.getName(), StringRef(),
+                                  CompileUnit->getFile(), 0, Type, 0,
+                                  DINode::FlagZero,
+                                  DISubprogram::SPFlagDefinition);
+}
+
+static DISubprogram *GetOrCreateSubprogram(Function &F) {
+  if (!F.getSubprogram())
+    F.setSubprogram(CreateSubprogram(F));
+  return F.getSubprogram();
+}
+
+SourceLocationScope::SourceLocationScope(SourceLocation Loc) {
+  if (!DebugInfoEnabled)
+    return;
+
+  Saved = Builder->getCurrentDebugLocation();
+  DISubprogram *SP =
+      GetOrCreateSubprogram(*Builder->GetInsertBlock()->getParent());
+  Builder->SetCurrentDebugLocation(
+      DILocation::get(*TheContext, Loc.Line, Loc.Col, SP));
+}
+
+SourceLocationScope::~SourceLocationScope() {
+  if (DebugInfoEnabled)
+    Builder->SetCurrentDebugLocation(Saved);
+}
+
+void FinalizeDebugInfo() {
+  if (!DebugInfoEnabled)
+    return;
+
+  std::set<DISubprogram *> Claimed;
+  for (Function &F : *TheModule) {
+    if (F.isDeclaration())
+      continue;
+
+    // Clones (multiversioned loops) may still share their original's
+    DISubprogram *SP = F.getSubprogram();
+    if (!SP || Claimed.count(SP)) {
+      SP = CreateSubprogram(F);
+      F.setSubprogram(SP);
+    }
+    Claimed.insert(SP);
+
+    for (BasicBlock &BB : F) {
+      for (Instruction &I : BB) {
+        DebugLoc Loc = I.getDebugLoc();
+
+        // Nodes like parallel for start in one function and finish emitting
+        // in another (the outlined body); keep their line, fix the scope
+        if (Loc && Loc->getScope()->getSubprogram() != SP)
+          I.setDebugLoc(
+              DILocation::get(*TheContext, Loc.getLine(), Loc.getCol(), SP));
+
+        // The verifier wants a location on every call between functions
+        // that have debug info; glue code (chunk calls) gets line 0
+        else if (!Loc && isa<CallBase>(I))
+          I.setDebugLoc(DILocation::get(*TheContext, 0, 0, SP));
+      }
+    }
+  }
+
+  DBuilder->finalize();
+}
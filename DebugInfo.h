@@ -0,0 +1,32 @@
+#ifndef DEBUGINFO_H
+#define DEBUGINFO_H
+
+#include "Lexer.h"
+#include "llvm/IR/DebugLoc.h"
+#include <string>
+
+// Line-table debug info: when enabled, every instruction carries the
+// SourceLocation of the AST node that emitted it, so reports built on LLVM
+// (IR size, machine-code size, optimization remarks) can point back at Kirk
+// source lines. Off by default; the features that need it turn it on.
+extern bool DebugInfoEnabled;
+
+// Creates the compile unit for InputPath (call after InitializeModule)
+void InitializeDebugInfo(const std::string &InputPath);
+// Gives every function a subprogram, fixes up locations emitted into a
+// different function than their node started in, and finalizes the
+// metadata. Call once the module is complete, before verifying it.
+void FinalizeDebugInfo();
+
+// Attributes everything a codegen() method emits to its node: sets the
+// Builder's location for the lifetime of the scope, then restores the
+// parent's location so its remaining instructions stay its own
+class SourceLocationScope {
+  llvm::DebugLoc Saved;
+
+public:
+  explicit SourceLocationScope(SourceLocation Loc);
+  ~SourceLocationScope();
+};
+
+#endif
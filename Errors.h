@@ -26,6 +26,15 @@ public:
 
   // The main function to display the error and exit
   void raise() const {
+    // The REPL rejects the entry instead, once its callers have unwound,
+    // each returning a placeholder. Whatever they report after the first
+    // error only follows from it.
+    if (RecoverFromErrors) {
+      if (!ErrorRaised)
+        LogErrorAt(Loc, Message);
+      ErrorRaised = true;
+      return;
+    }
     LogErrorAt(Loc, Message);
     std::exit(1); // All errors currently stop compilation
   }
@@ -45,11 +54,27 @@ public:
       : KirkError(Loc, "Arithmetic Error: " + Msg) {}
 };
 
+// Type Error : Operands or values of the wrong type
+class TypeError : public KirkError {
+public:
+  TypeError(SourceLocation Loc, const std::string &Msg)
+      : KirkError(Loc, "Type Error: " + Msg) {}
+};
+
+// Import Error : Modules that can't be found or built
+class ImportError : public KirkError {
+public:
+  ImportError(SourceLocation Loc, const std::string &Msg)
+      : KirkError(Loc, "Import Error: " + Msg) {}
+};
+
 // Reference Error : Variable lookup issues
 class ReferenceError : public KirkError {
 public:
+  // Works with any name-keyed symbol table (Sema's or Codegen's)
+  template <typename SymbolInfo>
   ReferenceError(SourceLocation Loc, const std::string &Name,
-                 const std::map<std::string, VarInfo> &SymbolTable)
+                 const std::map<std::string, SymbolInfo> &SymbolTable)
       : KirkError(Loc, "") {
 
     Message = "Unknown variable name: '" + Name + "'";
@@ -0,0 +1,381 @@
+#include "Bytecode.h"
+#include "runtime/InputReader.h"
+#include "runtime/MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <x86intrin.h>
+#define KIRK_X86_64 1
+#endif
+
+static int64_t ClockNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// rdtsc like llvm.readcyclecounter; elsewhere the clock stands in for it
+static int64_t ReadCycleCounter() {
+#ifdef KIRK_X86_64
+  return static_cast<int64_t>(__rdtsc());
+#else
+  return ClockNanoseconds();
+#endif
+}
+
+// Same report as kirk_bench_end in the runtime. The times include the
+// clock reads, whose least cost is subtracted.
+static void ReportBenchmark(const std::string &Name,
+                            std::vector<int64_t> &Samples, int64_t Warmup) {
+  int64_t Count = static_cast<int64_t>(Samples.size()) - Warmup;
+  if (Count <= 0) {
+    std::printf("bench %s: no iterations\n", Name.c_str());
+    return;
+  }
+
+  int64_t Overhead = INT64_MAX;
+  for (int i = 0; i < 1000; ++i) {
+    int64_t Start = ClockNanoseconds();
+    Overhead = std::min(Overhead, ClockNanoseconds() - Start);
+  }
+
+  std::vector<int64_t> Timed(Samples.begin() + Warmup, Samples.end());
+  for (int64_t &Time : Timed)
+    Time = std::max<int64_t>(0, Time - Overhead);
+  std::sort(Timed.begin(), Timed.end());
+
+  std::printf("bench %s: %lld iterations, min %lld ns, median %lld ns, "
+              "p99 %lld ns\n",
+              Name.c_str(), (long long)Count, (long long)Timed[0],
+              (long long)Timed[(Count - 1) / 2],
+              (long long)Timed[(Count * 99 + 99) / 100 - 1]);
+}
+
+// Threaded dispatch: every handler ends by jumping straight to the handler of
+// the next instruction through a label table, instead of returning to one
+// shared switch. Each handler gets its own indirect branch, which the branch
+// predictor can learn separately ("after a compare usually comes a jump").
+// Uses the GNU "labels as values" extension, supported by GCC and Clang.
+void RunBytecode(const BytecodeProgram &Program) {
+  static void *const Handlers[] = {
+#define KIRK_OPCODE_LABEL(Name) &&Do##Name,
+      KIRK_OPCODES(KIRK_OPCODE_LABEL)
+#undef KIRK_OPCODE_LABEL
+  };
+
+  std::vector<BytecodeValue> Registers(Program.NumRegisters);
+  for (const auto &Constant : Program.Constants)
+    Registers[Constant.first] = Constant.second;
+
+  // Iteration times of the benchmarks that are running
+  std::vector<std::vector<int64_t>> BenchSamples(Program.BenchmarkNames.size());
+
+  // The same reader compiled programs use, so input parses identically
+  static KirkInputReader Input;
+
+  // Mapped views, filled in by MapView
+  std::vector<const BytecodeValue *> ViewData(Program.ViewPaths.size());
+  std::vector<int64_t> ViewLengths(Program.ViewPaths.size());
+
+  // Collections of records, zeroed like the globals of compiled code
+  std::vector<std::vector<BytecodeValue>> Collections;
+  std::vector<BytecodeValue *> CollectionData;
+  for (int64_t Slots : Program.CollectionSlots) {
+    Collections.emplace_back(Slots, BytecodeValue{0});
+    CollectionData.push_back(Collections.back().data());
+  }
+
+  BytecodeValue *R = Registers.data();
+  const Instruction *Code = Program.Code.data();
+  const Instruction *IP = Code;
+
+#define DISPATCH() goto *Handlers[IP->Op]
+#define NEXT()                                                                 \
+  do {                                                                         \
+    ++IP;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+
+// Integer arithmetic wraps like LLVM's add/sub/mul instead of being UB
+#define INT_WRAP(Name, Operator)                                               \
+  Do##Name:                                                                    \
+  R[IP->A].I = static_cast<int64_t>(static_cast<uint64_t>(R[IP->B].I)         \
+                                        Operator static_cast<uint64_t>(        \
+                                            R[IP->C].I));                      \
+  NEXT();
+#define BINARY(Name, Field, Operator)                                          \
+  Do##Name:                                                                    \
+  R[IP->A].Field = R[IP->B].Field Operator R[IP->C].Field;                     \
+  NEXT();
+#define COMPARE(Name, Field, Operator)                                         \
+  Do##Name:                                                                    \
+  R[IP->A].I = R[IP->B].Field Operator R[IP->C].Field;                         \
+  NEXT();
+
+  DISPATCH();
+
+DoMove:
+  R[IP->A] = R[IP->B];
+  NEXT();
+
+DoMoveIf:
+  if (R[IP->B].I)
+    R[IP->A] = R[IP->C];
+  NEXT();
+
+  INT_WRAP(AddI, +)
+  INT_WRAP(SubI, -)
+  INT_WRAP(MulI, *)
+  BINARY(DivI, I, /)
+  BINARY(RemI, I, %)
+
+DoNegI:
+  R[IP->A].I = static_cast<int64_t>(0 - static_cast<uint64_t>(R[IP->B].I));
+  NEXT();
+
+  BINARY(AddD, D, +)
+  BINARY(SubD, D, -)
+  BINARY(MulD, D, *)
+  BINARY(DivD, D, /)
+
+DoRemD:
+  R[IP->A].D = std::fmod(R[IP->B].D, R[IP->C].D);
+  NEXT();
+
+DoNegD:
+  R[IP->A].D = -R[IP->B].D;
+  NEXT();
+
+DoPowD:
+  R[IP->A].D = std::pow(R[IP->B].D, R[IP->C].D);
+  NEXT();
+
+// Wraps for the most negative int, like llvm.abs without the poison flag
+DoAbsI:
+  R[IP->A].I = R[IP->B].I < 0
+                   ? static_cast<int64_t>(0 - static_cast<uint64_t>(R[IP->B].I))
+                   : R[IP->B].I;
+  NEXT();
+
+DoMinI:
+  R[IP->A].I = std::min(R[IP->B].I, R[IP->C].I);
+  NEXT();
+
+DoMaxI:
+  R[IP->A].I = std::max(R[IP->B].I, R[IP->C].I);
+  NEXT();
+
+  BINARY(AndI, I, &)
+  BINARY(OrI, I, |)
+  BINARY(XorI, I, ^)
+
+// Shift amounts are taken modulo 64, like the compiled code
+DoShlI:
+  R[IP->A].I = static_cast<int64_t>(static_cast<uint64_t>(R[IP->B].I)
+                                    << (R[IP->C].I & 63));
+  NEXT();
+
+DoShrI:
+  R[IP->A].I = R[IP->B].I >> (R[IP->C].I & 63);
+  NEXT();
+
+DoUShrI:
+  R[IP->A].I = static_cast<int64_t>(static_cast<uint64_t>(R[IP->B].I) >>
+                                    (R[IP->C].I & 63));
+  NEXT();
+
+DoNotI:
+  R[IP->A].I = ~R[IP->B].I;
+  NEXT();
+
+DoPopcntI:
+  R[IP->A].I = __builtin_popcountll(static_cast<uint64_t>(R[IP->B].I));
+  NEXT();
+
+// 64 for 0, like llvm.cttz / llvm.ctlz without the poison flag
+DoCtzI:
+  R[IP->A].I = R[IP->B].I == 0 ? 64 : __builtin_ctzll(R[IP->B].I);
+  NEXT();
+
+DoClzI:
+  R[IP->A].I = R[IP->B].I == 0 ? 64 : __builtin_clzll(R[IP->B].I);
+  NEXT();
+
+DoSqrtD:
+  R[IP->A].D = std::sqrt(R[IP->B].D);
+  NEXT();
+
+DoAbsD:
+  R[IP->A].D = std::fabs(R[IP->B].D);
+  NEXT();
+
+// fmin/fmax ignore a NaN operand, like llvm.minnum/maxnum
+DoMinD:
+  R[IP->A].D = std::fmin(R[IP->B].D, R[IP->C].D);
+  NEXT();
+
+DoMaxD:
+  R[IP->A].D = std::fmax(R[IP->B].D, R[IP->C].D);
+  NEXT();
+
+DoFloorD:
+  R[IP->A].D = std::floor(R[IP->B].D);
+  NEXT();
+
+// Rounded once, not after the multiply, so results match llvm.fma exactly
+DoFmaD:
+  R[IP->A].D = std::fma(R[IP->B].D, R[IP->C].D, R[IP->A].D);
+  NEXT();
+
+  COMPARE(LtI, I, <)
+  COMPARE(GtI, I, >)
+  COMPARE(EqI, I, ==)
+  COMPARE(NeI, I, !=)
+  COMPARE(LeI, I, <=)
+  COMPARE(GeI, I, >=)
+  COMPARE(LtD, D, <)
+  COMPARE(GtD, D, >)
+  COMPARE(EqD, D, ==)
+  COMPARE(LeD, D, <=)
+  COMPARE(GeD, D, >=)
+
+// Ordered not-equal (fcmp one), so NaN != x is false like the compiled code
+DoNeD:
+  R[IP->A].I = R[IP->B].D < R[IP->C].D || R[IP->B].D > R[IP->C].D;
+  NEXT();
+
+DoIntToDouble:
+  R[IP->A].D = static_cast<double>(R[IP->B].I);
+  NEXT();
+
+DoDoubleToInt:
+  R[IP->A].I = static_cast<int64_t>(R[IP->B].D);
+  NEXT();
+
+DoIntToBool:
+  R[IP->A].I = R[IP->B].I != 0;
+  NEXT();
+
+DoDoubleToBool:
+  R[IP->A].I = R[IP->B].D < 0.0 || R[IP->B].D > 0.0;
+  NEXT();
+
+DoJump:
+  IP = Code + IP->getTarget();
+  DISPATCH();
+
+DoJumpIfFalse:
+  if (R[IP->A].I == 0) {
+    IP = Code + IP->getTarget();
+    DISPATCH();
+  }
+  NEXT();
+
+// Same formats as the printf calls emitted by PrintExprAST::codegen
+DoPrintI:
+  std::printf("%lld\n", static_cast<long long>(R[IP->A].I));
+  NEXT();
+
+DoPrintD:
+  std::printf("%.2f\n", R[IP->A].D);
+  NEXT();
+
+DoPrintB:
+  std::printf("%d\n", static_cast<int>(R[IP->A].I));
+  NEXT();
+
+// Vectors print their B lanes as <a, b, ...>
+DoPrintVecI:
+  for (unsigned i = 0; i < IP->B; ++i)
+    std::printf(i ? ", %lld" : "<%lld",
+                static_cast<long long>(R[IP->A + i].I));
+  std::printf(">\n");
+  NEXT();
+
+DoPrintVecD:
+  for (unsigned i = 0; i < IP->B; ++i)
+    std::printf(i ? ", %.2f" : "<%.2f", R[IP->A + i].D);
+  std::printf(">\n");
+  NEXT();
+
+DoPrintVecB:
+  for (unsigned i = 0; i < IP->B; ++i)
+    std::printf(i ? ", %d" : "<%d", static_cast<int>(R[IP->A + i].I));
+  std::printf(">\n");
+  NEXT();
+
+DoClockNs:
+  R[IP->A].I = ClockNanoseconds();
+  NEXT();
+
+DoCycles:
+  R[IP->A].I = ReadCycleCounter();
+  NEXT();
+
+DoReadI:
+  R[IP->A].I = Input.readInt();
+  NEXT();
+
+DoReadD:
+  R[IP->A].D = Input.readDouble();
+  NEXT();
+
+DoReadB:
+  R[IP->A].I = Input.readBool();
+  NEXT();
+
+DoHasInput:
+  R[IP->A].I = Input.hasInput();
+  NEXT();
+
+DoBenchBegin:
+  BenchSamples[IP->A].clear();
+  NEXT();
+
+DoBenchSample:
+  BenchSamples[IP->A].push_back(R[IP->B].I);
+  NEXT();
+
+DoBenchEnd:
+  ReportBenchmark(Program.BenchmarkNames[IP->A], BenchSamples[IP->A],
+                  R[IP->B].I);
+  NEXT();
+
+DoMapView:
+  ViewData[IP->A] = static_cast<const BytecodeValue *>(
+      KirkMapFile(Program.ViewPaths[IP->A].c_str(), sizeof(BytecodeValue),
+                  &ViewLengths[IP->A]));
+  NEXT();
+
+DoLoadViewI:
+  R[IP->A].I = ViewData[IP->B][R[IP->C].I].I;
+  NEXT();
+
+DoLoadViewD:
+  R[IP->A].D = ViewData[IP->B][R[IP->C].I].D;
+  NEXT();
+
+DoViewLen:
+  R[IP->A].I = ViewLengths[IP->B];
+  NEXT();
+
+DoLoadField:
+  R[IP->A] = CollectionData[IP->B][R[IP->C].I];
+  NEXT();
+
+DoStoreField:
+  CollectionData[IP->B][R[IP->C].I] = R[IP->A];
+  NEXT();
+
+DoHalt:
+  std::fflush(stdout);
+
+#undef COMPARE
+#undef BINARY
+#undef INT_WRAP
+#undef NEXT
+#undef DISPATCH
+}
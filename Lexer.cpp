@@ -9,16 +9,27 @@ std::vector<std::string> SourceLines;
 SourceLocation CurLoc = {1, 0};
 int CurLine = 1;
 int CurCol = 0;
+int ErrorCount = 0;
+bool RecoverFromErrors = false;
+bool ErrorRaised = false;
 
 std::ifstream SourceFile;
 double NumVal;
 long long IntVal;
 bool BoolVal;
 std::string IdentifierStr;
+std::string StringVal;
+
+static std::istream *Input = &SourceFile;
+static int LastChar = ' ';
 
 void LogErrorAt(SourceLocation Loc, const std::string &Msg) {
+  ErrorCount++;
   std::cerr << "Error at " << Loc.Line << ":" << Loc.Col << ": " << Msg << "\n";
+  ShowSourceLine(Loc);
+}
 
+void ShowSourceLine(SourceLocation Loc) {
   if (Loc.Line > 0 && Loc.Line <= SourceLines.size()) {
     std::string LineContent = SourceLines[Loc.Line - 1];
     std::cerr << "  " << Loc.Line << " | " << LineContent << "\n";
@@ -26,13 +37,34 @@ void LogErrorAt(SourceLocation Loc, const std::string &Msg) {
     // Calculate indentation for the caret
     std::string LineNumStr = std::to_string(Loc.Line);
     std::cerr << "  " << std::string(LineNumStr.length(), ' ') << " | "
-              << std::string(Loc.Col - 1, ' ') << "^" << "\n";
+              << std::string(Loc.Col > 0 ? Loc.Col - 1 : 0, ' ') << "^"
+              << "\n";
   }
 }
 
-int gettok() {
-  static int LastChar = ' ';
+std::string GetSourceSnippet(SourceLocation Loc, size_t MaxLength) {
+  if (Loc.Line <= 0 || Loc.Line > (int)SourceLines.size())
+    return "";
+
+  std::string Text = SourceLines[Loc.Line - 1];
+  size_t First = Text.find_first_not_of(" \t");
+  if (First == std::string::npos)
+    return "";
+  Text = Text.substr(First);
+
+  if (Text.length() > MaxLength)
+    Text = Text.substr(0, MaxLength - 3) + "...";
+  return Text;
+}
+
+void SetLexerInput(std::istream &Stream, int FirstLine) {
+  Input = &Stream;
+  LastChar = ' ';
+  CurLine = FirstLine;
+  CurCol = 0;
+}
 
+int gettok() {
       static std::map<std::string, int> Keywords = {
         {"if", TOK_IF},          {"then", TOK_THEN},
         {"else", TOK_ELSE},      {"print", TOK_PRINT},
@@ -40,7 +72,20 @@ int gettok() {
         {"float", TOK_TYPE_DOUBLE},
         {"double", TOK_TYPE_DOUBLE},
         {"bool", TOK_TYPE_BOOL}, {"true", TOK_BOOL_LITERAL},
-        {"false", TOK_BOOL_LITERAL}};
+        {"false", TOK_BOOL_LITERAL},
+        {"for", TOK_FOR},        {"in", TOK_IN},
+        {"parallel", TOK_PARALLEL}, {"bench", TOK_BENCH},
+        {"view", TOK_VIEW},      {"import", TOK_IMPORT},
+        {"export", TOK_EXPORT},  {"break", TOK_BREAK},
+        {"continue", TOK_CONTINUE}, {"match", TOK_MATCH},
+        {"and", TOK_AND},        {"or", TOK_OR},
+        {"not", TOK_NOT},        {"xor", TOK_XOR},
+        {"likely", TOK_LIKELY},  {"unlikely", TOK_UNLIKELY},
+        {"struct", TOK_STRUCT},  {"generator", TOK_GENERATOR},
+        {"yield", TOK_YIELD},
+        {"vec4d", TOK_TYPE_VECTOR}, {"vec4i", TOK_TYPE_VECTOR},
+        {"vec4b", TOK_TYPE_VECTOR}, {"vec8d", TOK_TYPE_VECTOR},
+        {"vec8i", TOK_TYPE_VECTOR}, {"vec8b", TOK_TYPE_VECTOR}};
 
   while (isspace(LastChar)) {
     // Handle newlines to track line numbers
@@ -49,7 +94,7 @@ int gettok() {
       CurCol = 0;
     }
 
-    LastChar = SourceFile.get();
+    LastChar = Input->get();
 
     // Increment column for every character read
     if (LastChar != EOF) {
@@ -64,7 +109,7 @@ int gettok() {
   if (isalpha(LastChar)) {
     IdentifierStr = LastChar;
 
-    while (isalnum(LastChar = SourceFile.get()) || LastChar == '_') {
+    while (isalnum(LastChar = Input->get()) || LastChar == '_') {
       IdentifierStr += LastChar;
       CurCol++;
     }
@@ -80,14 +125,30 @@ int gettok() {
     return TOK_IDENTIFIER;
   }
 
-  // Numbers: [0-9.]+
+  // Range operator: '..'
+  if (LastChar == '.' && Input->peek() == '.') {
+    Input->get();
+    LastChar = Input->get();
+    CurCol += 2;
+    return TOK_RANGE;
+  }
+
+  // Field access: "p.x". A '.' before a digit still starts a number.
+  if (LastChar == '.' && isalpha(Input->peek())) {
+    LastChar = Input->get();
+    CurCol++;
+    return '.';
+  }
+
+  // Numbers: [0-9.]+ (a '..' ends the number, so "0..n" is a range)
   if (isdigit(LastChar) || LastChar == '.') {
     std::string NumStr;
     do {
       NumStr += LastChar;
-      LastChar = SourceFile.get();
+      LastChar = Input->get();
       CurCol++;
-    } while (isdigit(LastChar) || LastChar == '.');
+    } while (isdigit(LastChar) ||
+             (LastChar == '.' && Input->peek() != '.'));
 
     bool IsFloat = NumStr.find('.') != std::string::npos;
     if (IsFloat) {
@@ -99,25 +160,49 @@ int gettok() {
     return TOK_INT_LITERAL;
   }
 
+  // String literals: "..." on one line, without escapes
+  if (LastChar == '"') {
+    StringVal.clear();
+    while ((LastChar = Input->get()) != '"' && LastChar != '\n' &&
+           LastChar != EOF) {
+      StringVal += LastChar;
+      CurCol++;
+    }
+
+    if (LastChar != '"') {
+      LogErrorAt(CurLoc, "Unterminated string literal");
+      return TOK_STRING;
+    }
+    LastChar = Input->get();
+    CurCol += 2;
+    return TOK_STRING;
+  }
+
   if (LastChar == '=') {
-    LastChar = SourceFile.get();
+    LastChar = Input->get();
     CurCol++;
 
     if (LastChar == '=') {
-      LastChar = SourceFile.get();
+      LastChar = Input->get();
       CurCol++;
       return TOK_EQ;
     }
 
+    if (LastChar == '>') {
+      LastChar = Input->get();
+      CurCol++;
+      return TOK_ARROW;
+    }
+
     return TOK_ASSIGN;
   }
 
   if (LastChar == '!') {
-    LastChar = SourceFile.get();
+    LastChar = Input->get();
     CurCol++;
 
     if (LastChar == '=') {
-      LastChar = SourceFile.get();
+      LastChar = Input->get();
       CurCol++;
       return TOK_NEQ;
     }
@@ -126,35 +211,55 @@ int gettok() {
   }
 
   if (LastChar == '>') {
-    LastChar = SourceFile.get();
+    LastChar = Input->get();
     CurCol++;
 
     if (LastChar == '=') {
-      LastChar = SourceFile.get();
+      LastChar = Input->get();
       CurCol++;
       return TOK_GEQ;
     }
 
+    // ">>" shifts in copies of the sign bit, ">>>" zeros
+    if (LastChar == '>') {
+      LastChar = Input->get();
+      CurCol++;
+
+      if (LastChar == '>') {
+        LastChar = Input->get();
+        CurCol++;
+        return TOK_USHR;
+      }
+
+      return TOK_SHR;
+    }
+
     return '>';
   }
 
   if (LastChar == '<') {
-    LastChar = SourceFile.get();
+    LastChar = Input->get();
     CurCol++;
 
     if (LastChar == '=') {
-      LastChar = SourceFile.get();
+      LastChar = Input->get();
       CurCol++;
       return TOK_LEQ;
     }
 
+    if (LastChar == '<') {
+      LastChar = Input->get();
+      CurCol++;
+      return TOK_SHL;
+    }
+
     return '<';
   }
 
   if (LastChar == '/') {
-    if (SourceFile.peek() == '/') {
+    if (Input->peek() == '/') {
       do {
-        LastChar = SourceFile.get();
+        LastChar = Input->get();
         CurCol++;
       } while (LastChar != EOF && LastChar != '\n' && LastChar != '\r');
 
@@ -168,7 +273,7 @@ int gettok() {
 
   // Handle ASCII characters
   int ThisChar = LastChar;
-  LastChar = SourceFile.get();
+  LastChar = Input->get();
   CurCol++;
 
   return ThisChar;
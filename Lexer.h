@@ -2,6 +2,7 @@
 #define LEXER_H
 
 #include <fstream>
+#include <istream>
 #include <memory>
 #include <string>
 #include <vector>
@@ -16,9 +17,15 @@ extern double NumVal;
 extern long long IntVal;
 extern bool BoolVal;
 extern std::string IdentifierStr;
+extern std::string StringVal; // Contents of a TOK_STRING, without quotes
 
 extern std::vector<std::string> SourceLines;
 extern SourceLocation CurLoc;
+extern int ErrorCount; // Diagnostics reported through LogErrorAt
+// Set by the REPL: KirkError::raise() then returns instead of exiting, and
+// sets ErrorRaised, which rejects the entry
+extern bool RecoverFromErrors;
+extern bool ErrorRaised;
 
 enum Token {
   TOK_EOF = -1,
@@ -34,14 +41,49 @@ enum Token {
   TOK_NEQ = -11,
   TOK_LEQ = -12,
   TOK_GEQ = -13,
+  TOK_FOR = -14,
+  TOK_IN = -15,
+  TOK_PARALLEL = -16,
+  TOK_RANGE = -17, // '..'
+  TOK_STRING = -18,
+  TOK_BENCH = -19,
   TOK_INT_LITERAL = -20,
   TOK_BOOL_LITERAL = -21,
   TOK_TYPE_INT = -22,
   TOK_TYPE_DOUBLE = -23,
-  TOK_TYPE_BOOL = -24
+  TOK_TYPE_BOOL = -24,
+  TOK_VIEW = -25,
+  TOK_TYPE_VECTOR = -26, // vec4d, vec8i, ...: the spelling is in IdentifierStr
+  TOK_IMPORT = -27,
+  TOK_EXPORT = -28,
+  TOK_BREAK = -29,
+  TOK_CONTINUE = -30,
+  TOK_MATCH = -31,
+  TOK_ARROW = -32, // '=>'
+  TOK_AND = -33,
+  TOK_OR = -34,
+  TOK_NOT = -35,
+  TOK_XOR = -36,
+  TOK_SHL = -37, // '<<'
+  TOK_SHR = -38, // '>>', arithmetic
+  TOK_USHR = -39, // '>>>', logical
+  TOK_LIKELY = -40,
+  TOK_UNLIKELY = -41,
+  TOK_STRUCT = -42,
+  TOK_GENERATOR = -43,
+  TOK_YIELD = -44
 };
 
 int gettok();
+// Lexes Stream instead of SourceFile from now on, counting its first line as
+// line FirstLine. Used by the REPL for each entry.
+void SetLexerInput(std::istream &Stream, int FirstLine);
 void LogErrorAt(SourceLocation Loc, const std::string &Msg);
+// Prints the source line at Loc with a caret under its column, as errors
+// show it (to stderr; nothing if Loc is not in the file)
+void ShowSourceLine(SourceLocation Loc);
+// The source line at Loc without its indentation, cut to MaxLength
+// characters, for one-row-per-location reports
+std::string GetSourceSnippet(SourceLocation Loc, size_t MaxLength = 40);
 
 #endif
@@ -0,0 +1,360 @@
+#include "Modules.h"
+#include "Backend.h"
+#include "Codegen.h"
+#include "Errors.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/Program.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+using namespace llvm;
+
+std::string ModuleName;
+std::string ModuleDirectory = ".";
+std::string CompilerExecutable;
+std::vector<std::string> ModuleOptions;
+std::vector<std::string> ModuleBitcodeFiles;
+
+namespace {
+// The contents of a .kirki file
+struct ModuleInterface {
+  std::string Options; // ModuleOptions it was compiled with, space separated
+  std::vector<std::string> Imports;
+  std::vector<std::pair<std::string, KirkType>> Exports;
+};
+
+struct ImportedModule {
+  std::string Name;
+  ModuleInterface Interface;
+};
+} // namespace
+
+static const char *InterfaceHeader = "kirk-interface 1";
+
+static std::vector<ImportedModule> Imports; // The file's own, in order
+static std::vector<std::pair<std::string, KirkType>> Exports;
+
+// Modules being brought up to date, outermost first. Starts with those of
+// the compilers that ran this one, so an import cycle is caught however
+// many processes it spans.
+static std::vector<std::string> ImportStack;
+// Modules already up to date, and their interfaces
+static std::map<std::string, ModuleInterface> CheckedModules;
+
+std::string getInitSymbol(const std::string &Module) {
+  return "kirk.init." + Module;
+}
+
+std::string getExportSymbol(const std::string &Module,
+                            const std::string &Name) {
+  return "kirk.export." + Module + "." + Name;
+}
+
+static std::string getModulePath(const std::string &Module,
+                                 const char *Extension) {
+  SmallString<128> Path(ModuleDirectory);
+  sys::path::append(Path, Module + Extension);
+  return std::string(Path);
+}
+
+std::string getModuleCacheDirectory() {
+  SmallString<128> Path(ModuleDirectory);
+  sys::path::append(Path, "kirk-cache");
+  return std::string(Path);
+}
+
+static std::string getOptionsLine() {
+  std::string Line;
+  for (const std::string &Option : ModuleOptions)
+    Line += (Line.empty() ? "" : " ") + Option;
+  return Line;
+}
+
+static KirkType ParseTypeName(const std::string &Name) {
+  for (KirkType Type : {KIRK_INT, KIRK_DOUBLE, KIRK_BOOL, KIRK_VEC4D,
+                        KIRK_VEC4I, KIRK_VEC4B, KIRK_VEC8D, KIRK_VEC8I,
+                        KIRK_VEC8B})
+    if (Name == getTypeName(Type))
+      return Type;
+  return KIRK_VOID;
+}
+
+static std::string FormatInterface(const ModuleInterface &Interface) {
+  std::string Text = std::string(InterfaceHeader) + "\n";
+  Text += "options " + Interface.Options + "\n";
+  for (const std::string &Import : Interface.Imports)
+    Text += "import " + Import + "\n";
+  for (const auto &Export : Interface.Exports)
+    Text += "export " + std::string(getTypeName(Export.second)) + " " +
+            Export.first + "\n";
+  return Text;
+}
+
+// Returns false if Path is missing or isn't an interface this compiler wrote
+static bool ReadInterface(const std::string &Path,
+                          ModuleInterface &Interface) {
+  std::ifstream File(Path);
+  std::string Line;
+  if (!std::getline(File, Line) || Line != InterfaceHeader)
+    return false;
+
+  while (std::getline(File, Line)) {
+    std::istringstream Fields(Line);
+    std::string Kind, First, Second;
+    Fields >> Kind;
+
+    if (Kind == "options") {
+      std::getline(Fields >> std::ws, Interface.Options);
+    } else if (Kind == "import" && Fields >> First) {
+      Interface.Imports.push_back(First);
+    } else if (Kind == "export" && Fields >> First >> Second &&
+               ParseTypeName(First) != KIRK_VOID) {
+      Interface.Exports.push_back({Second, ParseTypeName(First)});
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool getModificationTime(const std::string &Path,
+                                sys::TimePoint<> &Time) {
+  sys::fs::file_status Status;
+  if (sys::fs::status(Path, Status) || !sys::fs::exists(Status))
+    return false;
+  Time = Status.getLastModificationTime();
+  return true;
+}
+
+// Runs `kirk --module` on a module in a process of its own, which brings
+// the module's own imports up to date first
+static bool BuildModule(const std::string &Name, std::string &Error) {
+  std::string Stack;
+  for (const std::string &Entry : ImportStack)
+    Stack += (Stack.empty() ? "" : ":") + Entry;
+  setenv("KIRK_IMPORT_STACK", Stack.c_str(), 1);
+
+  std::string Source = getModulePath(Name, ".kirk");
+  std::vector<StringRef> Args = {CompilerExecutable, "--module"};
+  for (const std::string &Option : ModuleOptions)
+    Args.push_back(Option);
+  Args.push_back(Source);
+
+  int Result = sys::ExecuteAndWait(CompilerExecutable, Args);
+  if (Result == 0)
+    return true;
+
+  if (Result < 0)
+    Error = "Could not run " + CompilerExecutable + " to compile module '" +
+            Name + "'";
+  else
+    Error = "Module '" + Name + "' (" + Source + ") has errors";
+  return false;
+}
+
+// Makes sure the module's bitcode and interface are up to date, rebuilding
+// it if not, and appends its bitcode (after that of everything it imports)
+// to ModuleBitcodeFiles
+static bool EnsureModule(const std::string &Name, ModuleInterface &Interface,
+                         std::string &Error) {
+  auto Checked = CheckedModules.find(Name);
+  if (Checked != CheckedModules.end()) {
+    Interface = Checked->second;
+    return true;
+  }
+
+  auto Cycle = std::find(ImportStack.begin(), ImportStack.end(), Name);
+  if (Cycle != ImportStack.end()) {
+    Error = "Import cycle: ";
+    for (; Cycle != ImportStack.end(); ++Cycle)
+      Error += *Cycle + " -> ";
+    Error += Name;
+    return false;
+  }
+
+  std::string Source = getModulePath(Name, ".kirk");
+  std::string Bitcode = getModulePath(Name, ".bc");
+  std::string InterfacePath = getModulePath(Name, ".kirki");
+
+  sys::TimePoint<> SourceTime, BuiltTime;
+  if (!getModificationTime(Source, SourceTime)) {
+    Error = "Cannot find module '" + Name + "' (" + Source + ")";
+    return false;
+  }
+
+  ImportStack.push_back(Name);
+  bool Stale = !ReadInterface(InterfacePath, Interface) ||
+               Interface.Options != getOptionsLine() ||
+               !getModificationTime(Bitcode, BuiltTime) ||
+               SourceTime > BuiltTime;
+
+  // What the module imported when it was built. If one of those fails, the
+  // source may not import it anymore, and rebuilding will tell.
+  for (size_t i = 0; !Stale && i < Interface.Imports.size(); ++i) {
+    ModuleInterface Dependency;
+    sys::TimePoint<> DependencyTime;
+    std::string Ignored;
+    Stale = !EnsureModule(Interface.Imports[i], Dependency, Ignored) ||
+            !getModificationTime(
+                getModulePath(Interface.Imports[i], ".kirki"),
+                DependencyTime) ||
+            DependencyTime > BuiltTime;
+  }
+
+  if (Stale) {
+    Interface = ModuleInterface();
+    if (!BuildModule(Name, Error)) {
+      ImportStack.pop_back();
+      return false;
+    }
+    if (!ReadInterface(InterfacePath, Interface)) {
+      Error = "Could not read the interface " + InterfacePath;
+      ImportStack.pop_back();
+      return false;
+    }
+
+    // Already rebuilt by the module's compiler; this collects their bitcode
+    for (const std::string &Import : Interface.Imports) {
+      ModuleInterface Dependency;
+      if (!EnsureModule(Import, Dependency, Error)) {
+        ImportStack.pop_back();
+        return false;
+      }
+    }
+  }
+
+  ImportStack.pop_back();
+  CheckedModules[Name] = Interface;
+  ModuleBitcodeFiles.push_back(Bitcode);
+  return true;
+}
+
+void ParseImports() {
+  if (std::optional<std::string> Stack =
+          sys::Process::GetEnv("KIRK_IMPORT_STACK")) {
+    std::istringstream Entries(*Stack);
+    std::string Entry;
+    while (std::getline(Entries, Entry, ':'))
+      ImportStack.push_back(Entry);
+  }
+  if (!ModuleName.empty() &&
+      std::find(ImportStack.begin(), ImportStack.end(), ModuleName) ==
+          ImportStack.end())
+    ImportStack.push_back(ModuleName);
+
+  std::map<std::string, std::string> Exporters; // Variable -> its module
+
+  while (CurTok == TOK_IMPORT || CurTok == ';') {
+    if (CurTok == ';') {
+      getNextToken();
+      continue;
+    }
+
+    getNextToken(); // eat 'import'
+    if (CurTok != TOK_IDENTIFIER) {
+      SyntaxError(CurLoc, "Expected a module name after 'import'").raise();
+      return;
+    }
+    ImportedModule Import = {IdentifierStr, {}};
+    SourceLocation NameLoc = CurLoc;
+    getNextToken();
+
+    for (const ImportedModule &Earlier : Imports) {
+      if (Earlier.Name == Import.Name) {
+        ImportError(NameLoc, "Module '" + Import.Name + "' is imported twice")
+            .raise();
+        return;
+      }
+    }
+
+    std::string Error;
+    if (!EnsureModule(Import.Name, Import.Interface, Error)) {
+      ImportError(NameLoc, Error).raise();
+      return;
+    }
+
+    for (const auto &Export : Import.Interface.Exports) {
+      auto Other = Exporters.find(Export.first);
+      if (Other != Exporters.end()) {
+        ImportError(NameLoc, "'" + Export.first + "' is exported by both '" +
+                                 Other->second + "' and '" + Import.Name +
+                                 "'")
+            .raise();
+        return;
+      }
+      Exporters[Export.first] = Import.Name;
+      SymbolTable[Export.first] = {Export.second, true};
+    }
+
+    Imports.push_back(std::move(Import));
+  }
+}
+
+void DeclareImports() {
+  FunctionType *InitTy = FunctionType::get(Type::getVoidTy(*TheContext), false);
+
+  for (const ImportedModule &Import : Imports) {
+    for (const auto &Export : Import.Interface.Exports) {
+      auto *Global = new GlobalVariable(
+          *TheModule, getLLVMType(Export.second), false,
+          GlobalValue::ExternalLinkage, nullptr,
+          getExportSymbol(Import.Name, Export.first));
+      NamedValues[Export.first] = {Global, Export.second};
+    }
+
+    Builder->CreateCall(
+        TheModule->getOrInsertFunction(getInitSymbol(Import.Name), InitTy));
+  }
+}
+
+void ExportVariable(GlobalVariable *Global, const std::string &Name,
+                    KirkType Type) {
+  if (ModuleName.empty())
+    return;
+
+  Global->setName(getExportSymbol(ModuleName, Name));
+  Global->setLinkage(GlobalValue::ExternalLinkage);
+  Exports.push_back({Name, Type});
+}
+
+bool WriteModuleFiles(std::vector<std::string> &OutputFiles) {
+  std::string Bitcode = getModulePath(ModuleName, ".bc");
+  if (!WriteThinLTOBitcode(Bitcode))
+    return false;
+  OutputFiles = {Bitcode};
+
+  ModuleInterface Interface;
+  Interface.Options = getOptionsLine();
+  for (const ImportedModule &Import : Imports)
+    Interface.Imports.push_back(Import.Name);
+  Interface.Exports = Exports;
+  std::string Text = FormatInterface(Interface);
+
+  // An unchanged interface keeps its old timestamp, so the modules that
+  // import this one are not rebuilt
+  std::string Path = getModulePath(ModuleName, ".kirki");
+  std::ifstream Old(Path);
+  std::stringstream OldText;
+  OldText << Old.rdbuf();
+  if (Old.is_open() && OldText.str() == Text)
+    return true;
+  Old.close();
+
+  std::ofstream File(Path, std::ios::trunc);
+  File << Text;
+  if (!File) {
+    std::cerr << "Error: Could not write " << Path << "\n";
+    return false;
+  }
+  OutputFiles.push_back(Path);
+  return true;
+}
@@ -0,0 +1,65 @@
+#ifndef MODULES_H
+#define MODULES_H
+
+#include "Types.h"
+#include <string>
+#include <vector>
+
+namespace llvm {
+class GlobalVariable;
+} // namespace llvm
+
+// Separate compilation. `import stats` at the start of a file makes the
+// variables stats.kirk declares with `export` visible (read-only), and runs
+// stats.kirk's top-level code once, before the importing file's own.
+//
+// `kirk --module stats.kirk` compiles a module on its own, into ThinLTO
+// bitcode with a summary (stats.bc) and a small interface (stats.kirki)
+// listing its options, imports and exported variables. Importers only read
+// the interface. They rerun the compiler on a module first when its source,
+// its options or the interface of something it imports is newer than its
+// bitcode. The interface is only rewritten when it changes, so editing a
+// module doesn't rebuild the modules that import it.
+//
+// `--emit-obj` links a program with every module it needs through ThinLTO,
+// which imports and inlines the modules' code across files again.
+
+// Set by `--module`: the name of the module being compiled (its file name
+// without ".kirk"). Empty for a program.
+extern std::string ModuleName;
+// Directory of the file being compiled, where its imports are looked up and
+// their bitcode and interfaces are written
+extern std::string ModuleDirectory;
+// This compiler, rerun with `--module` to rebuild an import
+extern std::string CompilerExecutable;
+// The options to rebuild imports with (-O, -mcpu, --fast-math, --fp-*), as
+// given on the command line. Recorded in the interface too.
+extern std::vector<std::string> ModuleOptions;
+// Bitcode of every module the program needs, directly or not, dependencies
+// first. Filled by ParseImports().
+extern std::vector<std::string> ModuleBitcodeFiles;
+
+// Where ThinLTO caches the object files of the program and its modules:
+// "kirk-cache" in ModuleDirectory
+std::string getModuleCacheDirectory();
+// Symbols of a module's initializer and of its exported variables
+std::string getInitSymbol(const std::string &Module);
+std::string getExportSymbol(const std::string &Module, const std::string &Name);
+
+// Parses the `import` statements at the start of the file (CurTok is the
+// first token), brings each module up to date and adds its exports to the
+// symbol table as read-only variables
+void ParseImports();
+// Declares the imported variables and calls the imports' initializers at
+// the Builder's insertion point
+void DeclareImports();
+// Gives an exported top-level variable of the module being compiled the
+// symbol importers link to, and records it for the interface. Variables a
+// program exports have no importers and stay as they are.
+void ExportVariable(llvm::GlobalVariable *Global, const std::string &Name,
+                    KirkType Type);
+// `--module`: writes "<module>.bc" and "<module>.kirki" into
+// ModuleDirectory. Returns false (after printing why) on failure.
+bool WriteModuleFiles(std::vector<std::string> &OutputFiles);
+
+#endif
@@ -0,0 +1,96 @@
+#include "Multiversion.h"
+#include "Codegen.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/TargetParser/Triple.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <iostream>
+#include <vector>
+
+using namespace llvm;
+
+bool MultiversionEnabled = false;
+
+static std::vector<Function *> HotFunctions;
+
+// x86-64 microarchitecture levels above the baseline, lowest first: levels
+// 2, 3 and 4 in the runtime's kirk_cpu_level() numbering
+static const char *const ISALevels[] = {"x86-64-v2", "x86-64-v3",
+                                        "x86-64-v4"};
+
+void MarkHotFunction(Function *F) {
+  if (MultiversionEnabled)
+    HotFunctions.push_back(F);
+}
+
+void EmitMultiversions() {
+  if (HotFunctions.empty())
+    return;
+
+  if (Triple(TheModule->getTargetTriple()).getArch() != Triple::x86_64) {
+    std::cerr << "Warning: --multiversion only applies to x86-64 targets, "
+                 "ignoring it\n";
+    return;
+  }
+
+  Type *PtrTy = PointerType::getUnqual(*TheContext);
+  Type *I32 = Type::getInt32Ty(*TheContext);
+
+  Function *Resolver = Function::Create(
+      FunctionType::get(Type::getVoidTy(*TheContext), false),
+      Function::InternalLinkage, "kirk.mv.resolve", TheModule.get());
+  IRBuilder<> ResolverBuilder(
+      BasicBlock::Create(*TheContext, "entry", Resolver));
+  Value *Level = ResolverBuilder.CreateCall(
+      TheModule->getOrInsertFunction("kirk_cpu_level", I32), {}, "cpulevel");
+
+  for (Function *F : HotFunctions) {
+    std::string Name = F->getName().str();
+    F->setName(Name + ".default");
+
+    // Every caller (including the runtime, for parallel bodies) now goes
+    // through a stub that tail-calls whichever copy the resolver picked.
+    // Until the resolver runs, that is the baseline copy.
+    Function *Stub = Function::Create(F->getFunctionType(), F->getLinkage(),
+                                      Name, TheModule.get());
+    F->replaceAllUsesWith(Stub);
+
+    auto *Impl = new GlobalVariable(*TheModule, PtrTy, false,
+                                    GlobalValue::InternalLinkage, F,
+                                    Name + ".impl");
+
+    IRBuilder<> StubBuilder(BasicBlock::Create(*TheContext, "entry", Stub));
+    std::vector<Value *> Args;
+    for (Argument &Arg : Stub->args())
+      Args.push_back(&Arg);
+    CallInst *Call = StubBuilder.CreateCall(
+        F->getFunctionType(), StubBuilder.CreateLoad(PtrTy, Impl, "impl"),
+        Args);
+    Call->setTailCallKind(CallInst::TCK_MustTail);
+    StubBuilder.CreateRetVoid();
+
+    Value *Selected = F;
+    unsigned MinLevel = 2;
+    for (const char *ISALevel : ISALevels) {
+      ValueToValueMapTy VMap;
+      Function *Clone = CloneFunction(F, VMap);
+      Clone->setName(Name + "." + ISALevel);
+      Clone->removeFnAttr("target-features");
+      Clone->addFnAttr("target-cpu", ISALevel);
+
+      Value *Supported = ResolverBuilder.CreateICmpSGE(
+          Level, ConstantInt::get(I32, MinLevel++), "supported");
+      Selected = ResolverBuilder.CreateSelect(Supported, Clone, Selected);
+    }
+    ResolverBuilder.CreateStore(Selected, Impl);
+  }
+  ResolverBuilder.CreateRetVoid();
+
+  // Resolve before main runs any statement, after its allocas
+  BasicBlock &Entry = TheModule->getFunction("main")->getEntryBlock();
+  BasicBlock::iterator InsertPt = Entry.begin();
+  while (isa<AllocaInst>(InsertPt))
+    ++InsertPt;
+  IRBuilder<>(&Entry, InsertPt).CreateCall(Resolver);
+
+  HotFunctions.clear();
+}
@@ -0,0 +1,20 @@
+#ifndef MULTIVERSION_H
+#define MULTIVERSION_H
+
+#include "llvm/IR/Function.h"
+
+// Set by `--multiversion`: hot loops (top-level while loops and parallel loop
+// bodies) are compiled once per x86-64 ISA level (v2, v3, v4) next to the
+// baseline copy, and a resolver run at the start of main picks the best copy
+// the CPU supports. One binary then runs at full speed on old and new
+// machines alike.
+extern bool MultiversionEnabled;
+
+// Registers an outlined function that holds a hot loop. Hot functions must
+// return void.
+void MarkHotFunction(llvm::Function *F);
+// Clones every hot function per ISA level and emits the startup resolver.
+// Call once the whole program, including main, has been generated.
+void EmitMultiversions();
+
+#endif
@@ -2,12 +2,26 @@
 #include "AST.h"
 #include "Errors.h"
 #include "Lexer.h"
+#include <algorithm>
+#include <cstdint>
 #include <map>
 #include <memory>
 
 // Current state of the Parser
 int CurTok; // The current token the parser is looking at
 static std::map<int, int> BinopPrecedence; // Precedence table: '*' > '+'
+static unsigned ExpressionDepth = 0; // Nested ParseExpression calls
+// Labels of the loops being parsed, innermost last, which tell "break outer"
+// from "break value"
+static std::vector<std::string> LoopLabels;
+// Struct types declared so far, which tell "Particle p" from an expression.
+// Never erased once their entry is kept, so the AST can point to them.
+static std::map<std::string, RecordType> RecordTypes;
+// Those declared by the REPL entry being read
+static std::vector<std::string> EntryRecordTypes;
+// Generators defined so far, which tell "for x in evens(10)" from a range.
+// Never erased once checked, so the AST can point to them.
+static std::map<std::string, GeneratorDef> Generators;
 
 // Reads the next token from the Lexer and updates CurTok
 int getNextToken() { return CurTok = gettok(); }
@@ -19,14 +33,28 @@ void InitializePrecedence() {
   BinopPrecedence[TOK_NEQ] = 10;
   BinopPrecedence[TOK_GEQ] = 10;
   BinopPrecedence[TOK_LEQ] = 10;
+  // The bitwise operators keep C's order among themselves and below '+',
+  // but bind tighter than comparisons: "x & 1 == 0" is "(x & 1) == 0"
+  BinopPrecedence['|'] = 12;
+  BinopPrecedence[TOK_XOR] = 13;
+  BinopPrecedence['&'] = 14;
+  BinopPrecedence[TOK_SHL] = 16;
+  BinopPrecedence[TOK_SHR] = 16;
+  BinopPrecedence[TOK_USHR] = 16;
   BinopPrecedence['+'] = 20;
   BinopPrecedence['-'] = 20;
   BinopPrecedence['*'] = 40;
   BinopPrecedence['/'] = 40;
   BinopPrecedence['%'] = 40;
   BinopPrecedence['^'] = 50;
+  BinopPrecedence[TOK_OR] = 4;
+  BinopPrecedence[TOK_AND] = 5;
 }
 
+// "not" binds looser than comparisons and arithmetic, but tighter than "and"
+// and "or": "not a < b and c" is "(not (a < b)) and c"
+static const int NotPrecedence = 6;
+
 // Returns the priority of the current operator. If it's not an operator (like a
 // number), returns -1.
 static int GetTokPrecedence() {
@@ -38,12 +66,28 @@ static int GetTokPrecedence() {
 }
 
 std::unique_ptr<ExprAST> ParseExpression();
-std::unique_ptr<ExprAST> ParseUnary();
 std::unique_ptr<ExprAST> ParseBlock();
 std::unique_ptr<ExprAST> ParsePrintExpr();
 std::unique_ptr<ExprAST> ParseWhileExpr();
+std::unique_ptr<ExprAST> ParseParallelForExpr();
+std::unique_ptr<ExprAST> ParseForExpr();
 std::unique_ptr<ExprAST> ParseVarDecl();
 std::unique_ptr<ExprAST> ParseBoolExpr();
+std::unique_ptr<ExprAST> ParseAnnotatedExpr();
+std::unique_ptr<ExprAST> ParseBenchExpr();
+std::unique_ptr<ExprAST> ParseViewDecl();
+std::unique_ptr<ExprAST> ParseExportDecl();
+std::unique_ptr<ExprAST> ParseBreakExpr();
+std::unique_ptr<ExprAST> ParseMatchExpr();
+std::unique_ptr<ExprAST> ParseStructDecl();
+std::unique_ptr<ExprAST> ParseGeneratorDecl();
+std::unique_ptr<ExprAST> ParseYieldExpr();
+static std::unique_ptr<ExprAST> ParseRecordDecl(const RecordType &Record,
+                                                SourceLocation TypeLoc);
+static std::unique_ptr<ExprAST> ParseLabeledLoop(const std::string &Label,
+                                                 SourceLocation LabelLoc);
+static std::unique_ptr<ExprAST> ParseBuiltinCall(const std::string &Name,
+                                                 SourceLocation CallLoc);
 
 static KirkType TokenToKirkType(int Tok) {
   switch (Tok) {
@@ -53,6 +97,12 @@ static KirkType TokenToKirkType(int Tok) {
     return KIRK_DOUBLE;
   case TOK_TYPE_BOOL:
     return KIRK_BOOL;
+  case TOK_TYPE_VECTOR: {
+    static const std::map<std::string, KirkType> VectorTypes = {
+        {"vec4d", KIRK_VEC4D}, {"vec4i", KIRK_VEC4I}, {"vec4b", KIRK_VEC4B},
+        {"vec8d", KIRK_VEC8D}, {"vec8i", KIRK_VEC8I}, {"vec8b", KIRK_VEC8B}};
+    return VectorTypes.at(IdentifierStr);
+  }
   default:
     SyntaxError(CurLoc, "Unknown type").raise();
     return KIRK_VOID;
@@ -61,14 +111,14 @@ static KirkType TokenToKirkType(int Tok) {
 
 // Called when CurTok is a Number.
 static std::unique_ptr<ExprAST> ParseNumberExpr(bool IsInteger) {
-  auto Result = IsInteger ? std::make_unique<NumberExprAST>(IntVal)
-                          : std::make_unique<NumberExprAST>(NumVal);
+  auto Result = IsInteger ? std::make_unique<NumberExprAST>(CurLoc, IntVal)
+                          : std::make_unique<NumberExprAST>(CurLoc, NumVal);
   getNextToken(); // consume the number
   return Result;
 }
 
 std::unique_ptr<ExprAST> ParseBoolExpr() {
-  auto Result = std::make_unique<BoolExprAST>(BoolVal);
+  auto Result = std::make_unique<BoolExprAST>(CurLoc, BoolVal);
   getNextToken();
   return Result;
 }
@@ -80,6 +130,61 @@ static std::unique_ptr<ExprAST> ParseIdentifierExpr() {
 
   getNextToken();
 
+  // Builtin call. The names are not keywords, so "int max = 3" still works.
+  // The '(' has to be on the same line: "x" followed by "(y + 1) * 2" on
+  // the next line is two statements.
+  if (CurTok == '(' && CurLoc.Line == VarLoc.Line)
+    return ParseBuiltinCall(IdName, VarLoc);
+
+  // Loop label, like "outer: while ..."
+  if (CurTok == ':')
+    return ParseLabeledLoop(IdName, VarLoc);
+
+  // Record declaration, like "Particle p" or "Particle[100] ps"
+  auto Record = RecordTypes.find(IdName);
+  if (Record != RecordTypes.end() &&
+      (CurTok == TOK_IDENTIFIER || CurTok == '['))
+    return ParseRecordDecl(Record->second, VarLoc);
+
+  // View element, or a collection's element if a field follows
+  std::unique_ptr<ExprAST> Index;
+  if (CurTok == '[') {
+    getNextToken();
+    Index = ParseExpression();
+    if (!Index)
+      return nullptr;
+
+    if (CurTok != ']') {
+      LogErrorAt(CurLoc, "Expected ']' after index");
+      return nullptr;
+    }
+    getNextToken();
+    if (CurTok != '.')
+      return std::make_unique<IndexExprAST>(VarLoc, IdName, std::move(Index));
+  }
+
+  // Field of a record, read or assigned
+  if (CurTok == '.') {
+    getNextToken(); // eat '.'
+    if (CurTok != TOK_IDENTIFIER) {
+      LogErrorAt(CurLoc, "Expected a field name after '.'");
+      return nullptr;
+    }
+    auto Field = std::make_unique<FieldExprAST>(
+        VarLoc, IdName, std::move(Index), IdentifierStr, CurLoc);
+    getNextToken();
+
+    if (CurTok != TOK_ASSIGN)
+      return Field;
+    getNextToken();
+
+    auto RHS = ParseExpression();
+    if (!RHS)
+      return nullptr;
+    return std::make_unique<FieldAssignmentExprAST>(VarLoc, std::move(Field),
+                                                    std::move(RHS));
+  }
+
   if (CurTok == TOK_ASSIGN) {
     getNextToken();
 
@@ -113,8 +218,15 @@ static std::unique_ptr<ExprAST> ParseParenExpr() {
 }
 
 std::unique_ptr<ExprAST> ParseIfExpr() {
+  SourceLocation IfLoc = CurLoc;
   getNextToken(); // Eating the if expression
 
+  BranchHint Hint = BRANCH_UNHINTED;
+  if (CurTok == TOK_LIKELY || CurTok == TOK_UNLIKELY) {
+    Hint = CurTok == TOK_LIKELY ? BRANCH_LIKELY : BRANCH_UNLIKELY;
+    getNextToken();
+  }
+
   auto Cond = ParseExpression();
   if (!Cond)
     return nullptr;
@@ -150,8 +262,8 @@ std::unique_ptr<ExprAST> ParseIfExpr() {
   if (!Else)
     return nullptr;
 
-  return std::make_unique<IfExprAST>(std::move(Cond), std::move(Then),
-                                     std::move(Else));
+  return std::make_unique<IfExprAST>(IfLoc, std::move(Cond), std::move(Then),
+                                     std::move(Else), Hint);
 }
 
 // "Primary" means the basic building blocks: numbers or parentheses.
@@ -185,61 +297,214 @@ static std::unique_ptr<ExprAST> ParsePrimary() {
   case TOK_WHILE:
     return ParseWhileExpr();
 
+  case TOK_FOR:
+    return ParseForExpr();
+
+  case TOK_PARALLEL:
+    return ParseParallelForExpr();
+
+  case '@':
+    return ParseAnnotatedExpr();
+
+  case TOK_BENCH:
+    return ParseBenchExpr();
+
+  case TOK_VIEW:
+    return ParseViewDecl();
+
+  case TOK_EXPORT:
+    return ParseExportDecl();
+
+  case TOK_BREAK:
+  case TOK_CONTINUE:
+    return ParseBreakExpr();
+
+  case TOK_MATCH:
+    return ParseMatchExpr();
+
+  case TOK_STRUCT:
+    return ParseStructDecl();
+
+  case TOK_GENERATOR:
+    return ParseGeneratorDecl();
+
+  case TOK_YIELD:
+    return ParseYieldExpr();
+
+  case TOK_LIKELY:
+  case TOK_UNLIKELY:
+    LogErrorAt(CurLoc, "'" + IdentifierStr +
+                           "' can only come right after 'if', as in "
+                           "\"if likely x > 0 { ... }\"");
+    return nullptr;
+
+  case TOK_IMPORT:
+    // ParseImports() consumes the ones at the start of the file
+    LogErrorAt(CurLoc, "Imports must come before the other statements of a "
+                       "file");
+    getNextToken();
+    return nullptr;
+
   case TOK_TYPE_INT:
   case TOK_TYPE_DOUBLE:
   case TOK_TYPE_BOOL:
+  case TOK_TYPE_VECTOR:
     return ParseVarDecl();
   }
 }
 
-// This function handles the "Right Hand Side" of an expression.
-// ExprPrec: The precedence of the operator strictly to our left.
-static std::unique_ptr<ExprAST> ParseBinOpRHS(int ExprPrec,
-                                              std::unique_ptr<ExprAST> LHS) {
-  while (true) {
-    // Look at the next operator
-    int TokPrec = GetTokPrecedence();
+// Expressions are parsed with an explicit operator stack (shunting-yard)
+// instead of one recursive call per operator, parenthesis or unary minus, so
+// machine-generated input nested millions of levels deep doesn't overflow
+// the stack. Only operands like if, print or a block recurse.
+namespace {
+enum PendingKind { PENDING_BINARY, PENDING_UNARY, PENDING_PAREN };
+
+struct PendingOp {
+  PendingKind Kind;
+  int Op; // Operator token
+  SourceLocation Loc;
+};
+} // namespace
+
+// The stacks are shared with nested calls (for an if inside an expression,
+// say), which only work above the entries they find
+static std::vector<std::unique_ptr<ExprAST>> Operands;
+static std::vector<PendingOp> Ops;
+
+void ResetParser() {
+  Operands.clear();
+  Ops.clear();
+  ExpressionDepth = 0;
+  LoopLabels.clear();
+
+  // A generator whose body was rejected can't be consumed
+  for (auto It = Generators.begin(); It != Generators.end();)
+    It = It->second.Checked ? std::next(It) : Generators.erase(It);
+
+  // Nor can the structs of a rejected entry be used, and they may be
+  // declared again
+  for (const std::string &Name : EntryRecordTypes)
+    RecordTypes.erase(Name);
+  EntryRecordTypes.clear();
+}
 
-    // If this is a low-precedence operator (or not an operator at all), then we
-    // are done with the current block. Return what we have. Example: If we are
-    // parsing "4 * 5 + 1", and we just built "4 * 5", the next op is "+". Since
-    // "+" (20) < "*" (40), we stop and return.
-    if (TokPrec < ExprPrec)
-      return LHS;
+void KeepParsedDeclarations() { EntryRecordTypes.clear(); }
 
-    int BinOp = CurTok;
-    getNextToken(); // consume binop
+std::unique_ptr<ExprAST> ParseExpression() {
+  struct DepthGuard {
+    DepthGuard() { ++ExpressionDepth; }
+    ~DepthGuard() { --ExpressionDepth; }
+  } Depth;
+
+  size_t OperandBase = Operands.size();
+  size_t OpBase = Ops.size();
+  size_t OpenParens = 0;
+
+  // Pops the operator on top of the stack and its operands, and pushes the
+  // node combining them
+  auto Reduce = [&]() {
+    PendingOp Top = Ops.back();
+    Ops.pop_back();
+
+    auto RHS = std::move(Operands.back());
+    Operands.pop_back();
+    if (Top.Kind == PENDING_UNARY) {
+      Operands.push_back(
+          std::make_unique<UnaryExprAST>(Top.Loc, Top.Op, std::move(RHS)));
+      return;
+    }
 
-    // Parse the primary expression after the binary operator
-    auto RHS = ParseUnary();
-    if (!RHS)
-      return nullptr;
+    auto LHS = std::move(Operands.back());
+    Operands.pop_back();
+
+    // "a and b and c" becomes one node with three operands
+    if (Top.Op == TOK_AND || Top.Op == TOK_OR) {
+      auto *Chain = dynamic_cast<LogicalExprAST *>(LHS.get());
+      if (!Chain || Chain->getOp() != Top.Op) {
+        LHS = std::make_unique<LogicalExprAST>(Top.Loc, Top.Op,
+                                               std::move(LHS));
+        Chain = static_cast<LogicalExprAST *>(LHS.get());
+      }
+      Chain->addOperand(std::move(RHS));
+      Operands.push_back(std::move(LHS));
+      return;
+    }
 
-    // LOOKAHEAD: Is the *next* operator even stronger?
-    // Example: "a + b * c"
-    // We are at "+". We parsed "b". Next op is "*". Since "*" is stronger than
-    // "+", we let "*" steal "b" as its LHS.
-    int NextPrec = GetTokPrecedence();
-    if (TokPrec < NextPrec) {
-      // Recursively parse the high-priority part first
-      RHS = ParseBinOpRHS(TokPrec + 1, std::move(RHS));
-      if (!RHS)
-        return nullptr;
+    Operands.push_back(std::make_unique<BinaryExprAST>(
+        Top.Loc, Top.Op, std::move(LHS), std::move(RHS)));
+  };
+
+  // Pending "not"s are reduced like binary operators of NotPrecedence
+  auto BindsAtLeast = [&](const PendingOp &Op, int Prec) {
+    if (Op.Kind == PENDING_BINARY)
+      return BinopPrecedence[Op.Op] >= Prec;
+    return Op.Kind == PENDING_UNARY && Op.Op == TOK_NOT &&
+           NotPrecedence >= Prec;
+  };
+
+  while (true) {
+    // Any number of unary minuses, '~'s, nots and opening parentheses
+    while (CurTok == '-' || CurTok == '~' || CurTok == TOK_NOT ||
+           CurTok == '(') {
+      if (CurTok == '(')
+        ++OpenParens;
+      Ops.push_back(
+          {CurTok == '(' ? PENDING_PAREN : PENDING_UNARY, CurTok, CurLoc});
+      getNextToken();
+    }
+
+    auto Operand = ParsePrimary();
+    if (!Operand) {
+      Operands.resize(OperandBase);
+      Ops.resize(OpBase);
+      return nullptr;
+    }
+    Operands.push_back(std::move(Operand));
+
+    while (true) {
+      // Unary minus and '~' bind tighter than any binary operator: "-x ^ 2"
+      // is "(-x) ^ 2"
+      while (Ops.size() > OpBase && Ops.back().Kind == PENDING_UNARY &&
+             Ops.back().Op != TOK_NOT)
+        Reduce();
+
+      // A ')' without a matching '(' in this expression belongs to an
+      // enclosing construct, like the end of print(...)
+      if (CurTok != ')' || OpenParens == 0)
+        break;
+      while (Ops.back().Kind != PENDING_PAREN)
+        Reduce();
+      Ops.pop_back();
+      --OpenParens;
+      getNextToken(); // eat ')'
     }
 
-    // Merge LHS and RHS into a new node
-    LHS =
-        std::make_unique<BinaryExprAST>(BinOp, std::move(LHS), std::move(RHS));
+    // Look at the next operator. If it isn't one, the expression is done.
+    int TokPrec = GetTokPrecedence();
+    if (TokPrec < 0)
+      break;
+
+    // Operators are left-associative: in "a - b + c", "a - b" is complete
+    // once "+" shows up, and so is anything of higher precedence
+    while (Ops.size() > OpBase && BindsAtLeast(Ops.back(), TokPrec))
+      Reduce();
+
+    Ops.push_back({PENDING_BINARY, CurTok, CurLoc});
+    getNextToken(); // consume binop
   }
-}
 
-// Entry point for parsing
-std::unique_ptr<ExprAST> ParseExpression() {
-  auto LHS = ParseUnary();
-  if (!LHS)
+  if (OpenParens > 0) {
+    SyntaxError(CurLoc, "Expected ')'").raise();
     return nullptr;
+  }
 
-  return ParseBinOpRHS(0, std::move(LHS));
+  while (Ops.size() > OpBase)
+    Reduce();
+
+  auto Result = std::move(Operands.back());
+  Operands.pop_back();
+  return Result;
 }
 
 // Parse API
@@ -250,27 +515,13 @@ std::unique_ptr<ExprAST> Parse() {
   return ParseExpression();
 }
 
-std::unique_ptr<ExprAST> ParseUnary() {
-  // If the current token is not an operator that handles unary (like '-'),
-  // then it must be a primary expression.
-  if (CurTok != '-')
-    return ParsePrimary();
-
-  int Opc = CurTok;
-  getNextToken();
-
-  if (auto Operand = ParseUnary())
-    return std::make_unique<UnaryExprAST>(Opc, std::move(Operand));
-
-  return nullptr;
-}
-
 std::unique_ptr<ExprAST> ParseBlock() {
   if (CurTok != '{') {
     LogErrorAt(CurLoc, "Expected '{'");
     return nullptr;
   }
 
+  SourceLocation BlockLoc = CurLoc;
   getNextToken();
   std::vector<std::unique_ptr<ExprAST>> Exprs;
 
@@ -292,10 +543,129 @@ std::unique_ptr<ExprAST> ParseBlock() {
   }
   getNextToken();
 
-  return std::make_unique<BlockExprAST>(std::move(Exprs));
+  return std::make_unique<BlockExprAST>(BlockLoc, std::move(Exprs));
+}
+
+// An int constant in a match pattern, like 3 or -1
+static bool ParsePatternValue(long long &Val) {
+  bool Negative = CurTok == '-';
+  if (Negative)
+    getNextToken();
+
+  if (CurTok != TOK_INT_LITERAL) {
+    LogErrorAt(CurLoc, "Match patterns must be integer constants or ranges, "
+                       "like 3, -1 or 10..20");
+    return false;
+  }
+  Val = Negative ? -IntVal : IntVal;
+  getNextToken();
+  return true;
+}
+
+// "3" or "10..20" (half-open, like the range of a for loop)
+static bool ParsePattern(MatchPattern &Pattern) {
+  Pattern.Loc = CurLoc;
+  if (!ParsePatternValue(Pattern.Low))
+    return false;
+  Pattern.Last = Pattern.Low;
+
+  if (CurTok == TOK_RANGE) {
+    getNextToken();
+    long long End;
+    if (!ParsePatternValue(End))
+      return false;
+    if (End <= Pattern.Low) {
+      LogErrorAt(Pattern.Loc, "Empty match range: " +
+                                  std::to_string(Pattern.Low) + ".." +
+                                  std::to_string(End) + " contains no value");
+      return false;
+    }
+    Pattern.Last = End - 1;
+  }
+  return true;
+}
+
+// "match x { 1 => a, 2 | 3 => b, 10..20 => c, _ => d }". An arm's value can
+// be a block. The commas between arms are required, since newlines don't end
+// an expression: "0 => a" and "-1 => b" on the next line would be "a - 1".
+std::unique_ptr<ExprAST> ParseMatchExpr() {
+  SourceLocation MatchLoc = CurLoc;
+  getNextToken(); // eat 'match'
+
+  auto Subject = ParseExpression();
+  if (!Subject)
+    return nullptr;
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after the match subject");
+    return nullptr;
+  }
+  getNextToken();
+
+  std::vector<MatchArm> Arms;
+  bool HasDefault = false;
+  while (CurTok != '}' && CurTok != TOK_EOF) {
+    if (HasDefault) {
+      LogErrorAt(CurLoc, "The '_' arm of a match must be the last one");
+      return nullptr;
+    }
+
+    MatchArm Arm;
+    if (CurTok == '_') {
+      HasDefault = true;
+      getNextToken();
+    } else {
+      while (true) {
+        MatchPattern Pattern;
+        if (!ParsePattern(Pattern))
+          return nullptr;
+        Arm.Patterns.push_back(Pattern);
+        if (CurTok != '|')
+          break;
+        getNextToken(); // eat '|'
+      }
+    }
+
+    if (CurTok != TOK_ARROW) {
+      LogErrorAt(CurLoc, "Expected '=>' after the match pattern");
+      return nullptr;
+    }
+    getNextToken();
+
+    Arm.Body = CurTok == '{' ? ParseBlock() : ParseExpression();
+    if (!Arm.Body)
+      return nullptr;
+    Arms.push_back(std::move(Arm));
+
+    if (CurTok == ',') {
+      getNextToken();
+    } else if (CurTok == TOK_ARROW) {
+      // The value ran on into the next arm's pattern
+      LogErrorAt(CurLoc, "Expected ',' before the next match arm");
+      return nullptr;
+    } else if (CurTok != '}') {
+      LogErrorAt(CurLoc, "Expected ',' or '}' after a match arm");
+      return nullptr;
+    }
+  }
+
+  if (CurTok != '}') {
+    LogErrorAt(CurLoc, "Expected '}'");
+    return nullptr;
+  }
+  if (!HasDefault) {
+    LogErrorAt(CurLoc, "A match needs a last '_' arm, for the values no "
+                       "other arm matches");
+    return nullptr;
+  }
+  getNextToken(); // eat '}'
+
+  return std::make_unique<MatchExprAST>(MatchLoc, std::move(Subject),
+                                        std::move(Arms));
 }
 
 std::unique_ptr<ExprAST> ParsePrintExpr() {
+  SourceLocation PrintLoc = CurLoc;
   getNextToken();
 
   if (CurTok != '(') {
@@ -314,10 +684,279 @@ std::unique_ptr<ExprAST> ParsePrintExpr() {
   }
   getNextToken();
 
-  return std::make_unique<PrintExprAST>(std::move(Expr));
+  return std::make_unique<PrintExprAST>(PrintLoc, std::move(Expr));
+}
+
+struct BuiltinSignature {
+  BuiltinFunction Callee;
+  size_t NumArgs;
+};
+
+// NumArgs of builtins that Sema checks instead, like shuffle
+static constexpr size_t VariadicArgs = SIZE_MAX;
+
+// Parses "(a, b, ...)" into Args, with CurTok on the '('
+static bool ParseCallArguments(const std::string &Name,
+                               std::vector<std::unique_ptr<ExprAST>> &Args) {
+  getNextToken(); // eat '('
+
+  while (CurTok != ')') {
+    auto Arg = ParseExpression();
+    if (!Arg)
+      return false;
+    Args.push_back(std::move(Arg));
+
+    if (CurTok == ',') {
+      getNextToken();
+    } else if (CurTok != ')') {
+      LogErrorAt(CurLoc, "Expected ',' or ')' in arguments to " + Name);
+      return false;
+    }
+  }
+  getNextToken(); // eat ')'
+  return true;
+}
+
+// Called with CurTok on the '(' after the builtin's name
+static std::unique_ptr<ExprAST> ParseBuiltinCall(const std::string &Name,
+                                                 SourceLocation CallLoc) {
+  static const std::map<std::string, BuiltinSignature> Builtins = {
+      {"sqrt", {BUILTIN_SQRT, 1}},   {"abs", {BUILTIN_ABS, 1}},
+      {"min", {BUILTIN_MIN, 2}},     {"max", {BUILTIN_MAX, 2}},
+      {"floor", {BUILTIN_FLOOR, 1}}, {"fma", {BUILTIN_FMA, 3}},
+      {"popcount", {BUILTIN_POPCOUNT, 1}}, {"ctz", {BUILTIN_CTZ, 1}},
+      {"clz", {BUILTIN_CLZ, 1}},
+      {"clock_ns", {BUILTIN_CLOCK_NS, 0}}, {"cycles", {BUILTIN_CYCLES, 0}},
+      {"read_int", {BUILTIN_READ_INT, 0}},
+      {"read_double", {BUILTIN_READ_DOUBLE, 0}},
+      {"read_bool", {BUILTIN_READ_BOOL, 0}},
+      {"has_input", {BUILTIN_HAS_INPUT, 0}},
+      {"lane", {BUILTIN_LANE, 2}},   {"with_lane", {BUILTIN_WITH_LANE, 3}},
+      {"shuffle", {BUILTIN_SHUFFLE, VariadicArgs}},
+      {"select", {BUILTIN_SELECT, 3}},
+      {"reduce_add", {BUILTIN_REDUCE_ADD, 1}},
+      {"reduce_mul", {BUILTIN_REDUCE_MUL, 1}},
+      {"reduce_min", {BUILTIN_REDUCE_MIN, 1}},
+      {"reduce_max", {BUILTIN_REDUCE_MAX, 1}},
+      {"any", {BUILTIN_ANY, 1}},     {"all", {BUILTIN_ALL, 1}}};
+
+  // len() takes a view or a collection, which are not expressions
+  if (Name == "len") {
+    getNextToken(); // eat '('
+    if (CurTok != TOK_IDENTIFIER) {
+      LogErrorAt(CurLoc,
+                 "Expected the name of a view or collection in len()");
+      return nullptr;
+    }
+    std::string ViewName = IdentifierStr;
+    getNextToken();
+
+    if (CurTok != ')') {
+      LogErrorAt(CurLoc, "Expected ')' after the name in len()");
+      return nullptr;
+    }
+    getNextToken();
+    return std::make_unique<LengthExprAST>(CallLoc, ViewName);
+  }
+
+  if (Generators.count(Name)) {
+    LogErrorAt(CallLoc, "Generator '" + Name +
+                            "' can only be consumed by a loop, like \"for x "
+                            "in " + Name + "(...)\"");
+    return nullptr;
+  }
+
+  auto Iter = Builtins.find(Name);
+  if (Iter == Builtins.end()) {
+    LogErrorAt(CallLoc, "Unknown function '" + Name +
+                            "' (builtins are sqrt, abs, min, max, floor, "
+                            "fma, clock_ns, cycles, read_int, read_double, "
+                            "read_bool, has_input, len, lane, with_lane, "
+                            "shuffle, select, reduce_add, reduce_mul, "
+                            "reduce_min, reduce_max, any and all)");
+    return nullptr;
+  }
+
+  std::vector<std::unique_ptr<ExprAST>> Args;
+  if (!ParseCallArguments(Name, Args))
+    return nullptr;
+
+  size_t Expected = Iter->second.NumArgs;
+  if (Expected != VariadicArgs && Args.size() != Expected) {
+    LogErrorAt(CallLoc, Name + " takes " + std::to_string(Expected) +
+                            (Expected == 1 ? " argument" : " arguments") +
+                            ", but " + std::to_string(Args.size()) +
+                            (Args.size() == 1 ? " was" : " were") + " given");
+    return nullptr;
+  }
+
+  return std::make_unique<BuiltinCallExprAST>(CallLoc, Iter->second.Callee,
+                                              std::move(Args));
+}
+
+static bool IsLoopHint(const std::string &Name) {
+  return Name == "unroll" || Name == "nounroll" || Name == "vectorize" ||
+         Name == "novectorize";
+}
+
+// The argument of "@unroll(8)" or "@vectorize(width=4)", with CurTok on the
+// '('. Returns 0 after reporting an error.
+static unsigned ParseLoopHintArgument(bool IsUnroll) {
+  getNextToken(); // eat '('
+  if (!IsUnroll) {
+    if (CurTok != TOK_IDENTIFIER || IdentifierStr != "width") {
+      LogErrorAt(CurLoc, "Expected 'width=' in @vectorize(...)");
+      return 0;
+    }
+    getNextToken();
+    if (CurTok != TOK_ASSIGN) {
+      LogErrorAt(CurLoc, "Expected '=' after 'width'");
+      return 0;
+    }
+    getNextToken();
+  }
+
+  SourceLocation ArgLoc = CurLoc;
+  long long Max = IsUnroll ? 1024 : 64;
+  bool Valid = CurTok == TOK_INT_LITERAL && IntVal >= 1 && IntVal <= Max &&
+               (IsUnroll || (IntVal & (IntVal - 1)) == 0);
+  if (!Valid) {
+    LogErrorAt(ArgLoc, IsUnroll ? "The unroll count must be an integer from "
+                                  "1 to 1024"
+                                : "The vector width must be a power of two "
+                                  "from 1 to 64");
+    return 0;
+  }
+  unsigned Arg = static_cast<unsigned>(IntVal);
+  getNextToken();
+
+  if (CurTok != ')') {
+    LogErrorAt(CurLoc, "Expected ')' after the loop hint's argument");
+    return 0;
+  }
+  getNextToken(); // eat ')'
+  return Arg;
+}
+
+// "@unroll(8) @vectorize(width=4) while ...": any number of loop hints, at
+// most one about unrolling and one about vectorizing, then the loop they
+// apply to. CurTok is the first hint's name.
+static std::unique_ptr<ExprAST> ParseLoopHints(SourceLocation AtLoc) {
+  LoopHints Hints;
+  std::string FirstHint = IdentifierStr;
+
+  while (true) {
+    std::string Name = IdentifierStr;
+    SourceLocation NameLoc = CurLoc;
+    getNextToken();
+
+    bool IsUnroll = Name == "unroll" || Name == "nounroll";
+    LoopHintSwitch &Switch = IsUnroll ? Hints.Unroll : Hints.Vectorize;
+    if (Switch != HINT_DEFAULT) {
+      LogErrorAt(NameLoc, IsUnroll ? "The loop already has an unroll hint"
+                                   : "The loop already has a vectorize hint");
+      return nullptr;
+    }
+    Switch = Name.compare(0, 2, "no") == 0 ? HINT_DISABLE : HINT_ENABLE;
+
+    if (CurTok == '(') {
+      if (Switch == HINT_DISABLE) {
+        LogErrorAt(CurLoc, "@" + Name + " takes no arguments");
+        return nullptr;
+      }
+      unsigned Arg = ParseLoopHintArgument(IsUnroll);
+      if (Arg == 0)
+        return nullptr;
+      (IsUnroll ? Hints.UnrollCount : Hints.VectorizeWidth) = Arg;
+    }
+
+    if (CurTok != '@')
+      break;
+    getNextToken(); // eat '@'
+    if (CurTok != TOK_IDENTIFIER || !IsLoopHint(IdentifierStr)) {
+      LogErrorAt(CurLoc, "Only other loop hints can come between @" +
+                             FirstHint + " and its loop");
+      return nullptr;
+    }
+  }
+
+  auto Loop = ParsePrimary();
+  if (!Loop)
+    return nullptr;
+
+  auto *Target = dynamic_cast<LoopExprAST *>(Loop.get());
+  if (!Target) {
+    LogErrorAt(AtLoc, "@" + FirstHint + " must be followed by a while or "
+                                        "for loop");
+    return nullptr;
+  }
+  Target->setHints(Hints);
+  return Loop;
+}
+
+// "@name" followed by a block or a primary expression
+std::unique_ptr<ExprAST> ParseAnnotatedExpr() {
+  SourceLocation AtLoc = CurLoc;
+  getNextToken(); // eat '@'
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected an annotation name after '@'");
+    return nullptr;
+  }
+
+  FloatMode Mode;
+  if (IdentifierStr == "fast_math") {
+    Mode = FLOAT_FAST;
+  } else if (IdentifierStr == "strict_math") {
+    Mode = FLOAT_STRICT;
+  } else if (IsLoopHint(IdentifierStr)) {
+    return ParseLoopHints(AtLoc);
+  } else {
+    LogErrorAt(CurLoc, "Unknown annotation '@" + IdentifierStr +
+                           "' (expected @fast_math, @strict_math, @unroll, "
+                           "@nounroll, @vectorize or @novectorize)");
+    return nullptr;
+  }
+  getNextToken();
+
+  auto Body = CurTok == '{' ? ParseBlock() : ParsePrimary();
+  if (!Body)
+    return nullptr;
+
+  return std::make_unique<FloatModeExprAST>(AtLoc, Mode, std::move(Body));
+}
+
+// bench "name" N { ... }
+std::unique_ptr<ExprAST> ParseBenchExpr() {
+  SourceLocation BenchLoc = CurLoc;
+  getNextToken(); // eat 'bench'
+
+  if (CurTok != TOK_STRING) {
+    LogErrorAt(CurLoc, "Expected a benchmark name in quotes after 'bench'");
+    return nullptr;
+  }
+  std::string Name = StringVal;
+  getNextToken();
+
+  auto Iterations = ParseExpression();
+  if (!Iterations)
+    return nullptr;
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after the benchmark's iteration count");
+    return nullptr;
+  }
+
+  auto Body = ParseBlock();
+  if (!Body)
+    return nullptr;
+
+  return std::make_unique<BenchExprAST>(BenchLoc, Name, std::move(Iterations),
+                                        std::move(Body));
 }
 
 std::unique_ptr<ExprAST> ParseWhileExpr() {
+  SourceLocation WhileLoc = CurLoc;
   getNextToken();
 
   auto Cond = ParseExpression();
@@ -334,33 +973,676 @@ std::unique_ptr<ExprAST> ParseWhileExpr() {
   if (!Body)
     return nullptr;
 
-  return std::make_unique<WhileExprAST>(std::move(Cond), std::move(Body));
+  return std::make_unique<WhileExprAST>(WhileLoc, std::move(Cond),
+                                        std::move(Body));
 }
 
-std::unique_ptr<ExprAST> ParseVarDecl() {
-  SourceLocation TypeLoc = CurLoc;
-  KirkType Type = TokenToKirkType(CurTok);
-  getNextToken();
+// CurTok is the ':' after the label
+static std::unique_ptr<ExprAST> ParseLabeledLoop(const std::string &Label,
+                                                 SourceLocation LabelLoc) {
+  getNextToken(); // eat ':'
 
-  if (CurTok != TOK_IDENTIFIER) {
-    LogErrorAt(CurLoc, "Expected identifier after type");
+  if (CurTok != TOK_WHILE && CurTok != TOK_FOR) {
+    LogErrorAt(CurLoc, "Expected 'while' or 'for' after label '" + Label +
+                           "'");
     return nullptr;
   }
+  bool Duplicate = std::find(LoopLabels.begin(), LoopLabels.end(), Label) !=
+                   LoopLabels.end();
 
-  std::string Name = IdentifierStr;
-  SourceLocation NameLoc = CurLoc;
-  getNextToken();
+  LoopLabels.push_back(Label);
+  auto Loop = CurTok == TOK_WHILE ? ParseWhileExpr() : ParseForExpr();
+  LoopLabels.pop_back();
+  if (!Loop)
+    return nullptr;
 
-  if (CurTok != TOK_ASSIGN) {
-    LogErrorAt(CurLoc, "Expected '=' after variable name");
+  // Reported after the loop, so parsing resumes behind it
+  if (Duplicate) {
+    LogErrorAt(LabelLoc, "Label '" + Label +
+                             "' is already used by an enclosing loop");
     return nullptr;
   }
 
-  getNextToken();
-  auto Init = ParseExpression();
-  if (!Init)
-    return nullptr;
+  static_cast<LoopExprAST *>(Loop.get())->setLabel(Label);
+  return Loop;
+}
 
-  return std::make_unique<VarDeclExprAST>(NameLoc, Name, Type,
-                                          std::move(Init));
+// Tokens that can start the value of a break
+static bool StartsBreakValue() {
+  switch (CurTok) {
+  case TOK_IDENTIFIER:
+  case TOK_NUMBER:
+  case TOK_INT_LITERAL:
+  case TOK_BOOL_LITERAL:
+  case TOK_TYPE_VECTOR:
+  case TOK_IF:
+  case TOK_MATCH:
+  case TOK_NOT:
+  case '(':
+  case '-':
+  case '~':
+    return true;
+  default:
+    return false;
+  }
+}
+
+// "break [label] [value]" or "continue [label]". Newlines don't end
+// statements, so the label and the value must be on the same line as the
+// break: "{ break \n x = 1 }" is a break followed by an assignment.
+std::unique_ptr<ExprAST> ParseBreakExpr() {
+  SourceLocation BreakLoc = CurLoc;
+  bool IsContinue = CurTok == TOK_CONTINUE;
+  getNextToken(); // eat 'break' or 'continue'
+
+  // A name is a label if an enclosing loop has it, and a value otherwise
+  std::string Label;
+  if (CurTok == TOK_IDENTIFIER && CurLoc.Line == BreakLoc.Line &&
+      std::find(LoopLabels.begin(), LoopLabels.end(), IdentifierStr) !=
+          LoopLabels.end()) {
+    Label = IdentifierStr;
+    getNextToken();
+  }
+
+  if (IsContinue)
+    return std::make_unique<ContinueExprAST>(BreakLoc, Label);
+
+  std::unique_ptr<ExprAST> Value;
+  if (CurLoc.Line == BreakLoc.Line && StartsBreakValue()) {
+    Value = ParseExpression();
+    if (!Value)
+      return nullptr;
+  }
+  return std::make_unique<BreakExprAST>(BreakLoc, Label, std::move(Value));
+}
+
+std::unique_ptr<ExprAST> ParseVarDecl() {
+  SourceLocation TypeLoc = CurLoc;
+  std::string TypeName = IdentifierStr;
+  KirkType Type = TokenToKirkType(CurTok);
+  getNextToken();
+
+  // A vector type followed by '(' is a constructor, like vec4d(0.0)
+  if (isVectorType(Type) && CurTok == '(') {
+    std::vector<std::unique_ptr<ExprAST>> Args;
+    if (!ParseCallArguments(TypeName, Args))
+      return nullptr;
+    return std::make_unique<VectorExprAST>(TypeLoc, Type, std::move(Args));
+  }
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected identifier after type");
+    return nullptr;
+  }
+
+  std::string Name = IdentifierStr;
+  SourceLocation NameLoc = CurLoc;
+  getNextToken();
+
+  if (CurTok != TOK_ASSIGN) {
+    LogErrorAt(CurLoc, "Expected '=' after variable name");
+    return nullptr;
+  }
+
+  getNextToken();
+  auto Init = ParseExpression();
+  if (!Init)
+    return nullptr;
+
+  return std::make_unique<VarDeclExprAST>(NameLoc, Name, Type,
+                                          std::move(Init));
+}
+
+// view int ids = mmap("ids.bin"), only as a top-level statement: the file
+// is mapped once, when the statement runs
+std::unique_ptr<ExprAST> ParseViewDecl() {
+  SourceLocation ViewLoc = CurLoc;
+  getNextToken(); // eat 'view'
+
+  if (CurTok != TOK_TYPE_INT && CurTok != TOK_TYPE_DOUBLE) {
+    LogErrorAt(CurLoc, "Expected 'int' or 'double' after 'view'");
+    return nullptr;
+  }
+  KirkType ElementType = TokenToKirkType(CurTok);
+  getNextToken();
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected identifier after view type");
+    return nullptr;
+  }
+  std::string Name = IdentifierStr;
+  SourceLocation NameLoc = CurLoc;
+  getNextToken();
+
+  if (CurTok != TOK_ASSIGN) {
+    LogErrorAt(CurLoc, "Expected '=' after view name");
+    return nullptr;
+  }
+  getNextToken();
+
+  if (CurTok != TOK_IDENTIFIER || IdentifierStr != "mmap") {
+    LogErrorAt(CurLoc, "Expected mmap(\"file\") after '='");
+    return nullptr;
+  }
+  getNextToken();
+
+  if (CurTok != '(') {
+    LogErrorAt(CurLoc, "Expected '(' after mmap");
+    return nullptr;
+  }
+  getNextToken();
+
+  if (CurTok != TOK_STRING) {
+    LogErrorAt(CurLoc, "Expected a file name in quotes in mmap()");
+    return nullptr;
+  }
+  std::string Path = StringVal;
+  getNextToken();
+
+  if (CurTok != ')') {
+    LogErrorAt(CurLoc, "Expected ')' after the file name");
+    return nullptr;
+  }
+  getNextToken();
+
+  if (ExpressionDepth > 1) {
+    LogErrorAt(ViewLoc, "Views can only be declared at top level");
+    return nullptr;
+  }
+
+  return std::make_unique<ViewDeclExprAST>(NameLoc, Name, ElementType, Path);
+}
+
+// struct Particle { double x, double v, int id }, only as a top-level
+// statement. Fields are ints, doubles or bools, separated by commas.
+std::unique_ptr<ExprAST> ParseStructDecl() {
+  SourceLocation StructLoc = CurLoc;
+  getNextToken(); // eat 'struct'
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected a name after 'struct'");
+    return nullptr;
+  }
+  RecordType Record;
+  Record.Name = IdentifierStr;
+  SourceLocation NameLoc = CurLoc;
+  getNextToken();
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after the struct name");
+    return nullptr;
+  }
+  getNextToken();
+
+  while (CurTok != '}') {
+    if (CurTok != TOK_TYPE_INT && CurTok != TOK_TYPE_DOUBLE &&
+        CurTok != TOK_TYPE_BOOL) {
+      LogErrorAt(CurLoc, "Expected a field type: int, double or bool");
+      return nullptr;
+    }
+    KirkType FieldType = TokenToKirkType(CurTok);
+    getNextToken();
+
+    if (CurTok != TOK_IDENTIFIER) {
+      LogErrorAt(CurLoc, "Expected a field name after its type");
+      return nullptr;
+    }
+    if (Record.getFieldIndex(IdentifierStr) >= 0) {
+      LogErrorAt(CurLoc, "Field '" + IdentifierStr + "' is declared twice");
+      return nullptr;
+    }
+    Record.Fields.push_back({IdentifierStr, FieldType});
+    getNextToken();
+
+    if (CurTok == ',') {
+      getNextToken();
+    } else if (CurTok != '}') {
+      LogErrorAt(CurLoc, "Expected ',' or '}' after a field");
+      return nullptr;
+    }
+  }
+  getNextToken(); // eat '}'
+
+  if (Record.Fields.empty()) {
+    LogErrorAt(NameLoc, "Struct '" + Record.Name + "' has no fields");
+    return nullptr;
+  }
+  if (RecordTypes.count(Record.Name)) {
+    LogErrorAt(NameLoc, "Struct '" + Record.Name + "' is already declared");
+    return nullptr;
+  }
+  if (ExpressionDepth > 1) {
+    LogErrorAt(StructLoc, "Structs can only be declared at top level");
+    return nullptr;
+  }
+
+  const RecordType *Registered = &(RecordTypes[Record.Name] = Record);
+  EntryRecordTypes.push_back(Record.Name);
+  return std::make_unique<StructDeclExprAST>(NameLoc, Registered);
+}
+
+// Particle p, or Particle[1000] ps layout(soa) for a collection, only as a
+// top-level statement. The layout must be on the same line as the name,
+// since newlines don't end statements.
+static std::unique_ptr<ExprAST> ParseRecordDecl(const RecordType &Record,
+                                                SourceLocation TypeLoc) {
+  long long Size = 0;
+  if (CurTok == '[') {
+    getNextToken();
+    if (CurTok != TOK_INT_LITERAL || IntVal < 1 || IntVal > (1LL << 32)) {
+      LogErrorAt(CurLoc, "Expected the collection size, an integer "
+                         "constant from 1 to 4294967296");
+      return nullptr;
+    }
+    Size = IntVal;
+    getNextToken();
+
+    if (CurTok != ']') {
+      LogErrorAt(CurLoc, "Expected ']' after the collection size");
+      return nullptr;
+    }
+    getNextToken();
+  }
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected a name after '" + Record.Name + "'");
+    return nullptr;
+  }
+  std::string Name = IdentifierStr;
+  SourceLocation NameLoc = CurLoc;
+  getNextToken();
+
+  RecordLayout Layout = LAYOUT_AOS;
+  if (CurTok == TOK_IDENTIFIER && IdentifierStr == "layout" &&
+      CurLoc.Line == NameLoc.Line) {
+    if (Size == 0) {
+      LogErrorAt(CurLoc, "Only collections have a layout, like \"" +
+                             Record.Name + "[100] " + Name +
+                             " layout(soa)\"");
+      return nullptr;
+    }
+    getNextToken();
+
+    if (CurTok != '(') {
+      LogErrorAt(CurLoc, "Expected '(' after 'layout'");
+      return nullptr;
+    }
+    getNextToken();
+
+    if (CurTok != TOK_IDENTIFIER ||
+        (IdentifierStr != "aos" && IdentifierStr != "soa")) {
+      LogErrorAt(CurLoc, "Expected 'aos' or 'soa' in layout()");
+      return nullptr;
+    }
+    Layout = IdentifierStr == "soa" ? LAYOUT_SOA : LAYOUT_AOS;
+    getNextToken();
+
+    if (CurTok != ')') {
+      LogErrorAt(CurLoc, "Expected ')' after the layout");
+      return nullptr;
+    }
+    getNextToken();
+  }
+
+  if (CurTok == TOK_ASSIGN) {
+    LogErrorAt(CurLoc, "Records start zeroed and can't be assigned as a "
+                       "whole; assign their fields, like " +
+                           Name + (Size ? "[i]" : "") + "." +
+                           Record.Fields[0].Name + " = ...");
+    return nullptr;
+  }
+  if (ExpressionDepth > 1) {
+    LogErrorAt(TypeLoc, "Records can only be declared at top level");
+    return nullptr;
+  }
+
+  return std::make_unique<RecordDeclExprAST>(NameLoc, Name, &Record, Size,
+                                             Layout);
+}
+
+static bool IsValueTypeToken(int Tok) {
+  return Tok == TOK_TYPE_INT || Tok == TOK_TYPE_DOUBLE ||
+         Tok == TOK_TYPE_BOOL || Tok == TOK_TYPE_VECTOR;
+}
+
+// generator int evens(int n) { ... }, only as a top-level statement. The
+// generator is registered after its body, so it can't consume itself.
+std::unique_ptr<ExprAST> ParseGeneratorDecl() {
+  SourceLocation GeneratorLoc = CurLoc;
+  getNextToken(); // eat 'generator'
+
+  if (!IsValueTypeToken(CurTok)) {
+    LogErrorAt(CurLoc, "Expected the type of the values the generator "
+                       "yields, like \"generator int evens(int n)\"");
+    return nullptr;
+  }
+  GeneratorDef Def;
+  Def.YieldType = TokenToKirkType(CurTok);
+  getNextToken();
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected the generator's name after its type");
+    return nullptr;
+  }
+  std::string Name = IdentifierStr;
+  Def.Name = Name;
+  Def.Loc = CurLoc;
+  getNextToken();
+
+  if (CurTok != '(') {
+    LogErrorAt(CurLoc, "Expected '(' after the generator's name");
+    return nullptr;
+  }
+  getNextToken();
+
+  while (CurTok != ')') {
+    if (!IsValueTypeToken(CurTok)) {
+      LogErrorAt(CurLoc, "Expected a parameter type, like \"int n\"");
+      return nullptr;
+    }
+    KirkType ParamType = TokenToKirkType(CurTok);
+    getNextToken();
+
+    if (CurTok != TOK_IDENTIFIER) {
+      LogErrorAt(CurLoc, "Expected a parameter name after its type");
+      return nullptr;
+    }
+    for (const GeneratorParam &Param : Def.Params) {
+      if (Param.Name == IdentifierStr) {
+        LogErrorAt(CurLoc, "Parameter '" + IdentifierStr +
+                               "' is declared twice");
+        return nullptr;
+      }
+    }
+    Def.Params.push_back({IdentifierStr, ParamType});
+    getNextToken();
+
+    if (CurTok == ',') {
+      getNextToken();
+    } else if (CurTok != ')') {
+      LogErrorAt(CurLoc, "Expected ',' or ')' after a parameter");
+      return nullptr;
+    }
+  }
+  getNextToken(); // eat ')'
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after the generator's parameters");
+    return nullptr;
+  }
+  Def.Body = ParseBlock();
+  if (!Def.Body)
+    return nullptr;
+
+  if (Generators.count(Name)) {
+    LogErrorAt(Def.Loc, "Generator '" + Name + "' is already declared");
+    return nullptr;
+  }
+  if (ExpressionDepth > 1) {
+    LogErrorAt(GeneratorLoc, "Generators can only be declared at top level");
+    return nullptr;
+  }
+
+  GeneratorDef *Registered = &(Generators[Name] = std::move(Def));
+  return std::make_unique<GeneratorDeclExprAST>(Registered->Loc, Registered);
+}
+
+// yield v, which Sema only accepts in a generator's body
+std::unique_ptr<ExprAST> ParseYieldExpr() {
+  SourceLocation YieldLoc = CurLoc;
+  getNextToken(); // eat 'yield'
+
+  auto Operand = ParseExpression();
+  if (!Operand)
+    return nullptr;
+  return std::make_unique<YieldExprAST>(YieldLoc, std::move(Operand));
+}
+
+// export int total = 0, only as a top-level statement: modules importing
+// this file can read the variable
+std::unique_ptr<ExprAST> ParseExportDecl() {
+  SourceLocation ExportLoc = CurLoc;
+  getNextToken(); // eat 'export'
+
+  if (CurTok != TOK_TYPE_INT && CurTok != TOK_TYPE_DOUBLE &&
+      CurTok != TOK_TYPE_BOOL && CurTok != TOK_TYPE_VECTOR) {
+    LogErrorAt(CurLoc, "Expected a variable declaration after 'export'");
+    return nullptr;
+  }
+
+  auto Decl = ParseVarDecl();
+  if (!Decl)
+    return nullptr;
+
+  auto *VarDecl = dynamic_cast<VarDeclExprAST *>(Decl.get());
+  if (!VarDecl) {
+    LogErrorAt(ExportLoc, "Expected a variable declaration after 'export'");
+    return nullptr;
+  }
+
+  if (ExpressionDepth > 1) {
+    LogErrorAt(ExportLoc, "Only top-level variables can be exported");
+    return nullptr;
+  }
+
+  VarDecl->setExported();
+  return Decl;
+}
+
+// Parses "reduce(+: sum, max: best)" into Reductions
+static bool ParseReductionClauses(std::vector<ReductionClause> &Reductions) {
+  getNextToken(); // eat 'reduce'
+
+  if (CurTok != '(') {
+    LogErrorAt(CurLoc, "Expected '(' after 'reduce'");
+    return false;
+  }
+  getNextToken();
+
+  while (true) {
+    ReductionOp Op;
+    if (CurTok == '+') {
+      Op = REDUCE_ADD;
+    } else if (CurTok == '*') {
+      Op = REDUCE_MUL;
+    } else if (CurTok == TOK_IDENTIFIER && IdentifierStr == "min") {
+      Op = REDUCE_MIN;
+    } else if (CurTok == TOK_IDENTIFIER && IdentifierStr == "max") {
+      Op = REDUCE_MAX;
+    } else {
+      LogErrorAt(CurLoc,
+                 "Expected reduction operator '+', '*', 'min' or 'max'");
+      return false;
+    }
+    getNextToken();
+
+    if (CurTok != ':') {
+      LogErrorAt(CurLoc, "Expected ':' after reduction operator");
+      return false;
+    }
+    getNextToken();
+
+    if (CurTok != TOK_IDENTIFIER) {
+      LogErrorAt(CurLoc, "Expected variable name in reduction");
+      return false;
+    }
+    Reductions.push_back({Op, IdentifierStr, CurLoc});
+    getNextToken();
+
+    if (CurTok != ',')
+      break;
+    getNextToken();
+  }
+
+  if (CurTok != ')') {
+    LogErrorAt(CurLoc, "Expected ')' after reduction list");
+    return false;
+  }
+  getNextToken();
+  return true;
+}
+
+// The rest of "for x in evens(100) { ... }", with CurTok on the name
+static std::unique_ptr<ExprAST> ParseGeneratorLoop(SourceLocation ForLoc,
+                                                   const std::string &VarName,
+                                                   GeneratorDef &Def) {
+  SourceLocation CallLoc = CurLoc;
+  getNextToken(); // eat the name
+
+  if (CurTok != '(') {
+    LogErrorAt(CurLoc, "Expected '(' and the arguments after generator '" +
+                           Def.Name + "'");
+    return nullptr;
+  }
+  std::vector<std::unique_ptr<ExprAST>> Args;
+  if (!ParseCallArguments(Def.Name, Args))
+    return nullptr;
+
+  // The body is still parsed after a wrong number of arguments, so its
+  // statements aren't reported as errors of their own
+  size_t Expected = Def.Params.size();
+  bool ArgsOK = Args.size() == Expected;
+  if (!ArgsOK)
+    LogErrorAt(CallLoc, Def.Name + " takes " + std::to_string(Expected) +
+                            (Expected == 1 ? " argument" : " arguments") +
+                            ", but " + std::to_string(Args.size()) +
+                            (Args.size() == 1 ? " was" : " were") + " given");
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after the generator's arguments");
+    return nullptr;
+  }
+  auto Body = ParseBlock();
+  if (!Body || !ArgsOK)
+    return nullptr;
+
+  return std::make_unique<GeneratorForExprAST>(ForLoc, VarName, &Def,
+                                               std::move(Args),
+                                               std::move(Body));
+}
+
+std::unique_ptr<ExprAST> ParseForExpr() {
+  SourceLocation ForLoc = CurLoc;
+  getNextToken(); // eat 'for'
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected loop variable name after 'for'");
+    return nullptr;
+  }
+  std::string VarName = IdentifierStr;
+  getNextToken();
+
+  if (CurTok != TOK_IN) {
+    LogErrorAt(CurLoc, "Expected 'in' after loop variable");
+    return nullptr;
+  }
+  getNextToken();
+
+  // A generator's name starts a generator loop, never a range
+  if (CurTok == TOK_IDENTIFIER) {
+    auto Generator = Generators.find(IdentifierStr);
+    if (Generator != Generators.end())
+      return ParseGeneratorLoop(ForLoc, VarName, Generator->second);
+  }
+
+  auto Start = ParseExpression();
+  if (!Start)
+    return nullptr;
+
+  if (CurTok != TOK_RANGE) {
+    LogErrorAt(CurLoc, "Expected '..' in loop range");
+    return nullptr;
+  }
+  getNextToken();
+
+  auto End = ParseExpression();
+  if (!End)
+    return nullptr;
+
+  long long Step = 1;
+  if (CurTok == TOK_IDENTIFIER && IdentifierStr == "step") {
+    SourceLocation StepLoc = CurLoc;
+    getNextToken();
+
+    bool Negative = CurTok == '-';
+    if (Negative)
+      getNextToken();
+
+    if (CurTok != TOK_INT_LITERAL || IntVal == 0) {
+      LogErrorAt(StepLoc, "The step of a for loop must be a nonzero integer "
+                          "constant, like 'step 2' or 'step -1'");
+      return nullptr;
+    }
+    Step = Negative ? -IntVal : IntVal;
+    getNextToken();
+  }
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after for range");
+    return nullptr;
+  }
+
+  auto Body = ParseBlock();
+  if (!Body)
+    return nullptr;
+
+  return std::make_unique<ForExprAST>(ForLoc, VarName, std::move(Start),
+                                      std::move(End), Step, std::move(Body));
+}
+
+std::unique_ptr<ExprAST> ParseParallelForExpr() {
+  SourceLocation ParallelLoc = CurLoc;
+  getNextToken(); // eat 'parallel'
+
+  if (CurTok != TOK_FOR) {
+    LogErrorAt(CurLoc, "Expected 'for' after 'parallel'");
+    return nullptr;
+  }
+  getNextToken();
+
+  if (CurTok != TOK_IDENTIFIER) {
+    LogErrorAt(CurLoc, "Expected loop variable name after 'for'");
+    return nullptr;
+  }
+  std::string VarName = IdentifierStr;
+  getNextToken();
+
+  if (CurTok != TOK_IN) {
+    LogErrorAt(CurLoc, "Expected 'in' after loop variable");
+    return nullptr;
+  }
+  getNextToken();
+
+  auto Start = ParseExpression();
+  if (!Start)
+    return nullptr;
+
+  if (CurTok != TOK_RANGE) {
+    LogErrorAt(CurLoc, "Expected '..' in loop range");
+    return nullptr;
+  }
+  getNextToken();
+
+  auto End = ParseExpression();
+  if (!End)
+    return nullptr;
+
+  std::vector<ReductionClause> Reductions;
+  if (CurTok == TOK_IDENTIFIER && IdentifierStr == "reduce") {
+    if (!ParseReductionClauses(Reductions))
+      return nullptr;
+  }
+
+  if (CurTok != '{') {
+    LogErrorAt(CurLoc, "Expected '{' after parallel for range");
+    return nullptr;
+  }
+
+  auto Body = ParseBlock();
+  if (!Body)
+    return nullptr;
+
+  return std::make_unique<ParallelForExprAST>(
+      ParallelLoc, VarName, std::move(Start), std::move(End),
+      std::move(Reductions), std::move(Body));
 }
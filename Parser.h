@@ -11,5 +11,10 @@ void InitializePrecedence();
 
 std::unique_ptr<ExprAST> ParseExpression();
 std::unique_ptr<ExprAST> Parse();
+// Drops the state of a statement abandoned halfway by an error, and the
+// structs declared by the rejected entry, so the REPL can parse its next one
+void ResetParser();
+// Keeps the structs declared by an entry the REPL has run
+void KeepParsedDeclarations();
 
 #endif
@@ -0,0 +1,122 @@
+#include "Profiler.h"
+#include "Codegen.h"
+#include "llvm/IR/Intrinsics.h"
+#include <vector>
+
+using namespace llvm;
+
+bool ProfilingEnabled = false;
+
+struct ProfileSite {
+  SourceLocation Loc;
+  ProfileSiteKind Kind;
+  GlobalVariable *Counters;
+};
+
+static std::vector<ProfileSite> ProfileSites;
+
+// { entries, iterations, cycles }, mirrored by KirkProfileCounters at runtime
+static StructType *getCountersType() {
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  return StructType::get(*TheContext, {I64, I64, I64});
+}
+
+// { line, col, kind, source text, counters }, mirrored by KirkProfileSite
+static StructType *getSiteType() {
+  Type *I32 = Type::getInt32Ty(*TheContext);
+  Type *Ptr = PointerType::getUnqual(*TheContext);
+  return StructType::get(*TheContext, {I32, I32, I32, Ptr, Ptr});
+}
+
+// rdtsc on x86, the cheapest monotonic-ish counter LLVM can give us
+static Value *ReadCycleCounter() {
+  Function *CounterFunc = Intrinsic::getOrInsertDeclaration(
+      TheModule.get(), Intrinsic::readcyclecounter);
+  return Builder->CreateCall(CounterFunc, {}, "cycles");
+}
+
+// Atomic, since loops inside a parallel for body update the same site from
+// several threads. Monotonic is enough: the report only reads the totals
+// after the threads have joined.
+static void AddToCounter(GlobalVariable *Counters, unsigned Field,
+                         Value *Delta) {
+  Value *Ptr = Builder->CreateStructGEP(getCountersType(), Counters, Field);
+  Builder->CreateAtomicRMW(AtomicRMWInst::Add, Ptr, Delta, MaybeAlign(8),
+                           AtomicOrdering::Monotonic);
+}
+
+ProfileProbe BeginProfileProbe(SourceLocation Loc, ProfileSiteKind Kind) {
+  auto *Counters = new GlobalVariable(
+      *TheModule, getCountersType(), false, GlobalValue::InternalLinkage,
+      Constant::getNullValue(getCountersType()), "kirk.prof.site");
+  ProfileSites.push_back({Loc, Kind, Counters});
+
+  ProfileProbe Probe;
+  Probe.Site = ProfileSites.size() - 1;
+
+  // The trip count lives in an entry-block alloca so mem2reg keeps it in a
+  // register; the global is only touched once per loop execution.
+  if (Kind == PROFILE_LOOP) {
+    Function *TheFunction = Builder->GetInsertBlock()->getParent();
+    Probe.Trips = CreateEntryBlockAlloca(TheFunction, "proftrips", KIRK_INT);
+    Builder->CreateStore(ConstantInt::get(Type::getInt64Ty(*TheContext), 0),
+                         Probe.Trips);
+  }
+
+  Probe.StartCycles = ReadCycleCounter();
+  return Probe;
+}
+
+void CountProfileTrip(const ProfileProbe &Probe) {
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  Value *Trips = Builder->CreateLoad(I64, Probe.Trips, "proftrips");
+  Builder->CreateStore(
+      Builder->CreateAdd(Trips, ConstantInt::get(I64, 1), "proftrips"),
+      Probe.Trips);
+}
+
+void EndProfileProbe(const ProfileProbe &Probe) {
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  Value *Elapsed =
+      Builder->CreateSub(ReadCycleCounter(), Probe.StartCycles, "profcycles");
+
+  Value *Iterations = ConstantInt::get(I64, 1);
+  if (Probe.Trips)
+    Iterations = Builder->CreateLoad(I64, Probe.Trips, "proftrips");
+
+  GlobalVariable *Counters = ProfileSites[Probe.Site].Counters;
+  AddToCounter(Counters, 0, ConstantInt::get(I64, 1));
+  AddToCounter(Counters, 1, Iterations);
+  AddToCounter(Counters, 2, Elapsed);
+}
+
+void EmitProfileReport() {
+  if (ProfileSites.empty())
+    return;
+
+  Type *I32 = Type::getInt32Ty(*TheContext);
+  Type *I64 = Type::getInt64Ty(*TheContext);
+  StructType *SiteTy = getSiteType();
+
+  std::vector<Constant *> Sites;
+  for (const ProfileSite &Site : ProfileSites) {
+    Constant *Source =
+        Builder->CreateGlobalString(GetSourceSnippet(Site.Loc), "profsrc");
+    Sites.push_back(ConstantStruct::get(
+        SiteTy, {ConstantInt::get(I32, Site.Loc.Line),
+                 ConstantInt::get(I32, Site.Loc.Col),
+                 ConstantInt::get(I32, Site.Kind), Source, Site.Counters}));
+  }
+
+  ArrayType *TableTy = ArrayType::get(SiteTy, Sites.size());
+  auto *Table = new GlobalVariable(*TheModule, TableTy, true,
+                                   GlobalValue::InternalLinkage,
+                                   ConstantArray::get(TableTy, Sites),
+                                   "kirk.prof.sites");
+
+  FunctionCallee ReportFunc = TheModule->getOrInsertFunction(
+      "kirk_profile_report", Type::getVoidTy(*TheContext),
+      PointerType::getUnqual(*TheContext), I64);
+  Builder->CreateCall(ReportFunc,
+                      {Table, ConstantInt::get(I64, Sites.size())});
+}
@@ -0,0 +1,29 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "Lexer.h"
+#include "llvm/IR/Instructions.h"
+
+// Set by `--instrument`: wrap loops and top-level statements with probes
+extern bool ProfilingEnabled;
+
+// What a profiling site measures. Must match the runtime's report labels.
+enum ProfileSiteKind { PROFILE_STATEMENT = 0, PROFILE_LOOP = 1 };
+
+// Handle for one probe, from the point it is opened until it is closed
+struct ProfileProbe {
+  unsigned Site = 0;
+  llvm::Value *StartCycles = nullptr;
+  llvm::AllocaInst *Trips = nullptr; // Only used by loop probes
+};
+
+// Reads the cycle counter and registers a new site at Loc
+ProfileProbe BeginProfileProbe(SourceLocation Loc, ProfileSiteKind Kind);
+// Counts one iteration of a loop probe (emit at the top of the loop body)
+void CountProfileTrip(const ProfileProbe &Probe);
+// Reads the cycle counter again and adds the deltas to the site counters
+void EndProfileProbe(const ProfileProbe &Probe);
+// Emits the site table and the call to the runtime report (end of main)
+void EmitProfileReport();
+
+#endif
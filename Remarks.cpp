@@ -0,0 +1,177 @@
+#include "Remarks.h"
+#include "Lexer.h"
+#include "SizeReport.h"
+#include "llvm/IR/DiagnosticHandler.h"
+#include "llvm/IR/DiagnosticInfo.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <tuple>
+#include <vector>
+
+using namespace llvm;
+
+bool MissedRemarksEnabled = false;
+bool PassedRemarksEnabled = false;
+std::string RemarksPath = "remarks.json";
+
+// Passes whose remarks are collected
+static bool IsReportedPass(StringRef PassName) {
+  return PassName == "loop-vectorize" || PassName == "loop-unroll" ||
+         PassName == "licm" || PassName == "gvn" || PassName == "inline";
+}
+
+namespace {
+struct Remark {
+  unsigned Line, Col; // 0:0 if the remark has no location
+  std::string Pass;   // "loop-vectorize", ...
+  std::string Kind;   // "analysis", "missed" or "passed"
+  std::string Name;   // The pass's identifier for the remark, "NotBeneficial"
+  std::string Function;
+  std::string Message;
+
+  auto getKey() const { return std::tie(Line, Col, Pass, Kind, Message); }
+};
+
+class RemarkCollector : public DiagnosticHandler {
+public:
+  bool isAnalysisRemarkEnabled(StringRef PassName) const override {
+    return MissedRemarksEnabled && IsReportedPass(PassName);
+  }
+  bool isMissedOptRemarkEnabled(StringRef PassName) const override {
+    return MissedRemarksEnabled && IsReportedPass(PassName);
+  }
+  bool isPassedOptRemarkEnabled(StringRef PassName) const override {
+    return PassedRemarksEnabled && IsReportedPass(PassName);
+  }
+  bool isAnyRemarkEnabled() const override {
+    return MissedRemarksEnabled || PassedRemarksEnabled;
+  }
+
+  bool handleDiagnostics(const DiagnosticInfo &DI) override;
+};
+} // namespace
+
+// Filled by the backend threads
+static std::mutex RemarksMutex;
+static std::vector<Remark> Remarks;
+
+bool RemarkCollector::handleDiagnostics(const DiagnosticInfo &DI) {
+  auto *Optimization = dyn_cast<DiagnosticInfoOptimizationBase>(&DI);
+  if (!Optimization)
+    return false; // Errors and warnings are printed as usual
+
+  // Remarks forced on by a pass (like the vectorizer's reasons for ignoring
+  // @vectorize) still respect the kinds asked for
+  if (!Optimization->isEnabled() ||
+      (Optimization->isPassed() ? !PassedRemarksEnabled
+                                : !MissedRemarksEnabled))
+    return true;
+
+  // Calls into the runtime (printf, kirk_read_int, ...) can never be
+  // inlined, and saying so for each of them is only noise
+  if (Optimization->getRemarkName() == "NoDefinition")
+    return true;
+
+  Remark R;
+  R.Line = R.Col = 0;
+  if (Optimization->isLocationAvailable()) {
+    DiagnosticLocation Loc = Optimization->getLocation();
+    R.Line = Loc.getLine();
+    R.Col = Loc.getColumn();
+  }
+  R.Kind = Optimization->isPassed()   ? "passed"
+           : Optimization->isMissed() ? "missed"
+                                      : "analysis";
+  R.Pass = std::string(Optimization->getPassName());
+  R.Name = Optimization->getRemarkName().str();
+  R.Function = Optimization->getFunction().getName().str();
+  R.Message = Optimization->getMsg();
+
+  std::lock_guard<std::mutex> Lock(RemarksMutex);
+  Remarks.push_back(std::move(R));
+  return true;
+}
+
+bool ParseRemarkKinds(const std::string &Kinds) {
+  std::istringstream List(Kinds);
+  std::string Kind;
+  while (std::getline(List, Kind, ',')) {
+    if (Kind == "missed") {
+      MissedRemarksEnabled = true;
+    } else if (Kind == "passed") {
+      PassedRemarksEnabled = true;
+    } else {
+      std::cerr << "Error: Unknown remark kind '" << Kind
+                << "' (expected missed or passed)\n";
+      return false;
+    }
+  }
+  if (!MissedRemarksEnabled && !PassedRemarksEnabled) {
+    std::cerr << "Error: Expected missed and/or passed after --remarks=\n";
+    return false;
+  }
+  return true;
+}
+
+void CollectRemarks(LLVMContext &Context) {
+  Context.setDiagnosticHandler(std::make_unique<RemarkCollector>());
+}
+
+void WriteRemarks(const std::string &InputPath) {
+  // Multiversioned clones and the copy compiled for output.ll repeat the
+  // same remarks
+  std::stable_sort(Remarks.begin(), Remarks.end(),
+                   [](const Remark &A, const Remark &B) {
+                     return A.getKey() < B.getKey();
+                   });
+  Remarks.erase(std::unique(Remarks.begin(), Remarks.end(),
+                            [](const Remark &A, const Remark &B) {
+                              return A.getKey() == B.getKey();
+                            }),
+                Remarks.end());
+
+  for (const Remark &R : Remarks) {
+    std::string Pass = R.Pass.empty() ? "" : ", " + R.Pass;
+    if (R.Line == 0) {
+      std::cerr << "Remark: " << R.Message << " [" << R.Kind << Pass << "]\n";
+      continue;
+    }
+    std::cerr << "Remark at " << R.Line << ":" << R.Col << ": " << R.Message
+              << " [" << R.Kind << Pass << "]\n";
+    ShowSourceLine({(int)R.Line, (int)R.Col});
+  }
+
+  std::error_code EC;
+  raw_fd_ostream Out(RemarksPath, EC);
+  if (EC) {
+    std::cerr << "Error writing " << RemarksPath << ": " << EC.message()
+              << "\n";
+    return;
+  }
+
+  Out << "{\n";
+  Out << "  \"file\": \"" << EscapeJSON(InputPath) << "\",\n";
+  Out << "  \"remarks\": [";
+  for (size_t i = 0; i < Remarks.size(); ++i) {
+    const Remark &R = Remarks[i];
+    Out << (i == 0 ? "\n" : ",\n");
+    Out << "    {\"line\": " << R.Line << ", \"col\": " << R.Col
+        << ", \"kind\": \"" << R.Kind << "\", \"pass\": \""
+        << EscapeJSON(R.Pass) << "\", \"name\": \"" << EscapeJSON(R.Name)
+        << "\", \"function\": \"" << EscapeJSON(R.Function)
+        << "\", \"message\": \"" << EscapeJSON(R.Message)
+        << "\", \"source\": \""
+        << EscapeJSON(GetSourceSnippet({(int)R.Line, (int)R.Col}, 80))
+        << "\"}";
+  }
+  Out << "\n  ]\n}\n";
+
+  std::printf("%zu remark(s) written to %s\n", Remarks.size(),
+              RemarksPath.c_str());
+}
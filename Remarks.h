@@ -0,0 +1,33 @@
+#ifndef REMARKS_H
+#define REMARKS_H
+
+#include <string>
+
+namespace llvm {
+class LLVMContext;
+} // namespace llvm
+
+// `--remarks=missed,passed`: collects the optimization remarks of the loop
+// vectorizer, the loop unroller, LICM, GVN and the inliner while the module
+// is optimized, and reports them at the Kirk source locations they are
+// about (through the debug locations from DebugInfo.h).
+
+// Which remarks to collect. Missed remarks come with the analysis remarks
+// that explain them ("cannot identify array bounds"). Both false when the
+// report is off.
+extern bool MissedRemarksEnabled;
+extern bool PassedRemarksEnabled;
+// Where the JSON dump goes (`--remarks-file=`, default "remarks.json")
+extern std::string RemarksPath;
+
+// Parses the kinds of `--remarks=missed,passed`. Returns false (after
+// printing why) for an unknown kind.
+bool ParseRemarkKinds(const std::string &Kinds);
+// Records the remarks the passes emit into Context from now on. Each
+// backend thread installs it on its own context.
+void CollectRemarks(llvm::LLVMContext &Context);
+// Prints every remark with its source line, in source order, and writes
+// the JSON dump
+void WriteRemarks(const std::string &InputPath);
+
+#endif
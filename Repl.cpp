@@ -0,0 +1,379 @@
+#include "Repl.h"
+#include "AST.h"
+#include "Backend.h"
+#include "Codegen.h"
+#include "Lexer.h"
+#include "Parser.h"
+#include "Sema.h"
+#include "TopLevel.h"
+#include "llvm/ExecutionEngine/Orc/AbsoluteSymbols.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+using namespace llvm;
+using namespace llvm::orc;
+
+// The runtime (runtime/Runtime.cpp) is linked into the compiler itself for
+// the REPL. These are the entry points JIT-compiled code may call.
+extern "C" {
+void kirk_parallel_for(int64_t Lo, int64_t Hi,
+                       void (*Body)(int64_t, int64_t, void *), void *Env);
+void kirk_parallel_lock();
+void kirk_parallel_unlock();
+int64_t kirk_clock_ns();
+int64_t *kirk_bench_begin(int64_t Total);
+void kirk_bench_end(const char *Name, int64_t *Samples, int64_t Total,
+                    int64_t Warmup);
+void *kirk_map_file(const char *Path, int64_t ElementSize, int64_t *Length);
+}
+
+namespace {
+// A variable or view declared by an earlier entry, by the globals its module
+// defines
+struct ReplSymbol {
+  KirkType Type;            // The element type for views
+  std::string Global;       // The value, or a view's base pointer
+  std::string LengthGlobal; // Views only
+};
+
+// A record or a collection declared by an earlier entry, and its globals
+struct ReplRecord {
+  const RecordType *Record;
+  long long CollectionSize;
+  RecordLayout Layout;
+  std::vector<std::string> Globals;
+};
+} // namespace
+
+static std::map<std::string, ReplSymbol> Variables;
+static std::map<std::string, ReplSymbol> Views;
+static std::map<std::string, ReplRecord> Records;
+static unsigned EntryCount = 0;
+
+static std::unique_ptr<LLJIT> CreateJIT() {
+  auto JTMB = JITTargetMachineBuilder::detectHost();
+  if (!JTMB) {
+    std::cerr << "Error: " << toString(JTMB.takeError()) << "\n";
+    return nullptr;
+  }
+  JTMB->setCodeGenOptLevel(getCodeGenOptLevel());
+
+  // The optimizer runs on every module before the JIT generates its code
+  auto TM = JTMB->createTargetMachine();
+  if (!TM) {
+    std::cerr << "Error: " << toString(TM.takeError()) << "\n";
+    return nullptr;
+  }
+
+  auto JIT = LLJITBuilder().setJITTargetMachineBuilder(std::move(*JTMB)).create();
+  if (!JIT) {
+    std::cerr << "Error: " << toString(JIT.takeError()) << "\n";
+    return nullptr;
+  }
+
+  std::shared_ptr<TargetMachine> Optimizer = std::move(*TM);
+  (*JIT)->getIRTransformLayer().setTransform(
+      [Optimizer](ThreadSafeModule TSM, MaterializationResponsibility &)
+          -> Expected<ThreadSafeModule> {
+        TSM.withModuleDo([&](Module &M) { OptimizeModule(M, *Optimizer); });
+        return TSM;
+      });
+
+  // printf and libm come from the process, the Kirk runtime from the table
+  // above
+  JITDylib &Main = (*JIT)->getMainJITDylib();
+  Main.addGenerator(
+      cantFail(DynamicLibrarySearchGenerator::GetForCurrentProcess(
+          (*JIT)->getDataLayout().getGlobalPrefix())));
+
+  MangleAndInterner Mangle((*JIT)->getExecutionSession(),
+                           (*JIT)->getDataLayout());
+  SymbolMap Runtime;
+  auto AddRuntimeSymbol = [&](const char *Name, auto *Address) {
+    Runtime[Mangle(Name)] = {ExecutorAddr::fromPtr(Address),
+                             JITSymbolFlags::Exported};
+  };
+  AddRuntimeSymbol("kirk_parallel_for", &kirk_parallel_for);
+  AddRuntimeSymbol("kirk_parallel_lock", &kirk_parallel_lock);
+  AddRuntimeSymbol("kirk_parallel_unlock", &kirk_parallel_unlock);
+  AddRuntimeSymbol("kirk_clock_ns", &kirk_clock_ns);
+  AddRuntimeSymbol("kirk_bench_begin", &kirk_bench_begin);
+  AddRuntimeSymbol("kirk_bench_end", &kirk_bench_end);
+  AddRuntimeSymbol("kirk_map_file", &kirk_map_file);
+  cantFail(Main.define(absoluteSymbols(std::move(Runtime))));
+
+  return std::move(*JIT);
+}
+
+// Net number of braces and parentheses Line opens, outside strings and
+// comments
+static int CountOpenBrackets(const std::string &Line) {
+  int Open = 0;
+  bool InString = false;
+  for (size_t i = 0; i < Line.size(); ++i) {
+    char C = Line[i];
+    if (InString) {
+      InString = C != '"';
+    } else if (C == '"') {
+      InString = true;
+    } else if (C == '/' && i + 1 < Line.size() && Line[i + 1] == '/') {
+      break;
+    } else if (C == '{' || C == '(') {
+      ++Open;
+    } else if (C == '}' || C == ')') {
+      --Open;
+    }
+  }
+  return Open;
+}
+
+// Reads a line, and more lines while a brace or parenthesis is still open,
+// into Text and SourceLines. Returns false at the end of input.
+static bool ReadEntry(std::string &Text, bool Interactive) {
+  Text.clear();
+  int Open = 0;
+  std::string Line;
+  do {
+    if (Interactive)
+      std::cout << (Text.empty() ? "kirk> " : "  ... ") << std::flush;
+    if (!std::getline(std::cin, Line))
+      return !Text.empty(); // The parser reports the unclosed bracket
+
+    SourceLines.push_back(Line);
+    Text += Line + "\n";
+    Open += CountOpenBrackets(Line);
+  } while (Open > 0);
+  return true;
+}
+
+// Whether the REPL prints the value of a statement: only expressions that
+// compute one, not declarations, assignments, blocks, or loops and
+// benchmarks (which evaluate to 0.0)
+static bool IsEchoed(ExprAST &AST) {
+  return AST.getType() != KIRK_VOID && !dynamic_cast<VarDeclExprAST *>(&AST) &&
+         !dynamic_cast<AssignmentExprAST *>(&AST) &&
+         !dynamic_cast<BlockExprAST *>(&AST) &&
+         !dynamic_cast<WhileExprAST *>(&AST) &&
+         !dynamic_cast<ForExprAST *>(&AST) &&
+         !dynamic_cast<ParallelForExprAST *>(&AST) &&
+         !dynamic_cast<GeneratorForExprAST *>(&AST) &&
+         !dynamic_cast<BenchExprAST *>(&AST) &&
+         !dynamic_cast<FloatModeExprAST *>(&AST);
+}
+
+// Parses and type-checks the statements of one entry. Returns false once the
+// first error has been reported.
+static bool CheckEntry(std::vector<std::unique_ptr<ExprAST>> &Statements) {
+  ErrorRaised = false;
+  int Errors = ErrorCount;
+  getNextToken();
+  while (CurTok != TOK_EOF && ErrorCount == Errors) {
+    if (CurTok == ';') {
+      getNextToken();
+      continue;
+    }
+
+    auto AST = ParseExpression();
+    if (!AST)
+      break;
+    AST->typecheck();
+
+    // A bare expression prints its value. The print node isn't type-checked
+    // again: codegen only needs its operand's type.
+    if (IsEchoed(*AST)) {
+      SourceLocation Loc = AST->getLoc();
+      AST = std::make_unique<PrintExprAST>(Loc, std::move(AST));
+    }
+    Statements.push_back(std::move(AST));
+  }
+  return ErrorCount == Errors && !ErrorRaised;
+}
+
+static GlobalVariable *DeclareGlobal(Type *Ty, const std::string &Name) {
+  return new GlobalVariable(*TheModule, Ty, false,
+                            GlobalValue::ExternalLinkage, nullptr, Name);
+}
+
+// Generates the entry into a new module holding one function, Name, that
+// runs it. Earlier entries' variables, views and records are declared as
+// external globals.
+static bool CompileEntry(std::vector<std::unique_ptr<ExprAST>> &Statements,
+                         const std::string &Name, const LLJIT &JIT) {
+  InitializeModule();
+  TheModule->setDataLayout(JIT.getDataLayout());
+  TheModule->setTargetTriple(JIT.getTargetTriple().str());
+
+  FunctionType *PrintfType =
+      FunctionType::get(Type::getInt32Ty(*TheContext),
+                        {PointerType::getUnqual(*TheContext)}, true);
+  Function::Create(PrintfType, Function::ExternalLinkage, "printf",
+                   TheModule.get());
+
+  NamedValues.clear();
+  for (const auto &[VarName, Var] : Variables)
+    NamedValues[VarName] = {DeclareGlobal(getLLVMType(Var.Type), Var.Global),
+                            Var.Type};
+
+  NamedViews.clear();
+  for (const auto &[ViewName, View] : Views)
+    NamedViews[ViewName] = {
+        DeclareGlobal(PointerType::getUnqual(*TheContext), View.Global),
+        DeclareGlobal(Type::getInt64Ty(*TheContext), View.LengthGlobal),
+        View.Type};
+
+  NamedRecords.clear();
+  for (const auto &[RecordName, Record] : Records) {
+    RecordInfo Info = {Record.Record, Record.CollectionSize, Record.Layout,
+                       {}};
+    std::vector<Type *> Types = getRecordStorageTypes(
+        *Record.Record, Record.CollectionSize, Record.Layout);
+    for (size_t i = 0; i < Types.size(); ++i)
+      Info.Storage.push_back(DeclareGlobal(Types[i], Record.Globals[i]));
+    NamedRecords[RecordName] = Info;
+  }
+
+  FunctionType *EntryType =
+      FunctionType::get(Type::getVoidTy(*TheContext), false);
+  BeginReplEntry(Function::Create(EntryType, Function::ExternalLinkage, Name,
+                                  TheModule.get()));
+  for (auto &AST : Statements)
+    AST->codegen();
+  Builder->CreateRetVoid();
+
+  // The REPL reads stdin itself, so the input builtins would compete with it
+  for (const Function &F : *TheModule) {
+    if (F.getName().starts_with("kirk_read_") ||
+        F.getName() == "kirk_has_input") {
+      LogErrorAt(Statements.front()->getLoc(),
+                 "read_int(), read_double(), read_bool() and has_input() "
+                 "are not available in the REPL");
+      return false;
+    }
+  }
+
+  if (verifyModule(*TheModule, &errs())) {
+    std::cerr << "Error: Generated invalid IR\n";
+    return false;
+  }
+  return true;
+}
+
+// Gives the globals of the variables, views and records the entry declared
+// external linkage, and records them for the following entries
+static void ExportDeclarations() {
+  for (const auto &[VarName, Var] : NamedValues) {
+    auto *Global = dyn_cast<GlobalVariable>(Var.Ptr);
+    if (!Global || Variables.count(VarName))
+      continue;
+    Global->setLinkage(GlobalValue::ExternalLinkage);
+    Variables[VarName] = {Var.Type, Global->getName().str(), ""};
+  }
+
+  for (const auto &[ViewName, View] : NamedViews) {
+    if (Views.count(ViewName))
+      continue;
+    View.Base->setLinkage(GlobalValue::ExternalLinkage);
+    View.Length->setLinkage(GlobalValue::ExternalLinkage);
+    Views[ViewName] = {View.ElementType, View.Base->getName().str(),
+                       View.Length->getName().str()};
+  }
+
+  for (const auto &[RecordName, Info] : NamedRecords) {
+    if (Records.count(RecordName))
+      continue;
+    ReplRecord &Record = Records[RecordName];
+    Record = {Info.Record, Info.CollectionSize, Info.Layout, {}};
+    for (GlobalVariable *Global : Info.Storage) {
+      Global->setLinkage(GlobalValue::ExternalLinkage);
+      Record.Globals.push_back(Global->getName().str());
+    }
+  }
+}
+
+// Destroys the IR of an entry that won't run, users before their context
+static void DiscardModule() {
+  NamedValues.clear();
+  NamedViews.clear();
+  NamedRecords.clear();
+  Builder.reset();
+  TheModule.reset();
+  TheContext.reset();
+}
+
+// Checks, compiles and runs the entry in Text, whose first line is line
+// FirstLine of the session
+static void RunEntry(const std::string &Text, int FirstLine, LLJIT &JIT) {
+  std::istringstream Stream(Text);
+  SetLexerInput(Stream, FirstLine);
+
+  // A rejected entry must leave no trace, not even the declarations that
+  // came before the error
+  std::map<std::string, SymbolInfo> SavedSymbols = SymbolTable;
+  std::vector<std::unique_ptr<ExprAST>> Statements;
+  bool Valid = CheckEntry(Statements);
+  if (Valid && Statements.empty())
+    return;
+
+  std::string Name = "kirk.repl." + std::to_string(EntryCount++);
+  if (Valid)
+    Valid = CompileEntry(Statements, Name, JIT);
+  if (!Valid) {
+    SymbolTable = std::move(SavedSymbols);
+    ResetParser();
+    ResetSema();
+    DiscardModule();
+    return;
+  }
+  ExportDeclarations();
+  KeepParsedDeclarations();
+
+  // The module and its context now belong to the JIT
+  NamedValues.clear();
+  NamedViews.clear();
+  NamedRecords.clear();
+  Builder.reset();
+  if (Error Err = JIT.addIRModule(
+          ThreadSafeModule(std::move(TheModule), std::move(TheContext)))) {
+    std::cerr << "Error: " << toString(std::move(Err)) << "\n";
+    return;
+  }
+
+  auto Entry = JIT.lookup(Name);
+  if (!Entry) {
+    std::cerr << "Error: " << toString(Entry.takeError()) << "\n";
+    return;
+  }
+  Entry->toPtr<void (*)()>()();
+  std::fflush(stdout);
+}
+
+int RunRepl() {
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  std::unique_ptr<LLJIT> JIT = CreateJIT();
+  if (!JIT)
+    return 1;
+  RecoverFromErrors = true;
+
+  bool Interactive = isatty(STDIN_FILENO);
+  std::string Text;
+  while (true) {
+    int FirstLine = SourceLines.size() + 1;
+    if (!ReadEntry(Text, Interactive))
+      break;
+    RunEntry(Text, FirstLine, *JIT);
+  }
+
+  if (Interactive)
+    std::cout << "\n";
+  return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef REPL_H
+#define REPL_H
+
+// `kirk --repl`: reads entries (a line, plus continuation lines while a brace
+// or parenthesis is open) from stdin and runs each one as soon as it is
+// complete. Every entry is type-checked against the variables declared so
+// far, compiled into a fresh module and added to an ORC JIT session, which
+// links it to the globals holding earlier entries' variables and views.
+// An error only discards the entry it is in.
+
+// Runs the session until the end of stdin. Returns the process exit code.
+int RunRepl();
+
+#endif
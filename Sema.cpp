@@ -0,0 +1,1068 @@
+#include "Sema.h"
+#include "AST.h"
+#include "Errors.h"
+#include "Lexer.h"
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+std::map<std::string, SymbolInfo> SymbolTable;
+
+static int getTypeRank(KirkType T) {
+  switch (T) {
+  case KIRK_DOUBLE:
+    return 3;
+  case KIRK_INT:
+    return 2;
+  case KIRK_BOOL:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+KirkType getCommonType(KirkType A, KirkType B) {
+  unsigned LanesA = getLaneCount(A);
+  unsigned LanesB = getLaneCount(B);
+  if (LanesA != 1 && LanesB != 1 && LanesA != LanesB)
+    return KIRK_VOID;
+
+  KirkType ElementA = getElementType(A);
+  KirkType ElementB = getElementType(B);
+  KirkType Element =
+      getTypeRank(ElementA) >= getTypeRank(ElementB) ? ElementA : ElementB;
+  return getVectorType(Element, LanesA > LanesB ? LanesA : LanesB);
+}
+
+const char *getTypeName(KirkType Type) {
+  switch (Type) {
+  case KIRK_INT:
+    return "int";
+  case KIRK_DOUBLE:
+    return "double";
+  case KIRK_BOOL:
+    return "bool";
+  case KIRK_VOID:
+    return "void";
+  case KIRK_VEC4D:
+    return "vec4d";
+  case KIRK_VEC4I:
+    return "vec4i";
+  case KIRK_VEC4B:
+    return "vec4b";
+  case KIRK_VEC8D:
+    return "vec8d";
+  case KIRK_VEC8I:
+    return "vec8i";
+  case KIRK_VEC8B:
+    return "vec8b";
+  }
+  return "unknown";
+}
+
+// Operands must produce a value; print() for example does not
+static void RequireValue(const ExprAST &E) {
+  if (E.getType() == KIRK_VOID)
+    TypeError(E.getLoc(), "Expression does not produce a value").raise();
+}
+
+// Converts a literal operand at compile time, so "1 + 2.5" becomes
+// "1.0 + 2.5" instead of a runtime conversion. Returns null for non-literals.
+static std::unique_ptr<ExprAST> FoldLiteralCast(const ExprAST &E,
+                                                KirkType DestType) {
+  bool IsDouble;
+  double DoubleVal = 0.0;
+  long long IntVal = 0;
+
+  if (auto *Num = dynamic_cast<const NumberExprAST *>(&E)) {
+    IsDouble = !Num->isInteger();
+    DoubleVal = Num->getDoubleVal();
+    IntVal = Num->getIntVal();
+  } else if (auto *Bool = dynamic_cast<const BoolExprAST *>(&E)) {
+    IsDouble = false;
+    IntVal = Bool->getVal() ? 1 : 0;
+  } else {
+    return nullptr;
+  }
+
+  std::unique_ptr<ExprAST> Result;
+  switch (DestType) {
+  case KIRK_DOUBLE:
+    Result = std::make_unique<NumberExprAST>(
+        E.getLoc(), IsDouble ? DoubleVal : static_cast<double>(IntVal));
+    break;
+  case KIRK_INT:
+    if (!IsDouble) {
+      Result = std::make_unique<NumberExprAST>(E.getLoc(), IntVal);
+    } else if (DoubleVal > -9.2e18 && DoubleVal < 9.2e18) {
+      Result = std::make_unique<NumberExprAST>(
+          E.getLoc(), static_cast<long long>(DoubleVal));
+    }
+    break;
+  case KIRK_BOOL:
+    // Matches the runtime conversions: fcmp one / icmp ne against zero
+    Result = std::make_unique<BoolExprAST>(
+        E.getLoc(), IsDouble ? (DoubleVal != 0.0 && !std::isnan(DoubleVal))
+                             : IntVal != 0);
+    break;
+  default:
+    break;
+  }
+
+  if (Result)
+    Result->typecheck();
+  return Result;
+}
+
+// Converts an already checked expression to DestType, folding literals and
+// wrapping everything else in an implicit CastExprAST
+static std::unique_ptr<ExprAST> Coerce(std::unique_ptr<ExprAST> E,
+                                       KirkType DestType) {
+  RequireValue(*E);
+  KirkType SrcType = E->getType();
+  if (SrcType == DestType)
+    return E;
+
+  // Vectors convert lane by lane to vectors of the same width, and scalars
+  // convert to the element type and are splatted. Nothing turns a vector
+  // back into a scalar implicitly.
+  if (isVectorType(SrcType) || isVectorType(DestType)) {
+    if (isVectorType(SrcType) &&
+        getLaneCount(SrcType) != getLaneCount(DestType)) {
+      std::string Hint = DestType == KIRK_BOOL &&
+                                 getElementType(SrcType) == KIRK_BOOL
+                             ? " (use any() or all())"
+                             : "";
+      TypeError(E->getLoc(), std::string("Expected a ") +
+                                 getTypeName(DestType) + ", not a " +
+                                 getTypeName(SrcType) + Hint)
+          .raise();
+    }
+    if (!isVectorType(SrcType))
+      E = Coerce(std::move(E), getElementType(DestType));
+    return std::make_unique<CastExprAST>(std::move(E), DestType);
+  }
+
+  if (auto Folded = FoldLiteralCast(*E, DestType))
+    return Folded;
+
+  return std::make_unique<CastExprAST>(std::move(E), DestType);
+}
+
+KirkType NumberExprAST::typecheck() {
+  return ResolvedType = isInteger() ? KIRK_INT : KIRK_DOUBLE;
+}
+
+KirkType BoolExprAST::typecheck() { return ResolvedType = KIRK_BOOL; }
+
+// Checks the operands of Root and of the operators nested in it bottom-up,
+// then each operator itself
+KirkType OperatorExprAST::typecheck() {
+  return WalkOperatorTree<KirkType>(
+      this, [](OperatorExprAST *) {},
+      [](ExprAST *Leaf) { return Leaf->typecheck(); },
+      [](OperatorExprAST *, size_t, KirkType &) {},
+      [](OperatorExprAST *Node, llvm::ArrayRef<KirkType>) {
+        return Node->typecheckOperator();
+      });
+}
+
+// Casts are only created by Coerce, on operands that were already checked
+KirkType CastExprAST::typecheckOperator() { return ResolvedType; }
+
+// The generator whose body is being checked, if any, and the symbols
+// outside it, which its body can't see
+static GeneratorDef *EnclosingGenerator = nullptr;
+static std::map<std::string, SymbolInfo> OutsideGenerator;
+
+// Explains a name the body of a generator can't see: it runs wherever a
+// loop consumes it, with nothing but its parameters to go on
+static void CheckOutsideGenerator(SourceLocation Loc, const std::string &Name) {
+  if (EnclosingGenerator && OutsideGenerator.count(Name))
+    SyntaxError(Loc, "Generator '" + EnclosingGenerator->Name +
+                         "' cannot use the variable '" + Name +
+                         "'; pass it in as a parameter instead")
+        .raise();
+}
+
+KirkType VariableExprAST::typecheck() {
+  auto Iter = SymbolTable.find(Name);
+  if (Iter == SymbolTable.end()) {
+    CheckOutsideGenerator(Loc, Name);
+    ReferenceError(Loc, Name, SymbolTable).raise();
+    return KIRK_VOID;
+  }
+
+  if (Iter->second.IsView) {
+    TypeError(Loc, "'" + Name + "' is a view; use " + Name + "[i] or len(" +
+                       Name + ")")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  if (const RecordType *Record = Iter->second.Record) {
+    std::string Element = Iter->second.CollectionSize ? Name + "[i]" : Name;
+    TypeError(Loc, "'" + Name + "' is a record, not a value; use one of its "
+                       "fields, like " + Element + "." +
+                       Record->Fields[0].Name)
+        .raise();
+    return KIRK_VOID;
+  }
+
+  return ResolvedType = Iter->second.Type;
+}
+
+KirkType AssignmentExprAST::typecheck() {
+  RHS->typecheck();
+
+  auto Iter = SymbolTable.find(Name);
+  if (Iter == SymbolTable.end()) {
+    CheckOutsideGenerator(Loc, Name);
+    SyntaxError(Loc, "Variable must be declared with a type before use")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  if (Iter->second.IsView) {
+    SyntaxError(Loc, "Cannot assign to view '" + Name +
+                         "' (views are read-only)")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  if (Iter->second.Record) {
+    SyntaxError(Loc, "Cannot assign to record '" + Name +
+                         "' as a whole; assign its fields one by one")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  if (Iter->second.IsReadOnly) {
+    SyntaxError(Loc, "Cannot assign to read-only variable '" + Name +
+                         "' (loop variables, imported variables and "
+                         "variables captured by a parallel for are "
+                         "read-only)")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  RHS = Coerce(std::move(RHS), Iter->second.Type);
+  return ResolvedType = Iter->second.Type;
+}
+
+KirkType VarDeclExprAST::typecheck() {
+  if (SymbolTable.count(Name)) {
+    SyntaxError(Loc, "Variable already declared").raise();
+    return KIRK_VOID;
+  }
+
+  InitVal->typecheck();
+  InitVal = Coerce(std::move(InitVal), DeclType);
+
+  SymbolTable[Name] = {DeclType};
+  return ResolvedType = DeclType;
+}
+
+KirkType ViewDeclExprAST::typecheck() {
+  if (SymbolTable.count(Name)) {
+    SyntaxError(Loc, "Variable already declared").raise();
+    return KIRK_VOID;
+  }
+
+  SymbolTable[Name] = {ElementType, true, true};
+  return ResolvedType = KIRK_VOID;
+}
+
+// Looks up a view for "v[i]" or "len(v)"
+static const SymbolInfo *LookupView(SourceLocation Loc,
+                                    const std::string &Name) {
+  auto Iter = SymbolTable.find(Name);
+  if (Iter == SymbolTable.end()) {
+    ReferenceError(Loc, Name, SymbolTable).raise();
+    return nullptr;
+  }
+
+  if (!Iter->second.IsView) {
+    std::string Hint = Iter->second.Record
+                           ? " (use a field of a record, like " + Name +
+                                 (Iter->second.CollectionSize ? "[i]" : "") +
+                                 "." + Iter->second.Record->Fields[0].Name +
+                                 ")"
+                           : "";
+    TypeError(Loc, "'" + Name + "' is not a view" + Hint).raise();
+    return nullptr;
+  }
+  return &Iter->second;
+}
+
+KirkType IndexExprAST::typecheck() {
+  Index->typecheck();
+
+  const SymbolInfo *View = LookupView(Loc, Name);
+  if (!View)
+    return KIRK_VOID;
+
+  Index = Coerce(std::move(Index), KIRK_INT);
+  return ResolvedType = View->Type;
+}
+
+KirkType LengthExprAST::typecheck() {
+  auto Iter = SymbolTable.find(Name);
+  if (Iter != SymbolTable.end() && Iter->second.CollectionSize) {
+    CollectionSize = Iter->second.CollectionSize;
+    return ResolvedType = KIRK_INT;
+  }
+
+  if (!LookupView(Loc, Name))
+    return KIRK_VOID;
+  return ResolvedType = KIRK_INT;
+}
+
+// Struct names live in the parser's own table, apart from variables
+KirkType StructDeclExprAST::typecheck() { return ResolvedType = KIRK_VOID; }
+
+KirkType RecordDeclExprAST::typecheck() {
+  if (SymbolTable.count(Name)) {
+    SyntaxError(Loc, "Variable already declared").raise();
+    return KIRK_VOID;
+  }
+
+  SymbolInfo Symbol = {KIRK_VOID};
+  Symbol.Record = Record;
+  Symbol.CollectionSize = Size;
+  SymbolTable[Name] = Symbol;
+  return ResolvedType = KIRK_VOID;
+}
+
+KirkType FieldExprAST::typecheck() {
+  if (Index)
+    Index->typecheck();
+
+  auto Iter = SymbolTable.find(Name);
+  if (Iter == SymbolTable.end()) {
+    ReferenceError(Loc, Name, SymbolTable).raise();
+    return KIRK_VOID;
+  }
+
+  const RecordType *Record = Iter->second.Record;
+  if (!Record) {
+    TypeError(Loc, "'" + Name + "' is not a record").raise();
+    return KIRK_VOID;
+  }
+
+  bool IsCollection = Iter->second.CollectionSize != 0;
+  if (IsCollection != (Index != nullptr)) {
+    TypeError(Loc, IsCollection
+                       ? "'" + Name + "' is a collection of " + Record->Name +
+                             "; pick an element, like " + Name + "[i]." +
+                             Field
+                       : "'" + Name + "' is a single " + Record->Name +
+                             ", not a collection; use " + Name + "." + Field)
+        .raise();
+    return KIRK_VOID;
+  }
+
+  FieldIndex = Record->getFieldIndex(Field);
+  if (FieldIndex < 0) {
+    std::string Fields;
+    for (const RecordField &Candidate : Record->Fields)
+      Fields += (Fields.empty() ? "" : ", ") + Candidate.Name;
+    TypeError(FieldLoc, "Struct " + Record->Name + " has no field '" + Field +
+                            "' (its fields are " + Fields + ")")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  if (Index)
+    Index = Coerce(std::move(Index), KIRK_INT);
+  return ResolvedType = Record->Fields[FieldIndex].Type;
+}
+
+// A record captured by a parallel for is read-only in its body, like any
+// other capture. The elements of a collection stay writable, so each
+// iteration can fill in its own.
+KirkType FieldAssignmentExprAST::typecheck() {
+  KirkType FieldType = Target->typecheck();
+  RHS->typecheck();
+
+  auto Iter = SymbolTable.find(Target->getName());
+  if (!Target->isElement() && Iter != SymbolTable.end() &&
+      Iter->second.IsReadOnly) {
+    SyntaxError(Loc, "Cannot assign to a field of read-only record '" +
+                         Target->getName() +
+                         "' (records captured by a parallel for are "
+                         "read-only)")
+        .raise();
+    return KIRK_VOID;
+  }
+
+  RHS = Coerce(std::move(RHS), FieldType);
+  return ResolvedType = FieldType;
+}
+
+// The type both operands of a binary operator, or both branches of an if,
+// are converted to
+static KirkType MergeTypes(SourceLocation Loc, KirkType A, KirkType B) {
+  KirkType Merged = getCommonType(A, B);
+  if (Merged == KIRK_VOID && A != KIRK_VOID && B != KIRK_VOID)
+    TypeError(Loc, std::string("Cannot combine a ") + getTypeName(A) +
+                       " and a " + getTypeName(B) +
+                       " (vectors must have the same number of lanes)")
+        .raise();
+  return Merged;
+}
+
+// Bools (and bool lanes) count as ints in arithmetic
+static KirkType getNumericType(KirkType T) {
+  if (getElementType(T) == KIRK_BOOL)
+    return getVectorType(KIRK_INT, getLaneCount(T));
+  return T;
+}
+
+KirkType BinaryExprAST::typecheckOperator() {
+  RequireValue(*LHS);
+  RequireValue(*RHS);
+
+  // Vectors work lane by lane; comparing them gives a mask
+  KirkType CommonType = MergeTypes(Loc, LHS->getType(), RHS->getType());
+  KirkType NumericType = getNumericType(CommonType);
+  unsigned Lanes = getLaneCount(CommonType);
+  KirkType OperandType;
+
+  switch (Op) {
+  case '+':
+  case '-':
+  case '*':
+  case '/':
+  case '%':
+    OperandType = NumericType;
+    ResolvedType = NumericType;
+    break;
+
+  case '<':
+  case '>':
+  case TOK_EQ:
+  case TOK_NEQ:
+  case TOK_GEQ:
+  case TOK_LEQ:
+    OperandType = NumericType;
+    ResolvedType = getVectorType(KIRK_BOOL, Lanes);
+    break;
+
+  // Power always goes through llvm.pow on doubles
+  case '^':
+    OperandType = getVectorType(KIRK_DOUBLE, Lanes);
+    ResolvedType = OperandType;
+    break;
+
+  // Bitwise operators take ints. '&', '|' and xor keep bools (and masks)
+  // bools, as "and" and "or" without the short-circuit; shifts promote them.
+  case '&':
+  case '|':
+  case TOK_XOR:
+  case TOK_SHL:
+  case TOK_SHR:
+  case TOK_USHR:
+    if (getElementType(CommonType) == KIRK_DOUBLE)
+      TypeError(Loc, std::string("Bitwise operators work on ints, not on a ") +
+                         getTypeName(CommonType))
+          .raise();
+    OperandType = Op == '&' || Op == '|' || Op == TOK_XOR ? CommonType
+                                                          : NumericType;
+    ResolvedType = OperandType;
+    break;
+
+  default:
+    SyntaxError(Loc, "Invalid binary operator").raise();
+    return KIRK_VOID;
+  }
+
+  LHS = Coerce(std::move(LHS), OperandType);
+  RHS = Coerce(std::move(RHS), OperandType);
+  return ResolvedType;
+}
+
+KirkType UnaryExprAST::typecheckOperator() {
+  RequireValue(*Operand);
+
+  // "not" works on bools and, lane by lane, on masks
+  if (Opcode == TOK_NOT) {
+    Operand = Coerce(std::move(Operand),
+                     getVectorType(KIRK_BOOL,
+                                   getLaneCount(Operand->getType())));
+    return ResolvedType = Operand->getType();
+  }
+
+  if (Opcode != '-' && Opcode != '~') {
+    SyntaxError(Loc, "Unknown unary operator").raise();
+    return KIRK_VOID;
+  }
+  if (Opcode == '~' && getElementType(Operand->getType()) == KIRK_DOUBLE)
+    TypeError(Loc, std::string("'~' works on ints, not on a ") +
+                       getTypeName(Operand->getType()))
+        .raise();
+
+  Operand = Coerce(std::move(Operand), getNumericType(Operand->getType()));
+
+  return ResolvedType = Operand->getType();
+}
+
+KirkType LogicalExprAST::typecheck() {
+  for (auto &Operand : Operands) {
+    Operand->typecheck();
+    Operand = Coerce(std::move(Operand), KIRK_BOOL);
+  }
+  return ResolvedType = KIRK_BOOL;
+}
+
+KirkType IfExprAST::typecheck() {
+  Cond->typecheck();
+  Cond = Coerce(std::move(Cond), KIRK_BOOL);
+
+  Then->typecheck();
+  Else->typecheck();
+
+  // An if whose branch has no value (like print) is only run for effect
+  if (Then->getType() == KIRK_VOID || Else->getType() == KIRK_VOID)
+    return ResolvedType = KIRK_VOID;
+
+  KirkType MergeType = MergeTypes(Loc, Then->getType(), Else->getType());
+  Then = Coerce(std::move(Then), MergeType);
+  Else = Coerce(std::move(Else), MergeType);
+  return ResolvedType = MergeType;
+}
+
+KirkType MatchExprAST::typecheck() {
+  Subject->typecheck();
+  KirkType SubjectType = Subject->getType();
+  if (SubjectType != KIRK_INT && SubjectType != KIRK_BOOL) {
+    TypeError(Subject->getLoc(), std::string("Can only match an int or a "
+                                             "bool, not a ") +
+                                     getTypeName(SubjectType))
+        .raise();
+    return KIRK_VOID;
+  }
+  Subject = Coerce(std::move(Subject), KIRK_INT);
+
+  // The switch needs every value to lead to one arm: sorted by their first
+  // value, each pattern must start after the previous one ends
+  std::vector<const MatchPattern *> Patterns;
+  for (const MatchArm &Arm : Arms)
+    for (const MatchPattern &Pattern : Arm.Patterns)
+      Patterns.push_back(&Pattern);
+  std::stable_sort(Patterns.begin(), Patterns.end(),
+                   [](const MatchPattern *A, const MatchPattern *B) {
+                     return A->Low < B->Low;
+                   });
+  for (size_t i = 1; i < Patterns.size(); ++i) {
+    if (Patterns[i]->Low <= Patterns[i - 1]->Last) {
+      // Point at whichever of the two comes later in the source
+      const MatchPattern *Later =
+          std::tie(Patterns[i]->Loc.Line, Patterns[i]->Loc.Col) >
+                  std::tie(Patterns[i - 1]->Loc.Line, Patterns[i - 1]->Loc.Col)
+              ? Patterns[i]
+              : Patterns[i - 1];
+      SyntaxError(Later->Loc, "Value " + std::to_string(Patterns[i]->Low) +
+                                  " is matched by more than one pattern")
+          .raise();
+      return KIRK_VOID;
+    }
+  }
+
+  // Like an if, a match has no value if one of its arms has none
+  bool HasValue = true;
+  for (MatchArm &Arm : Arms)
+    HasValue &= Arm.Body->typecheck() != KIRK_VOID;
+  if (!HasValue)
+    return ResolvedType = KIRK_VOID;
+
+  KirkType MergeType = Arms[0].Body->getType();
+  for (MatchArm &Arm : Arms)
+    MergeType = MergeTypes(Arm.Body->getLoc(), MergeType, Arm.Body->getType());
+  for (MatchArm &Arm : Arms)
+    Arm.Body = Coerce(std::move(Arm.Body), MergeType);
+  return ResolvedType = MergeType;
+}
+
+KirkType BlockExprAST::typecheck() {
+  ResolvedType = KIRK_VOID;
+  for (auto &Expr : Expressions)
+    ResolvedType = Expr->typecheck();
+  return ResolvedType;
+}
+
+KirkType PrintExprAST::typecheck() {
+  Expr->typecheck();
+  if (Expr->getType() == KIRK_VOID)
+    TypeError(Expr->getLoc(), "Cannot print an expression that does not "
+                              "produce a value")
+        .raise();
+
+  return ResolvedType = KIRK_VOID;
+}
+
+KirkType BuiltinCallExprAST::typecheck() {
+  // The timers and input readers take no arguments
+  switch (Callee) {
+  case BUILTIN_CLOCK_NS:
+  case BUILTIN_CYCLES:
+  case BUILTIN_READ_INT:
+    return ResolvedType = KIRK_INT;
+  case BUILTIN_READ_DOUBLE:
+    return ResolvedType = KIRK_DOUBLE;
+  case BUILTIN_READ_BOOL:
+  case BUILTIN_HAS_INPUT:
+    return ResolvedType = KIRK_BOOL;
+  default:
+    break;
+  }
+
+  for (auto &Arg : Args) {
+    Arg->typecheck();
+    RequireValue(*Arg);
+  }
+
+  if (Callee >= BUILTIN_LANE)
+    return typecheckVectorBuiltin();
+
+  // abs, min and max keep int operands int, and the bit counts only take
+  // ints; the rest work on doubles. With a vector argument they work lane by
+  // lane, splatting scalar arguments.
+  KirkType OperandType = KIRK_INT;
+  for (auto &Arg : Args)
+    OperandType = MergeTypes(Loc, OperandType, Arg->getType());
+  if (Callee == BUILTIN_POPCOUNT || Callee == BUILTIN_CTZ ||
+      Callee == BUILTIN_CLZ) {
+    if (getElementType(OperandType) == KIRK_DOUBLE)
+      TypeError(Loc, std::string(Callee == BUILTIN_POPCOUNT ? "popcount"
+                                 : Callee == BUILTIN_CTZ    ? "ctz"
+                                                            : "clz") +
+                         "() expects an int, not a " +
+                         getTypeName(OperandType))
+          .raise();
+  } else if (Callee != BUILTIN_ABS && Callee != BUILTIN_MIN &&
+             Callee != BUILTIN_MAX) {
+    OperandType = getVectorType(KIRK_DOUBLE, getLaneCount(OperandType));
+  }
+
+  for (auto &Arg : Args)
+    Arg = Coerce(std::move(Arg), OperandType);
+  return ResolvedType = OperandType;
+}
+
+// Lane numbers must be integer literals, as shufflevector requires
+static unsigned GetLaneNumber(const ExprAST &E, unsigned NumLanes) {
+  auto *Num = dynamic_cast<const NumberExprAST *>(&E);
+  if (!Num || !Num->isInteger()) {
+    TypeError(E.getLoc(), "Lane numbers must be integer constants").raise();
+    return 0;
+  }
+
+  if (Num->getIntVal() < 0 || Num->getIntVal() >= NumLanes)
+    TypeError(E.getLoc(), "Lane " + std::to_string(Num->getIntVal()) +
+                              " is out of range (0 to " +
+                              std::to_string(NumLanes - 1) + ")")
+        .raise();
+  return static_cast<unsigned>(Num->getIntVal());
+}
+
+static void RequireVector(const ExprAST &E, const char *Builtin) {
+  if (!isVectorType(E.getType()))
+    TypeError(E.getLoc(), std::string(Builtin) + "() expects a vector, not a " +
+                              getTypeName(E.getType()))
+        .raise();
+}
+
+static void RequireMask(const ExprAST &E, const char *Builtin) {
+  if (!isVectorType(E.getType()) || getElementType(E.getType()) != KIRK_BOOL)
+    TypeError(E.getLoc(), std::string(Builtin) +
+                              "() expects a mask like vec4b, not a " +
+                              getTypeName(E.getType()))
+        .raise();
+}
+
+KirkType BuiltinCallExprAST::typecheckVectorBuiltin() {
+  switch (Callee) {
+  case BUILTIN_LANE:
+  case BUILTIN_WITH_LANE: {
+    RequireVector(*Args[0], Callee == BUILTIN_LANE ? "lane" : "with_lane");
+    KirkType VectorType = Args[0]->getType();
+    LaneNumbers.push_back(GetLaneNumber(*Args[1], getLaneCount(VectorType)));
+    Args.erase(Args.begin() + 1);
+
+    if (Callee == BUILTIN_LANE)
+      return ResolvedType = getElementType(VectorType);
+    Args[1] = Coerce(std::move(Args[1]), getElementType(VectorType));
+    return ResolvedType = VectorType;
+  }
+
+  // shuffle(v, lanes...) or shuffle(a, b, lanes...), where b's lanes are
+  // numbered after a's
+  case BUILTIN_SHUFFLE: {
+    if (Args.empty()) {
+      TypeError(Loc, "shuffle() takes a vector and lane numbers").raise();
+      return KIRK_VOID;
+    }
+    RequireVector(*Args[0], "shuffle");
+    KirkType SourceType = Args[0]->getType();
+
+    size_t NumSources = 1;
+    if (Args.size() > 1 && isVectorType(Args[1]->getType())) {
+      if (Args[1]->getType() != SourceType)
+        TypeError(Args[1]->getLoc(),
+                  std::string("Both vectors in shuffle() must have the same "
+                              "type, but this is a ") +
+                      getTypeName(Args[1]->getType()) + ", not a " +
+                      getTypeName(SourceType))
+            .raise();
+      NumSources = 2;
+    }
+
+    size_t Count = Args.size() - NumSources;
+    ResolvedType = getVectorType(getElementType(SourceType), Count);
+    if (Count == 1 || ResolvedType == KIRK_VOID)
+      TypeError(Loc, "shuffle() must pick 4 or 8 lanes, not " +
+                         std::to_string(Count))
+          .raise();
+
+    for (size_t I = NumSources; I < Args.size(); ++I)
+      LaneNumbers.push_back(
+          GetLaneNumber(*Args[I], getLaneCount(SourceType) * NumSources));
+    Args.resize(NumSources);
+    return ResolvedType;
+  }
+
+  // select(mask, a, b): lane i of a where lane i of the mask is true, else
+  // lane i of b
+  case BUILTIN_SELECT: {
+    RequireMask(*Args[0], "select");
+    KirkType ValueType = MergeTypes(Loc, Args[1]->getType(), Args[2]->getType());
+    ResolvedType = MergeTypes(Loc, ValueType, Args[0]->getType());
+    Args[1] = Coerce(std::move(Args[1]), ResolvedType);
+    Args[2] = Coerce(std::move(Args[2]), ResolvedType);
+    return ResolvedType;
+  }
+
+  case BUILTIN_REDUCE_ADD:
+  case BUILTIN_REDUCE_MUL:
+  case BUILTIN_REDUCE_MIN:
+  case BUILTIN_REDUCE_MAX:
+    RequireVector(*Args[0], Callee == BUILTIN_REDUCE_ADD   ? "reduce_add"
+                            : Callee == BUILTIN_REDUCE_MUL ? "reduce_mul"
+                            : Callee == BUILTIN_REDUCE_MIN ? "reduce_min"
+                                                           : "reduce_max");
+    Args[0] = Coerce(std::move(Args[0]), getNumericType(Args[0]->getType()));
+    return ResolvedType = getElementType(Args[0]->getType());
+
+  case BUILTIN_ANY:
+  case BUILTIN_ALL:
+    RequireMask(*Args[0], Callee == BUILTIN_ANY ? "any" : "all");
+    return ResolvedType = KIRK_BOOL;
+
+  default:
+    return KIRK_VOID;
+  }
+}
+
+KirkType VectorExprAST::typecheck() {
+  unsigned Lanes = getLaneCount(VectorType);
+  for (auto &Arg : Args)
+    Arg->typecheck();
+
+  // One value is splatted, or converted if it is a vector
+  if (Args.size() == 1) {
+    Args[0] = Coerce(std::move(Args[0]), VectorType);
+    return ResolvedType = VectorType;
+  }
+
+  if (Args.size() != Lanes)
+    TypeError(Loc, std::string(getTypeName(VectorType)) + " takes 1 or " +
+                       std::to_string(Lanes) + " values, but " +
+                       std::to_string(Args.size()) + " were given")
+        .raise();
+
+  for (auto &Arg : Args)
+    Arg = Coerce(std::move(Arg), getElementType(VectorType));
+  return ResolvedType = VectorType;
+}
+
+// The loops around the code being checked, innermost last, with the breaks
+// that leave each. The body of a parallel for or a bench starts with a
+// barrier instead (a null Loop): break and continue can't leave code that
+// is outlined or timed.
+namespace {
+struct EnclosingLoop {
+  LoopExprAST *Loop;
+  std::vector<BreakExprAST *> Breaks;
+  const char *Barrier = nullptr; // What the barrier stands for
+};
+} // namespace
+
+static std::vector<EnclosingLoop> EnclosingLoops;
+
+void ResetSema() {
+  EnclosingLoops.clear();
+  EnclosingGenerator = nullptr;
+  OutsideGenerator.clear();
+}
+
+// Type-checks the body of a parallel for or a bench behind a barrier
+static void TypecheckBarrierBody(ExprAST &Body, const char *Barrier) {
+  EnclosingLoops.push_back({nullptr, {}, Barrier});
+  Body.typecheck();
+  EnclosingLoops.pop_back();
+}
+
+// The loop a break or continue leaves: the innermost one, or the one with
+// Label
+static EnclosingLoop *FindLoop(SourceLocation Loc, const std::string &Label,
+                               const char *Keyword) {
+  for (auto It = EnclosingLoops.rbegin(); It != EnclosingLoops.rend(); ++It) {
+    if (!It->Loop) {
+      SyntaxError(Loc, std::string("'") + Keyword +
+                           "' cannot leave the body of " + It->Barrier)
+          .raise();
+      return nullptr;
+    }
+    if (Label.empty() || It->Loop->getLabel() == Label)
+      return &*It;
+  }
+  SyntaxError(Loc, std::string("'") + Keyword + "' outside of a loop").raise();
+  return nullptr;
+}
+
+// Pops the loop whose body was just checked and works out its type: the
+// common type of its break values, or double (for 0.0) if no break has one
+static KirkType FinishLoop() {
+  EnclosingLoop Finished = std::move(EnclosingLoops.back());
+  EnclosingLoops.pop_back();
+
+  KirkType Type = KIRK_VOID;
+  for (BreakExprAST *Break : Finished.Breaks)
+    if (Break->hasValue())
+      Type = Type == KIRK_VOID ? Break->getValueType()
+                               : MergeTypes(Break->getLoc(), Type,
+                                            Break->getValueType());
+  if (Type == KIRK_VOID)
+    return KIRK_DOUBLE;
+
+  Finished.Loop->setBreaksWithValue();
+  for (BreakExprAST *Break : Finished.Breaks)
+    if (Break->hasValue())
+      Break->coerceValue(Type);
+  return Type;
+}
+
+void BreakExprAST::coerceValue(KirkType Type) {
+  Result = Coerce(std::move(Result), Type);
+}
+
+KirkType BreakExprAST::typecheck() {
+  if (Result) {
+    Result->typecheck();
+    RequireValue(*Result);
+  }
+
+  EnclosingLoop *Enclosing = FindLoop(Loc, Label, "break");
+  if (!Enclosing)
+    return KIRK_VOID;
+  Target = Enclosing->Loop;
+  Enclosing->Breaks.push_back(this);
+
+  // Nothing runs after a break; like loops it counts as 0.0
+  return ResolvedType = KIRK_DOUBLE;
+}
+
+KirkType ContinueExprAST::typecheck() {
+  EnclosingLoop *Enclosing = FindLoop(Loc, Label, "continue");
+  if (!Enclosing)
+    return KIRK_VOID;
+  Target = Enclosing->Loop;
+  return ResolvedType = KIRK_DOUBLE;
+}
+
+KirkType BenchExprAST::typecheck() {
+  Iterations->typecheck();
+  Iterations = Coerce(std::move(Iterations), KIRK_INT);
+  TypecheckBarrierBody(*Body, "a bench");
+
+  // Like loops, benchmarks evaluate to 0.0
+  return ResolvedType = KIRK_DOUBLE;
+}
+
+KirkType FloatModeExprAST::typecheck() {
+  return ResolvedType = Body->typecheck();
+}
+
+KirkType WhileExprAST::typecheck() {
+  Cond->typecheck();
+  Cond = Coerce(std::move(Cond), KIRK_BOOL);
+
+  EnclosingLoops.push_back({this, {}});
+  Body->typecheck();
+
+  // 0.0, unless a break leaves the loop with a value
+  return ResolvedType = FinishLoop();
+}
+
+KirkType ForExprAST::typecheck() {
+  Start->typecheck();
+  End->typecheck();
+  Start = Coerce(std::move(Start), KIRK_INT);
+  End = Coerce(std::move(End), KIRK_INT);
+
+  // The loop variable shadows an outer variable with the same name until
+  // the loop ends
+  auto Outer = SymbolTable.find(VarName);
+  bool HadOuter = Outer != SymbolTable.end();
+  SymbolInfo Saved = HadOuter ? Outer->second : SymbolInfo{KIRK_VOID};
+  SymbolTable[VarName] = {KIRK_INT, true};
+
+  EnclosingLoops.push_back({this, {}});
+  Body->typecheck();
+
+  if (HadOuter)
+    SymbolTable[VarName] = Saved;
+  else
+    SymbolTable.erase(VarName);
+
+  // Like while loops, for loops evaluate to 0.0 or their break value
+  return ResolvedType = FinishLoop();
+}
+
+KirkType ParallelForExprAST::typecheck() {
+  Start->typecheck();
+  End->typecheck();
+  Start = Coerce(std::move(Start), KIRK_INT);
+  End = Coerce(std::move(End), KIRK_INT);
+
+  std::map<std::string, SymbolInfo> Saved = SymbolTable;
+
+  // Everything captured from the enclosing scope is read-only in the body,
+  // except the reduction variables
+  for (auto &Entry : SymbolTable)
+    Entry.second.IsReadOnly = true;
+
+  for (const ReductionClause &R : Reductions) {
+    auto Iter = Saved.find(R.VarName);
+    if (Iter == Saved.end()) {
+      ReferenceError(R.Loc, R.VarName, Saved).raise();
+      return KIRK_VOID;
+    }
+    if (R.VarName == VarName) {
+      SyntaxError(R.Loc, "The loop variable cannot be a reduction variable")
+          .raise();
+      return KIRK_VOID;
+    }
+    if (Iter->second.Type != KIRK_INT && Iter->second.Type != KIRK_DOUBLE) {
+      TypeError(R.Loc, "Reduction variable '" + R.VarName +
+                           "' must be an int or a double, not " +
+                           getTypeName(Iter->second.Type))
+          .raise();
+      return KIRK_VOID;
+    }
+    if (Iter->second.IsReadOnly) {
+      SyntaxError(R.Loc, "Cannot reduce into read-only variable '" +
+                             R.VarName + "'")
+          .raise();
+      return KIRK_VOID;
+    }
+    if (!SymbolTable[R.VarName].IsReadOnly) {
+      SyntaxError(R.Loc, "Variable '" + R.VarName +
+                             "' appears in more than one reduction")
+          .raise();
+      return KIRK_VOID;
+    }
+    SymbolTable[R.VarName].IsReadOnly = false;
+  }
+
+  // The loop variable shadows any captured variable with the same name
+  SymbolTable[VarName] = {KIRK_INT, true};
+
+  TypecheckBarrierBody(*Body, "a parallel for");
+
+  SymbolTable = std::move(Saved);
+  return ResolvedType = KIRK_DOUBLE;
+}
+
+// The body is checked here, once, against a symbol table of its own
+KirkType GeneratorDeclExprAST::typecheck() {
+  std::map<std::string, SymbolInfo> Outside = SymbolTable;
+
+  // Views and records are globals, and stay visible
+  SymbolTable.clear();
+  for (const auto &Entry : Outside)
+    if (Entry.second.IsView || Entry.second.Record)
+      SymbolTable.insert(Entry);
+  for (const GeneratorParam &Param : Def->Params)
+    SymbolTable[Param.Name] = {Param.Type};
+
+  OutsideGenerator = Outside;
+  EnclosingGenerator = Def;
+  Def->NumYields = 0;
+  Def->Body->typecheck();
+  EnclosingGenerator = nullptr;
+  OutsideGenerator.clear();
+  SymbolTable = std::move(Outside);
+
+  // The REPL goes on after an error in the body, but rejects the entry
+  if (ErrorRaised)
+    return KIRK_VOID;
+  if (Def->NumYields == 0) {
+    SyntaxError(Loc, "Generator '" + Def->Name + "' never yields a value")
+        .raise();
+    return KIRK_VOID;
+  }
+  Def->Checked = true;
+  return ResolvedType = KIRK_VOID;
+}
+
+KirkType YieldExprAST::typecheck() {
+  Operand->typecheck();
+
+  if (!EnclosingGenerator) {
+    SyntaxError(Loc, "'yield' outside of a generator").raise();
+    return KIRK_VOID;
+  }
+
+  // A parallel body or a bench can't suspend the generator around it
+  for (const EnclosingLoop &Loop : EnclosingLoops) {
+    if (!Loop.Loop) {
+      SyntaxError(Loc, std::string("'yield' cannot leave the body of ") +
+                           Loop.Barrier)
+          .raise();
+      return KIRK_VOID;
+    }
+  }
+
+  Operand = Coerce(std::move(Operand), EnclosingGenerator->YieldType);
+  EnclosingGenerator->NumYields++;
+
+  // Like break, yield itself counts as 0.0
+  return ResolvedType = KIRK_DOUBLE;
+}
+
+KirkType GeneratorForExprAST::typecheck() {
+  for (size_t i = 0; i < Args.size(); ++i) {
+    Args[i]->typecheck();
+    Args[i] = Coerce(std::move(Args[i]), Def->Params[i].Type);
+  }
+
+  // The loop variable shadows an outer variable with the same name until
+  // the loop ends
+  auto Outer = SymbolTable.find(VarName);
+  bool HadOuter = Outer != SymbolTable.end();
+  SymbolInfo Saved = HadOuter ? Outer->second : SymbolInfo{KIRK_VOID};
+  SymbolTable[VarName] = {Def->YieldType, true};
+
+  EnclosingLoops.push_back({this, {}});
+  Body->typecheck();
+
+  if (HadOuter)
+    SymbolTable[VarName] = Saved;
+  else
+    SymbolTable.erase(VarName);
+
+  // Like other loops, generator loops evaluate to 0.0 or their break value
+  return ResolvedType = FinishLoop();
+}
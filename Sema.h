@@ -0,0 +1,32 @@
+#ifndef SEMA_H
+#define SEMA_H
+
+#include "Types.h"
+#include <map>
+#include <string>
+
+struct SymbolInfo {
+  KirkType Type;
+  bool IsReadOnly = false; // Loop variables and captures in parallel bodies
+  bool IsView = false;     // Type is then the element type
+  // Records and collections of them, whose Type is void: the struct type,
+  // and the collection's size (0 for a single record)
+  const RecordType *Record = nullptr;
+  long long CollectionSize = 0;
+};
+
+// Symbol Table used during semantic analysis. Like NamedValues during
+// codegen, top-level declarations stay visible for the rest of the program.
+extern std::map<std::string, SymbolInfo> SymbolTable;
+
+// Implicit promotion order for mixed operands: bool -> int -> double. Vector
+// lanes promote the same way, and a scalar mixed with a vector is splatted
+// to its width. Vectors of different widths have no common type: KIRK_VOID.
+KirkType getCommonType(KirkType A, KirkType B);
+// Spelling of a type in diagnostics, like "int"
+const char *getTypeName(KirkType Type);
+// Forgets the loops of a statement abandoned halfway by an error, like
+// ResetParser() does for the parser
+void ResetSema();
+
+#endif
@@ -0,0 +1,181 @@
+#include "SizeReport.h"
+#include "Codegen.h"
+#include "Lexer.h"
+#include "llvm/DebugInfo/DWARF/DWARFContext.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace llvm;
+
+std::string SizeReportPath;
+
+struct SizeCounts {
+  uint64_t Instructions = 0;
+  uint64_t Blocks = 0;
+  uint64_t MachineBytes = 0;
+};
+
+// Keyed by (line, column); line 0 collects compiler glue with no Kirk
+// source (allocas, chunk calls, profiling probes)
+static std::map<std::pair<unsigned, unsigned>, SizeCounts> Sizes;
+
+static std::pair<unsigned, unsigned> getKey(const DebugLoc &Loc) {
+  if (!Loc)
+    return {0, 0};
+  return {Loc.getLine(), Loc.getCol()};
+}
+
+void CollectIRSizes() {
+  for (Function &F : *TheModule) {
+    for (BasicBlock &BB : F) {
+      DebugLoc BlockLoc;
+      for (Instruction &I : BB) {
+        Sizes[getKey(I.getDebugLoc())].Instructions++;
+        if (!BlockLoc)
+          BlockLoc = I.getDebugLoc();
+      }
+      Sizes[getKey(BlockLoc)].Blocks++;
+    }
+  }
+}
+
+bool CollectMachineCodeSizes(MemoryBufferRef Object) {
+  Expected<std::unique_ptr<object::ObjectFile>> File =
+      object::ObjectFile::createObjectFile(Object);
+  if (!File) {
+    std::cerr << "Error: " << toString(File.takeError()) << "\n";
+    return false;
+  }
+
+  std::unique_ptr<DWARFContext> DWARF = DWARFContext::create(**File);
+  for (const auto &Unit : DWARF->compile_units()) {
+    const DWARFDebugLine::LineTable *Table =
+        DWARF->getLineTableForUnit(Unit.get());
+    if (!Table)
+      continue;
+
+    // Each row covers the bytes up to the next row of its sequence
+    for (const DWARFDebugLine::Sequence &Seq : Table->Sequences) {
+      for (uint32_t i = Seq.FirstRowIndex; i + 1 < Seq.LastRowIndex; ++i) {
+        const DWARFDebugLine::Row &Row = Table->Rows[i];
+        const DWARFDebugLine::Row &Next = Table->Rows[i + 1];
+        unsigned Column = Row.Line == 0 ? 0 : Row.Column;
+        Sizes[{Row.Line, Column}].MachineBytes +=
+            Next.Address.Address - Row.Address.Address;
+      }
+    }
+  }
+  return true;
+}
+
+std::string EscapeJSON(const std::string &Text) {
+  std::string Escaped;
+  for (char C : Text) {
+    if (C == '"' || C == '\\') {
+      Escaped += '\\';
+      Escaped += C;
+    } else if (C == '\t') {
+      Escaped += "\\t";
+    } else if (static_cast<unsigned char>(C) < 0x20) {
+      char Buffer[8];
+      std::snprintf(Buffer, sizeof(Buffer), "\\u%04x", C);
+      Escaped += Buffer;
+    } else {
+      Escaped += C;
+    }
+  }
+  return Escaped;
+}
+
+void WriteSizeReport(const std::string &InputPath) {
+  SizeCounts Total;
+  std::vector<std::pair<std::pair<unsigned, unsigned>, SizeCounts>> Rows(
+      Sizes.begin(), Sizes.end());
+  for (const auto &Row : Rows) {
+    Total.Instructions += Row.second.Instructions;
+    Total.Blocks += Row.second.Blocks;
+    Total.MachineBytes += Row.second.MachineBytes;
+  }
+
+  // Table: biggest contributors first
+  std::vector<std::pair<std::pair<unsigned, unsigned>, SizeCounts>> Sorted =
+      Rows;
+  std::stable_sort(Sorted.begin(), Sorted.end(),
+                   [](const auto &A, const auto &B) {
+                     if (A.second.MachineBytes != B.second.MachineBytes)
+                       return A.second.MachineBytes > B.second.MachineBytes;
+                     return A.second.Instructions > B.second.Instructions;
+                   });
+
+  std::printf("\n=== Kirk IR size report (sorted by machine-code bytes) ===\n");
+  std::printf("%-9s %12s %8s %14s %7s  %s\n", "location", "ir insts",
+              "blocks", "machine bytes", "share", "source");
+
+  for (const auto &Row : Sorted) {
+    const SizeCounts &C = Row.second;
+    char Location[32];
+    if (Row.first.first == 0)
+      std::snprintf(Location, sizeof(Location), "<glue>");
+    else
+      std::snprintf(Location, sizeof(Location), "%u:%u", Row.first.first,
+                    Row.first.second);
+
+    double Share = Total.MachineBytes > 0
+                       ? 100.0 * C.MachineBytes / Total.MachineBytes
+                       : 0.0;
+    std::string Source =
+        Row.first.first == 0
+            ? ""
+            : GetSourceSnippet({(int)Row.first.first, (int)Row.first.second});
+
+    std::printf("%-9s %12llu %8llu %14llu %6.1f%%  %s\n", Location,
+                (unsigned long long)C.Instructions,
+                (unsigned long long)C.Blocks,
+                (unsigned long long)C.MachineBytes, Share, Source.c_str());
+  }
+  std::printf("%-9s %12llu %8llu %14llu\n", "total",
+              (unsigned long long)Total.Instructions,
+              (unsigned long long)Total.Blocks,
+              (unsigned long long)Total.MachineBytes);
+
+  // JSON: in source order, so two versions diff line by line
+  std::error_code EC;
+  raw_fd_ostream Out(SizeReportPath, EC);
+  if (EC) {
+    std::cerr << "Error writing " << SizeReportPath << ": " << EC.message()
+              << "\n";
+    return;
+  }
+
+  Out << "{\n";
+  Out << "  \"file\": \"" << EscapeJSON(InputPath) << "\",\n";
+  Out << "  \"total\": {\"instructions\": " << Total.Instructions
+      << ", \"blocks\": " << Total.Blocks
+      << ", \"machine_bytes\": " << Total.MachineBytes << "},\n";
+  Out << "  \"locations\": [";
+
+  for (size_t i = 0; i < Rows.size(); ++i) {
+    const auto &Row = Rows[i];
+    std::string Source =
+        Row.first.first == 0
+            ? ""
+            : GetSourceSnippet({(int)Row.first.first, (int)Row.first.second},
+                               80);
+
+    Out << (i == 0 ? "\n" : ",\n");
+    Out << "    {\"line\": " << Row.first.first
+        << ", \"col\": " << Row.first.second
+        << ", \"instructions\": " << Row.second.Instructions
+        << ", \"blocks\": " << Row.second.Blocks
+        << ", \"machine_bytes\": " << Row.second.MachineBytes
+        << ", \"source\": \"" << EscapeJSON(Source) << "\"}";
+  }
+  Out << "\n  ]\n}\n";
+
+  std::printf("Size report written to %s\n", SizeReportPath.c_str());
+}
@@ -0,0 +1,28 @@
+#ifndef SIZEREPORT_H
+#define SIZEREPORT_H
+
+#include "llvm/Support/MemoryBuffer.h"
+#include <string>
+
+// `--ir-size-report`: attributes emitted LLVM instructions, basic blocks and
+// final machine-code bytes to the SourceLocation of the AST node that
+// produced them (through the debug locations from DebugInfo.h).
+
+// Where the JSON dump goes; empty when the report is off
+extern std::string SizeReportPath;
+
+// Counts instructions and blocks of the unoptimized module, i.e. what
+// output.ll contains. Blocks count toward their first located instruction.
+void CollectIRSizes();
+// Adds the machine-code bytes of a compiled object file, using its DWARF
+// line table to map address ranges back to source locations
+bool CollectMachineCodeSizes(llvm::MemoryBufferRef Object);
+// Prints the table (largest machine code first) and writes the JSON dump
+// (sorted by location, so CI can diff it between versions)
+void WriteSizeReport(const std::string &InputPath);
+
+// Text as the contents of a JSON string (quotes, backslashes and control
+// characters escaped). Shared with the remarks dump.
+std::string EscapeJSON(const std::string &Text);
+
+#endif
@@ -0,0 +1,172 @@
+#include "TopLevel.h"
+#include "Codegen.h"
+#include "Modules.h"
+#include <vector>
+
+using namespace llvm;
+
+unsigned ChunkInstructionLimit = 4096;
+Function *TopLevelFunction = nullptr;
+
+static Function *MainFunction = nullptr;
+static BasicBlock *MainTail = nullptr; // Where main calls the next chunk
+static Function *OutlinedCaller = nullptr;
+static BasicBlock *OutlinedCallBlock = nullptr;
+
+struct TopLevelVariable {
+  GlobalVariable *Global;
+  std::string Name;
+};
+static std::vector<TopLevelVariable> TopLevelVariables;
+
+// A module's top-level code goes into its initializer, which every module
+// importing it calls. Only the first call runs it.
+static void BeginModuleInitializer() {
+  FunctionType *FT = FunctionType::get(Type::getVoidTy(*TheContext), false);
+  MainFunction = Function::Create(FT, Function::ExternalLinkage,
+                                  getInitSymbol(ModuleName), TheModule.get());
+
+  auto *Initialized = new GlobalVariable(
+      *TheModule, Builder->getInt1Ty(), false, GlobalValue::InternalLinkage,
+      Builder->getFalse(), "kirk.initialized");
+
+  BasicBlock *Entry = BasicBlock::Create(*TheContext, "entry", MainFunction);
+  BasicBlock *Done = BasicBlock::Create(*TheContext, "done", MainFunction);
+  BasicBlock *Body = BasicBlock::Create(*TheContext, "init", MainFunction);
+
+  Builder->SetInsertPoint(Entry);
+  Builder->CreateCondBr(Builder->CreateLoad(Builder->getInt1Ty(), Initialized),
+                        Done, Body);
+  Builder->SetInsertPoint(Done);
+  Builder->CreateRetVoid();
+
+  Builder->SetInsertPoint(Body);
+  Builder->CreateStore(Builder->getTrue(), Initialized);
+  TopLevelFunction = MainFunction;
+}
+
+void BeginTopLevel() {
+  if (!ModuleName.empty()) {
+    BeginModuleInitializer();
+    return;
+  }
+
+  FunctionType *FT = FunctionType::get(Type::getInt32Ty(*TheContext), false);
+  MainFunction =
+      Function::Create(FT, Function::ExternalLinkage, "main", TheModule.get());
+
+  Builder->SetInsertPoint(
+      BasicBlock::Create(*TheContext, "entry", MainFunction));
+  TopLevelFunction = MainFunction;
+}
+
+void BeginReplEntry(Function *Entry) {
+  Builder->SetInsertPoint(BasicBlock::Create(*TheContext, "entry", Entry));
+  TopLevelFunction = Entry;
+  TopLevelVariables.clear(); // Earlier entries' modules are gone
+}
+
+void EndTopLevelStatement() {
+  if (ChunkInstructionLimit == 0 ||
+      TopLevelFunction->getInstructionCount() < ChunkInstructionLimit)
+    return;
+
+  if (TopLevelFunction == MainFunction)
+    MainTail = Builder->GetInsertBlock();
+  else
+    Builder->CreateRetVoid();
+
+  FunctionType *ChunkTy =
+      FunctionType::get(Type::getVoidTy(*TheContext), false);
+  Function *Chunk = Function::Create(ChunkTy, Function::InternalLinkage,
+                                     "kirk.chunk", TheModule.get());
+
+  // Inlining the chunks back into their single caller would rebuild the
+  // giant function we are trying to avoid
+  Chunk->addFnAttr(Attribute::NoInline);
+
+  IRBuilder<> MainBuilder(MainTail);
+  MainBuilder.CreateCall(Chunk);
+
+  Builder->SetInsertPoint(BasicBlock::Create(*TheContext, "entry", Chunk));
+  TopLevelFunction = Chunk;
+}
+
+Function *BeginOutlinedStatement() {
+  FunctionType *FT = FunctionType::get(Type::getVoidTy(*TheContext), false);
+  Function *Outlined = Function::Create(FT, Function::InternalLinkage,
+                                        "kirk.loop", TheModule.get());
+  Outlined->addFnAttr(Attribute::NoInline);
+
+  Builder->CreateCall(Outlined);
+  OutlinedCaller = TopLevelFunction;
+  OutlinedCallBlock = Builder->GetInsertBlock();
+
+  Builder->SetInsertPoint(BasicBlock::Create(*TheContext, "entry", Outlined));
+  TopLevelFunction = Outlined;
+  return Outlined;
+}
+
+void EndOutlinedStatement() {
+  Builder->CreateRetVoid();
+
+  TopLevelFunction = OutlinedCaller;
+  Builder->SetInsertPoint(OutlinedCallBlock);
+}
+
+// A variable whose every use ended up in one function (all of main for
+// small programs) doesn't need to be shared: give it back an alloca so
+// mem2reg can promote it to registers
+static void LocalizeTopLevelVariables() {
+  for (const TopLevelVariable &Var : TopLevelVariables) {
+    GlobalVariable *Global = Var.Global;
+    if (!Global->hasLocalLinkage())
+      continue; // Exported from a module
+
+    Function *Owner = nullptr;
+    bool IsShared = false;
+
+    for (User *U : Global->users()) {
+      auto *I = dyn_cast<Instruction>(U);
+      if (!I || (Owner && I->getFunction() != Owner)) {
+        IsShared = true;
+        break;
+      }
+      Owner = I->getFunction();
+    }
+
+    if (IsShared)
+      continue;
+
+    if (Owner) {
+      IRBuilder<> EntryBuilder(&Owner->getEntryBlock(),
+                               Owner->getEntryBlock().begin());
+      Global->replaceAllUsesWith(
+          EntryBuilder.CreateAlloca(Global->getValueType(), nullptr, Var.Name));
+    }
+    Global->eraseFromParent();
+  }
+  TopLevelVariables.clear();
+}
+
+void FinishTopLevel() {
+  if (TopLevelFunction != MainFunction) {
+    Builder->CreateRetVoid();
+    Builder->SetInsertPoint(MainTail);
+  }
+  TopLevelFunction = MainFunction;
+
+  LocalizeTopLevelVariables();
+}
+
+GlobalVariable *CreateTopLevelVariable(const std::string &Name,
+                                       KirkType Type) {
+  llvm::Type *Ty = getLLVMType(Type);
+
+  // Prefixed so a variable can't collide with printf or a runtime function
+  auto *Global = new GlobalVariable(*TheModule, Ty, false,
+                                    GlobalValue::InternalLinkage,
+                                    Constant::getNullValue(Ty), "kirk.var." + Name);
+  TopLevelVariables.push_back({Global, Name});
+  return Global;
+}
@@ -0,0 +1,47 @@
+#ifndef TOPLEVEL_H
+#define TOPLEVEL_H
+
+#include "Types.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include <string>
+
+// Layout of the top-level program. Statements are emitted into `main` until
+// it holds ChunkInstructionLimit instructions. From then on, each further
+// chunk of statements goes into its own internal "kirk.chunk" function, and
+// main calls the chunks in order. A huge generated program thus becomes many
+// medium-sized functions instead of one giant function that LLVM's
+// superlinear passes and the register allocator choke on.
+
+// Set by `--chunk-size=N`; 0 keeps the whole program in main
+extern unsigned ChunkInstructionLimit;
+
+// The function currently receiving top-level statements
+extern llvm::Function *TopLevelFunction;
+
+// Creates main (a module's initializer, for `--module`) and points the
+// Builder at its entry block
+void BeginTopLevel();
+// Called after each top-level statement: starts a new chunk once the
+// current one is full
+void EndTopLevelStatement();
+// Emits the next top-level statement into its own internal "kirk.loop"
+// function, called from the current top-level function. Its declarations
+// still become shared top-level variables. Used to multiversion loops.
+llvm::Function *BeginOutlinedStatement();
+void EndOutlinedStatement();
+// Closes the last chunk, turns variables that ended up used by a single
+// function back into allocas and leaves the Builder at the end of main
+void FinishTopLevel();
+
+// `--repl`: makes Entry, a function in TheModule, the top-level function for
+// one REPL entry and points the Builder at its entry block. Entries are
+// never chunked, and their variables are never localized.
+void BeginReplEntry(llvm::Function *Entry);
+
+// Storage for a variable declared at top level. Chunks share variables, so
+// they live in module globals rather than in one function's allocas.
+llvm::GlobalVariable *CreateTopLevelVariable(const std::string &Name,
+                                             KirkType Type);
+
+#endif
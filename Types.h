@@ -1,6 +1,76 @@
 #ifndef TYPES_H
 #define TYPES_H
 
-enum KirkType { KIRK_VOID, KIRK_DOUBLE, KIRK_INT, KIRK_BOOL };
+#include <string>
+#include <vector>
+
+enum KirkType {
+  KIRK_VOID,
+  KIRK_DOUBLE,
+  KIRK_INT,
+  KIRK_BOOL,
+  // Fixed-width SIMD vectors: <N x double>, <N x i64> and <N x i1> masks
+  KIRK_VEC4D,
+  KIRK_VEC4I,
+  KIRK_VEC4B,
+  KIRK_VEC8D,
+  KIRK_VEC8I,
+  KIRK_VEC8B
+};
+
+inline bool isVectorType(KirkType T) { return T >= KIRK_VEC4D; }
+
+// Number of lanes; 1 for scalars
+inline unsigned getLaneCount(KirkType T) {
+  if (!isVectorType(T))
+    return 1;
+  return T >= KIRK_VEC8D ? 8 : 4;
+}
+
+// Type of one lane; scalars are their own element type
+inline KirkType getElementType(KirkType T) {
+  if (!isVectorType(T))
+    return T;
+  static const KirkType Elements[] = {KIRK_DOUBLE, KIRK_INT, KIRK_BOOL};
+  return Elements[(T - KIRK_VEC4D) % 3];
+}
+
+// The vector of Lanes Element lanes, KIRK_VOID if Kirk has no such type.
+// One lane is the scalar itself.
+inline KirkType getVectorType(KirkType Element, unsigned Lanes) {
+  if (Lanes == 1)
+    return Element;
+  if ((Lanes != 4 && Lanes != 8) || Element == KIRK_VOID ||
+      isVectorType(Element))
+    return KIRK_VOID;
+  int First = Lanes == 4 ? KIRK_VEC4D : KIRK_VEC8D;
+  return static_cast<KirkType>(First + (Element - KIRK_DOUBLE));
+}
+
+// A record type, declared with "struct Particle { double x, double v }".
+// Records aren't values: a record variable or collection is only used
+// through its fields, which are scalars.
+struct RecordField {
+  std::string Name;
+  KirkType Type;
+};
+
+struct RecordType {
+  std::string Name;
+  std::vector<RecordField> Fields;
+
+  // Position of the field called FieldName, -1 if there is none
+  int getFieldIndex(const std::string &FieldName) const {
+    for (size_t i = 0; i < Fields.size(); ++i)
+      if (Fields[i].Name == FieldName)
+        return static_cast<int>(i);
+    return -1;
+  }
+};
+
+// How a collection of records ("Particle[1000] ps") is laid out in memory:
+// an array of structs, or one array per field ("layout(soa)"), whose
+// elements are contiguous for loops that scan a few fields
+enum RecordLayout { LAYOUT_AOS, LAYOUT_SOA };
 
 #endif
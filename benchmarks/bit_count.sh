@@ -0,0 +1,27 @@
+#!/bin/bash
+# Times counting the set bits of pseudo-random ints with % and / against
+# the bitwise operators and popcount(). Both must print the same total.
+#
+# Usage: benchmarks/bit_count.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building both versions...${RESET}"
+build_program "$BENCH_DIR/arith" "$ROOT/benchmarks/bit_count_arith.kirk"
+build_program "$BENCH_DIR/builtin" "$ROOT/benchmarks/bit_count_builtin.kirk"
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-20s %10s %10s  %s\n" "program" "ms" "vs arith" "output"
+
+BASE=$(best_time "$BENCH_DIR/arith")
+for NAME in arith builtin; do
+    MS=$(best_time "$BENCH_DIR/$NAME")
+    CHANGE=""
+    [ "$NAME" = builtin ] && CHANGE=$(percent_change "$BASE" "$MS")
+    printf "%-20s %10s %10s  %s\n" "$NAME" "$MS" "$CHANGE" \
+        "$("$BENCH_DIR/$NAME")"
+done
@@ -0,0 +1,79 @@
+#!/bin/bash
+# Shared helpers for the Kirk benchmark scripts. Source it, don't run it.
+#
+# Environment overrides:
+#   KIRK       compiler binary (default: ./kirk in the repository root)
+#   CXX        C++ compiler used for the runtime and for linking
+#   OPT_LEVEL  optimization level passed to opt/llc (default: -O2)
+#   RUNS       timed runs per measurement; the best one is reported
+
+BOLD="\033[1m"
+GREEN="\033[0;32m"
+BLUE="\033[0;34m"
+RESET="\033[0m"
+
+ROOT=$(cd "$(dirname "${BASH_SOURCE[0]}")/.." && pwd)
+KIRK=${KIRK:-$ROOT/kirk}
+CXX=${CXX:-clang++}
+OPT_LEVEL=${OPT_LEVEL:--O2}
+RUNS=${RUNS:-5}
+
+BENCH_DIR=$(mktemp -d)
+trap 'rm -rf "$BENCH_DIR"' EXIT
+
+if [ ! -x "$KIRK" ]; then
+    echo "Error: $KIRK not found. Run ./update_compiler.sh first."
+    exit 1
+fi
+
+build_runtime() {
+    $CXX -O2 -fPIC -c "$ROOT/runtime/Runtime.cpp" -o "$BENCH_DIR/runtime.o"
+}
+
+# build_program <output binary> <input.kirk> [kirk options...]
+build_program() {
+    local out=$1
+    local src
+    src=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+    shift 2
+
+    (cd "$BENCH_DIR" && "$KIRK" "$@" "$src" > /dev/null)
+    opt $OPT_LEVEL "$BENCH_DIR/output.ll" -o "$BENCH_DIR/output.bc"
+    llc $OPT_LEVEL -relocation-model=pic -filetype=obj "$BENCH_DIR/output.bc" \
+        -o "$BENCH_DIR/output.o"
+    $CXX "$BENCH_DIR/output.o" "$BENCH_DIR/runtime.o" -o "$out" -lm -lpthread
+}
+
+# build_emit_obj <output binary> <input.kirk> [kirk options...]: builds it
+# as compile_and_run.sh does, with kirk's own pipeline and backend
+build_emit_obj() {
+    local out=$1
+    local src
+    src=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+    shift 2
+
+    rm -f "$BENCH_DIR"/output*.o
+    (cd "$BENCH_DIR" && "$KIRK" --emit-obj $OPT_LEVEL "$@" "$src" > /dev/null)
+    $CXX "$BENCH_DIR"/output*.o "$BENCH_DIR/runtime.o" -o "$out" -lm -lpthread
+}
+
+# best_time <command...>: prints the best wall time in milliseconds
+best_time() {
+    local best=""
+    for ((run = 0; run < RUNS; run++)); do
+        local start end ms
+        start=$(date +%s%N)
+        "$@" > /dev/null 2>&1
+        end=$(date +%s%N)
+        ms=$(( (end - start) / 1000000 ))
+        if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then
+            best=$ms
+        fi
+    done
+    echo "$best"
+}
+
+# percent_change <baseline> <value>
+percent_change() {
+    awk -v a="$1" -v b="$2" 'BEGIN { if (a == 0) print "n/a"; else printf "%+.1f%%", 100.0 * (b - a) / a }'
+}
@@ -0,0 +1,60 @@
+#!/bin/bash
+# Stress test for machine-generated expressions nested millions of levels
+# deep: a long chained sum, deeply nested parentheses on either side, and a
+# long run of unary minuses. Times the front end alone (--check), IR
+# generation (output.ll) and the interpreter, and prints the result.
+#
+# Usage: benchmarks/deep_expressions.sh [depth]   (default 1000000)
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+DEPTH=${1:-1000000}
+
+echo -e "${GREEN}[1 / 2]${RESET} ${BOLD}Generating expressions of depth ${DEPTH}...${RESET}"
+
+# x + x + x + ...: a left-leaning tree
+awk -v n="$DEPTH" 'BEGIN {
+    printf "int x = 1\nint sum = x"
+    for (i = 1; i < n; i++) printf " + x"
+    printf "\nprint(sum)\n"
+}' > "$BENCH_DIR/chain.kirk"
+
+# ((((x + 1) - 1) + 1) ...): nested parentheses on the left
+awk -v n="$DEPTH" 'BEGIN {
+    printf "int x = 1\nint v = "
+    for (i = 0; i < n; i++) printf "("
+    printf "x"
+    for (i = 0; i < n; i++) printf (i % 2 ? " - 1)" : " + 1)")
+    printf "\nprint(v)\n"
+}' > "$BENCH_DIR/left_parens.kirk"
+
+# x * (x * (x * ...)): nested parentheses on the right
+awk -v n="$DEPTH" 'BEGIN {
+    printf "int x = 1\nint v = "
+    for (i = 1; i < n; i++) printf "x * ("
+    printf "x"
+    for (i = 1; i < n; i++) printf ")"
+    printf "\nprint(v)\n"
+}' > "$BENCH_DIR/right_parens.kirk"
+
+# - - - ... x
+awk -v n="$DEPTH" 'BEGIN {
+    printf "int x = 1\nint v = "
+    for (i = 0; i < n; i++) printf "- "
+    printf "x\nprint(v)\n"
+}' > "$BENCH_DIR/unary.kirk"
+
+echo -e "${GREEN}[2 / 2]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-14s %12s %12s %12s %10s\n" "shape" "--check ms" "output.ll ms" \
+    "--interp ms" "result"
+
+for SHAPE in chain left_parens right_parens unary; do
+    SRC="$BENCH_DIR/$SHAPE.kirk"
+    CHECK=$(best_time "$KIRK" --check "$SRC")
+    EMIT=$(cd "$BENCH_DIR" && best_time "$KIRK" "$SRC")
+    INTERP=$(best_time "$KIRK" --interp "$SRC")
+    RESULT=$("$KIRK" --interp "$SRC")
+    printf "%-14s %12s %12s %12s %10s\n" "$SHAPE" "$CHECK" "$EMIT" "$INTERP" \
+        "$RESULT"
+done
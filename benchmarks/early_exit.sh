@@ -0,0 +1,28 @@
+#!/bin/bash
+# Times a search loop that ends through a flag tested by the loop condition
+# against one that leaves through "break value". Both must print the same
+# total.
+#
+# Usage: benchmarks/early_exit.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building both versions...${RESET}"
+build_program "$BENCH_DIR/flag" "$ROOT/benchmarks/early_exit_flag.kirk"
+build_program "$BENCH_DIR/break" "$ROOT/benchmarks/early_exit_break.kirk"
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-20s %10s %10s  %s\n" "program" "ms" "vs flag" "output"
+
+BASE=$(best_time "$BENCH_DIR/flag")
+for NAME in flag break; do
+    MS=$(best_time "$BENCH_DIR/$NAME")
+    CHANGE=""
+    [ "$NAME" = break ] && CHANGE=$(percent_change "$BASE" "$MS")
+    printf "%-20s %10s %10s  %s\n" "$NAME" "$MS" "$CHANGE" \
+        "$("$BENCH_DIR/$NAME")"
+done
@@ -0,0 +1,44 @@
+#!/bin/bash
+# Times a floating-point sum loop built with strict IEEE semantics, with
+# --fp-reassoc, with --fp-reassoc --fp-contract=fast, and with --fast-math,
+# then strict and reassociated again with -march=native, where the vectorized
+# loop can use wider vectors. Reassociated sums round differently, so the
+# printed results may differ in the last digits.
+#
+# Usage: benchmarks/fast_math.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+SRC="$ROOT/benchmarks/fast_math.kirk"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building strict and fast-math binaries...${RESET}"
+build_program "$BENCH_DIR/strict" "$SRC"
+build_program "$BENCH_DIR/reassoc" "$SRC" --fp-reassoc
+build_program "$BENCH_DIR/contract" "$SRC" --fp-reassoc --fp-contract=fast
+build_program "$BENCH_DIR/fast" "$SRC" --fast-math
+build_program "$BENCH_DIR/native" "$SRC" -march=native
+build_program "$BENCH_DIR/native_reassoc" "$SRC" -march=native --fp-reassoc
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-40s %10s %10s  %s\n" "flags" "ms" "vs strict" "output"
+
+STRICT=$(best_time "$BENCH_DIR/strict")
+printf "%-40s %10s %10s  %s\n" "(strict IEEE)" "$STRICT" "" \
+    "$("$BENCH_DIR/strict" | tr '\n' ' ')"
+
+for VARIANT in "reassoc:--fp-reassoc" \
+               "contract:--fp-reassoc --fp-contract=fast" \
+               "fast:--fast-math" \
+               "native:-march=native" \
+               "native_reassoc:-march=native --fp-reassoc"; do
+    NAME=${VARIANT%%:*}
+    FLAGS=${VARIANT#*:}
+    MS=$(best_time "$BENCH_DIR/$NAME")
+    printf "%-40s %10s %10s  %s\n" "$FLAGS" "$MS" \
+        "$(percent_change "$STRICT" "$MS")" \
+        "$("$BENCH_DIR/$NAME" | tr '\n' ' ')"
+done
@@ -0,0 +1,34 @@
+#!/bin/bash
+# Times a two-stage generator pipeline against the same loop fused by hand.
+# Once opt has split, elided and inlined the coroutines, the pipeline should
+# be a plain loop in main with no malloc and no resume calls, and run about
+# as fast. It is built twice: through opt and llc, and with --emit-obj on
+# every thread, as compile_and_run.sh builds it. All must print the same
+# total.
+#
+# Usage: benchmarks/generator_pipeline.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building both versions...${RESET}"
+build_program "$BENCH_DIR/fused" "$ROOT/benchmarks/generator_fused.kirk"
+build_program "$BENCH_DIR/generators" \
+    "$ROOT/benchmarks/generator_pipeline.kirk"
+build_emit_obj "$BENCH_DIR/generators_emit_obj" \
+    "$ROOT/benchmarks/generator_pipeline.kirk"
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-20s %10s %10s  %s\n" "program" "ms" "vs fused" "output"
+
+BASE=$(best_time "$BENCH_DIR/fused")
+for NAME in fused generators generators_emit_obj; do
+    MS=$(best_time "$BENCH_DIR/$NAME")
+    CHANGE=""
+    [ "$NAME" != fused ] && CHANGE=$(percent_change "$BASE" "$MS")
+    printf "%-20s %10s %10s  %s\n" "$NAME" "$MS" "$CHANGE" \
+        "$("$BENCH_DIR/$NAME")"
+done
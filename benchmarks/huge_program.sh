@@ -0,0 +1,62 @@
+#!/bin/bash
+# Measures compile time on a huge generated top-level program: one giant
+# main function versus outlined chunks optimized and code-generated on
+# several threads by `kirk --emit-obj`.
+#
+# Usage: benchmarks/huge_program.sh [statements]   (default 20000)
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+STATEMENTS=${1:-20000}
+SRC="$BENCH_DIR/huge.kirk"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Generating a ${STATEMENTS}-statement program...${RESET}"
+awk -v n="$STATEMENTS" 'BEGIN {
+    print "int acc = 0"
+    for (i = 0; i < n; i += 3) {
+        printf "int v%d = %d %% 13\n", i, i
+        printf "while v%d < 20 { v%d = v%d + 3 }\n", i, i, i
+        printf "acc = if v%d > 21 then acc + v%d else acc - 1\n", i, i
+    }
+    print "print(acc)"
+}' > "$SRC"
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+# Single function, the way the compiler worked before outlining
+monolithic() {
+    (cd "$BENCH_DIR" && "$KIRK" --chunk-size=0 "$SRC" > /dev/null)
+    opt $OPT_LEVEL "$BENCH_DIR/output.ll" -o "$BENCH_DIR/output.bc"
+    llc $OPT_LEVEL -relocation-model=pic -filetype=obj "$BENCH_DIR/output.bc" \
+        -o "$BENCH_DIR/output.o"
+}
+
+# in_process <kirk options...>
+in_process() {
+    rm -f "$BENCH_DIR"/output*.o
+    (cd "$BENCH_DIR" && "$KIRK" --emit-obj $OPT_LEVEL "$@" "$SRC" > /dev/null)
+}
+
+run_program() {
+    $CXX "$BENCH_DIR"/output*.o "$BENCH_DIR/runtime.o" -o "$BENCH_DIR/program" \
+        -lm -lpthread
+    "$BENCH_DIR/program"
+}
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing compilation (best of ${RUNS})${RESET}"
+printf "%-44s %12s %10s\n" "configuration" "compile ms" "output"
+
+report() {
+    local label=$1
+    shift
+    local ms
+    ms=$(best_time "$@")
+    printf "%-44s %12s %10s\n" "$label" "$ms" "$(run_program)"
+}
+
+report "opt + llc, one giant main" monolithic
+report "--emit-obj, one giant main" in_process --chunk-size=0 --jobs=1
+report "--emit-obj, outlined chunks, 1 thread" in_process --jobs=1
+report "--emit-obj, outlined chunks, all threads" in_process
@@ -0,0 +1,24 @@
+#!/bin/bash
+# Quantifies the runtime overhead of `kirk --instrument`.
+#
+# Usage: benchmarks/instrument_overhead.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+echo -e "${GREEN}[1 / 2]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 2]${RESET} ${BOLD}Timing plain vs instrumented builds (best of ${RUNS})${RESET}"
+printf "%-26s %10s %14s %10s\n" "program" "plain ms" "instrumented" "overhead"
+
+for NAME in instrument_long_loops instrument_short_loops; do
+    build_program "$BENCH_DIR/plain" "$ROOT/benchmarks/$NAME.kirk"
+    build_program "$BENCH_DIR/instrumented" "$ROOT/benchmarks/$NAME.kirk" --instrument
+
+    PLAIN=$(best_time "$BENCH_DIR/plain")
+    INSTRUMENTED=$(best_time "$BENCH_DIR/instrumented")
+
+    printf "%-26s %10s %14s %10s\n" "$NAME" "$PLAIN" "$INSTRUMENTED" \
+        "$(percent_change "$PLAIN" "$INSTRUMENTED")"
+done
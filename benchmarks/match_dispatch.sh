@@ -0,0 +1,59 @@
+#!/bin/bash
+# Times a 32-way dispatch on a pseudo-random int in 0..128, with arms for
+# ranges of 4 values, written as a match (one switch, lowered to a jump
+# table) and as a chain of if/else expressions testing k < 4, k < 8, ...
+# Both versions must print the same checksum.
+#
+# Usage: benchmarks/match_dispatch.sh [iterations] (default 50000000)
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+ITERATIONS=${1:-50000000}
+ARMS=32
+
+# program <match|if>: the benchmark program
+program() {
+    awk -v style="$1" -v arms=$ARMS -v n="$ITERATIONS" 'BEGIN {
+        print "int state = 1"
+        print "int sum = 0"
+        printf "for i in 0..%d {\n", n
+        print "  state = (state * 1103515245 + 12345) % 2147483648"
+        printf "  int k = (state / 65536) %% %d\n", arms * 4
+        if (style == "match") {
+            print "  sum = sum + match k {"
+            for (a = 0; a < arms - 1; a++)
+                printf "    %d..%d => state %% %d,\n", a * 4, a * 4 + 4, a + 7
+            printf "    _ => state %% %d\n", arms + 7
+            print "  }"
+        } else {
+            printf "  sum = sum + "
+            for (a = 0; a < arms - 1; a++)
+                printf "if k < %d then state %% %d else ", a * 4 + 4, a + 7
+            printf "state %% %d\n", arms + 7
+        }
+        print "}"
+        print "print(sum)"
+    }'
+}
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building both versions...${RESET}"
+program match > "$BENCH_DIR/match.kirk"
+program if > "$BENCH_DIR/if_chain.kirk"
+build_program "$BENCH_DIR/if_chain" "$BENCH_DIR/if_chain.kirk"
+build_program "$BENCH_DIR/match" "$BENCH_DIR/match.kirk"
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-20s %10s %12s  %s\n" "program" "ms" "vs if chain" "output"
+
+BASE=$(best_time "$BENCH_DIR/if_chain")
+for NAME in if_chain match; do
+    MS=$(best_time "$BENCH_DIR/$NAME")
+    CHANGE=""
+    [ "$NAME" = match ] && CHANGE=$(percent_change "$BASE" "$MS")
+    printf "%-20s %10s %12s  %s\n" "$NAME" "$MS" "$CHANGE" \
+        "$("$BENCH_DIR/$NAME")"
+done
@@ -0,0 +1,94 @@
+#!/bin/bash
+# Streams a file of doubles (2 GiB by default) through a Kirk reduction loop
+# over a memory-mapped view, and through the same loop written in C++ over
+# mmap, for comparison. The file is read once before timing, so the runs
+# measure reading from the page cache rather than from the disk; pass a size
+# larger than RAM to include the disk.
+#
+# Usage: benchmarks/mmap_views.sh [GiB]
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+GIB=${1:-2}
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Writing ${GIB} GiB of doubles and building the readers...${RESET}"
+
+# Pseudo-random doubles in [0, 1000), written in native byte order
+cat > "$BENCH_DIR/generate.cpp" <<'CPP'
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+int main(int argc, char **argv) {
+  long long Count = std::atoll(argv[1]);
+  static double Buffer[1 << 16];
+  uint64_t State = 88172645463325252ull;
+
+  for (long long Done = 0; Done < Count;) {
+    long long Block = Count - Done < (1 << 16) ? Count - Done : (1 << 16);
+    for (long long i = 0; i < Block; ++i) {
+      State ^= State << 13;
+      State ^= State >> 7;
+      State ^= State << 17;
+      Buffer[i] = (State >> 11) * 0x1.0p-53 * 1000.0;
+    }
+    std::fwrite(Buffer, sizeof(double), Block, stdout);
+    Done += Block;
+  }
+  return 0;
+}
+CPP
+
+cat > "$BENCH_DIR/mmap_reader.cpp" <<'CPP'
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main() {
+  int FD = open("data.bin", O_RDONLY);
+  struct stat Info;
+  fstat(FD, &Info);
+  long long Count = Info.st_size / sizeof(double);
+  auto *Data = static_cast<const double *>(
+      mmap(nullptr, Info.st_size, PROT_READ, MAP_PRIVATE, FD, 0));
+  madvise(const_cast<double *>(Data), Info.st_size, MADV_SEQUENTIAL);
+
+  double Sum = 0.0;
+  for (long long i = 0; i < Count; ++i)
+    Sum += Data[i];
+  std::printf("%lld\n%.2f\n", Count, Sum);
+  return 0;
+}
+CPP
+
+$CXX -O2 "$BENCH_DIR/generate.cpp" -o "$BENCH_DIR/generate"
+$CXX -O2 "$BENCH_DIR/mmap_reader.cpp" -o "$BENCH_DIR/mmap_reader"
+build_program "$BENCH_DIR/kirk_strict" "$ROOT/benchmarks/mmap_views.kirk"
+build_program "$BENCH_DIR/kirk_reassoc" "$ROOT/benchmarks/mmap_views.kirk" \
+    --fp-reassoc
+
+COUNT=$((GIB * 134217728))
+"$BENCH_DIR/generate" "$COUNT" > "$BENCH_DIR/data.bin"
+cat "$BENCH_DIR/data.bin" > /dev/null
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Summing ${COUNT} doubles (best of ${RUNS})${RESET}"
+printf "%-28s %10s %10s  %s\n" "reader" "ms" "GB/s" "count, sum"
+
+cd "$BENCH_DIR"
+for ROW in "kirk view:./kirk_strict" \
+           "kirk view --fp-reassoc:./kirk_reassoc" \
+           "C++ mmap:./mmap_reader"; do
+    NAME=${ROW%%:*}
+    READER=${ROW#*:}
+    MS=$(best_time $READER)
+    RESULT=$($READER | tr '\n' ' ')
+    printf "%-28s %10s %10s  %s\n" "$NAME" "$MS" \
+        "$(awk -v b="$((COUNT * 8))" -v ms="$MS" 'BEGIN { if (ms > 0) printf "%.2f", b / ms / 1e6 }')" \
+        "$RESULT"
+done
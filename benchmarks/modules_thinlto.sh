@@ -0,0 +1,88 @@
+#!/bin/bash
+# Measures separate compilation: a program split into N modules that import
+# a common base module, built from scratch, rebuilt with nothing changed,
+# after editing one module, and after changing the base's interface. The
+# same program in a single file is the baseline. ThinLTO must give both
+# versions the same result.
+#
+# Usage: benchmarks/modules_thinlto.sh [modules] [statements per module]
+#        (default 40 modules of 1500 statements)
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+MODULES=${1:-40}
+STATEMENTS=${2:-1500}
+MOD_DIR="$BENCH_DIR/modules"
+mkdir -p "$MOD_DIR"
+
+# module_body <index>: the statements of module <index>, which export v<index>
+module_body() {
+    awk -v m="$1" -v n="$STATEMENTS" 'BEGIN {
+        printf "export int v%d = 0\n", m
+        for (i = 0; i < n; i += 3) {
+            printf "int m%d_%d = (%d + seed) %% 13\n", m, i, i
+            printf "while m%d_%d < 20 { m%d_%d = m%d_%d + 3 }\n", m, i, m, i, m, i
+            printf "v%d = if m%d_%d > 21 then v%d + m%d_%d else v%d - 1\n", m, m, i, m, m, i, m
+        }
+    }'
+}
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Generating ${MODULES} modules of ${STATEMENTS} statements...${RESET}"
+echo "export int seed = 7" > "$MOD_DIR/base.kirk"
+{
+    echo "export int seed = 7"
+    for ((m = 0; m < MODULES; m++)); do
+        echo "import base" > "$MOD_DIR/m$m.kirk"
+        module_body $m >> "$MOD_DIR/m$m.kirk"
+        module_body $m | sed 's/^export //'
+    done
+    echo -n "print(0"
+    for ((m = 0; m < MODULES; m++)); do echo -n " + v$m"; done
+    echo ")"
+} > "$BENCH_DIR/single.kirk"
+{
+    for ((m = 0; m < MODULES; m++)); do echo "import m$m"; done
+    echo -n "print(0"
+    for ((m = 0; m < MODULES; m++)); do echo -n " + v$m"; done
+    echo ")"
+} > "$MOD_DIR/main.kirk"
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+# build <input.kirk>: prints the wall time of `kirk --emit-obj` in ms
+build() {
+    local start end
+    rm -f "$BENCH_DIR"/output*.o
+    start=$(date +%s%N)
+    (cd "$BENCH_DIR" && "$KIRK" --emit-obj $OPT_LEVEL "$1" > /dev/null)
+    end=$(date +%s%N)
+    echo $(( (end - start) / 1000000 ))
+}
+
+run_program() {
+    $CXX "$BENCH_DIR"/output*.o "$BENCH_DIR/runtime.o" -o "$BENCH_DIR/program" \
+        -lm -lpthread
+    "$BENCH_DIR/program"
+}
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing builds${RESET}"
+printf "%-40s %12s %12s\n" "build" "compile ms" "output"
+
+report() {
+    local label=$1
+    local ms
+    ms=$(build "$2")
+    printf "%-40s %12s %12s\n" "$label" "$ms" "$(run_program)"
+}
+
+report "single file" "$BENCH_DIR/single.kirk"
+report "modules, from scratch" "$MOD_DIR/main.kirk"
+report "modules, nothing changed" "$MOD_DIR/main.kirk"
+
+echo "v0 = v0 + 1" >> "$MOD_DIR/m0.kirk"
+report "modules, one module edited" "$MOD_DIR/main.kirk"
+
+echo "export int unused = 1" >> "$MOD_DIR/base.kirk"
+report "modules, base interface changed" "$MOD_DIR/main.kirk"
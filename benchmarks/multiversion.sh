@@ -0,0 +1,35 @@
+#!/bin/bash
+# Runs one `--multiversion` binary with the dispatcher capped at each x86-64
+# ISA level (KIRK_CPU_LEVEL), next to a generic build and a -march=native
+# build of the same program.
+#
+# Usage: benchmarks/multiversion.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+SRC="$ROOT/benchmarks/multiversion.kirk"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building generic, native and multiversioned binaries...${RESET}"
+build_program "$BENCH_DIR/generic" "$SRC"
+build_program "$BENCH_DIR/native" "$SRC" -march=native
+build_program "$BENCH_DIR/multi" "$SRC" --multiversion
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-34s %10s %10s\n" "binary" "ms" "vs generic"
+
+GENERIC=$(best_time "$BENCH_DIR/generic")
+printf "%-34s %10s %10s\n" "generic x86-64" "$GENERIC" ""
+
+NATIVE=$(best_time "$BENCH_DIR/native")
+printf "%-34s %10s %10s\n" "-march=native" "$NATIVE" \
+    "$(percent_change "$GENERIC" "$NATIVE")"
+
+for LEVEL in 1 2 3 4; do
+    MS=$(KIRK_CPU_LEVEL=$LEVEL best_time "$BENCH_DIR/multi")
+    printf "%-34s %10s %10s\n" "--multiversion, level <= $LEVEL" "$MS" \
+        "$(percent_change "$GENERIC" "$MS")"
+done
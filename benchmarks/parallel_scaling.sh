@@ -0,0 +1,25 @@
+#!/bin/bash
+# Measures `parallel for` speedup from 1 up to MAX_THREADS (default: all
+# cores) by varying KIRK_NUM_THREADS on the same binary.
+#
+# Usage: benchmarks/parallel_scaling.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+MAX_THREADS=${MAX_THREADS:-$(nproc)}
+
+echo -e "${GREEN}[1 / 2]${RESET} ${BOLD}Building benchmarks/parallel_scaling.kirk...${RESET}"
+build_runtime
+build_program "$BENCH_DIR/parallel" "$ROOT/benchmarks/parallel_scaling.kirk"
+
+echo -e "${GREEN}[2 / 2]${RESET} ${BOLD}Timing 1..${MAX_THREADS} threads (best of ${RUNS})${RESET}"
+printf "%8s %10s %10s\n" "threads" "ms" "speedup"
+
+BASELINE=""
+for ((THREADS = 1; THREADS <= MAX_THREADS; THREADS++)); do
+    MS=$(KIRK_NUM_THREADS=$THREADS best_time "$BENCH_DIR/parallel")
+    [ -z "$BASELINE" ] && BASELINE=$MS
+    printf "%8d %10s %10s\n" "$THREADS" "$MS" \
+        "$(awk -v a="$BASELINE" -v b="$MS" 'BEGIN { if (b == 0) print "n/a"; else printf "%.2fx", a / b }')"
+done
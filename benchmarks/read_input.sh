@@ -0,0 +1,114 @@
+#!/bin/bash
+# Pipes N numbers (100 million by default) into Kirk programs that sum them
+# with read_int() and read_double(), and into the same loops written in C++
+# with scanf, for comparison. "pipe only" is the time to produce the input
+# and drain the pipe, which every other row includes.
+#
+# Usage: benchmarks/read_input.sh [count]
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+COUNT=${1:-100000000}
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building the input generator and the readers...${RESET}"
+
+# Pseudo-random numbers, one per line: integers of up to 10 digits, or
+# decimals with up to six fraction digits
+cat > "$BENCH_DIR/generate.cpp" <<'CPP'
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char **argv) {
+  long long Count = std::atoll(argv[1]);
+  bool Doubles = std::strcmp(argv[2], "double") == 0;
+  static char Buffer[1 << 16];
+  char *Out = Buffer;
+  uint64_t State = 88172645463325252ull;
+
+  for (long long i = 0; i < Count; ++i) {
+    State ^= State << 13;
+    State ^= State >> 7;
+    State ^= State << 17;
+    if (Out > Buffer + sizeof(Buffer) - 64) {
+      std::fwrite(Buffer, 1, Out - Buffer, stdout);
+      Out = Buffer;
+    }
+
+    long long Value = (long long)(State % 20000000000ull) - 10000000000ll;
+    if (!Doubles) {
+      Out = std::to_chars(Out, Out + 32, Value).ptr;
+    } else {
+      // Value / 1000, then six fraction digits
+      Out = std::to_chars(Out, Out + 32, Value / 1000).ptr;
+      unsigned Fraction = (State >> 44) % 1000000;
+      *Out++ = '.';
+      for (int Digit = 5; Digit >= 0; --Digit) {
+        Out[Digit] = '0' + Fraction % 10;
+        Fraction /= 10;
+      }
+      Out += 6;
+    }
+    *Out++ = '\n';
+  }
+  std::fwrite(Buffer, 1, Out - Buffer, stdout);
+  return 0;
+}
+CPP
+
+cat > "$BENCH_DIR/scanf_reader.cpp" <<'CPP'
+#include <cstdio>
+#include <cstring>
+
+int main(int argc, char **argv) {
+  long long Count = 0;
+  if (std::strcmp(argv[1], "double") == 0) {
+    double Value, Sum = 0.0;
+    while (std::scanf("%lf", &Value) == 1) {
+      Sum += Value;
+      ++Count;
+    }
+    std::printf("%lld\n%.2f\n", Count, Sum);
+  } else {
+    long long Value, Sum = 0;
+    while (std::scanf("%lld", &Value) == 1) {
+      Sum += Value;
+      ++Count;
+    }
+    std::printf("%lld\n%lld\n", Count, Sum);
+  }
+  return 0;
+}
+CPP
+
+$CXX -O2 "$BENCH_DIR/generate.cpp" -o "$BENCH_DIR/generate"
+$CXX -O2 "$BENCH_DIR/scanf_reader.cpp" -o "$BENCH_DIR/scanf_reader"
+build_program "$BENCH_DIR/kirk_int" "$ROOT/benchmarks/read_input.kirk"
+build_program "$BENCH_DIR/kirk_double" "$ROOT/benchmarks/read_input_double.kirk"
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing ${COUNT} numbers through a pipe (best of ${RUNS})${RESET}"
+printf "%-28s %10s %14s  %s\n" "reader" "ms" "M numbers/s" "count, sum"
+
+GEN="$BENCH_DIR/generate $COUNT"
+for TYPE in int double; do
+    for ROW in "pipe only:cat" \
+               "kirk read_$TYPE():$BENCH_DIR/kirk_$TYPE" \
+               "scanf:$BENCH_DIR/scanf_reader $TYPE"; do
+        NAME=${ROW%%:*}
+        READER=${ROW#*:}
+        MS=$(best_time bash -c "$GEN $TYPE | $READER > /dev/null")
+        RESULT=""
+        if [ "$NAME" != "pipe only" ]; then
+            RESULT=$(bash -c "$GEN $TYPE | $READER" | tr '\n' ' ')
+        fi
+        printf "%-28s %10s %14s  %s\n" "$NAME ($TYPE)" "$MS" \
+            "$(awk -v n="$COUNT" -v ms="$MS" 'BEGIN { if (ms > 0) printf "%.1f", n / ms / 1000 }')" \
+            "$RESULT"
+    done
+done
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Times a loop summing one field of a million records, with the collection
+# laid out as an array of structs and, from the same source, as a struct of
+# arrays (layout(soa)). Both must print the same total. --fp-reassoc lets
+# LLVM vectorize the floating-point sum in both.
+#
+# Usage: benchmarks/record_layout.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building both layouts...${RESET}"
+sed 's/layout(aos)/layout(soa)/' "$ROOT/benchmarks/record_layout.kirk" \
+    > "$BENCH_DIR/record_layout_soa.kirk"
+build_program "$BENCH_DIR/aos" "$ROOT/benchmarks/record_layout.kirk" \
+    --fp-reassoc
+build_program "$BENCH_DIR/soa" "$BENCH_DIR/record_layout_soa.kirk" \
+    --fp-reassoc
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-20s %10s %10s  %s\n" "layout" "ms" "vs aos" "output"
+
+BASE=$(best_time "$BENCH_DIR/aos")
+for NAME in aos soa; do
+    MS=$(best_time "$BENCH_DIR/$NAME")
+    CHANGE=""
+    [ "$NAME" = soa ] && CHANGE=$(percent_change "$BASE" "$MS")
+    printf "%-20s %10s %10s  %s\n" "$NAME" "$MS" "$CHANGE" \
+        "$("$BENCH_DIR/$NAME")"
+done
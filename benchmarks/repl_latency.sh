@@ -0,0 +1,34 @@
+#!/bin/bash
+# Measures the per-entry latency of `kirk --repl`: pipes in a session of N
+# small entries (a declaration and an expression that reads it, alternately)
+# and divides the wall time, minus that of an empty session, by N. Repeated
+# at -O0 and -O2.
+#
+# Usage: benchmarks/repl_latency.sh [entries]
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+ENTRIES=${1:-1000}
+SESSION="$BENCH_DIR/session.txt"
+
+echo -e "${GREEN}[1 / 2]${RESET} ${BOLD}Writing a session of ${ENTRIES} entries...${RESET}"
+for ((i = 0; i < ENTRIES / 2; i++)); do
+    echo "int v$i = $i"
+    echo "v$i * 2 + 1"
+done > "$SESSION"
+
+run_session() {
+    "$KIRK" --repl "$1" < "$2"
+}
+
+echo -e "${GREEN}[2 / 2]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-8s %12s %12s %14s\n" "level" "startup ms" "session ms" "ms per entry"
+
+for LEVEL in -O0 -O2; do
+    STARTUP=$(best_time run_session "$LEVEL" /dev/null)
+    TOTAL=$(best_time run_session "$LEVEL" "$SESSION")
+    PER_ENTRY=$(awk -v t="$TOTAL" -v s="$STARTUP" -v n="$ENTRIES" \
+        'BEGIN { printf "%.2f", (t - s) / n }')
+    printf "%-8s %12s %12s %14s\n" "$LEVEL" "$STARTUP" "$TOTAL" "$PER_ENTRY"
+done
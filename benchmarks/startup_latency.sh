@@ -0,0 +1,41 @@
+#!/bin/bash
+# Compares time-to-output of `kirk --interp` against the native pipeline
+# (kirk -> llc -> link -> run) on a short script, and on a long-running
+# loop where the compiled code's speed starts to pay for its build time.
+#
+# Usage: benchmarks/startup_latency.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+# The native pipeline as compile_and_run.sh runs it, end to end
+native_pipeline() {
+    (cd "$BENCH_DIR" && "$KIRK" "$1" > /dev/null)
+    llc -relocation-model=pic -filetype=obj "$BENCH_DIR/output.ll" \
+        -o "$BENCH_DIR/output.o"
+    $CXX "$BENCH_DIR/output.o" "$BENCH_DIR/runtime.o" -o "$BENCH_DIR/program" \
+        -lm -lpthread
+    "$BENCH_DIR/program"
+}
+
+echo -e "${GREEN}[1 / 2]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 2]${RESET} ${BOLD}Timing interpreter vs native pipeline (best of ${RUNS})${RESET}"
+printf "%-26s %10s %12s %12s\n" "program" "interp ms" "pipeline ms" "run-only ms"
+
+for NAME in startup_script instrument_long_loops; do
+    SRC="$ROOT/benchmarks/$NAME.kirk"
+
+    # Both must agree before their timings mean anything
+    if ! diff <("$KIRK" --interp "$SRC") <(native_pipeline "$SRC") > /dev/null; then
+        echo "Error: --interp output differs from the compiled program for $NAME"
+        exit 1
+    fi
+
+    INTERP=$(best_time "$KIRK" --interp "$SRC")
+    PIPELINE=$(best_time native_pipeline "$SRC")
+    RUN_ONLY=$(best_time "$BENCH_DIR/program")
+
+    printf "%-26s %10s %12s %12s\n" "$NAME" "$INTERP" "$PIPELINE" "$RUN_ONLY"
+done
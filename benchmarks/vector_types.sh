@@ -0,0 +1,36 @@
+#!/bin/bash
+# Times a floating-point sum loop written with scalars and with explicit
+# vec4d partial sums, at the default target and with -march=native. The
+# vector version adds in a different order, so its results may differ in the
+# last digits.
+#
+# Usage: benchmarks/vector_types.sh
+set -e
+
+source "$(dirname "$0")/common.sh"
+
+SCALAR="$ROOT/benchmarks/vector_scalar.kirk"
+EXPLICIT="$ROOT/benchmarks/vector_explicit.kirk"
+
+echo -e "${GREEN}[1 / 3]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+build_runtime
+
+echo -e "${GREEN}[2 / 3]${RESET} ${BOLD}Building scalar and vector binaries...${RESET}"
+build_program "$BENCH_DIR/scalar" "$SCALAR"
+build_program "$BENCH_DIR/explicit" "$EXPLICIT"
+build_program "$BENCH_DIR/scalar_native" "$SCALAR" -march=native
+build_program "$BENCH_DIR/explicit_native" "$EXPLICIT" -march=native
+
+echo -e "${GREEN}[3 / 3]${RESET} ${BOLD}Timing (best of ${RUNS})${RESET}"
+printf "%-30s %10s %10s  %s\n" "program" "ms" "vs scalar" "output"
+
+for TARGET in "" "_native"; do
+    BASE=$(best_time "$BENCH_DIR/scalar$TARGET")
+    for NAME in scalar explicit; do
+        MS=$(best_time "$BENCH_DIR/$NAME$TARGET")
+        CHANGE=""
+        [ "$NAME" = explicit ] && CHANGE=$(percent_change "$BASE" "$MS")
+        printf "%-30s %10s %10s  %s\n" "$NAME$TARGET" "$MS" "$CHANGE" \
+            "$("$BENCH_DIR/$NAME$TARGET" | tr '\n' ' ')"
+    done
+done
@@ -9,17 +9,19 @@ RESET="\033[0m"
 TOTAL_STEPS=5
 
 if [ $# -eq 0 ]; then
-    echo "Usage: $0 <input.kirk>"
+    echo "Usage: $0 <input.kirk> [kirk options...]"
     exit 1
 fi
 
 INPUT_FILE=$1
+shift
 
 cleanup() {
     EXIT_CODE=$?
     
     echo -e "${GREEN}[5 / ${TOTAL_STEPS}]${RESET} ${BOLD}Cleaning up temporary files...${RESET}"
-    rm -f output.o
+    rm -f output.o output.*.o
+    rm -f runtime.o
     rm -f program
 
     if [ $EXIT_CODE -eq 0 ]; then
@@ -31,14 +33,15 @@ cleanup() {
 
 trap cleanup EXIT INT TERM
 
-echo -e "${GREEN}[1 / ${TOTAL_STEPS}]${RESET} ${BOLD}Compiling Kirk source:${RESET} $INPUT_FILE"
-./kirk "$INPUT_FILE"
+echo -e "${GREEN}[1 / ${TOTAL_STEPS}]${RESET} ${BOLD}Compiling Kirk source to object files (PIC mode):${RESET} $INPUT_FILE"
+rm -f output.o output.*.o
+./kirk --emit-obj "$@" "$INPUT_FILE"
 
-echo -e "${GREEN}[2 / ${TOTAL_STEPS}]${RESET} ${BOLD}Generating object file (PIC mode)...${RESET}"
-llc -relocation-model=pic -filetype=obj output.ll -o output.o
+echo -e "${GREEN}[2 / ${TOTAL_STEPS}]${RESET} ${BOLD}Compiling the Kirk runtime...${RESET}"
+clang++ -O2 -fPIC -c runtime/Runtime.cpp -o runtime.o
 
 echo -e "${GREEN}[3 / ${TOTAL_STEPS}]${RESET} ${BOLD}Linking executable...${RESET}"
-clang output.o -o program -lm
+clang++ output*.o runtime.o -o program -lm
 
 echo -e "${GREEN}[4 / ${TOTAL_STEPS}]${RESET} ${BOLD}Running program output:${RESET}"
 echo ""
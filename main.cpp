@@ -1,35 +1,304 @@
+#include "Backend.h"
+#include "Bytecode.h"
 #include "Codegen.h"
+#include "DebugInfo.h"
 #include "Lexer.h"
+#include "Modules.h"
+#include "Multiversion.h"
 #include "Parser.h"
+#include "Profiler.h"
+#include "Remarks.h"
+#include "Repl.h"
+#include "Sema.h"
+#include "SizeReport.h"
+#include "TopLevel.h"
 #include "llvm/IR/Verifier.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
+#include <cctype>
 #include <fstream>
 #include <iostream>
 
 using namespace llvm;
 
+static void PrintUsage() {
+  std::cerr << "Usage: kirk [options] <filename.kirk>\n"
+            << "       kirk --repl [options]\n"
+            << "Options:\n"
+            << "  --check        Parse and type-check only, without generating\n"
+            << "                 code\n"
+            << "  --instrument   Profile while loops and top-level statements,\n"
+            << "                 printing a report when the program exits\n"
+            << "  --interp       Run the program directly on the bytecode\n"
+            << "                 interpreter instead of writing output.ll\n"
+            << "  --repl         Read statements from stdin and JIT-compile\n"
+            << "                 and run each one as it is entered\n"
+            << "  --module       Compile an imported module on its own, to\n"
+            << "                 <name>.bc and its interface <name>.kirki\n"
+            << "  --emit-obj     Optimize and write native object files\n"
+            << "                 (output.o, or output.<n>.o per partition)\n"
+            << "                 instead of output.ll. Required for programs\n"
+            << "                 that import modules, which it links with\n"
+            << "                 ThinLTO\n"
+            << "  -O0 .. -O3     Optimization level for --emit-obj (default -O2)\n"
+            << "  --jobs=N       Threads for --emit-obj (default: all cores)\n"
+            << "  -mcpu=CPU      Generate code for CPU (\"native\" for this\n"
+            << "                 machine); -march=CPU is the same\n"
+            << "  --ir-size-report[=FILE]\n"
+            << "                 Attribute IR instructions, blocks and machine\n"
+            << "                 code bytes to source locations; prints a table\n"
+            << "                 and writes JSON (default ir-size-report.json)\n"
+            << "  --remarks[=missed,passed]\n"
+            << "                 Report what the vectorizer, unroller, LICM,\n"
+            << "                 GVN and inliner did (passed) or could not do\n"
+            << "                 (missed, the default) at the source lines,\n"
+            << "                 and write them as JSON\n"
+            << "  --remarks-file=FILE\n"
+            << "                 Where --remarks writes JSON (default\n"
+            << "                 remarks.json)\n"
+            << "  --fast-math    Let LLVM reorder and simplify floating-point\n"
+            << "                 math as if it were exact (all fast-math flags)\n"
+            << "  --fp-reassoc   Only allow reassociation, so floating-point\n"
+            << "                 reductions can be vectorized\n"
+            << "  --fp-contract=fast|off\n"
+            << "                 Allow fusing a * b + c into one FMA\n"
+            << "  --multiversion Compile hot loops for x86-64-v2/v3/v4 too and\n"
+            << "                 pick the best copy for the CPU at startup\n"
+            << "  --chunk-size=N Outline top-level statements into a new\n"
+            << "                 function every N IR instructions (default\n"
+            << "                 4096, 0 disables)\n";
+}
+
+// Parses the N of an option like "--jobs=N"
+static bool ParseCount(const std::string &Arg, size_t PrefixLength,
+                       unsigned &Count) {
+  std::string Digits = Arg.substr(PrefixLength);
+  if (Digits.empty() || Digits.size() > 9 ||
+      Digits.find_first_not_of("0123456789") != std::string::npos) {
+    std::cerr << "Error: Expected a number in " << Arg << "\n";
+    return false;
+  }
+  Count = std::stoul(Digits);
+  return true;
+}
+
+// `--check`: runs the front end (parser and semantic analysis) over the
+// whole file without initializing LLVM
+static int CheckProgram(const char *InputPath) {
+  getNextToken();
+  ParseImports();
+
+  while (CurTok != TOK_EOF) {
+    if (CurTok == ';') {
+      getNextToken();
+      continue;
+    }
+
+    if (auto AST = ParseExpression())
+      AST->typecheck();
+    else
+      getNextToken();
+  }
+
+  if (ErrorCount > 0) {
+    std::cerr << InputPath << ": " << ErrorCount << " error(s) found\n";
+    return 1;
+  }
+
+  std::cout << InputPath << ": no errors found\n";
+  return 0;
+}
+
+// `--interp`: lowers the whole file to register bytecode and runs it in
+// process, skipping LLVM, llc and the linker entirely
+static int InterpretProgram() {
+  BytecodeEmitter Emitter;
+  getNextToken();
+
+  if (CurTok == TOK_IMPORT) {
+    std::cerr << "Error: --interp can't run programs that import modules; "
+                 "compile them with --emit-obj\n";
+    return 1;
+  }
+
+  while (CurTok != TOK_EOF) {
+    if (CurTok == ';') {
+      getNextToken();
+      continue;
+    }
+
+    if (auto AST = ParseExpression()) {
+      AST->typecheck();
+
+      // Temporaries never outlive their top-level statement
+      unsigned Mark = Emitter.markTemps();
+      AST->lowerToBytecode(Emitter);
+      Emitter.releaseTemps(Mark);
+    } else {
+      getNextToken();
+    }
+  }
+
+  // Like the compiler, refuse to run a program that had syntax errors
+  if (ErrorCount > 0)
+    return 1;
+
+  RunBytecode(Emitter.finish());
+  return 0;
+}
+
 int main(int argc, char **argv) {
-  if (argc < 2) {
-    std::cerr << "Usage: kirk <filename.kirk>\n";
+  const char *InputPath = nullptr;
+  bool CheckOnly = false;
+  bool Interpret = false;
+  bool Repl = false;
+  bool EmitObject = false;
+  bool CompileModule = false;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string Arg = argv[i];
+
+    // Imports are rebuilt with the same code generation options
+    if (Arg.rfind("-O", 0) == 0 || Arg.rfind("-march=", 0) == 0 ||
+        Arg.rfind("-mcpu=", 0) == 0 || Arg == "--fast-math" ||
+        Arg.rfind("--fp-", 0) == 0)
+      ModuleOptions.push_back(Arg);
+
+    if (Arg == "--check") {
+      CheckOnly = true;
+    } else if (Arg == "--instrument") {
+      ProfilingEnabled = true;
+    } else if (Arg == "--interp") {
+      Interpret = true;
+    } else if (Arg == "--repl") {
+      Repl = true;
+    } else if (Arg == "--module") {
+      CompileModule = true;
+    } else if (Arg == "--emit-obj") {
+      EmitObject = true;
+    } else if (Arg.size() == 3 && Arg[0] == '-' && Arg[1] == 'O' &&
+               Arg[2] >= '0' && Arg[2] <= '3') {
+      OptLevel = Arg[2] - '0';
+    } else if (Arg.rfind("-march=", 0) == 0) {
+      TargetCPU = Arg.substr(7);
+    } else if (Arg.rfind("-mcpu=", 0) == 0) {
+      TargetCPU = Arg.substr(6);
+    } else if (Arg == "--ir-size-report") {
+      SizeReportPath = "ir-size-report.json";
+      DebugInfoEnabled = true;
+    } else if (Arg.rfind("--ir-size-report=", 0) == 0) {
+      SizeReportPath = Arg.substr(17);
+      DebugInfoEnabled = true;
+    } else if (Arg == "--remarks") {
+      MissedRemarksEnabled = true;
+      DebugInfoEnabled = true;
+    } else if (Arg.rfind("--remarks=", 0) == 0) {
+      if (!ParseRemarkKinds(Arg.substr(10)))
+        return 1;
+      DebugInfoEnabled = true;
+    } else if (Arg.rfind("--remarks-file=", 0) == 0) {
+      RemarksPath = Arg.substr(15);
+    } else if (Arg == "--fast-math") {
+      DefaultFastMath.setFast();
+    } else if (Arg == "--fp-reassoc") {
+      DefaultFastMath.setAllowReassoc();
+    } else if (Arg == "--fp-contract=fast") {
+      DefaultFastMath.setAllowContract();
+    } else if (Arg == "--fp-contract=off") {
+      DefaultFastMath.setAllowContract(false);
+    } else if (Arg == "--multiversion") {
+      MultiversionEnabled = true;
+    } else if (Arg.rfind("--jobs=", 0) == 0) {
+      if (!ParseCount(Arg, 7, BackendJobs))
+        return 1;
+    } else if (Arg.rfind("--chunk-size=", 0) == 0) {
+      if (!ParseCount(Arg, 13, ChunkInstructionLimit))
+        return 1;
+    } else if (Arg.size() > 1 && Arg[0] == '-') {
+      std::cerr << "Error: Unknown option " << Arg << "\n";
+      PrintUsage();
+      return 1;
+    } else {
+      InputPath = argv[i];
+    }
+  }
+
+  if (Repl) {
+    if (InputPath || CheckOnly || Interpret || CompileModule || EmitObject ||
+        ProfilingEnabled || DebugInfoEnabled || MultiversionEnabled ||
+        !TargetCPU.empty()) {
+      std::cerr << "Error: --repl reads stdin and only takes -O, --fast-math "
+                   "and the --fp options\n";
+      return 1;
+    }
+    InitializePrecedence();
+    return RunRepl();
+  }
+
+  if (!InputPath) {
+    PrintUsage();
+    return 1;
+  }
+
+  if (Interpret && (ProfilingEnabled || DebugInfoEnabled)) {
+    std::cerr << "Error: --instrument, --ir-size-report and --remarks are not "
+                 "supported with --interp\n";
+    return 1;
+  }
+
+  if (CompileModule && (Interpret || EmitObject || ProfilingEnabled ||
+                        DebugInfoEnabled || MultiversionEnabled)) {
+    std::cerr << "Error: --module only takes -O, -mcpu, --fast-math and the "
+                 "--fp options\n";
     return 1;
   }
 
-  SourceFile.open(argv[1]);
+  // Imports are found next to the file, and built by rerunning the compiler
+  SmallString<128> Directory(sys::path::parent_path(InputPath));
+  if (!Directory.empty())
+    ModuleDirectory = std::string(Directory);
+  CompilerExecutable =
+      sys::fs::getMainExecutable(argv[0], reinterpret_cast<void *>(&PrintUsage));
+
+  if (CompileModule) {
+    ModuleName = sys::path::stem(InputPath).str();
+    bool IsIdentifier = !ModuleName.empty() && isalpha(ModuleName[0]);
+    for (char C : ModuleName)
+      IsIdentifier = IsIdentifier && (isalnum(C) || C == '_');
+    if (!IsIdentifier) {
+      std::cerr << "Error: The name of module " << InputPath
+                << " must be an identifier, to be imported by it\n";
+      return 1;
+    }
+  }
+
+  SourceFile.open(InputPath);
   if (!SourceFile.is_open()) {
-    std::cerr << "Error: Could not open file " << argv[1] << "\n";
+    std::cerr << "Error: Could not open file " << InputPath << "\n";
     return 1;
   }
 
   // Read file into memory for error printing
-  std::ifstream File(argv[1]);
+  std::ifstream File(InputPath);
   std::string Line;
   while (std::getline(File, Line)) {
     SourceLines.push_back(Line);
   }
 
-  InitializeModule(); // Initialize LLVM Context, Module, Builder
   InitializePrecedence();
 
+  if (CheckOnly)
+    return CheckProgram(InputPath);
+
+  if (Interpret)
+    return InterpretProgram();
+
+  InitializeModule(); // Initialize LLVM Context, Module, Builder
+  if (!InitializeTarget())
+    return 1;
+  InitializeDebugInfo(InputPath);
+
   // Setup the main function wrapper to hold all the code
   FunctionType *PrintfType =
       FunctionType::get(Type::getInt32Ty(*TheContext),
@@ -37,16 +306,26 @@ int main(int argc, char **argv) {
   Function *PrintfFunc = Function::Create(PrintfType, Function::ExternalLinkage,
                                           "printf", TheModule.get());
 
-  FunctionType *FT = FunctionType::get(Type::getInt32Ty(*TheContext), false);
-  Function *TheFunction =
-      Function::Create(FT, Function::ExternalLinkage, "main", TheModule.get());
-
-  BasicBlock *Entry = BasicBlock::Create(*TheContext, "entry", TheFunction);
-  Builder->SetInsertPoint(Entry);
+  BeginTopLevel();
 
   // Load the first token before entering the loop
   getNextToken();
 
+  ParseImports();
+  if (!CompileModule && !ModuleBitcodeFiles.empty()) {
+    if (!EmitObject) {
+      std::cerr << "Error: Programs that import modules need --emit-obj, "
+                   "which links them with ThinLTO\n";
+      return 1;
+    }
+    if (ProfilingEnabled || DebugInfoEnabled) {
+      std::cerr << "Error: --instrument, --ir-size-report and --remarks are "
+                   "not supported for programs that import modules\n";
+      return 1;
+    }
+  }
+  DeclareImports();
+
   // Main Loop
   while (true) {
     if (CurTok == TOK_EOF)
@@ -58,20 +337,96 @@ int main(int argc, char **argv) {
     }
 
     // Parse the next expression
+    SourceLocation StmtLoc = CurLoc;
     auto AST = ParseExpression();
 
     if (AST) {
+      // Resolve names and types (and insert casts) before emitting any IR
+      AST->typecheck();
+
+      ProfileProbe Probe;
+      if (ProfilingEnabled)
+        Probe = BeginProfileProbe(StmtLoc, PROFILE_STATEMENT);
+
+      // Top-level loops get a function of their own to be multiversioned
+      bool Outline = MultiversionEnabled &&
+                     (dynamic_cast<WhileExprAST *>(AST.get()) ||
+                      dynamic_cast<ForExprAST *>(AST.get()));
+      if (Outline)
+        MarkHotFunction(BeginOutlinedStatement());
+
       AST->codegen();
+
+      if (Outline)
+        EndOutlinedStatement();
+      if (ProfilingEnabled)
+        EndProfileProbe(Probe);
+
+      EndTopLevelStatement();
     } else {
       // Error Recovery: Skip token and try again
       getNextToken();
     }
   }
 
+  FinishTopLevel();
+
+  if (ProfilingEnabled)
+    EmitProfileReport();
+
   // Only after the loop ends (EOF), we add the return statement.
-  Builder->CreateRet(ConstantInt::get(*TheContext, APInt(32, 0)));
-  // Verify and Print
-  verifyFunction(*TheFunction);
+  if (ModuleName.empty())
+    Builder->CreateRet(ConstantInt::get(*TheContext, APInt(32, 0)));
+  else
+    Builder->CreateRetVoid();
+
+  // Multiversioned copies carry their own target-cpu, which the module-wide
+  // attributes must not override
+  EmitMultiversions();
+  ApplyTargetAttributes();
+  FinalizeDebugInfo();
+  // Verify and Print. Nothing checks the IR after this: --emit-obj hands it
+  // straight to the optimizer and the backend.
+  if (verifyModule(*TheModule, &errs())) {
+    std::cerr << "Error: Generated invalid IR\n";
+    return 1;
+  }
+
+  bool SizeReport = !SizeReportPath.empty();
+  if (SizeReport)
+    CollectIRSizes();
+  bool Remarks = MissedRemarksEnabled || PassedRemarksEnabled;
+
+  if (CompileModule || EmitObject) {
+    std::vector<std::string> OutputFiles;
+    bool Written;
+    if (CompileModule)
+      Written = WriteModuleFiles(OutputFiles);
+    else if (!ModuleBitcodeFiles.empty())
+      Written = LinkThinLTO(ModuleBitcodeFiles, getModuleCacheDirectory(),
+                            OutputFiles);
+    else
+      Written = EmitObjectFiles(OutputFiles);
+    if (!Written)
+      return 1;
+
+    std::cout << "Successfully compiled to";
+    for (const std::string &File : OutputFiles)
+      std::cout << " " << File;
+    std::cout << "\n";
+
+    if (SizeReport) {
+      for (const std::string &File : OutputFiles) {
+        auto Object = MemoryBuffer::getFile(File);
+        if (!Object || !CollectMachineCodeSizes((*Object)->getMemBufferRef()))
+          return 1;
+      }
+      WriteSizeReport(InputPath);
+    }
+    if (Remarks)
+      WriteRemarks(InputPath);
+    return 0;
+  }
 
   std::error_code EC;
   raw_fd_ostream OutFile("output.ll", EC);
@@ -82,5 +437,20 @@ int main(int argc, char **argv) {
     std::cerr << "Error writing file: " << EC.message() << "\n";
   }
 
+  if (SizeReport || Remarks) {
+    // Machine code (and remarks) as --emit-obj would produce them
+    SmallVector<char, 0> Object;
+    if (!EmitObjectToMemory(Object))
+      return 1;
+    if (SizeReport) {
+      if (!CollectMachineCodeSizes(MemoryBufferRef(
+              StringRef(Object.data(), Object.size()), "output.o")))
+        return 1;
+      WriteSizeReport(InputPath);
+    }
+    if (Remarks)
+      WriteRemarks(InputPath);
+  }
+
   return 0;
 }
@@ -0,0 +1,210 @@
+// Buffered stdin reader behind read_int(), read_double(), read_bool() and
+// has_input().
+//
+// Header-only so the runtime (Runtime.cpp) and the interpreter
+// (Interpreter.cpp) parse input exactly the same way. Input goes into a 1 MiB
+// buffer with one read() at a time, which returns what is available, so a
+// value typed at a terminal or written to a pipe is read as soon as it is
+// complete. Integers are parsed by hand and doubles with std::from_chars,
+// both straight out of the buffer, so there is no per-number locking, locale
+// lookup or format-string parsing like scanf has.
+
+#ifndef KIRK_INPUT_READER_H
+#define KIRK_INPUT_READER_H
+
+#include <cerrno>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+class KirkInputReader {
+  static constexpr size_t BufferSize = 1 << 20;
+  // A number is parsed in place. With this many bytes buffered, the next
+  // token is either complete or too long to be a value anyway.
+  static constexpr size_t MaxToken = 4096;
+
+  char *Buffer = nullptr;
+  size_t Pos = 0;
+  size_t End = 0;
+  bool AtEOF = false;
+
+  static bool isSpace(char C) {
+    return C == ' ' || C == '\n' || C == '\t' || C == '\r' || C == '\f' ||
+           C == '\v';
+  }
+
+  // Moves the unread bytes to the front and appends what one read() of
+  // stdin returns, without waiting for the buffer to fill. A read error ends
+  // the input like the end of file does.
+  void refill() {
+    if (!Buffer)
+      Buffer = static_cast<char *>(std::malloc(BufferSize));
+    std::memmove(Buffer, Buffer + Pos, End - Pos);
+    End -= Pos;
+    Pos = 0;
+
+    ssize_t Read;
+    do
+      Read = ::read(STDIN_FILENO, Buffer + End, BufferSize - End);
+    while (Read < 0 && errno == EINTR);
+    if (Read <= 0)
+      AtEOF = true;
+    else
+      End += Read;
+  }
+
+  // Skips whitespace and makes sure the next token is entirely buffered.
+  // Near the end of the buffer that means followed by whitespace or the end
+  // of input, reading more only until it is. Returns false at the end of
+  // input.
+  bool startToken() {
+    size_t Length = 0; // Of the part of the token buffered so far
+    while (true) {
+      while (Pos < End && isSpace(Buffer[Pos]))
+        ++Pos;
+      if (End - Pos >= MaxToken || AtEOF)
+        break;
+      while (Pos + Length < End && !isSpace(Buffer[Pos + Length]))
+        ++Length;
+      if (Pos + Length < End)
+        break;
+      refill();
+    }
+    return Pos < End;
+  }
+
+  // Eight digits at a time (as in fast_float): checks that all eight bytes
+  // at P are digits and converts them with three multiplies instead of a
+  // loop whose length the branch predictor can't guess
+  static bool parseEightDigits(const char *P, uint64_t &Value) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t Chunk;
+    std::memcpy(&Chunk, P, 8);
+    if ((((Chunk & 0xF0F0F0F0F0F0F0F0) |
+          (((Chunk + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) !=
+         0x3333333333333333))
+      return false;
+
+    Chunk -= 0x3030303030303030;
+    Chunk = Chunk * 10 + (Chunk >> 8);
+    Chunk = (((Chunk & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+             (((Chunk >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >>
+            32;
+    Value = Value * 100000000 + Chunk;
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  // The token ends at whitespace or at the end of input
+  bool atTokenEnd() const { return Pos == End || isSpace(Buffer[Pos]); }
+
+  bool fitsInInt(size_t First, size_t Last, bool Negative) const {
+    uint64_t Limit = Negative ? uint64_t(INT64_MAX) + 1 : uint64_t(INT64_MAX);
+    uint64_t Value = 0;
+    for (size_t i = First; i < Last; ++i) {
+      unsigned Digit = Buffer[i] - '0';
+      if (Value > (Limit - Digit) / 10)
+        return false;
+      Value = Value * 10 + Digit;
+    }
+    return true;
+  }
+
+  [[noreturn]] void fail(const char *Builtin, const char *Expected) {
+    if (!startToken()) {
+      std::fprintf(stderr, "Error: %s(): expected %s, found the end of input\n",
+                   Builtin, Expected);
+    } else {
+      size_t Length = 0;
+      while (Pos + Length < End && Length < 40 &&
+             !isSpace(Buffer[Pos + Length]))
+        ++Length;
+      std::fprintf(stderr, "Error: %s(): expected %s, found \"%.*s\"\n",
+                   Builtin, Expected, (int)Length, Buffer + Pos);
+    }
+    std::exit(1);
+  }
+
+public:
+  // has_input(): whether anything but whitespace is left
+  bool hasInput() { return startToken(); }
+
+  // [+-]digits, in the range of a Kirk int
+  int64_t readInt() {
+    if (!startToken())
+      fail("read_int", "an integer");
+
+    size_t Start = Pos;
+    bool Negative = Buffer[Pos] == '-';
+    if (Buffer[Pos] == '-' || Buffer[Pos] == '+')
+      ++Pos;
+
+    uint64_t Value = 0;
+    size_t FirstDigit = Pos;
+    while (End - Pos >= 8 && parseEightDigits(Buffer + Pos, Value))
+      Pos += 8;
+    while (Pos < End && Buffer[Pos] >= '0' && Buffer[Pos] <= '9')
+      Value = Value * 10 + (Buffer[Pos++] - '0');
+
+    if (Pos == FirstDigit || !atTokenEnd()) {
+      Pos = Start;
+      fail("read_int", "an integer");
+    }
+
+    // Up to 18 digits always fit, so only longer numbers pay for the check
+    if (Pos - FirstDigit > 18 && !fitsInInt(FirstDigit, Pos, Negative)) {
+      Pos = Start;
+      fail("read_int", "an integer that fits in an int");
+    }
+    return Negative ? static_cast<int64_t>(0 - Value)
+                    : static_cast<int64_t>(Value);
+  }
+
+  // Anything std::from_chars accepts, plus a leading '+': "3", "-2.5e-3",
+  // "inf", "nan"
+  double readDouble() {
+    if (!startToken())
+      fail("read_double", "a number");
+
+    size_t Start = Pos;
+    if (Buffer[Pos] == '+' && Pos + 1 < End && Buffer[Pos + 1] != '-')
+      ++Pos;
+
+    double Value = 0.0;
+    std::from_chars_result Result =
+        std::from_chars(Buffer + Pos, Buffer + End, Value);
+    Pos = Result.ptr - Buffer;
+    if (Result.ec != std::errc() || !atTokenEnd()) {
+      Pos = Start;
+      fail("read_double", "a number");
+    }
+    return Value;
+  }
+
+  // "true", "false", "1" or "0"
+  bool readBool() {
+    if (!startToken())
+      fail("read_bool", "true or false");
+
+    static const char *const Words[] = {"false", "true", "0", "1"};
+    for (int i = 0; i < 4; ++i) {
+      size_t Length = std::strlen(Words[i]);
+      if (End - Pos >= Length &&
+          std::memcmp(Buffer + Pos, Words[i], Length) == 0) {
+        size_t Start = Pos;
+        Pos += Length;
+        if (atTokenEnd())
+          return i % 2 == 1;
+        Pos = Start;
+      }
+    }
+    fail("read_bool", "true or false");
+  }
+};
+
+#endif
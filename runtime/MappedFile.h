@@ -0,0 +1,68 @@
+// Read-only file mappings behind `view T name = mmap("path")`.
+//
+// Header-only so the runtime (Runtime.cpp) and the interpreter
+// (Interpreter.cpp) accept and reject files the same way. The file is mapped
+// privately and read-only, so element reads are plain loads from the page
+// cache: nothing is copied, and pages the program never touches are never
+// read. POSIX only.
+
+#ifndef KIRK_MAPPED_FILE_H
+#define KIRK_MAPPED_FILE_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Maps Path and returns its first element, storing the number of
+// ElementSize-byte elements in *Length. Exits with an error if the file
+// can't be mapped or doesn't hold a whole number of elements.
+inline void *KirkMapFile(const char *Path, int64_t ElementSize,
+                         int64_t *Length) {
+  int FD = open(Path, O_RDONLY);
+  struct stat Info;
+  if (FD < 0 || fstat(FD, &Info) != 0) {
+    std::fprintf(stderr, "Error: mmap(\"%s\"): %s\n", Path,
+                 std::strerror(errno));
+    std::exit(1);
+  }
+
+  if (Info.st_size % ElementSize != 0) {
+    std::fprintf(stderr,
+                 "Error: mmap(\"%s\"): the file is %lld bytes, which is not a "
+                 "whole number of %lld-byte elements\n",
+                 Path, (long long)Info.st_size, (long long)ElementSize);
+    std::exit(1);
+  }
+
+  *Length = Info.st_size / ElementSize;
+
+  // mmap refuses empty mappings; an empty view never dereferences its base
+  if (Info.st_size == 0) {
+    close(FD);
+    static int64_t Empty;
+    return &Empty;
+  }
+
+  void *Data = mmap(nullptr, Info.st_size, PROT_READ, MAP_PRIVATE, FD, 0);
+  int MapError = errno;
+  close(FD); // The mapping keeps the file alive
+  if (Data == MAP_FAILED) {
+    std::fprintf(stderr, "Error: mmap(\"%s\"): %s\n", Path,
+                 std::strerror(MapError));
+    std::exit(1);
+  }
+
+  // Views are mostly streamed front to back by reduction loops: ask for
+  // aggressive read-ahead and early reuse of the pages already read. Only a
+  // hint, so a failure is ignored.
+  madvise(Data, Info.st_size, MADV_SEQUENTIAL);
+  return Data;
+}
+
+#endif
@@ -0,0 +1,432 @@
+// Kirk runtime support library.
+//
+// Linked into every compiled Kirk program (see compile_and_run.sh). The
+// compiler emits calls to the extern "C" entry points below, so their names
+// and struct layouts are part of the compiler/runtime ABI.
+
+#include "InputReader.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <cpuid.h>
+#define KIRK_X86_64 1
+#endif
+
+namespace {
+
+// Parallel loops (`parallel for`)
+//
+// A small work-stealing pool. Each parallel loop is cut into chunks that are
+// dealt out round-robin to per-thread deques. Owners pop from the back of
+// their own deque; idle threads steal from the front of someone else's, so
+// uneven iterations still balance out. The calling thread works too.
+
+using KirkParallelBody = void (*)(int64_t Lo, int64_t Hi, void *Env);
+
+struct ChunkRange {
+  int64_t Begin;
+  int64_t End;
+};
+
+class WorkQueue {
+  std::mutex Lock;
+  std::deque<ChunkRange> Chunks;
+
+public:
+  void push(ChunkRange Chunk) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    Chunks.push_back(Chunk);
+  }
+
+  bool popBack(ChunkRange &Chunk) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (Chunks.empty())
+      return false;
+    Chunk = Chunks.back();
+    Chunks.pop_back();
+    return true;
+  }
+
+  bool stealFront(ChunkRange &Chunk) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (Chunks.empty())
+      return false;
+    Chunk = Chunks.front();
+    Chunks.pop_front();
+    return true;
+  }
+};
+
+// Set on pool threads and while the caller runs a loop; nested parallel
+// loops run serially instead of deadlocking on the pool.
+thread_local bool InParallelLoop = false;
+
+class ThreadPool {
+  std::vector<std::thread> Workers;
+  std::vector<std::unique_ptr<WorkQueue>> Queues; // [0] is the caller's
+
+  std::mutex JobLock;
+  std::condition_variable JobReady;
+  uint64_t JobGeneration = 0;
+  bool ShuttingDown = false;
+
+  KirkParallelBody Body = nullptr;
+  void *Env = nullptr;
+  std::atomic<int64_t> PendingChunks{0};
+
+  bool runOneChunk(unsigned Self) {
+    ChunkRange Chunk;
+    bool Found = Queues[Self]->popBack(Chunk);
+
+    for (unsigned i = 1; !Found && i < Queues.size(); ++i)
+      Found = Queues[(Self + i) % Queues.size()]->stealFront(Chunk);
+
+    if (!Found)
+      return false;
+
+    Body(Chunk.Begin, Chunk.End, Env);
+    PendingChunks.fetch_sub(1, std::memory_order_acq_rel);
+    return true;
+  }
+
+  void drain(unsigned Self) {
+    while (PendingChunks.load(std::memory_order_acquire) > 0) {
+      if (!runOneChunk(Self))
+        std::this_thread::yield();
+    }
+  }
+
+  void workerLoop(unsigned Self) {
+    InParallelLoop = true;
+    uint64_t SeenGeneration = 0;
+
+    while (true) {
+      {
+        std::unique_lock<std::mutex> Guard(JobLock);
+        JobReady.wait(Guard, [&] {
+          return ShuttingDown || JobGeneration != SeenGeneration;
+        });
+        if (ShuttingDown)
+          return;
+        SeenGeneration = JobGeneration;
+      }
+      drain(Self);
+    }
+  }
+
+public:
+  explicit ThreadPool(unsigned NumThreads) {
+    for (unsigned i = 0; i < NumThreads; ++i)
+      Queues.push_back(std::make_unique<WorkQueue>());
+    for (unsigned i = 1; i < NumThreads; ++i)
+      Workers.emplace_back([this, i] { workerLoop(i); });
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> Guard(JobLock);
+      ShuttingDown = true;
+    }
+    JobReady.notify_all();
+    for (std::thread &Worker : Workers)
+      Worker.join();
+  }
+
+  unsigned size() const { return Queues.size(); }
+
+  void run(int64_t Lo, int64_t Hi, KirkParallelBody LoopBody, void *LoopEnv) {
+    // ~8 chunks per thread leaves room for stealing without making the
+    // per-chunk overhead (deque lock, reduction merge) noticeable
+    int64_t Count = Hi - Lo;
+    int64_t Grain = std::max<int64_t>(1, Count / (int64_t)(size() * 8));
+    int64_t NumChunks = (Count + Grain - 1) / Grain;
+
+    Body = LoopBody;
+    Env = LoopEnv;
+    PendingChunks.store(NumChunks, std::memory_order_release);
+
+    unsigned Next = 0;
+    for (int64_t Begin = Lo; Begin < Hi; Begin += Grain) {
+      Queues[Next]->push({Begin, std::min(Hi, Begin + Grain)});
+      Next = (Next + 1) % size();
+    }
+
+    {
+      std::lock_guard<std::mutex> Guard(JobLock);
+      ++JobGeneration;
+    }
+    JobReady.notify_all();
+
+    InParallelLoop = true;
+    drain(0);
+    InParallelLoop = false;
+  }
+};
+
+// KIRK_NUM_THREADS overrides the thread count; defaults to all cores
+unsigned GetNumThreads() {
+  if (const char *Env = std::getenv("KIRK_NUM_THREADS")) {
+    int Requested = std::atoi(Env);
+    if (Requested > 0)
+      return Requested;
+  }
+  unsigned Cores = std::thread::hardware_concurrency();
+  return Cores > 0 ? Cores : 1;
+}
+
+ThreadPool &GetThreadPool() {
+  static ThreadPool Pool(GetNumThreads());
+  return Pool;
+}
+
+std::mutex ReductionLock;
+
+KirkInputReader Input;
+
+// Multiversioning (`kirk --multiversion`)
+//
+// Reads CPUID directly rather than trusting the compiler's cpu-model
+// tables, and checks XCR0 so AVX/AVX-512 only count when the OS saves
+// their registers. Level 1 is baseline x86-64.
+int DetectCPULevel() {
+#ifdef KIRK_X86_64
+  unsigned Eax, Ebx, Ecx, Edx;
+  if (!__get_cpuid(1, &Eax, &Ebx, &Ecx, &Edx))
+    return 1;
+  unsigned Leaf1Ecx = Ecx;
+
+  unsigned ExtEcx = 0;
+  if (__get_cpuid(0x80000001, &Eax, &Ebx, &Ecx, &Edx))
+    ExtEcx = Ecx;
+
+  unsigned Leaf7Ebx = 0;
+  if (__get_cpuid_count(7, 0, &Eax, &Ebx, &Ecx, &Edx))
+    Leaf7Ebx = Ebx;
+
+  auto Has = [](unsigned Reg, unsigned Bits) { return (Reg & Bits) == Bits; };
+
+  // x86-64-v2: SSE3, SSSE3, CX16, SSE4.1, SSE4.2, POPCNT, LAHF
+  if (!Has(Leaf1Ecx, 1u << 0 | 1u << 9 | 1u << 13 | 1u << 19 | 1u << 20 |
+                         1u << 23) ||
+      !Has(ExtEcx, 1u << 0))
+    return 1;
+
+  // x86-64-v3: FMA, MOVBE, OSXSAVE, AVX, F16C, LZCNT, BMI1, AVX2, BMI2
+  if (!Has(Leaf1Ecx, 1u << 12 | 1u << 22 | 1u << 27 | 1u << 28 | 1u << 29) ||
+      !Has(ExtEcx, 1u << 5) || !Has(Leaf7Ebx, 1u << 3 | 1u << 5 | 1u << 8))
+    return 2;
+
+  unsigned XCR0Lo, XCR0Hi;
+  __asm__("xgetbv" : "=a"(XCR0Lo), "=d"(XCR0Hi) : "c"(0));
+  if (!Has(XCR0Lo, 0x6)) // SSE and AVX state
+    return 2;
+
+  // x86-64-v4: AVX512F, DQ, CD, BW, VL, plus opmask and ZMM state
+  if (!Has(Leaf7Ebx, 1u << 16 | 1u << 17 | 1u << 28 | 1u << 30 | 1u << 31) ||
+      !Has(XCR0Lo, 0xE6))
+    return 3;
+
+  return 4;
+#else
+  return 1;
+#endif
+}
+
+// Benchmarks (`bench "name" N { ... }`)
+
+int64_t ClockNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// The least time two back-to-back clock reads ever take, which every
+// recorded iteration also pays
+int64_t ClockOverhead() {
+  static const int64_t Overhead = [] {
+    int64_t Best = INT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+      int64_t Start = ClockNanoseconds();
+      Best = std::min(Best, ClockNanoseconds() - Start);
+    }
+    return Best;
+  }();
+  return Overhead;
+}
+
+} // namespace
+
+extern "C" {
+
+// Profiling (`kirk --instrument`)
+
+// Mirrors getCountersType() in Profiler.cpp
+struct KirkProfileCounters {
+  int64_t Entries;
+  int64_t Iterations;
+  int64_t Cycles;
+};
+
+// Mirrors getSiteType() in Profiler.cpp
+struct KirkProfileSite {
+  int32_t Line;
+  int32_t Col;
+  int32_t Kind; // 0 = top-level statement, 1 = loop (ProfileSiteKind)
+  const char *Source;
+  KirkProfileCounters *Counters;
+};
+
+void kirk_profile_report(const KirkProfileSite *Sites, int64_t Count) {
+  std::vector<const KirkProfileSite *> Sorted;
+  int64_t TotalCycles = 0;
+
+  for (int64_t i = 0; i < Count; ++i) {
+    if (Sites[i].Counters->Entries == 0)
+      continue;
+    Sorted.push_back(&Sites[i]);
+    if (Sites[i].Kind == 0)
+      TotalCycles += Sites[i].Counters->Cycles;
+  }
+
+  std::sort(Sorted.begin(), Sorted.end(),
+            [](const KirkProfileSite *A, const KirkProfileSite *B) {
+              return A->Counters->Cycles > B->Counters->Cycles;
+            });
+
+  // Report goes to stderr so the program's own output stays untouched
+  std::fprintf(stderr, "\n=== Kirk profile (sorted by total cycles) ===\n");
+  std::fprintf(stderr, "%-9s %-5s %14s %16s %12s %7s  %s\n", "location",
+               "kind", "iterations", "total cycles", "cycles/iter", "share",
+               "source");
+
+  for (const KirkProfileSite *Site : Sorted) {
+    const KirkProfileCounters *C = Site->Counters;
+    char Location[32];
+    std::snprintf(Location, sizeof(Location), "%d:%d", Site->Line, Site->Col);
+
+    double PerIteration =
+        C->Iterations > 0 ? (double)C->Cycles / (double)C->Iterations : 0.0;
+    double Share =
+        TotalCycles > 0 ? 100.0 * (double)C->Cycles / (double)TotalCycles
+                        : 0.0;
+
+    std::fprintf(stderr, "%-9s %-5s %14lld %16lld %12.1f %6.1f%%  %s\n",
+                 Location, Site->Kind == 1 ? "loop" : "stmt",
+                 (long long)C->Iterations, (long long)C->Cycles, PerIteration,
+                 Share, Site->Source);
+  }
+}
+
+// Parallel loops (`parallel for`)
+
+void kirk_parallel_for(int64_t Lo, int64_t Hi, KirkParallelBody Body,
+                       void *Env) {
+  if (Lo >= Hi)
+    return;
+
+  if (InParallelLoop) {
+    Body(Lo, Hi, Env);
+    return;
+  }
+
+  ThreadPool &Pool = GetThreadPool();
+  if (Pool.size() == 1) {
+    Body(Lo, Hi, Env);
+    return;
+  }
+
+  Pool.run(Lo, Hi, Body, Env);
+}
+
+// Guards the once-per-chunk merge of reduction variables
+void kirk_parallel_lock() { ReductionLock.lock(); }
+
+void kirk_parallel_unlock() { ReductionLock.unlock(); }
+
+// Timing builtins and benchmarks
+
+// clock_ns(): a monotonic clock in nanoseconds
+int64_t kirk_clock_ns() { return ClockNanoseconds(); }
+
+// Room for one time per iteration, warm-up included
+int64_t *kirk_bench_begin(int64_t Total) {
+  auto *Samples =
+      static_cast<int64_t *>(std::malloc(std::max<int64_t>(Total, 1) * 8));
+  if (!Samples) {
+    std::fprintf(stderr, "Error: Not enough memory to record %lld benchmark "
+                         "iterations\n",
+                 (long long)Total);
+    std::exit(1);
+  }
+  return Samples;
+}
+
+// Reports the iterations after the warm-up and frees the samples. Same
+// format as the interpreter's report (Interpreter.cpp).
+void kirk_bench_end(const char *Name, int64_t *Samples, int64_t Total,
+                    int64_t Warmup) {
+  int64_t Count = Total - Warmup;
+  if (Count <= 0) {
+    std::printf("bench %s: no iterations\n", Name);
+    std::free(Samples);
+    return;
+  }
+
+  int64_t *Timed = Samples + Warmup;
+  int64_t Overhead = ClockOverhead();
+  for (int64_t i = 0; i < Count; ++i)
+    Timed[i] = std::max<int64_t>(0, Timed[i] - Overhead);
+  std::sort(Timed, Timed + Count);
+
+  std::printf("bench %s: %lld iterations, min %lld ns, median %lld ns, "
+              "p99 %lld ns\n",
+              Name, (long long)Count, (long long)Timed[0],
+              (long long)Timed[(Count - 1) / 2],
+              (long long)Timed[(Count * 99 + 99) / 100 - 1]);
+  std::free(Samples);
+}
+
+// Input builtins. Bools are returned as 0 / 1 in an int32_t, so the compiler
+// doesn't depend on how the C ABI passes bool.
+
+int64_t kirk_read_int() { return Input.readInt(); }
+
+double kirk_read_double() { return Input.readDouble(); }
+
+int32_t kirk_read_bool() { return Input.readBool(); }
+
+int32_t kirk_has_input() { return Input.hasInput(); }
+
+// Views (`view T name = mmap("path")`). The mapping lives until the program
+// exits.
+void *kirk_map_file(const char *Path, int64_t ElementSize, int64_t *Length) {
+  return KirkMapFile(Path, ElementSize, Length);
+}
+
+// Multiversioning (`kirk --multiversion`)
+
+// Called once by the startup resolver to pick each hot loop's copy.
+// KIRK_CPU_LEVEL caps the level, to test the older copies on new hardware.
+int32_t kirk_cpu_level() {
+  int Level = DetectCPULevel();
+  if (const char *Env = std::getenv("KIRK_CPU_LEVEL")) {
+    int Cap = std::atoi(Env);
+    if (Cap >= 1 && Cap < Level)
+      Level = Cap;
+  }
+  return Level;
+}
+
+} // extern "C"
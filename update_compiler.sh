@@ -12,9 +12,9 @@ if ! command -v llvm-config &> /dev/null; then
 fi
 
 echo -e "${GREEN}[1 / 2]${RESET} ${BOLD}Updating the Kirk Compiler...${RESET}"
-echo -e "        ${BLUE}Sources:${RESET} main.cpp Lexer.cpp Parser.cpp Codegen.cpp Algorithms.cpp"
+echo -e "        ${BLUE}Sources:${RESET} main.cpp Lexer.cpp Parser.cpp Sema.cpp Codegen.cpp Profiler.cpp DebugInfo.cpp SizeReport.cpp Remarks.cpp TopLevel.cpp Backend.cpp Multiversion.cpp Bytecode.cpp Interpreter.cpp Repl.cpp Modules.cpp Algorithms.cpp runtime/Runtime.cpp"
 
-clang++ main.cpp Lexer.cpp Parser.cpp Codegen.cpp Algorithms.cpp `llvm-config --cxxflags --ldflags --system-libs --libs core` -o kirk
+clang++ main.cpp Lexer.cpp Parser.cpp Sema.cpp Codegen.cpp Profiler.cpp DebugInfo.cpp SizeReport.cpp Remarks.cpp TopLevel.cpp Backend.cpp Multiversion.cpp Bytecode.cpp Interpreter.cpp Repl.cpp Modules.cpp Algorithms.cpp runtime/Runtime.cpp `llvm-config --cxxflags --ldflags --system-libs --libs core native passes bitreader bitwriter transformutils debuginfodwarf object orcjit lto` -o kirk
 
 echo -e "${GREEN}[2 / 2]${RESET} ${BOLD}Verifying build...${RESET}"
 